@@ -0,0 +1,957 @@
+// applyplan.cpp
+
+#include "applyplan.h"
+#include "ingest.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string_view>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Moves claimed by a worker at a time
+constexpr size_t kMoveChunk = 16;
+
+// "name (2).ext" .. "name (kMaxSuffix).ext" are tried when a name is taken
+constexpr unsigned kMaxSuffix = 1000;
+
+// Copies across filesystems are made under "<target>.medama-part.<index>",
+// so two moves to the same name never share one
+constexpr const char* kPartSuffix = ".medama-part.";
+
+fs::path ToPath(const std::string& s)
+{
+#ifdef __linux__
+    return fs::path(s);
+#else
+    return fs::path(std::u8string(s.begin(), s.end()));
+#endif
+}
+
+std::string FromPath(const fs::path& p)
+{
+#ifdef __linux__
+    return p.native();
+#else
+    std::u8string u = p.u8string();
+    return std::string(u.begin(), u.end());
+#endif
+}
+
+// "dir/name.ext" -> "dir/name (n).ext"; a leading dot is not an extension
+std::string WithSuffix(const std::string& path, unsigned n)
+{
+    size_t slash = path.find_last_of("/\\");
+    size_t leaf = slash == std::string::npos ? 0 : slash + 1;
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || dot <= leaf)
+        dot = path.size();
+
+    return path.substr(0, dot) + " (" + std::to_string(n) + ")" + path.substr(dot);
+}
+
+// Modification time in seconds since the epoch, or -1
+int64_t ModifiedSeconds(const fs::path& p)
+{
+    std::error_code ec;
+    auto t = fs::last_write_time(p, ec);
+    if (ec)
+        return -1;
+    auto sys = std::chrono::file_clock::to_sys(t);
+    return std::chrono::duration_cast<std::chrono::seconds>(sys.time_since_epoch()).count();
+}
+
+// ------------------------------- Journal -----------------------------------
+//
+// One record per line, fields separated by tabs, with '\\', '\t' and '\n'
+// escaped. The last R record starts the run that counts:
+//   R  <count> <run ID>
+//   M  <folder>                                  created by this run
+//   P  <index> <size> <mtime> <source> <target>  planned move
+//   C  <index> <copy> <original>                 copied across filesystems,
+//                                                the original not removed yet
+//   D  <index> <final target>                    moved
+//   S  <index>                                   skipped, source gone
+//   U  <index>                                   undone or abandoned
+
+std::string Escape(std::string_view s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        switch (c) {
+        case '\\': out += "\\\\"; break;
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        default:   out += c; break;
+        }
+    }
+    return out;
+}
+
+std::vector<std::string> SplitRecord(std::string_view line)
+{
+    std::vector<std::string> fields(1);
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '\t') {
+            fields.emplace_back();
+        } else if (c == '\\' && i + 1 < line.size()) {
+            char e = line[++i];
+            fields.back() += e == 't' ? '\t' : e == 'n' ? '\n' : e;
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+// --------------------------- Moving one file ------------------------------
+
+enum class MoveResult { Renamed, Copied, SourceMissing, Failed };
+
+#ifdef __linux__
+
+// rename() that never replaces an existing target. Returns 0 or an errno.
+int RenameNoReplace(const std::string& from, const std::string& to)
+{
+    if (::renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0)
+        return 0;
+    if (errno != EINVAL && errno != ENOSYS)
+        return errno;
+
+    // Filesystem without RENAME_NOREPLACE: link() fails on an existing
+    // target just the same. A second name left behind would be taken for
+    // the moved file, so it goes again if the old one cannot.
+    if (::link(from.c_str(), to.c_str()) == 0) {
+        if (::unlink(from.c_str()) == 0)
+            return 0;
+        int err = errno;
+        ::unlink(to.c_str());
+        return err;
+    }
+    if (errno != EPERM && errno != ENOTSUP)
+        return errno;
+
+    // ... and without hard links either: check, then rename
+    struct stat st;
+    if (::lstat(to.c_str(), &st) == 0)
+        return EEXIST;
+    return ::rename(from.c_str(), to.c_str()) == 0 ? 0 : errno;
+}
+
+// Makes a finished rename in dir survive a crash
+void SyncDirectory(const std::string& dir)
+{
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+// Copies from into a new file `part` with mode and timestamps, and waits
+// for the copy to reach the disk. Returns bytes copied or -1.
+int64_t CopyContents(const std::string& from, const std::string& part)
+{
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (in < 0)
+        return -1;
+
+    struct stat st;
+    if (::fstat(in, &st) != 0) {
+        ::close(in);
+        return -1;
+    }
+    ::posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // The name is this move's alone; one that exists is left over from an
+    // interrupted attempt at the same move
+    const int flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+    int out = ::open(part.c_str(), flags, st.st_mode & 07777);
+    if (out < 0 && errno == EEXIST && ::unlink(part.c_str()) == 0)
+        out = ::open(part.c_str(), flags, st.st_mode & 07777);
+    if (out < 0) {
+        ::close(in);
+        return -1;
+    }
+
+    // In-kernel copy first; older kernels refuse it across filesystems, in
+    // which case a plain read/write loop takes over
+    int64_t copied = 0;
+    bool ok = true;
+    bool kernelCopy = true;
+    std::vector<char> buf;
+
+    while (copied < st.st_size) {
+        if (kernelCopy) {
+            ssize_t got = ::copy_file_range(in, nullptr, out, nullptr,
+                                            static_cast<size_t>(st.st_size - copied), 0);
+            if (got > 0) {
+                copied += got;
+                continue;
+            }
+            if (got == 0)
+                break;   // file shrank
+            if (copied == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                                errno == EOPNOTSUPP)) {
+                kernelCopy = false;
+                buf.resize(size_t(1) << 20);
+                continue;
+            }
+            ok = false;
+            break;
+        }
+
+        ssize_t got = ::read(in, buf.data(), buf.size());
+        if (got <= 0) {
+            ok = got == 0;
+            break;
+        }
+        for (ssize_t off = 0; off < got;) {
+            ssize_t put = ::write(out, buf.data() + off, static_cast<size_t>(got - off));
+            if (put < 0) {
+                ok = false;
+                break;
+            }
+            off += put;
+        }
+        if (!ok)
+            break;
+        copied += got;
+    }
+
+    if (ok) {
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        ::futimens(out, times);
+
+        // The original is removed once the copy is in place, so the copy
+        // has to be on disk first
+        ok = ::fsync(out) == 0;
+    }
+    ::close(in);
+    if (::close(out) != 0)
+        ok = false;
+
+    if (!ok) {
+        ::unlink(part.c_str());
+        return -1;
+    }
+    return copied;
+}
+
+bool SourceExists(const std::string& path)
+{
+    struct stat st;
+    return ::lstat(path.c_str(), &st) == 0;
+}
+
+#else
+
+int RenameNoReplace(const std::string& from, const std::string& to)
+{
+    std::error_code ec;
+    if (fs::exists(ToPath(to), ec))
+        return EEXIST;
+    fs::rename(ToPath(from), ToPath(to), ec);
+    if (!ec)
+        return 0;
+    if (ec == std::errc::cross_device_link)
+        return EXDEV;
+    return ec == std::errc::no_such_file_or_directory ? ENOENT : EIO;
+}
+
+void SyncDirectory(const std::string&)
+{
+}
+
+int64_t CopyContents(const std::string& from, const std::string& part)
+{
+    // As on Linux: the name is this move's alone
+    std::error_code ec;
+    fs::remove(ToPath(part), ec);
+    fs::copy_file(ToPath(from), ToPath(part), fs::copy_options::none, ec);
+    if (ec)
+        return -1;
+    fs::last_write_time(ToPath(part), fs::last_write_time(ToPath(from), ec), ec);
+    return static_cast<int64_t>(fs::file_size(ToPath(part), ec));
+}
+
+bool SourceExists(const std::string& path)
+{
+    std::error_code ec;
+    return fs::exists(ToPath(path), ec);
+}
+
+#endif
+
+// Removes the original of a copy that is in place. True if it is gone.
+bool DropOriginal(const std::string& path)
+{
+    std::error_code ec;
+    fs::remove(ToPath(path), ec);
+    return !ec || !SourceExists(path);
+}
+
+// Called once a cross-filesystem copy is in place, before its original is
+// removed, to record that both exist; false cancels the move
+using OnCopyPlaced = std::function<bool(const std::string& copy)>;
+
+// Moves from to `to`, or to the first free "to (n)" when allowSuffix.
+// index identifies the move for the name of a cross-filesystem copy.
+MoveResult MoveFile(const std::string& from, const std::string& to, bool allowSuffix, size_t index,
+                    const OnCopyPlaced& placed, std::string& final, uint64_t& bytesCopied)
+{
+    unsigned attempts = allowSuffix ? kMaxSuffix : 1;
+    for (unsigned n = 1; n <= attempts; ++n) {
+        std::string candidate = n == 1 ? to : WithSuffix(to, n);
+
+        int err = RenameNoReplace(from, candidate);
+        if (err == 0) {
+            final = std::move(candidate);
+            return MoveResult::Renamed;
+        }
+        if (err == EEXIST)
+            continue;
+        if (err == ENOENT && !SourceExists(from))
+            return MoveResult::SourceMissing;
+        if (err != EXDEV)
+            return MoveResult::Failed;
+
+        // Different filesystem: copy next to the target, then rename the
+        // copy into place the same way and drop the original
+        std::string part = to + kPartSuffix + std::to_string(index);
+        int64_t copied = CopyContents(from, part);
+        if (copied < 0)
+            return SourceExists(from) ? MoveResult::Failed : MoveResult::SourceMissing;
+
+        for (; n <= attempts; ++n) {
+            candidate = n == 1 ? to : WithSuffix(to, n);
+            err = RenameNoReplace(part, candidate);
+            if (err != EEXIST)
+                break;
+        }
+        if (err != 0) {
+            std::error_code ec;
+            fs::remove(ToPath(part), ec);
+            return MoveResult::Failed;
+        }
+
+        // Only a copy that is known to be in place, and known to be so
+        // after a crash, replaces the original. An original that cannot
+        // be removed, e.g. in a read-only folder, keeps the file where it
+        // was.
+        SyncDirectory(FromPath(ToPath(candidate).parent_path()));
+        if (!placed(candidate) || !DropOriginal(from)) {
+            std::error_code ec;
+            fs::remove(ToPath(candidate), ec);
+            return MoveResult::Failed;
+        }
+
+        bytesCopied = static_cast<uint64_t>(copied);
+        final = std::move(candidate);
+        return MoveResult::Copied;
+    }
+    return MoveResult::Failed;
+}
+
+// A regular file of the planned size and mtime is at path
+bool IsPlannedFile(const std::string& path, uint64_t size, int64_t mtime)
+{
+    std::error_code ec;
+    fs::path p = ToPath(path);
+    return fs::is_regular_file(p, ec) && fs::file_size(p, ec) == size && ModifiedSeconds(p) == mtime;
+}
+
+// The destinations that belong to a move of the run, so that looking for a
+// move the journal lost never takes another move's file
+class Claims {
+public:
+    bool Claim(const std::string& path)
+    {
+        std::lock_guard lock(m_mutex);
+        return m_paths.insert(path).second;
+    }
+
+    bool Contains(const std::string& path)
+    {
+        std::lock_guard lock(m_mutex);
+        return m_paths.contains(path);
+    }
+
+private:
+    std::mutex            m_mutex;
+    std::set<std::string> m_paths;
+};
+
+// Where a move that was not journaled as done may have put its file: the
+// first unclaimed one of target, "target (2)", ... that is a regular file of
+// the planned size and mtime. MoveFile() took the first free name, so the
+// search ends at a free one, unless another move of the run held it and has
+// been undone since.
+std::string FindArrival(const std::string& target, uint64_t size, int64_t mtime, Claims& claims)
+{
+    for (unsigned n = 1; n <= kMaxSuffix; ++n) {
+        std::string candidate = n == 1 ? target : WithSuffix(target, n);
+        fs::path path = ToPath(candidate);
+        std::error_code ec;
+        if (!fs::exists(fs::symlink_status(path, ec))) {
+            if (claims.Contains(candidate))
+                continue;
+            break;
+        }
+        if (IsPlannedFile(candidate, size, mtime) && claims.Claim(candidate))
+            return candidate;
+    }
+    return {};
+}
+
+} // namespace
+
+std::string SafeFolderName(const std::string& utf8Label)
+{
+    std::string name;
+    name.reserve(utf8Label.size());
+    for (unsigned char c : utf8Label)
+        name += (c < 0x20 || std::string_view("<>:\"/\\|?*").find(c) != std::string_view::npos) ? '_' : c;
+
+    // Windows drops trailing dots and spaces
+    while (!name.empty() && (name.back() == '.' || name.back() == ' '))
+        name.pop_back();
+    if (name.empty() || name == "." || name == "..")
+        name = "_";
+    return name;
+}
+
+std::vector<PlannedMove> PlanMoves(const std::vector<FileInfo>& files, const Grouping& grouping,
+                                   std::span<const CategoryId> order,
+                                   const CategoryRegistry& categories,
+                                   std::vector<FileIndex>* fileOf)
+{
+    std::vector<PlannedMove> moves;
+    moves.reserve(grouping.FileCount());
+    if (fileOf) {
+        fileOf->clear();
+        fileOf->reserve(grouping.FileCount());
+    }
+
+    for (CategoryId id : order) {
+        wxString folder = wxString::FromUTF8(SafeFolderName(categories.Label(id).utf8_string()));
+        std::string nativeFolder = ToFileSystem(folder);
+
+        for (FileIndex i : grouping.Files(id)) {
+            const FileInfo& f = files[i];
+            moves.push_back({f.NativePath(), nativeFolder, f.size.GetValue(),
+                             static_cast<int64_t>(f.modified.GetTicks())});
+            if (fileOf)
+                fileOf->push_back(i);
+        }
+    }
+    return moves;
+}
+
+std::vector<PlannedMove> PlanMoves(const std::vector<FileInfo>& files, const Grouping& grouping,
+                                   const PlanTree& tree, std::span<const CategoryId> leaves,
+                                   const CategoryRegistry& categories,
+                                   std::vector<FileIndex>* fileOf)
+{
+    std::vector<PlannedMove> moves;
+    moves.reserve(grouping.FileCount());
+    if (fileOf) {
+        fileOf->clear();
+        fileOf->reserve(grouping.FileCount());
+    }
+
+    for (CategoryId leaf : leaves) {
+        std::string nativeFolder;
+        for (size_t k = 0; k < tree.Levels(); ++k) {
+            if (k > 0)
+                nativeFolder += '/';
+            CategoryId id = tree.Category(leaf, k);
+            nativeFolder += ToFileSystem(wxString::FromUTF8(SafeFolderName(categories.Label(id).utf8_string())));
+        }
+
+        for (FileIndex i : grouping.Files(leaf)) {
+            const FileInfo& f = files[i];
+            moves.push_back({f.NativePath(), nativeFolder, f.size.GetValue(),
+                             static_cast<int64_t>(f.modified.GetTicks())});
+            if (fileOf)
+                fileOf->push_back(i);
+        }
+    }
+    return moves;
+}
+
+// ---------------------------- Journal I/O ---------------------------------
+
+struct ApplyPlanJob::Entry {
+    enum State : uint8_t {
+        Pending,
+        Copied,     // copy at final, the source may still be there
+        Done,
+        Returned,   // being undone: copy at source, final may still be there
+        Skipped,
+        Undone
+    };
+
+    uint64_t    size = 0;
+    int64_t     mtime = 0;
+    std::string source;
+    std::string target;     // planned
+    std::string final;      // where it actually went, once Copied or Done
+    State       state = Pending;
+
+    // Left part way by an interrupted run
+    bool Interrupted() const { return state == Pending || state == Copied || state == Returned; }
+};
+
+class ApplyPlanJob::Journal {
+public:
+    ~Journal() { Close(); }
+
+    bool Open(const std::string& path)
+    {
+        m_file = std::fopen(path.c_str(), "ab");
+        return m_file != nullptr;
+    }
+
+    bool Close()
+    {
+        if (!m_file)
+            return !m_failed;
+        Sync();
+        if (std::fclose(m_file) != 0)
+            m_failed = true;
+        m_file = nullptr;
+        return !m_failed;
+    }
+
+    // Buffers one record. False once any write has failed.
+    bool Write(std::initializer_list<std::string_view> fields)
+    {
+        std::string line;
+        for (std::string_view field : fields) {
+            if (!line.empty())
+                line += '\t';
+            line += Escape(field);
+        }
+        line += '\n';
+
+        std::lock_guard lock(m_mutex);
+        if (std::fwrite(line.data(), 1, line.size(), m_file) != line.size())
+            m_failed = true;
+        return !m_failed;
+    }
+
+    // Puts the records so far on disk. Moves are only started after their
+    // P records are synced, and every chunk of moves syncs its outcomes, so
+    // a crash loses at most the outcomes of the chunks in flight (which
+    // Resume and Undo then look for, see FindArrival()).
+    bool Sync()
+    {
+        std::lock_guard lock(m_mutex);
+        if (std::fflush(m_file) != 0)
+            m_failed = true;
+#ifdef __linux__
+        else if (::fdatasync(::fileno(m_file)) != 0)
+            m_failed = true;
+#endif
+        return !m_failed;
+    }
+
+    bool Failed() const { return m_failed.load(); }
+
+    // Reads the last run of the journal at path
+    static bool Load(const std::string& path, std::vector<Entry>& entries, std::vector<std::string>& folders,
+                     std::string& run)
+    {
+        std::ifstream in(ToPath(path), std::ios::binary);
+        if (!in)
+            return false;
+
+        std::string line;
+        while (std::getline(in, line)) {
+            std::vector<std::string> f = SplitRecord(line);
+            const std::string& kind = f[0];
+
+            if (kind == "R") {
+                entries.clear();
+                folders.clear();
+                run = f.size() >= 3 ? f[2] : std::string();
+                continue;
+            }
+            if (kind == "M" && f.size() >= 2) {
+                folders.push_back(f[1]);
+                continue;
+            }
+            if (f.size() < 2)
+                continue;   // torn last line of a crashed run
+
+            size_t index = std::strtoull(f[1].c_str(), nullptr, 10);
+            if (kind == "P" && f.size() >= 6) {
+                if (entries.size() <= index)
+                    entries.resize(index + 1);
+                Entry& e = entries[index];
+                e.size = std::strtoull(f[2].c_str(), nullptr, 10);
+                e.mtime = std::strtoll(f[3].c_str(), nullptr, 10);
+                e.source = f[4];
+                e.target = f[5];
+                continue;
+            }
+            if (index >= entries.size())
+                continue;
+
+            Entry& e = entries[index];
+            if (kind == "C" && f.size() >= 4) {
+                // Copied by the run, or back to the source by an Undo
+                e.state = f[2] == e.source ? Entry::Returned : Entry::Copied;
+                e.final = f[2] == e.source ? f[3] : f[2];
+            } else if (kind == "D" && f.size() >= 3) {
+                e.state = Entry::Done;
+                e.final = f[2];
+            } else if (kind == "S") {
+                e.state = Entry::Skipped;
+            } else if (kind == "U") {
+                e.state = Entry::Undone;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::FILE*        m_file = nullptr;
+    std::mutex        m_mutex;
+    std::atomic<bool> m_failed{false};
+};
+
+// ------------------------------ ApplyPlanJob ------------------------------
+
+ApplyPlanJob::JournalState ApplyPlanJob::ReadJournalState(const std::string& targetRoot)
+{
+    JournalState state;
+    std::vector<Entry> entries;
+    std::vector<std::string> folders;
+    std::string run;
+    if (!Journal::Load(FromPath(ToPath(targetRoot) / kJournalName), entries, folders, run))
+        return state;
+
+    state.exists = true;
+    state.planned = entries.size();
+    for (const Entry& e : entries) {
+        state.done += e.state == Entry::Done || e.state == Entry::Returned;
+        state.pending += e.state == Entry::Pending || e.state == Entry::Copied;
+    }
+    return state;
+}
+
+ApplyPlanJob::ApplyPlanJob(Mode mode, std::string targetRoot, std::vector<PlannedMove> moves, unsigned threads)
+    : m_mode(mode)
+    , m_root(std::move(targetRoot))
+    , m_moves(std::move(moves))
+    // Renames are metadata operations; a few in flight hide their latency
+    // without contending on the target directories' locks
+    , m_threads(threads ? threads : std::clamp(std::thread::hardware_concurrency(), 2u, 8u))
+{
+}
+
+ApplyPlanJob::~ApplyPlanJob()
+{
+    Cancel();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void ApplyPlanJob::Start(OnFinished onFinished)
+{
+    m_onFinished = std::move(onFinished);
+    m_startTime = std::chrono::steady_clock::now();
+    m_running = true;
+
+    m_thread = std::jthread([this](std::stop_token stop) {
+        Run(stop);
+
+        m_elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - m_startTime).count();
+        bool cancelled = stop.stop_requested();
+        m_running = false;
+        if (m_onFinished)
+            m_onFinished(cancelled);
+    });
+}
+
+void ApplyPlanJob::Cancel()
+{
+    m_thread.request_stop();
+}
+
+ApplyPlanJob::Progress ApplyPlanJob::GetProgress() const
+{
+    Progress p;
+    p.files = m_files.load(std::memory_order_relaxed);
+    p.done = m_done.load(std::memory_order_relaxed);
+    p.renamed = m_renamed.load(std::memory_order_relaxed);
+    p.copied = m_copied.load(std::memory_order_relaxed);
+    p.skipped = m_skipped.load(std::memory_order_relaxed);
+    p.errors = m_errors.load(std::memory_order_relaxed);
+    p.bytesCopied = m_bytesCopied.load(std::memory_order_relaxed);
+
+    int64_t ns = m_elapsedNs.load();
+    if (ns < 0)
+        ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - m_startTime).count();
+    p.elapsedSeconds = ns / 1e9;
+    return p;
+}
+
+void ApplyPlanJob::Run(std::stop_token stop)
+{
+    const fs::path root = ToPath(m_root);
+    const std::string journalPath = FromPath(root / kJournalName);
+
+    std::error_code ec;
+    fs::create_directories(root, ec);
+
+    std::vector<Entry> entries;
+    std::vector<std::string> folders;
+    bool haveJournal = Journal::Load(journalPath, entries, folders, m_runId);
+
+    if (m_mode != Mode::Apply && !haveJournal) {
+        m_error = "No journal found in the target folder.";
+        return;
+    }
+    if (m_mode == Mode::Apply && std::ranges::any_of(entries, &Entry::Interrupted)) {
+        m_error = "The previous run in this folder was interrupted. Resume or undo it first.";
+        return;
+    }
+
+    Journal journal;
+    if (!journal.Open(journalPath)) {
+        m_error = "Cannot write the journal in the target folder.";
+        return;
+    }
+
+    if (m_mode == Mode::Apply) {
+        // New run: folders first, then every planned move, so the journal
+        // describes the whole run before the first file is touched
+        entries.clear();
+        entries.resize(m_moves.size());
+
+        // Tells this run apart from earlier ones in the same folder
+        std::random_device random;
+        uint64_t id = (uint64_t(random()) << 32 | random()) ^
+                      static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(id));
+        m_runId = hex;
+
+        journal.Write({"R", std::to_string(m_moves.size()), m_runId});
+
+        std::set<std::string> made;
+        for (const PlannedMove& move : m_moves) {
+            if (made.contains(move.folder))
+                continue;
+
+            // Nested folders are created, and journaled, level by level
+            size_t cut = 0;
+            do {
+                cut = move.folder.find('/', cut + 1);
+                std::string level = move.folder.substr(0, cut);
+                if (made.insert(level).second && fs::create_directory(root / ToPath(level), ec))
+                    journal.Write({"M", level});
+            } while (cut != std::string::npos);
+        }
+
+        for (size_t i = 0; i < m_moves.size(); ++i) {
+            const PlannedMove& move = m_moves[i];
+            Entry& e = entries[i];
+            e.size = move.size;
+            e.mtime = move.mtime;
+            e.source = move.source;
+            e.target = FromPath(root / ToPath(move.folder) / ToPath(move.source).filename());
+            journal.Write({"P", std::to_string(i), std::to_string(e.size), std::to_string(e.mtime),
+                           e.source, e.target});
+        }
+    }
+
+    // Nothing moves unless the journal can describe it
+    if (!journal.Sync()) {
+        m_error = "Cannot write the journal in the target folder.";
+        return;
+    }
+
+    m_destinations.assign(entries.size(), std::string());
+    m_sources.reserve(entries.size());
+    for (const Entry& e : entries)
+        m_sources.push_back(e.source);
+    RunMoves(stop, entries, journal, m_mode == Mode::Undo);
+
+    // Undo also takes down the folders the run created, if they are empty
+    if (m_mode == Mode::Undo && !stop.stop_requested() && m_errors.load() == 0) {
+        for (auto it = folders.rbegin(); it != folders.rend(); ++it)
+            fs::remove(root / ToPath(*it), ec);
+    }
+
+    if (!journal.Close() && m_error.empty())
+        m_error = "Writing the journal failed; files were moved but Resume and Undo may not find all of them.";
+}
+
+void ApplyPlanJob::RunMoves(std::stop_token stop, std::vector<Entry>& entries, Journal& journal, bool undo)
+{
+    // The moves this job is responsible for
+    std::vector<size_t> todo;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Entry::State s = entries[i].state;
+        if (undo ? s == Entry::Done || entries[i].Interrupted() : s == Entry::Pending || s == Entry::Copied)
+            todo.push_back(i);
+    }
+    m_files = todo.size();
+
+    // Where the moves journaled as done put their files
+    Claims claims;
+    for (const Entry& e : entries)
+        if (e.state == Entry::Done || e.state == Entry::Copied || e.state == Entry::Returned)
+            claims.Claim(e.final);
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> journalFailed{false};
+    auto worker = [&] {
+        while (!stop.stop_requested() && !journalFailed.load()) {
+            size_t begin = next.fetch_add(kMoveChunk);
+            if (begin >= todo.size())
+                break;
+            size_t end = std::min(todo.size(), begin + kMoveChunk);
+
+            for (size_t t = begin; t < end && !stop.stop_requested(); ++t) {
+                size_t i = todo[t];
+                Entry& e = entries[i];
+                std::string index = std::to_string(i);
+                uint64_t bytes = 0;
+
+                if (undo) {
+                    // A copy and its original both exist: the source one
+                    // stays, whichever it is
+                    if ((e.state == Entry::Copied || e.state == Entry::Returned) && SourceExists(e.source)) {
+                        if (DropOriginal(e.final)) {
+                            journal.Write({"U", index});
+                            m_destinations[i] = e.source;
+                            m_copied.fetch_add(1, std::memory_order_relaxed);
+                        } else {
+                            m_errors.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        m_done.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+
+                    // Not journaled as done, yet it may have been moved just
+                    // before a crash: only a source still in place proves
+                    // it never was
+                    std::string from = e.final;
+                    if (e.state == Entry::Pending) {
+                        from.clear();
+                        if (!SourceExists(e.source))
+                            from = FindArrival(e.target, e.size, e.mtime, claims);
+                        if (from.empty()) {
+                            journal.Write({"U", index});
+                            m_skipped.fetch_add(1, std::memory_order_relaxed);
+                            m_done.fetch_add(1, std::memory_order_relaxed);
+                            continue;
+                        }
+                    }
+
+                    std::error_code ec;
+                    fs::create_directories(ToPath(e.source).parent_path(), ec);
+
+                    auto placed = [&](const std::string& copy) {
+                        return journal.Write({"C", index, copy, from}) && journal.Sync();
+                    };
+                    std::string back;
+                    MoveResult r = MoveFile(from, e.source, false, i, placed, back, bytes);
+                    if (r == MoveResult::Renamed || r == MoveResult::Copied) {
+                        journal.Write({"U", index});
+                        m_destinations[i] = back;
+                        (r == MoveResult::Renamed ? m_renamed : m_copied).fetch_add(1, std::memory_order_relaxed);
+                        m_bytesCopied.fetch_add(bytes, std::memory_order_relaxed);
+                    } else if (r == MoveResult::SourceMissing) {
+                        journal.Write({"U", index});
+                        m_skipped.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        m_errors.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    m_done.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                std::string final;
+                MoveResult r;
+                if (e.state == Entry::Copied && IsPlannedFile(e.final, e.size, e.mtime)) {
+                    // Interrupted after the copy was in place: only the
+                    // original is left to remove
+                    final = e.final;
+                    r = DropOriginal(e.source) ? MoveResult::Copied : MoveResult::Failed;
+                } else {
+                    auto placed = [&](const std::string& copy) {
+                        return journal.Write({"C", index, copy, e.source}) && journal.Sync();
+                    };
+                    r = MoveFile(e.source, e.target, true, i, placed, final, bytes);
+                }
+
+                if (r == MoveResult::SourceMissing) {
+                    // A crash between the move and its D record leaves the
+                    // file at its planned target, or a suffixed one, with
+                    // nothing journaled
+                    final = FindArrival(e.target, e.size, e.mtime, claims);
+                    if (!final.empty())
+                        r = MoveResult::Renamed;
+                } else if (r == MoveResult::Renamed || r == MoveResult::Copied) {
+                    claims.Claim(final);
+                }
+
+                switch (r) {
+                case MoveResult::Renamed:
+                case MoveResult::Copied:
+                    journal.Write({"D", index, final});
+                    m_destinations[i] = final;
+                    (r == MoveResult::Renamed ? m_renamed : m_copied).fetch_add(1, std::memory_order_relaxed);
+                    m_bytesCopied.fetch_add(bytes, std::memory_order_relaxed);
+                    break;
+                case MoveResult::SourceMissing:
+                    journal.Write({"S", index});
+                    m_skipped.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                case MoveResult::Failed:
+                    m_errors.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                m_done.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // The outcomes of each chunk reach the disk before the next one
+            // starts; moves the journal cannot record are not made
+            if (!journal.Sync() && !journalFailed.exchange(true))
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    unsigned threads = static_cast<unsigned>(std::min<size_t>(m_threads, std::max<size_t>(1, todo.size() / kMoveChunk)));
+    std::vector<std::jthread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t)
+        workers.emplace_back(worker);
+    worker();
+}
@@ -0,0 +1,153 @@
+// applyplan.h
+//
+// Carries out an organization plan on disk: every file is moved into a
+// folder named after its category below a target directory. Moves are
+// rename(2)s where possible and copy + unlink across filesystems.
+//
+// Each run is recorded in an append-only journal in the target directory,
+// so a run that was interrupted can be resumed, and the last run can be
+// undone, even after a restart.
+
+#pragma once
+
+#include "classifier.h"
+#include "fileinfo.h"
+#include "grouping.h"
+#include "plantree.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PlannedMove {
+    std::string source;       // ToFileSystem() form
+    std::string folder;       // category folder name, see SafeFolderName(), or
+                              // one per level joined by '/' for nested plans
+    uint64_t    size = 0;
+    int64_t     mtime = 0;    // seconds since the epoch
+};
+
+// Turns a category label into a folder name that is valid on every
+// platform we support, e.g. "Tiny (< 100KB)" -> "Tiny (_ 100KB)".
+std::string SafeFolderName(const std::string& utf8Label);
+
+// The moves that put the files of every category in `order` into that
+// category's folder. fileOf, if given, receives the file index of each move.
+std::vector<PlannedMove> PlanMoves(const std::vector<FileInfo>& files, const Grouping& grouping,
+                                   std::span<const CategoryId> order,
+                                   const CategoryRegistry& categories,
+                                   std::vector<FileIndex>* fileOf = nullptr);
+
+// Same for a hierarchical plan: the files of every leaf of tree in
+// `leaves` go into nested folders, one per level, e.g. "Images/Older".
+std::vector<PlannedMove> PlanMoves(const std::vector<FileInfo>& files, const Grouping& grouping,
+                                   const PlanTree& tree, std::span<const CategoryId> leaves,
+                                   const CategoryRegistry& categories,
+                                   std::vector<FileIndex>* fileOf = nullptr);
+
+class ApplyPlanJob {
+public:
+    enum class Mode {
+        Apply,      // start a new run with the given moves
+        Resume,     // finish the moves of the last run that have not happened
+        Undo        // move the files of the last run back, remove its folders
+    };
+
+    // What the journal in a target directory says about its last run
+    struct JournalState {
+        bool   exists = false;
+        size_t planned = 0;
+        size_t done = 0;        // moved and not undone
+        size_t pending = 0;     // neither moved, skipped nor undone
+    };
+
+    struct Progress {
+        uint64_t files = 0;        // moves in this job
+        uint64_t done = 0;         // handled, whatever the outcome
+        uint64_t renamed = 0;
+        uint64_t copied = 0;       // moved across filesystems
+        uint64_t skipped = 0;      // source gone
+        uint64_t errors = 0;
+        uint64_t bytesCopied = 0;
+        double   elapsedSeconds = 0.0;
+
+        double FilesPerSecond() const { return elapsedSeconds > 0.0 ? done / elapsedSeconds : 0.0; }
+        double BytesPerSecond() const { return elapsedSeconds > 0.0 ? bytesCopied / elapsedSeconds : 0.0; }
+    };
+
+    // Called once on the job's thread when it is done
+    using OnFinished = std::function<void(bool cancelled)>;
+
+    static constexpr const char* kJournalName = ".medama-journal";
+
+    static JournalState ReadJournalState(const std::string& targetRoot);
+
+    // moves is only used by Mode::Apply. threads == 0 picks a default.
+    ApplyPlanJob(Mode mode, std::string targetRoot, std::vector<PlannedMove> moves = {},
+                 unsigned threads = 0);
+    ~ApplyPlanJob();
+
+    ApplyPlanJob(const ApplyPlanJob&) = delete;
+    ApplyPlanJob& operator=(const ApplyPlanJob&) = delete;
+
+    void Start(OnFinished onFinished);
+    void Cancel();
+
+    Mode     GetMode() const { return m_mode; }
+    bool     IsRunning() const { return m_running.load(); }
+    Progress GetProgress() const;
+
+    // Valid once finished. A non-empty error means the job could not run at
+    // all, e.g. the journal is not writable, or that the journal stopped
+    // taking records part way through.
+    const std::string& Error() const { return m_error; }
+
+    // Valid once finished, one string per move of the run. Mode::Apply:
+    // where moves[i] ended up. Mode::Undo: where move i of the last run was
+    // put back, i.e. its source. Empty if this job did not move it.
+    const std::vector<std::string>& Destinations() const { return m_destinations; }
+
+    // Valid once the job has run: the source of every move of the run, in
+    // the order of Destinations(), and the ID its journal gives it (empty
+    // for journals written before runs had IDs). Tells a Resume or Undo
+    // which files it moved, and whether it is the run a caller knows.
+    const std::vector<std::string>& Sources() const { return m_sources; }
+    const std::string&              RunId() const { return m_runId; }
+
+private:
+    struct Entry;
+    class Journal;
+
+    Mode                     m_mode;
+    std::string              m_root;
+    std::vector<PlannedMove> m_moves;
+    unsigned                 m_threads;
+    OnFinished               m_onFinished;
+
+    std::vector<std::string> m_destinations;
+    std::vector<std::string> m_sources;
+    std::string              m_runId;
+    std::string              m_error;
+
+    std::jthread          m_thread;
+    std::atomic<bool>     m_running{false};
+
+    std::atomic<uint64_t> m_files{0};
+    std::atomic<uint64_t> m_done{0};
+    std::atomic<uint64_t> m_renamed{0};
+    std::atomic<uint64_t> m_copied{0};
+    std::atomic<uint64_t> m_skipped{0};
+    std::atomic<uint64_t> m_errors{0};
+    std::atomic<uint64_t> m_bytesCopied{0};
+
+    std::chrono::steady_clock::time_point m_startTime;
+    std::atomic<int64_t>                  m_elapsedNs{-1};   // set once finished
+
+    void Run(std::stop_token stop);
+    void RunMoves(std::stop_token stop, std::vector<Entry>& entries, Journal& journal, bool undo);
+};
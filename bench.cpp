@@ -0,0 +1,552 @@
+// bench.cpp
+//
+// medama-bench: generates synthetic trees (see treegen.h) and times every
+// stage of the pipeline on them, from scanning to export. Results go out as
+// one JSON document so runs can be stored and compared over time.
+//
+//   medama-bench --files 1k,100k,1M --repeat 5 --output baseline.json
+
+#include "buckets.h"
+#include "classifier.h"
+#include "diskusage.h"
+#include "duplicates.h"
+#include "fileinfo.h"
+#include "grouping.h"
+#include "ingest.h"
+#include "metaindex.h"
+#include "organizer.h"
+#include "pathstore.h"
+#include "planexport.h"
+#include "plantree.h"
+#include "scanner.h"
+#include "similar.h"
+#include "sniffer.h"
+#include "thumbcache.h"
+#include "treegen.h"
+#include "treemap.h"
+
+#include <wx/cmdline.h>
+#include <wx/init.h>
+#include <wx/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const wxCmdLineEntryDesc kOptions[] = {
+    { wxCMD_LINE_SWITCH, "h", "help", "show this help",
+      wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+    { wxCMD_LINE_OPTION, "n", "files", "tree sizes to run, e.g. 1k,100k,1M (default)" },
+    { wxCMD_LINE_OPTION, "r", "repeat", "runs per measurement, the best and the median are reported (default 3)",
+      wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, nullptr, "depth", "directory levels (default 3)", wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, nullptr, "fanout", "subdirectories per directory (default 8)", wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, nullptr, "extensions", "extension mix, e.g. jpg=20,txt=10,=5 (empty: no extension)" },
+    { wxCMD_LINE_OPTION, nullptr, "size-median", "median file size in bytes (default 65536)", wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, nullptr, "size-sigma", "log-normal sigma of file sizes (default 2.0)", wxCMD_LINE_VAL_DOUBLE },
+    { wxCMD_LINE_OPTION, nullptr, "size-max", "largest file size in bytes (default 256 MiB)", wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, nullptr, "mtime-days", "spread of modification times (default 1500)", wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, nullptr, "seed", "generator seed (default 1)", wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_OPTION, "d", "dir", "where to create the trees (default: the temp directory)" },
+    { wxCMD_LINE_OPTION, "o", "output", "write the JSON results to this file instead of standard output" },
+    { wxCMD_LINE_SWITCH, nullptr, "skip-content", "skip content sniffing, the duplicate search and the image comparison" },
+    { wxCMD_LINE_SWITCH, nullptr, "keep", "keep the generated trees" },
+    wxCMD_LINE_DESC_END
+};
+
+// JSON field names of the strategies
+constexpr const char* kStrategyKeys[kStrategyCount] = {
+    "type", "date", "size", "extension", "real_type", "duplicates", "rules", "similar"
+};
+
+struct Phase {
+    std::string         name;
+    size_t              items = 0;
+    std::vector<double> seconds;
+
+    double Best() const { return *std::min_element(seconds.begin(), seconds.end()); }
+
+    double Median() const
+    {
+        std::vector<double> sorted = seconds;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+};
+
+struct Run {
+    TreeStats          tree;
+    std::vector<Phase> phases;
+    size_t             pathBytes = 0;   // PathStore after one scan
+};
+
+template <typename Fn>
+void Measure(Run& run, std::string name, size_t items, unsigned repeat, Fn fn)
+{
+    Phase phase{std::move(name), items, {}};
+    for (unsigned r = 0; r < repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        phase.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::fprintf(stderr, "  %-28s %12.3f ms\n", phase.name.c_str(), phase.Best() * 1e3);
+    run.phases.push_back(std::move(phase));
+}
+
+// Runs a job that reports completion through a single OnFinished callback
+template <typename Job>
+void RunToEnd(Job& job)
+{
+    std::promise<void> done;
+    std::future<void> finished = done.get_future();
+    job.Start([&done](bool) { done.set_value(); });
+    finished.wait();
+}
+
+std::vector<FileInfo> Scan(const wxString& root, const MetadataIndex* index = nullptr,
+                           std::vector<ScannedDirectory>* dirs = nullptr)
+{
+    std::vector<FileInfo> files;
+    std::mutex            mutex;
+    std::promise<void>    done;
+    std::future<void>     finished = done.get_future();
+
+    DirectoryScanner scanner(root, 0, index);
+    scanner.Start(
+        [&](std::vector<FileInfo>&& batch) {
+            std::lock_guard lock(mutex);
+            files.insert(files.end(), std::make_move_iterator(batch.begin()),
+                         std::make_move_iterator(batch.end()));
+        },
+        [&done](bool) { done.set_value(); });
+    finished.wait();
+    if (dirs)
+        *dirs = scanner.TakeDirectories();
+    return files;
+}
+
+// "1k,100k,1M" -> 1000, 100000, 1000000
+bool ParseCounts(const wxString& text, std::vector<size_t>& counts)
+{
+    std::string s = text.utf8_string();
+    size_t pos = 0;
+    while (pos < s.size()) {
+        char* end = nullptr;
+        double value = std::strtod(s.c_str() + pos, &end);
+        if (end == s.c_str() + pos || value < 1)
+            return false;
+        if (*end == 'k' || *end == 'K')
+            value *= 1e3, ++end;
+        else if (*end == 'm' || *end == 'M')
+            value *= 1e6, ++end;
+        if (*end != ',' && *end != '\0')
+            return false;
+        counts.push_back(static_cast<size_t>(value));
+        pos = static_cast<size_t>(end - s.c_str()) + (*end == ',' ? 1 : 0);
+    }
+    return !counts.empty();
+}
+
+std::string JsonString(const std::string& s)
+{
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+            continue;
+        }
+        out += c;
+    }
+    return out + '"';
+}
+
+std::string MixToString(const std::vector<std::pair<std::string, unsigned>>& mix)
+{
+    std::string text;
+    for (const auto& [ext, weight] : mix) {
+        if (!text.empty())
+            text += ',';
+        text += ext + '=' + std::to_string(weight);
+    }
+    return text;
+}
+
+bool BenchmarkTree(const TreeSpec& spec, const fs::path& root, const fs::path& scratch,
+                   unsigned repeat, bool content, Run& run)
+{
+    std::string error;
+    bool generated = false;
+    Measure(run, "generate", spec.files, 1,
+            [&] { generated = GenerateTree(root.string(), spec, run.tree, error); });
+    if (!generated) {
+        std::fprintf(stderr, "medama-bench: %s\n", error.c_str());
+        return false;
+    }
+
+    // ----- Ingestion -----
+
+    std::vector<FileInfo> files;
+    wxString rootName = FromFileSystem(root.string());
+    std::vector<ScannedDirectory> dirs;
+    Measure(run, "ingest.scan", spec.files, repeat, [&] {
+        // Nothing refers to the previous scan's paths any more
+        files.clear();
+        PathStore::Get().Clear();
+        files = Scan(rootName, nullptr, &dirs);
+    });
+    run.pathBytes = PathStore::Get().MemoryUsage();
+    std::fprintf(stderr, "  %-28s %12.1f MB\n", "path store", run.pathBytes / (1024.0 * 1024.0));
+
+    // Scan order depends on thread timing; a fixed order keeps the rest comparable
+    SortByPath(files);
+    const size_t n = files.size();
+
+    // A rescan of the unchanged tree, served by the metadata index
+    {
+        wxString indexName = FromFileSystem((scratch / "medama.idx").string());
+        std::vector<ContentFacts> facts(n);
+        Measure(run, "index.write", n, repeat,
+                [&] { WriteMetadataIndex(indexName, root.string(), dirs, files, facts); });
+
+        MetadataIndex index;
+        Measure(run, "index.open", n, repeat, [&] { index.Open(indexName, root.string()); });
+        Measure(run, "ingest.rescan", spec.files, repeat, [&] { Scan(rootName, &index); });
+
+        std::error_code ec;
+        fs::remove(scratch / "medama.idx", ec);
+    }
+
+    // ----- Classification -----
+
+    CategoryRegistry    categories;
+    ExtensionClassifier classifier;
+    Organizer           organizer(categories, classifier);
+    std::vector<CategoryId> column(n);
+
+    // The size and date kernels work on the raw columns StrategyKeys keeps
+    std::vector<uint64_t> sizeColumn(n);
+    std::vector<int64_t>  mtimeColumn(n);
+    for (size_t i = 0; i < n; ++i) {
+        sizeColumn[i] = files[i].size.GetValue();
+        mtimeColumn[i] = files[i].modified.GetTicks();
+    }
+    int64_t now = wxDateTime::Now().GetTicks();
+
+    Measure(run, "classify.type", n, repeat, [&] {
+        for (size_t i = 0; i < n; ++i)
+            column[i] = organizer.TypeCategory(files[i]);
+    });
+    Measure(run, "classify.date", n, repeat, [&] {
+        BucketAges(mtimeColumn, now, organizer.AgeBuckets(), column);
+    });
+    Measure(run, "classify.size", n, repeat, [&] {
+        BucketSizes(sizeColumn, organizer.SizeBuckets(), column);
+    });
+    Measure(run, "classify.extension", n, repeat, [&] {
+        for (size_t i = 0; i < n; ++i)
+            column[i] = categories.ExtensionCategory(files[i].NativeName());
+    });
+
+    StrategyKeys keys;
+    Measure(run, "classify.all.serial", n, repeat, [&] {
+        keys.Clear();
+        organizer.ComputeKeys(files, keys, false);
+    });
+    Measure(run, "classify.all.parallel", n, repeat, [&] {
+        keys.Clear();
+        organizer.ComputeKeys(files, keys, true);
+    });
+
+    if (content) {
+        std::vector<std::string> paths;
+        std::vector<uint64_t> sizes;
+        paths.reserve(n);
+        sizes.reserve(n);
+        for (const FileInfo& f : files) {
+            paths.push_back(f.NativePath());
+            sizes.push_back(f.size.GetValue());
+        }
+
+        Measure(run, "classify.real_type", n, repeat, [&] {
+            ContentSniffer sniffer(paths, keys.Column(Strategy::ByType));
+            RunToEnd(sniffer);
+            Organizer::SetSniffedCategories(keys, 0, sniffer.Results());
+        });
+        Measure(run, "classify.duplicates", n, repeat, [&] {
+            DuplicateFinder finder(paths, sizes);
+            RunToEnd(finder);
+            organizer.SetDuplicateCategories(keys, finder);
+        });
+
+        // The generated files are not real images, so a stand-in decoder
+        // turns the head of each into a thumbnail. What is measured is the
+        // job around the decoding: workers, hashing, clustering and cache.
+        auto decode = [](const std::string& path, std::vector<uint8_t>& thumbnail) {
+            thumbnail.assign(kThumbnailPixels, 0);
+            std::FILE* in = std::fopen(path.c_str(), "rb");
+            if (!in)
+                return false;
+            size_t got = std::fread(thumbnail.data(), 1, thumbnail.size(), in);
+            std::fclose(in);
+            return got > 0;
+        };
+
+        const auto& byType = keys.Column(Strategy::ByType);
+        std::vector<std::string> imagePaths(n);
+        std::vector<ThumbnailKey> imageKeys(n);
+        size_t images = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (byType[i] == Category::Images) {
+                imagePaths[i] = paths[i];
+                imageKeys[i] = ThumbnailKeyOf(files[i]);
+                ++images;
+            }
+        }
+
+        Measure(run, "classify.similar", images, repeat, [&] {
+            SimilarImageFinder finder(imagePaths, imageKeys, decode);
+            RunToEnd(finder);
+            organizer.SetSimilarCategories(keys, finder);
+        });
+
+        // A repeat run, every thumbnail and hash coming from the cache
+        ThumbnailCache cache;
+        cache.Open(FromFileSystem((scratch / "thumbnails").string()));
+        {
+            SimilarImageFinder warm(imagePaths, imageKeys, decode, &cache);
+            RunToEnd(warm);
+        }
+        Measure(run, "classify.similar.cached", images, repeat, [&] {
+            SimilarImageFinder finder(imagePaths, imageKeys, decode, &cache);
+            RunToEnd(finder);
+            organizer.SetSimilarCategories(keys, finder);
+        });
+        cache.Close();
+
+        std::error_code ec;
+        fs::remove(scratch / "thumbnails.idx", ec);
+        fs::remove(scratch / "thumbnails.dat", ec);
+    }
+
+    // ----- Grouping -----
+
+    Grouping grouping;
+    for (size_t s = 0; s < kStrategyCount; ++s) {
+        Strategy strategy = static_cast<Strategy>(s);
+        Measure(run, std::string("group.") + kStrategyKeys[s] + ".serial", n, repeat,
+                [&] { organizer.Group(keys, strategy, grouping, false); });
+        Measure(run, std::string("group.") + kStrategyKeys[s] + ".parallel", n, repeat,
+                [&] { organizer.Group(keys, strategy, grouping, true); });
+    }
+
+    // Three levels in one pass, then the headings above the leaves
+    const Strategy nested[] = {Strategy::ByType, Strategy::ByDate, Strategy::BySize};
+    PlanTree plan;
+    PlanOutline outline;
+    for (bool parallel : {false, true}) {
+        Measure(run, parallel ? "group.nested.parallel" : "group.nested.serial", n, repeat, [&] {
+            plan.SetLevels(std::size(nested));
+            organizer.GroupPlan(keys, nested, plan, grouping, parallel);
+        });
+    }
+    std::vector<CategoryId> leaves = organizer.SortedLeaves(plan, grouping);
+    Measure(run, "group.nested.outline", leaves.size(), repeat,
+            [&] { outline.Build(plan, grouping, leaves, keys.sizes); });
+
+    // ----- Disk usage -----
+
+    DiskUsage usage;
+    const auto& byType = keys.Column(Strategy::ByType);
+    Measure(run, "usage.serial", n, repeat, [&] { usage.Build(files, byType, categories.size(), false); });
+    Measure(run, "usage.parallel", n, repeat, [&] { usage.Build(files, byType, categories.size(), true); });
+
+    // One level of the treemap, every directory below the top at once
+    std::vector<uint64_t> weights;
+    for (uint32_t child : usage.Children(usage.Top()))
+        weights.push_back(usage[child].bytes);
+    std::vector<TreemapRect> rects;
+    Measure(run, "usage.squarify", weights.size(), repeat,
+            [&] { Squarify(weights, TreemapRect{0, 0, 1920, 1080}, rects); });
+
+    // ----- Export -----
+
+    organizer.Group(keys, Strategy::ByType, grouping, true);
+    std::vector<CategoryId> order = organizer.SortedCategories(grouping);
+
+    PlanExporter exporter;
+    const std::pair<const char*, PlanFormat> formats[] = {
+        {"tree", PlanFormat::Tree}, {"jsonl", PlanFormat::JsonLines}, {"csv", PlanFormat::Csv}
+    };
+    for (const auto& [ext, format] : formats) {
+        fs::path target = scratch / (std::string("plan.") + ext);
+        wxString targetName = FromFileSystem(target.string());
+        Measure(run, std::string("export.") + ext, n, repeat, [&] {
+            exporter.Export(targetName, format, "Benchmark plan", files, grouping, order, categories);
+        });
+        std::error_code ec;
+        fs::remove(target, ec);
+    }
+
+    // ----- List population -----
+
+    // What the file list's cache hint does per row, for every row
+    Measure(run, "list.format_rows", n, repeat, [&] {
+        wxString size, modified;
+        for (const FileInfo& f : files) {
+            size = FormatFileSize(f.size);
+            modified = f.modified.FormatISOCombined(' ');
+        }
+    });
+    return true;
+}
+
+void WriteJson(std::FILE* out, const TreeSpec& spec, unsigned repeat, const std::vector<Run>& runs)
+{
+    char timestamp[32];
+    std::time_t t = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&t));
+
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"benchmark\": \"medama\",\n");
+    std::fprintf(out, "  \"timestamp\": \"%s\",\n", timestamp);
+    std::fprintf(out, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    std::fprintf(out, "  \"avx2\": %s,\n", BucketKernelsUseAvx2() ? "true" : "false");
+#ifdef NDEBUG
+    std::fprintf(out, "  \"optimized\": true,\n");
+#else
+    std::fprintf(out, "  \"optimized\": false,\n");
+#endif
+    std::fprintf(out, "  \"repeat\": %u,\n", repeat);
+    std::fprintf(out, "  \"tree\": {\"depth\": %u, \"fanout\": %u, \"size_median\": %.0f, "
+                      "\"size_sigma\": %g, \"size_max\": %llu, \"mtime_days\": %u, \"seed\": %llu, "
+                      "\"extensions\": %s},\n",
+                 spec.depth, spec.fanout, spec.sizeMedian, spec.sizeSigma,
+                 static_cast<unsigned long long>(spec.sizeMax), spec.mtimeDays,
+                 static_cast<unsigned long long>(spec.seed),
+                 JsonString(MixToString(spec.extensions.empty() ? DefaultExtensionMix() : spec.extensions)).c_str());
+    std::fprintf(out, "  \"runs\": [\n");
+
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const Run& run = runs[r];
+        std::fprintf(out, "    {\"files\": %zu, \"directories\": %zu, \"bytes\": %llu, "
+                          "\"path_store_bytes\": %zu, \"phases\": [\n",
+                     run.tree.files, run.tree.directories,
+                     static_cast<unsigned long long>(run.tree.bytes), run.pathBytes);
+        for (size_t p = 0; p < run.phases.size(); ++p) {
+            const Phase& phase = run.phases[p];
+            double best = phase.Best();
+            std::fprintf(out, "      {\"name\": %s, \"items\": %zu, \"best_s\": %.6f, \"median_s\": %.6f, "
+                              "\"items_per_s\": %.0f}%s\n",
+                         JsonString(phase.name).c_str(), phase.items, best, phase.Median(),
+                         best > 0.0 ? phase.items / best : 0.0, p + 1 < run.phases.size() ? "," : "");
+        }
+        std::fprintf(out, "    ]}%s\n", r + 1 < runs.size() ? "," : "");
+    }
+
+    std::fprintf(out, "  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    wxInitializer initializer(argc, argv);
+    if (!initializer.IsOk()) {
+        std::fprintf(stderr, "medama-bench: failed to initialize wxWidgets\n");
+        return 1;
+    }
+
+    wxCmdLineParser parser(kOptions, argc, argv);
+    parser.SetLogo("Times scanning, classification, grouping, export and list formatting "
+                   "on synthetic file trees.");
+    switch (parser.Parse()) {
+    case -1: return 0;
+    case 0:  break;
+    default: return 2;
+    }
+
+    TreeSpec spec;
+    wxString text;
+    long number = 0;
+    double real = 0.0;
+
+    std::vector<size_t> counts;
+    if (!ParseCounts(parser.Found("files", &text) ? text : wxString("1k,100k,1M"), counts)) {
+        std::fprintf(stderr, "medama-bench: bad --files list\n");
+        return 2;
+    }
+    if (parser.Found("extensions", &text) && !ParseExtensionMix(text.utf8_string(), spec.extensions)) {
+        std::fprintf(stderr, "medama-bench: bad --extensions mix\n");
+        return 2;
+    }
+
+    unsigned repeat = 3;
+    if (parser.Found("repeat", &number))
+        repeat = static_cast<unsigned>(std::max(1L, number));
+    if (parser.Found("depth", &number))
+        spec.depth = static_cast<unsigned>(std::max(0L, number));
+    if (parser.Found("fanout", &number))
+        spec.fanout = static_cast<unsigned>(std::max(1L, number));
+    if (parser.Found("size-median", &number))
+        spec.sizeMedian = static_cast<double>(std::max(0L, number));
+    if (parser.Found("size-sigma", &real))
+        spec.sizeSigma = std::max(0.0, real);
+    if (parser.Found("size-max", &number))
+        spec.sizeMax = static_cast<uint64_t>(std::max(0L, number));
+    if (parser.Found("mtime-days", &number))
+        spec.mtimeDays = static_cast<unsigned>(std::max(0L, number));
+    if (parser.Found("seed", &number))
+        spec.seed = static_cast<uint64_t>(number);
+
+    fs::path base = parser.Found("dir", &text) ? fs::path(ToFileSystem(text)) : fs::temp_directory_path();
+    const bool content = !parser.Found("skip-content");
+    const bool keep = parser.Found("keep");
+
+    std::vector<Run> runs;
+    for (size_t count : counts) {
+        spec.files = count;
+        fs::path scratch = base / ("medama-bench-" + std::to_string(wxGetProcessId()) + "-" + std::to_string(count));
+        fs::path root = scratch / "tree";
+
+        std::fprintf(stderr, "%zu files in %s\n", count, root.string().c_str());
+        runs.emplace_back();
+        bool ok = BenchmarkTree(spec, root, scratch, repeat, content, runs.back());
+
+        if (!keep) {
+            std::error_code ec;
+            fs::remove_all(scratch, ec);
+        }
+        if (!ok)
+            return 1;
+    }
+
+    std::FILE* out = stdout;
+    if (parser.Found("output", &text)) {
+        out = std::fopen(ToFileSystem(text).c_str(), "w");
+        if (!out) {
+            std::fprintf(stderr, "medama-bench: cannot write %s\n", text.utf8_string().c_str());
+            return 1;
+        }
+    }
+    WriteJson(out, spec, repeat, runs);
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
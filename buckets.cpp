@@ -0,0 +1,332 @@
+// buckets.cpp
+
+#include "buckets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MEDAMA_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct Unit {
+    char        suffix;
+    uint64_t    scale;
+    const char* singular;
+    const char* plural;
+};
+
+// Largest first, so formatting picks the coarsest exact unit
+const Unit kSizeUnits[] = {
+    {'T', uint64_t(1) << 40, "TB", "TB"},
+    {'G', uint64_t(1) << 30, "GB", "GB"},
+    {'M', uint64_t(1) << 20, "MB", "MB"},
+    {'K', uint64_t(1) << 10, "KB", "KB"},
+    {'B', 1, "B", "B"},
+};
+
+const Unit kAgeUnits[] = {
+    {'y', 365 * kSecondsPerDay, "year", "years"},
+    {'m', 30 * kSecondsPerDay, "month", "months"},
+    {'w', 7 * kSecondsPerDay, "week", "weeks"},
+    {'d', kSecondsPerDay, "day", "days"},
+    {'h', 60 * 60, "hour", "hours"},
+    {'s', 1, "second", "seconds"},
+};
+
+const Unit& ExactUnit(std::span<const Unit> units, uint64_t value)
+{
+    for (const Unit& unit : units) {
+        if (value % unit.scale == 0)
+            return unit;
+    }
+    return units.back();
+}
+
+// "100 KB", "3 months"
+std::string FormatAmount(std::span<const Unit> units, uint64_t value)
+{
+    const Unit& unit = ExactUnit(units, value);
+    uint64_t count = value / unit.scale;
+    char buf[48];
+    std::snprintf(buf, sizeof(buf), "%llu %s", static_cast<unsigned long long>(count),
+                  count == 1 ? unit.singular : unit.plural);
+    return buf;
+}
+
+// "100K", "3m"
+std::string FormatLimits(std::span<const Unit> units, std::span<const uint64_t> limits, bool bareIsDays)
+{
+    std::string text;
+    for (uint64_t limit : limits) {
+        const Unit& unit = ExactUnit(units, limit);
+        if (!text.empty())
+            text += ", ";
+        text += std::to_string(limit / unit.scale);
+        if (!(bareIsDays && unit.suffix == 'd') && unit.suffix != 'B')
+            text += unit.suffix;
+    }
+    return text;
+}
+
+bool ParseLimits(std::string_view text, std::span<const Unit> units, uint64_t bareScale, bool byteSuffix,
+                 std::span<const uint64_t> defaults, std::vector<uint64_t>& limits)
+{
+    std::vector<uint64_t> result;
+
+    size_t i = 0;
+    auto isSeparator = [](char c) { return c == ',' || c == ' ' || c == '\t'; };
+    auto isLetter = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
+
+    for (;;) {
+        while (i < text.size() && isSeparator(text[i]))
+            ++i;
+        if (i == text.size())
+            break;
+
+        // Number, with an optional fraction
+        size_t start = i;
+        while (i < text.size() && ((text[i] >= '0' && text[i] <= '9') || text[i] == '.'))
+            ++i;
+        std::string number(text.substr(start, i - start));
+        char* end = nullptr;
+        double amount = number.empty() ? 0.0 : std::strtod(number.c_str(), &end);
+        if (number.empty() || *end != '\0')
+            return false;
+
+        // Unit: a letter, then for sizes an optional "B" or "iB"
+        size_t unitStart = i;
+        while (i < text.size() && isLetter(text[i]))
+            ++i;
+        std::string_view suffix = text.substr(unitStart, i - unitStart);
+
+        uint64_t scale = bareScale;
+        if (!suffix.empty()) {
+            char first = static_cast<char>(suffix[0] | 0x20);
+            std::string_view rest = suffix.substr(1);
+            const Unit* found = nullptr;
+            for (const Unit& unit : units) {
+                if ((unit.suffix | 0x20) == first)
+                    found = &unit;
+            }
+            bool restOk = rest.empty() || (byteSuffix && found && found->scale > 1 &&
+                                           (rest == "B" || rest == "b" || rest == "iB" || rest == "ib"));
+            if (!found || !restOk)
+                return false;
+            scale = found->scale;
+        }
+
+        double value = std::round(amount * static_cast<double>(scale));
+        if (value < 1.0 || value > 9.2e18)
+            return false;
+        result.push_back(static_cast<uint64_t>(value));
+    }
+
+    if (result.empty())
+        result.assign(defaults.begin(), defaults.end());
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    if (result.size() > kMaxBucketLimits)
+        return false;
+
+    limits = std::move(result);
+    return true;
+}
+
+// Labels like "Size 2: 1 MB – 10 MB", numbered so the label sort keeps the
+// buckets in order
+Buckets MakeBuckets(std::span<const uint64_t> limits, std::span<const uint64_t> defaults,
+                    CategoryId firstBuiltin, const char* name, std::span<const Unit> units,
+                    CategoryRegistry& registry)
+{
+    Buckets buckets;
+    buckets.limits.assign(limits.begin(), limits.end());
+
+    if (std::ranges::equal(limits, defaults)) {
+        for (size_t k = 0; k <= limits.size(); ++k)
+            buckets.categories.push_back(static_cast<CategoryId>(firstBuiltin + k));
+        return buckets;
+    }
+
+    int width = static_cast<int>(std::to_string(limits.size() + 1).size());
+    for (size_t k = 0; k <= limits.size(); ++k) {
+        std::string range;
+        if (limits.empty())
+            range = "all";
+        else if (k == 0)
+            range = "< " + FormatAmount(units, limits[0]);
+        else if (k == limits.size())
+            range = "≥ " + FormatAmount(units, limits[k - 1]);
+        else
+            range = FormatAmount(units, limits[k - 1]) + " – " + FormatAmount(units, limits[k]);
+
+        char prefix[48];
+        std::snprintf(prefix, sizeof(prefix), "%s %0*zu: ", name, width, k + 1);
+        buckets.categories.push_back(registry.Intern(prefix + range));
+    }
+    return buckets;
+}
+
+// ----------------------------- Scalar kernels ----------------------------
+
+void BucketSizesScalar(const uint64_t* sizes, size_t n, const Buckets& buckets, CategoryId* out)
+{
+    const uint64_t* limits = buckets.limits.data();
+    const size_t count = buckets.limits.size();
+    for (size_t i = 0; i < n; ++i) {
+        size_t k = 0;
+        for (size_t l = 0; l < count; ++l)
+            k += sizes[i] >= limits[l];
+        out[i] = buckets.categories[k];
+    }
+}
+
+void BucketAgesScalar(const int64_t* mtimes, size_t n, int64_t now, const Buckets& buckets, CategoryId* out)
+{
+    const uint64_t* limits = buckets.limits.data();
+    const size_t count = buckets.limits.size();
+    for (size_t i = 0; i < n; ++i) {
+        int64_t age = now - mtimes[i];
+        size_t k = 0;
+        for (size_t l = 0; l < count; ++l)
+            k += age >= static_cast<int64_t>(limits[l]);
+        out[i] = buckets.categories[k];
+    }
+}
+
+// ------------------------------ AVX2 kernels -----------------------------
+
+#ifdef MEDAMA_AVX2_KERNELS
+
+// AVX2 only compares signed 64-bit lanes. Each lane counts the limits it
+// has not reached (cmpgt yields -1), so bucket = limit count - that count;
+// the category is then gathered from the table.
+
+__attribute__((target("avx2")))
+void BucketSizesAvx2(const uint64_t* sizes, size_t n, const Buckets& buckets, CategoryId* out)
+{
+    // Flipping the sign bit maps unsigned order onto signed order
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+
+    __m256i limits[kMaxBucketLimits];
+    const size_t count = buckets.limits.size();
+    for (size_t l = 0; l < count; ++l)
+        limits[l] = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(buckets.limits[l])), bias);
+
+    const __m256i total = _mm256_set1_epi64x(static_cast<int64_t>(count));
+    const int* table = reinterpret_cast<const int*>(buckets.categories.data());
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(sizes + i)), bias);
+        __m256i below = _mm256_setzero_si256();
+        for (size_t l = 0; l < count; ++l)
+            below = _mm256_add_epi64(below, _mm256_cmpgt_epi64(limits[l], v));
+        __m256i bucket = _mm256_add_epi64(total, below);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_i64gather_epi32(table, bucket, 4));
+    }
+    BucketSizesScalar(sizes + i, n - i, buckets, out + i);
+}
+
+__attribute__((target("avx2")))
+void BucketAgesAvx2(const int64_t* mtimes, size_t n, int64_t now, const Buckets& buckets, CategoryId* out)
+{
+    __m256i limits[kMaxBucketLimits];
+    const size_t count = buckets.limits.size();
+    for (size_t l = 0; l < count; ++l)
+        limits[l] = _mm256_set1_epi64x(static_cast<int64_t>(buckets.limits[l]));
+
+    const __m256i nowv = _mm256_set1_epi64x(now);
+    const __m256i total = _mm256_set1_epi64x(static_cast<int64_t>(count));
+    const int* table = reinterpret_cast<const int*>(buckets.categories.data());
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i age = _mm256_sub_epi64(nowv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mtimes + i)));
+        __m256i below = _mm256_setzero_si256();
+        for (size_t l = 0; l < count; ++l)
+            below = _mm256_add_epi64(below, _mm256_cmpgt_epi64(limits[l], age));
+        __m256i bucket = _mm256_add_epi64(total, below);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_i64gather_epi32(table, bucket, 4));
+    }
+    BucketAgesScalar(mtimes + i, n - i, now, buckets, out + i);
+}
+
+#endif
+
+} // namespace
+
+size_t Buckets::IndexOf(uint64_t value) const
+{
+    return static_cast<size_t>(std::upper_bound(limits.begin(), limits.end(), value) - limits.begin());
+}
+
+Buckets MakeSizeBuckets(std::span<const uint64_t> limits, CategoryRegistry& registry)
+{
+    return MakeBuckets(limits, kDefaultSizeLimits, Category::SizeTiny, "Size", kSizeUnits, registry);
+}
+
+Buckets MakeAgeBuckets(std::span<const uint64_t> limits, CategoryRegistry& registry)
+{
+    return MakeBuckets(limits, kDefaultAgeLimits, Category::DateToday, "Age", kAgeUnits, registry);
+}
+
+bool ParseSizeLimits(std::string_view text, std::vector<uint64_t>& limits)
+{
+    return ParseLimits(text, kSizeUnits, 1, true, kDefaultSizeLimits, limits);
+}
+
+bool ParseAgeLimits(std::string_view text, std::vector<uint64_t>& limits)
+{
+    return ParseLimits(text, kAgeUnits, kSecondsPerDay, false, kDefaultAgeLimits, limits);
+}
+
+std::string FormatSizeLimits(std::span<const uint64_t> limits)
+{
+    return FormatLimits(kSizeUnits, limits, false);
+}
+
+std::string FormatAgeLimits(std::span<const uint64_t> limits)
+{
+    return FormatLimits(kAgeUnits, limits, true);
+}
+
+bool BucketKernelsUseAvx2()
+{
+#ifdef MEDAMA_AVX2_KERNELS
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+void BucketSizes(std::span<const uint64_t> sizes, const Buckets& buckets, std::span<CategoryId> out)
+{
+    size_t n = std::min(sizes.size(), out.size());
+#ifdef MEDAMA_AVX2_KERNELS
+    if (BucketKernelsUseAvx2()) {
+        BucketSizesAvx2(sizes.data(), n, buckets, out.data());
+        return;
+    }
+#endif
+    BucketSizesScalar(sizes.data(), n, buckets, out.data());
+}
+
+void BucketAges(std::span<const int64_t> mtimes, int64_t now, const Buckets& buckets,
+                std::span<CategoryId> out)
+{
+    size_t n = std::min(mtimes.size(), out.size());
+#ifdef MEDAMA_AVX2_KERNELS
+    if (BucketKernelsUseAvx2()) {
+        BucketAgesAvx2(mtimes.data(), n, now, buckets, out.data());
+        return;
+    }
+#endif
+    BucketAgesScalar(mtimes.data(), n, now, buckets, out.data());
+}
@@ -0,0 +1,241 @@
+// classifier.cpp
+
+#include "classifier.h"
+#include "ingest.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+// Labels for Category::Images .. Category::Unique, in enum order
+const char* const kBuiltinLabels[] = {
+    "Images", "Audio", "Videos", "Code", "Archives",
+    "Documents", "Spreadsheets", "Presentations", "Executables", "Other",
+
+    "Tiny (< 100KB)", "Small (< 1MB)", "Medium (< 10MB)",
+    "Large (< 100MB)", "Very Large (> 100MB)",
+
+    "Today", "Yesterday", "This Week", "This Month",
+    "Last 3 Months", "This Year", "Older",
+
+    "No Extension",
+
+    "Unique Files",
+};
+static_assert(std::size(kBuiltinLabels) == Category::BuiltinCount);
+
+std::string_view Trim(std::string_view s)
+{
+    const char* ws = " \t\r\n";
+    size_t b = s.find_first_not_of(ws);
+    if (b == std::string_view::npos)
+        return {};
+    size_t e = s.find_last_not_of(ws);
+    return s.substr(b, e - b + 1);
+}
+
+} // namespace
+
+// -------------------------- CategoryRegistry ------------------------------
+
+CategoryRegistry::CategoryRegistry()
+{
+    for (const char* label : kBuiltinLabels)
+        Intern(label);
+}
+
+CategoryId CategoryRegistry::Intern(std::string_view utf8Label)
+{
+    auto it = m_byLabel.find(utf8Label);
+    if (it != m_byLabel.end())
+        return it->second;
+
+    CategoryId id = static_cast<CategoryId>(m_labels.size());
+    m_labels.push_back(wxString::FromUTF8(utf8Label.data(), utf8Label.size()));
+    m_byLabel.emplace(std::string(utf8Label), id);
+    return id;
+}
+
+CategoryId CategoryRegistry::Add(std::string_view utf8Label)
+{
+    CategoryId id = static_cast<CategoryId>(m_labels.size());
+    m_labels.push_back(wxString::FromUTF8(utf8Label.data(), utf8Label.size()));
+    return id;
+}
+
+void CategoryRegistry::Relabel(CategoryId id, std::string_view utf8Label)
+{
+    m_labels[id] = wxString::FromUTF8(utf8Label.data(), utf8Label.size());
+}
+
+CategoryId CategoryRegistry::ExtensionCategory(std::string_view nativeName)
+{
+    uint64_t key = PackExtension(nativeName.data(), nativeName.size());
+    if (key == kNoExtension)
+        return Category::NoExtension;
+
+    if (key != kUnpackableExtension) {
+        auto it = m_byPackedExtension.find(key);
+        if (it != m_byPackedExtension.end())
+            return it->second;
+
+        char label[kMaxPackedExtension + 2] = {'.'};
+        size_t len = 1;
+        for (uint64_t k = key; k; k >>= 8)
+            label[len++] = static_cast<char>(k & 0xff);
+
+        CategoryId id = Intern(std::string_view(label, len));
+        m_byPackedExtension.emplace(key, id);
+        return id;
+    }
+
+    // Long or non-ASCII extension: take the slow path through wxString
+    wxString ext = FromFileSystem(nativeName).AfterLast('.').Lower();
+    return Intern(("." + ext).utf8_string());
+}
+
+// ------------------------- ExtensionClassifier ----------------------------
+
+ExtensionClassifier::ExtensionClassifier()
+    : m_keys(kBuiltinExtensionTable.keys.begin(), kBuiltinExtensionTable.keys.end())
+    , m_categories(kBuiltinExtensionTable.categories.begin(), kBuiltinExtensionTable.categories.end())
+    , m_seeds{kBuiltinExtensionTable.seed}
+    , m_bits(BuiltinExtensionTable::kBits)
+{
+}
+
+bool ExtensionClassifier::AddMapping(std::string_view ext, CategoryId category)
+{
+    if (!ext.empty() && ext.front() == '.')
+        ext.remove_prefix(1);
+
+    uint64_t key = PackExtension(ext);
+    if (key == kNoExtension || key == kUnpackableExtension)
+        return false;
+
+    Apply({{key, category}});
+    return true;
+}
+
+void ExtensionClassifier::Apply(const std::vector<Entry>& additions)
+{
+    std::unordered_map<uint64_t, CategoryId> merged;
+    for (size_t slot = 0; slot < m_keys.size(); ++slot) {
+        if (m_keys[slot] != kNoExtension)
+            merged[m_keys[slot]] = m_categories[slot];
+    }
+    for (const auto& [key, category] : additions)
+        merged[key] = category;
+
+    // About four keys per bucket, at most four filled slots in five
+    const size_t n = merged.size();
+    size_t buckets = 1;
+    while (buckets * 4 < n)
+        buckets *= 2;
+    unsigned bits = BuiltinExtensionTable::kBits;
+    while ((size_t(1) << bits) * 4 < n * 5)
+        ++bits;
+
+    // The keys grouped by bucket (a counting sort), then the buckets by
+    // size, largest first, which are the hardest to place
+    std::vector<uint64_t> keys;
+    std::vector<size_t> start;
+    std::vector<size_t> order;
+    std::vector<uint8_t> occupied;
+    std::vector<uint64_t> seeds;
+    for (;;) {
+        start.assign(buckets + 1, 0);
+        for (const auto& kv : merged)
+            ++start[PerfectHashBucket(kv.first, buckets - 1) + 1];
+        size_t largest = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            largest = std::max(largest, start[b + 1]);
+            start[b + 1] += start[b];
+        }
+        keys.assign(n, 0);
+        std::vector<size_t> fill(start.begin(), start.end() - 1);
+        for (const auto& kv : merged)
+            keys[fill[PerfectHashBucket(kv.first, buckets - 1)]++] = kv.first;
+
+        std::vector<size_t> bySize(largest + 2, 0);
+        for (size_t b = 0; b < buckets; ++b)
+            ++bySize[largest - (start[b + 1] - start[b]) + 1];
+        for (size_t k = 1; k < bySize.size(); ++k)
+            bySize[k] += bySize[k - 1];
+        order.assign(buckets, 0);
+        for (size_t b = 0; b < buckets; ++b)
+            order[bySize[largest - (start[b + 1] - start[b])]++] = b;
+
+        occupied.assign(size_t(1) << bits, 0);
+        seeds.assign(buckets, 1);
+        bool ok = true;
+        for (size_t b : order) {
+            std::span<const uint64_t> bucket(keys.data() + start[b], start[b + 1] - start[b]);
+            if (bucket.empty())
+                break;
+            seeds[b] = FindPerfectHashSeed(bucket, bits, occupied, 1u << 16);
+            if (seeds[b] == 0) {
+                ok = false;
+                break;
+            }
+        }
+        if (ok)
+            break;
+
+        // Practically never: a bucket fits nowhere in the table
+        ++bits;
+    }
+
+    m_seeds = std::move(seeds);
+    m_bucketMask = buckets - 1;
+    m_bits = bits;
+    m_keys.assign(size_t(1) << bits, kNoExtension);
+    m_categories.assign(size_t(1) << bits, Category::Other);
+    for (const auto& [key, category] : merged) {
+        size_t slot = PerfectHashSlot(key, m_seeds[PerfectHashBucket(key, m_bucketMask)], bits);
+        m_keys[slot] = key;
+        m_categories[slot] = category;
+    }
+}
+
+int ExtensionClassifier::LoadMappings(const wxString& path, CategoryRegistry& registry)
+{
+    std::ifstream in(ToFileSystem(path));
+    if (!in)
+        return -1;
+
+    std::vector<Entry> additions;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string_view rest(line);
+        rest = rest.substr(0, rest.find('#'));
+
+        size_t eq = rest.find('=');
+        if (eq == std::string_view::npos)
+            continue;
+
+        std::string_view category = Trim(rest.substr(eq + 1));
+        if (category.empty())
+            continue;
+        CategoryId id = registry.Intern(category);
+
+        std::string_view exts = rest.substr(0, eq);
+        while (!exts.empty()) {
+            size_t comma = exts.find(',');
+            std::string_view ext = Trim(exts.substr(0, comma));
+            if (!ext.empty() && ext.front() == '.')
+                ext.remove_prefix(1);
+
+            uint64_t key = PackExtension(ext);
+            if (key != kNoExtension && key != kUnpackableExtension)
+                additions.emplace_back(key, id);
+
+            exts = comma == std::string_view::npos ? std::string_view() : exts.substr(comma + 1);
+        }
+    }
+
+    if (!additions.empty())
+        Apply(additions);
+    return static_cast<int>(additions.size());
+}
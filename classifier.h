@@ -0,0 +1,331 @@
+// classifier.h
+//
+// Category IDs and the extension classifier behind the "By File Type" and
+// "By Extension" strategies. Categories travel as small integers and are
+// only turned into display labels by CategoryRegistry::Label().
+
+#pragma once
+
+#include <wx/string.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+using CategoryId = uint32_t;
+
+// Categories that exist in every registry, in registration order. IDs from
+// Category::BuiltinCount on are interned at runtime (user-defined types and
+// per-extension groups).
+namespace Category {
+enum : CategoryId {
+    // By File Type
+    Images = 0,
+    Audio,
+    Videos,
+    Code,
+    Archives,
+    Documents,
+    Spreadsheets,
+    Presentations,
+    Executables,     // only assigned by content sniffing
+    Other,
+
+    // By File Size
+    SizeTiny,
+    SizeSmall,
+    SizeMedium,
+    SizeLarge,
+    SizeVeryLarge,
+
+    // By Date Modified
+    DateToday,
+    DateYesterday,
+    DateThisWeek,
+    DateThisMonth,
+    DateLast3Months,
+    DateThisYear,
+    DateOlder,
+
+    // By Extension
+    NoExtension,
+
+    // Find Duplicates
+    Unique,
+
+    BuiltinCount
+};
+}
+
+// Interns category labels. Not thread-safe; lookups by ID are cheap.
+class CategoryRegistry {
+public:
+    CategoryRegistry();
+
+    // Returns the ID for label, registering it on first use.
+    CategoryId Intern(std::string_view utf8Label);
+
+    // Registers a category that Intern() never returns, for one whose label
+    // changes while its ID is reused, such as a ranked duplicate set
+    CategoryId Add(std::string_view utf8Label);
+    void       Relabel(CategoryId id, std::string_view utf8Label);
+
+    // Returns the ID of the "By Extension" group for a file name in
+    // file-system form (see FileInfo), e.g. ".png" for "Photo.PNG" or
+    // Category::NoExtension.
+    CategoryId ExtensionCategory(std::string_view nativeName);
+
+    const wxString& Label(CategoryId id) const { return m_labels[id]; }
+    size_t          size() const { return m_labels.size(); }
+
+private:
+    // Lets m_byLabel be probed with a string_view without building a key
+    struct LabelHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+    };
+
+    std::vector<wxString>                                                 m_labels;
+    std::unordered_map<std::string, CategoryId, LabelHash, std::equal_to<>> m_byLabel;
+    std::unordered_map<uint64_t, CategoryId>                              m_byPackedExtension;
+};
+
+// ------------------------- Extension keys ---------------------------------
+
+// Extensions of up to kMaxPackedExtension ASCII characters are packed,
+// lowercased, into a 64-bit key (first character in the lowest byte).
+inline constexpr size_t   kMaxPackedExtension = 8;
+inline constexpr uint64_t kNoExtension = 0;
+inline constexpr uint64_t kUnpackableExtension = ~uint64_t(0);
+
+// Packs the extension of a file name by looking only at its tail. Follows
+// wxFileName: a leading dot (hidden file) or a trailing dot is not an
+// extension. Returns kNoExtension or kUnpackableExtension (too long or not
+// ASCII) when there is nothing to pack.
+template <typename CharT>
+constexpr uint64_t PackExtension(const CharT* name, size_t len)
+{
+    size_t n = 0;
+    size_t i = len;
+    while (i > 0 && name[i - 1] != CharT('.')) {
+        --i;
+        if (++n > kMaxPackedExtension) {
+            // Keep looking for the dot only to tell "long" from "none"
+            while (i > 0 && name[i - 1] != CharT('.'))
+                --i;
+            return i > 1 ? kUnpackableExtension : kNoExtension;
+        }
+    }
+
+    // i is one past the dot; i == 1 is a hidden file such as ".bashrc"
+    if (i <= 1 || n == 0)
+        return kNoExtension;
+
+    uint64_t key = 0;
+    for (size_t k = 0; k < n; ++k) {
+        auto c = static_cast<std::make_unsigned_t<CharT>>(name[i + k]);
+        if (c >= 0x80 || c == 0)
+            return kUnpackableExtension;
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        key |= uint64_t(c) << (8 * k);
+    }
+    return key;
+}
+
+constexpr uint64_t PackExtension(std::string_view ext)
+{
+    // Callers pass the bare extension; reuse the tail parser on "x.<ext>"
+    if (ext.empty() || ext.size() > kMaxPackedExtension)
+        return ext.empty() ? kNoExtension : kUnpackableExtension;
+
+    char buf[kMaxPackedExtension + 2] = {'x', '.'};
+    for (size_t k = 0; k < ext.size(); ++k)
+        buf[k + 2] = ext[k];
+    return PackExtension(buf, ext.size() + 2);
+}
+
+inline uint64_t PackExtension(const wxString& name)
+{
+    return PackExtension(name.wc_str(), name.length());
+}
+
+// ------------------------- Perfect hashing --------------------------------
+//
+// Two levels, after CHD ("compress, hash and displace"): a key's bucket
+// picks a seed, and that seed hashes the key to its slot. Every bucket gets
+// the first seed that puts its keys into free slots, largest buckets first,
+// so a table is laid out in time linear in its keys. A table with a single
+// bucket is an ordinary seeded perfect hash.
+
+// The bucket of key among bucketMask + 1 (a power of two)
+constexpr size_t PerfectHashBucket(uint64_t key, size_t bucketMask)
+{
+    key ^= key >> 29;
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & bucketMask;
+}
+
+constexpr size_t PerfectHashSlot(uint64_t key, uint64_t seed, unsigned bits)
+{
+    // splitmix64 finalizer, so every seed is an independent hash
+    uint64_t z = key ^ seed;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<size_t>((z ^ (z >> 31)) >> (64 - bits));
+}
+
+// Searches for a seed that maps every key to its own slot of a 2^bits
+// table among those not yet occupied, and marks them. occupied must have
+// 2^bits entries. Returns 0 on failure.
+constexpr uint64_t FindPerfectHashSeed(std::span<const uint64_t> keys, unsigned bits,
+                                       std::span<uint8_t> occupied, unsigned attempts = 4096)
+{
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (unsigned a = 0; a < attempts; ++a) {
+        // splitmix64 sequence, never 0
+        state += 0x9E3779B97F4A7C15ull;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        uint64_t seed = (z ^ (z >> 31)) | 1;
+
+        size_t placed = 0;
+        while (placed < keys.size()) {
+            uint8_t& slot = occupied[PerfectHashSlot(keys[placed], seed, bits)];
+            if (slot)
+                break;
+            slot = 1;
+            ++placed;
+        }
+        if (placed == keys.size())
+            return seed;
+
+        // Give back the slots this seed took
+        while (placed > 0)
+            occupied[PerfectHashSlot(keys[--placed], seed, bits)] = 0;
+    }
+    return 0;
+}
+
+struct ExtensionMapping {
+    std::string_view ext;
+    CategoryId       category;
+};
+
+inline constexpr ExtensionMapping kBuiltinExtensions[] = {
+    {"jpg", Category::Images}, {"jpeg", Category::Images}, {"png", Category::Images},
+    {"gif", Category::Images}, {"bmp", Category::Images}, {"svg", Category::Images},
+    {"webp", Category::Images}, {"ico", Category::Images},
+
+    {"mp3", Category::Audio}, {"wav", Category::Audio}, {"flac", Category::Audio},
+    {"aac", Category::Audio}, {"m4a", Category::Audio}, {"ogg", Category::Audio},
+    {"wma", Category::Audio},
+
+    {"mp4", Category::Videos}, {"avi", Category::Videos}, {"mkv", Category::Videos},
+    {"mov", Category::Videos}, {"wmv", Category::Videos}, {"flv", Category::Videos},
+    {"webm", Category::Videos}, {"mpeg", Category::Videos},
+
+    {"js", Category::Code}, {"jsx", Category::Code}, {"ts", Category::Code},
+    {"tsx", Category::Code}, {"py", Category::Code}, {"java", Category::Code},
+    {"cpp", Category::Code}, {"c", Category::Code}, {"h", Category::Code},
+    {"cs", Category::Code}, {"php", Category::Code}, {"rb", Category::Code},
+    {"go", Category::Code}, {"rs", Category::Code}, {"swift", Category::Code},
+    {"html", Category::Code}, {"css", Category::Code}, {"json", Category::Code},
+    {"xml", Category::Code},
+
+    {"zip", Category::Archives}, {"rar", Category::Archives}, {"7z", Category::Archives},
+    {"tar", Category::Archives}, {"gz", Category::Archives}, {"bz2", Category::Archives},
+    {"xz", Category::Archives},
+
+    {"txt", Category::Documents}, {"doc", Category::Documents}, {"docx", Category::Documents},
+    {"pdf", Category::Documents}, {"rtf", Category::Documents}, {"odt", Category::Documents},
+    {"pages", Category::Documents},
+
+    {"xls", Category::Spreadsheets}, {"xlsx", Category::Spreadsheets}, {"csv", Category::Spreadsheets},
+    {"ods", Category::Spreadsheets}, {"numbers", Category::Spreadsheets},
+
+    {"ppt", Category::Presentations}, {"pptx", Category::Presentations},
+    {"odp", Category::Presentations}, {"key", Category::Presentations},
+};
+
+// The built-in table, laid out at compile time as a single bucket.
+struct BuiltinExtensionTable {
+    static constexpr unsigned kBits = 9;
+    static constexpr size_t   kSlots = size_t(1) << kBits;
+
+    uint64_t                         seed = 0;
+    std::array<uint64_t, kSlots>     keys{};
+    std::array<CategoryId, kSlots>   categories{};
+};
+
+constexpr BuiltinExtensionTable MakeBuiltinExtensionTable()
+{
+    constexpr size_t n = std::size(kBuiltinExtensions);
+
+    std::array<uint64_t, n> keys{};
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = PackExtension(kBuiltinExtensions[i].ext);
+
+    BuiltinExtensionTable table;
+    std::array<uint8_t, BuiltinExtensionTable::kSlots> occupied{};
+    table.seed = FindPerfectHashSeed(keys, BuiltinExtensionTable::kBits, occupied);
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t slot = PerfectHashSlot(keys[i], table.seed, BuiltinExtensionTable::kBits);
+        table.keys[slot] = keys[i];
+        table.categories[slot] = kBuiltinExtensions[i].category;
+    }
+    return table;
+}
+
+inline constexpr BuiltinExtensionTable kBuiltinExtensionTable = MakeBuiltinExtensionTable();
+static_assert(kBuiltinExtensionTable.seed != 0, "no perfect hash for the built-in extensions");
+
+// Maps file names to "By File Type" categories with two hashes, one probe
+// and no allocation. Starts from the compile-time table; AddMapping() and
+// LoadMappings() extend it at startup, after which the table is rebuilt
+// into a new two-level perfect hash.
+class ExtensionClassifier {
+public:
+    ExtensionClassifier();
+
+    template <typename CharT>
+    CategoryId Classify(const CharT* name, size_t len) const
+    {
+        uint64_t key = PackExtension(name, len);
+        size_t slot = PerfectHashSlot(key, m_seeds[PerfectHashBucket(key, m_bucketMask)], m_bits);
+        return m_keys[slot] == key && key != kNoExtension ? m_categories[slot] : Category::Other;
+    }
+
+    CategoryId Classify(std::string_view nativeName) const
+    {
+        return Classify(nativeName.data(), nativeName.size());
+    }
+
+    // Maps ext (without the dot, at most kMaxPackedExtension ASCII
+    // characters) to category, replacing any existing mapping.
+    bool AddMapping(std::string_view ext, CategoryId category);
+
+    // Reads "ext[, ext...] = Category" lines ('#' starts a comment) and
+    // interns unknown category names into registry. Returns the number of
+    // mappings added, or -1 if the file cannot be read.
+    int LoadMappings(const wxString& path, CategoryRegistry& registry);
+
+private:
+    using Entry = std::pair<uint64_t, CategoryId>;
+
+    std::vector<uint64_t>   m_keys;
+    std::vector<CategoryId> m_categories;
+    std::vector<uint64_t>   m_seeds;            // one per bucket
+    size_t                  m_bucketMask = 0;
+    unsigned                m_bits = 0;
+
+    // Merges additions (later ones win) into the current mappings and lays
+    // the result out as a new perfect hash.
+    void Apply(const std::vector<Entry>& additions);
+};
@@ -0,0 +1,577 @@
+// cli.cpp
+//
+// medama-cli: organizes a directory tree without a display, for servers and
+// scheduled jobs. Uses the same scanner, strategies and exporter as the GUI.
+//
+//   medama-cli --strategy date --output plan.jsonl /srv/share
+//   medama-cli --strategy type --apply /srv/sorted /srv/share
+//   medama-cli --strategy type --then date,size /srv/share
+//   medama-cli --undo /srv/sorted
+//   medama-cli --index share.idx --strategy dups /srv/share
+//   medama-cli --timings --trace scan.json /srv/share > /dev/null
+//   medama-cli --rules policy.conf --strategy rules --apply /srv/sorted /srv/share
+
+#include "applyplan.h"
+#include "buckets.h"
+#include "classifier.h"
+#include "duplicates.h"
+#include "fileinfo.h"
+#include "grouping.h"
+#include "ingest.h"
+#include "metaindex.h"
+#include "organizer.h"
+#include "planexport.h"
+#include "rules.h"
+#include "scanner.h"
+#include "sniffer.h"
+#include "sortkeys.h"
+#include "trace.h"
+
+#include <wx/arrstr.h>
+#include <wx/cmdline.h>
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/init.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <mutex>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+constexpr int kExitOk = 0;
+constexpr int kExitFailure = 1;
+constexpr int kExitUsage = 2;
+constexpr int kExitInterrupted = 130;
+
+const wxCmdLineEntryDesc kOptions[] = {
+    { wxCMD_LINE_SWITCH, "h", "help", "show this help",
+      wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+    { wxCMD_LINE_OPTION, "s", "strategy", "type (default), date, size, ext, real, dups or rules" },
+    { wxCMD_LINE_OPTION, nullptr, "then", "up to two more strategies to nest folders by, e.g. date,size" },
+    { wxCMD_LINE_OPTION, nullptr, "sort", "order inside each category: name, size or mtime, or e.g. size-desc (default: by path)" },
+    { wxCMD_LINE_OPTION, "f", "format", "plan format: tree, jsonl or csv (default: from --output, else tree)" },
+    { wxCMD_LINE_OPTION, "o", "output", "write the plan to this file instead of standard output" },
+    { wxCMD_LINE_OPTION, "a", "apply", "move the files into category folders below this directory" },
+    { wxCMD_LINE_OPTION, nullptr, "resume", "finish an interrupted run in this directory" },
+    { wxCMD_LINE_OPTION, nullptr, "undo", "undo the last run in this directory" },
+    { wxCMD_LINE_OPTION, "m", "mappings", "extension mappings file, \"ext[, ext...] = Category\" lines" },
+    { wxCMD_LINE_OPTION, "r", "rules", "rules file for --strategy rules, \"conditions -> Category\" lines" },
+    { wxCMD_LINE_OPTION, nullptr, "size-limits", "size buckets, e.g. \"100K, 1M, 10M, 100M\" (the default)" },
+    { wxCMD_LINE_OPTION, nullptr, "age-limits", "date buckets in days, or with h, w, m, y, e.g. \"1, 2, 1w, 1m, 3m, 1y\"" },
+    { wxCMD_LINE_OPTION, "i", "index", "metadata index: rescan only what changed since the last run, then update it" },
+    { wxCMD_LINE_OPTION, "j", "threads", "scanner threads (default: one per core)",
+      wxCMD_LINE_VAL_NUMBER },
+    { wxCMD_LINE_SWITCH, nullptr, "serial", "organize on a single thread" },
+    { wxCMD_LINE_SWITCH, "p", "progress", "report progress on standard error" },
+    { wxCMD_LINE_SWITCH, "q", "quiet", "print no summary" },
+    { wxCMD_LINE_SWITCH, "t", "timings", "print the time, files/s and allocations of each phase" },
+    { wxCMD_LINE_OPTION, nullptr, "trace", "write a Chrome trace-event file of the phases (chrome://tracing)" },
+    { wxCMD_LINE_PARAM, nullptr, nullptr, "directory",
+      wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
+    wxCMD_LINE_DESC_END
+};
+
+std::atomic<bool> g_interrupted{false};
+
+extern "C" void OnInterrupt(int)
+{
+    g_interrupted.store(true);
+}
+
+// Blocks until a background job's OnFinished has run. Ctrl+C cancels the
+// job, and report() is called about once a second while it runs.
+class Completion {
+public:
+    void Finished(bool cancelled)
+    {
+        std::lock_guard lock(m_mutex);
+        m_finished = true;
+        m_cancelled = cancelled;
+        m_cv.notify_all();
+    }
+
+    // Returns false if the job was cancelled
+    bool Wait(const std::function<void()>& cancel, const std::function<void()>& report)
+    {
+        bool cancelRequested = false;
+        auto nextReport = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+        for (;;) {
+            {
+                std::unique_lock lock(m_mutex);
+                if (m_cv.wait_for(lock, std::chrono::milliseconds(100), [this] { return m_finished; }))
+                    return !m_cancelled;
+            }
+            if (g_interrupted.load() && !cancelRequested) {
+                cancel();
+                cancelRequested = true;
+            }
+            if (report && std::chrono::steady_clock::now() >= nextReport) {
+                report();
+                nextReport += std::chrono::seconds(1);
+            }
+        }
+    }
+
+private:
+    std::mutex              m_mutex;
+    std::condition_variable m_cv;
+    bool                    m_finished = false;
+    bool                    m_cancelled = false;
+};
+
+bool ParseStrategy(const wxString& name, Strategy& strategy)
+{
+    static const std::pair<const char*, Strategy> kNames[] = {
+        {"type", Strategy::ByType},     {"date", Strategy::ByDate},
+        {"size", Strategy::BySize},     {"ext", Strategy::ByExtension},
+        {"real", Strategy::ByRealType}, {"dups", Strategy::ByDuplicates},
+        {"rules", Strategy::ByRules},
+    };
+    for (const auto& [key, value] : kNames) {
+        if (name == key) {
+            strategy = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParseSortOrder(const wxString& name, SortOrder& order)
+{
+    wxString column;
+    order.descending = name.EndsWith("-desc", &column);
+    if (!order.descending)
+        column = name;
+    if (column == "name")
+        order.column = SortColumn::Name;
+    else if (column == "size")
+        order.column = SortColumn::Size;
+    else if (column == "mtime")
+        order.column = SortColumn::Modified;
+    else
+        return false;
+    return true;
+}
+
+bool ParseFormat(const wxString& name, PlanFormat& format)
+{
+    if (name == "tree")
+        format = PlanFormat::Tree;
+    else if (name == "jsonl")
+        format = PlanFormat::JsonLines;
+    else if (name == "csv")
+        format = PlanFormat::Csv;
+    else
+        return false;
+    return true;
+}
+
+double MiB(uint64_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+// Runs a Resume or Undo job, or an Apply job with the given moves
+int RunApply(ApplyPlanJob::Mode mode, const wxString& root, std::vector<PlannedMove> moves,
+             bool progress, bool quiet)
+{
+    ApplyPlanJob job(mode, ToFileSystem(root), std::move(moves));
+    Completion completion;
+    job.Start([&completion](bool cancelled) { completion.Finished(cancelled); });
+
+    bool completed = completion.Wait([&job] { job.Cancel(); }, [&job, progress] {
+        if (!progress)
+            return;
+        ApplyPlanJob::Progress p = job.GetProgress();
+        std::fprintf(stderr, "moving: %llu of %llu files, %.0f files/s\n",
+                     static_cast<unsigned long long>(p.done), static_cast<unsigned long long>(p.files),
+                     p.FilesPerSecond());
+    });
+
+    if (!job.Error().empty()) {
+        std::fprintf(stderr, "medama-cli: %s\n", job.Error().c_str());
+        return kExitFailure;
+    }
+
+    ApplyPlanJob::Progress p = job.GetProgress();
+    if (!quiet) {
+        const char* verb = mode == ApplyPlanJob::Mode::Undo ? "restored" : "moved";
+        std::fprintf(stderr,
+                     "%s %llu of %llu files (%llu renamed, %llu copied, %.1f MiB), "
+                     "%llu skipped, %llu errors in %.2f s, %.0f files/s\n",
+                     verb, static_cast<unsigned long long>(p.renamed + p.copied),
+                     static_cast<unsigned long long>(p.files),
+                     static_cast<unsigned long long>(p.renamed),
+                     static_cast<unsigned long long>(p.copied), MiB(p.bytesCopied),
+                     static_cast<unsigned long long>(p.skipped),
+                     static_cast<unsigned long long>(p.errors), p.elapsedSeconds,
+                     p.FilesPerSecond());
+    }
+    if (!completed) {
+        std::fprintf(stderr, "medama-cli: interrupted; use --resume or --undo on %s\n",
+                     root.utf8_string().c_str());
+        return kExitInterrupted;
+    }
+    return p.errors ? kExitFailure : kExitOk;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    wxInitializer initializer(argc, argv);
+    if (!initializer.IsOk()) {
+        std::fprintf(stderr, "medama-cli: failed to initialize wxWidgets\n");
+        return kExitFailure;
+    }
+
+    wxCmdLineParser parser(kOptions, argc, argv);
+    parser.SetLogo("Organizes a directory tree into category folders, or prints the plan.");
+    switch (parser.Parse()) {
+    case -1: return kExitOk;     // --help
+    case 0:  break;
+    default: return kExitUsage;
+    }
+
+    std::signal(SIGINT, OnInterrupt);
+    std::signal(SIGTERM, OnInterrupt);
+
+    const bool progress = parser.Found("progress");
+    const bool quiet = parser.Found("quiet");
+
+    // ----- Journal-only runs -----
+
+    wxString journalRoot;
+    if (parser.Found("resume", &journalRoot))
+        return RunApply(ApplyPlanJob::Mode::Resume, journalRoot, {}, progress, quiet);
+    if (parser.Found("undo", &journalRoot))
+        return RunApply(ApplyPlanJob::Mode::Undo, journalRoot, {}, progress, quiet);
+
+    // ----- Options -----
+
+    if (parser.GetParamCount() != 1) {
+        parser.Usage();
+        return kExitUsage;
+    }
+    wxString root = parser.GetParam(0);
+    if (!wxDirExists(root)) {
+        std::fprintf(stderr, "medama-cli: %s is not a directory\n", root.utf8_string().c_str());
+        return kExitFailure;
+    }
+
+    Strategy strategy = Strategy::ByType;
+    wxString value;
+    if (parser.Found("strategy", &value) && !ParseStrategy(value, strategy)) {
+        std::fprintf(stderr, "medama-cli: unknown strategy '%s'\n", value.utf8_string().c_str());
+        return kExitUsage;
+    }
+
+    // Outermost first; more than one level makes a nested plan
+    std::vector<Strategy> levels{strategy};
+    if (parser.Found("then", &value)) {
+        for (const wxString& name : wxSplit(value, ',', '\0')) {
+            Strategy level;
+            if (!ParseStrategy(name.Strip(wxString::both), level)) {
+                std::fprintf(stderr, "medama-cli: unknown strategy '%s'\n", name.utf8_string().c_str());
+                return kExitUsage;
+            }
+            if (std::find(levels.begin(), levels.end(), level) == levels.end())
+                levels.push_back(level);
+        }
+        if (levels.size() > kMaxPlanLevels) {
+            std::fprintf(stderr, "medama-cli: --then takes at most %zu strategies\n", kMaxPlanLevels - 1);
+            return kExitUsage;
+        }
+    }
+    auto uses = [&levels](Strategy s) { return std::find(levels.begin(), levels.end(), s) != levels.end(); };
+
+    wxString planName = StrategyName(strategy);
+    for (size_t k = 1; k < levels.size(); ++k)
+        planName += wxString(" → ") + StrategyName(levels[k]);
+
+    SortOrder sortOrder;
+    if (parser.Found("sort", &value) && !ParseSortOrder(value, sortOrder)) {
+        std::fprintf(stderr, "medama-cli: unknown sort order '%s'\n", value.utf8_string().c_str());
+        return kExitUsage;
+    }
+
+    wxString output;
+    bool hasOutput = parser.Found("output", &output);
+    PlanFormat format = hasOutput ? PlanFormatFromFileName(output) : PlanFormat::Tree;
+    if (parser.Found("format", &value) && !ParseFormat(value, format)) {
+        std::fprintf(stderr, "medama-cli: unknown format '%s'\n", value.utf8_string().c_str());
+        return kExitUsage;
+    }
+
+    wxString applyRoot;
+    bool apply = parser.Found("apply", &applyRoot);
+    if (apply && ApplyPlanJob::ReadJournalState(ToFileSystem(applyRoot)).pending > 0) {
+        std::fprintf(stderr, "medama-cli: a previous run in %s was interrupted; "
+                             "use --resume or --undo first\n", applyRoot.utf8_string().c_str());
+        return kExitFailure;
+    }
+
+    long threads = 0;
+    if (parser.Found("threads", &threads) && threads < 0) {
+        std::fprintf(stderr, "medama-cli: --threads must not be negative\n");
+        return kExitUsage;
+    }
+
+    const bool parallel = !parser.Found("serial");
+
+    CategoryRegistry    categories;
+    ExtensionClassifier classifier;
+    Organizer           organizer(categories, classifier);
+
+    wxString mappings;
+    if (parser.Found("mappings", &mappings) && classifier.LoadMappings(mappings, categories) < 0) {
+        std::fprintf(stderr, "medama-cli: cannot read %s\n", mappings.utf8_string().c_str());
+        return kExitFailure;
+    }
+
+    wxString rulesFile;
+    if (parser.Found("rules", &rulesFile)) {
+        RuleSet rules;
+        std::string error;
+        if (!rules.Load(rulesFile, categories, error)) {
+            std::fprintf(stderr, "medama-cli: %s: %s\n", rulesFile.utf8_string().c_str(), error.c_str());
+            return kExitFailure;
+        }
+        organizer.SetRules(std::move(rules));
+    } else if (uses(Strategy::ByRules)) {
+        std::fprintf(stderr, "medama-cli: --strategy rules needs --rules FILE\n");
+        return kExitUsage;
+    }
+
+    std::vector<uint64_t> limits;
+    if (parser.Found("size-limits", &value)) {
+        if (!ParseSizeLimits(value.utf8_string(), limits)) {
+            std::fprintf(stderr, "medama-cli: invalid size limits '%s'\n", value.utf8_string().c_str());
+            return kExitUsage;
+        }
+        organizer.SetSizeLimits(limits);
+    }
+    if (parser.Found("age-limits", &value)) {
+        if (!ParseAgeLimits(value.utf8_string(), limits)) {
+            std::fprintf(stderr, "medama-cli: invalid age limits '%s'\n", value.utf8_string().c_str());
+            return kExitUsage;
+        }
+        organizer.SetAgeLimits(limits);
+    }
+
+    // ----- Scan -----
+
+    std::vector<FileInfo> files;
+    std::mutex            filesMutex;
+
+    MetadataIndex index;
+    DirectoryScanner scanner(root, static_cast<unsigned>(threads), &index);
+
+    wxString indexFile;
+    const bool useIndex = parser.Found("index", &indexFile);
+    if (useIndex && !index.Open(indexFile, scanner.Root()) && wxFileExists(indexFile) && !quiet)
+        std::fprintf(stderr, "medama-cli: ignoring %s, it is unreadable or for another directory\n",
+                     indexFile.utf8_string().c_str());
+
+    Completion scanned;
+    scanner.Start(
+        [&](std::vector<FileInfo>&& batch) {
+            std::lock_guard lock(filesMutex);
+            files.insert(files.end(), std::make_move_iterator(batch.begin()),
+                         std::make_move_iterator(batch.end()));
+        },
+        [&scanned](bool cancelled) { scanned.Finished(cancelled); });
+
+    if (!scanned.Wait([&scanner] { scanner.Cancel(); }, [&scanner, progress] {
+            if (!progress)
+                return;
+            IngestJob::Progress p = scanner.GetProgress();
+            std::fprintf(stderr, "scanning: %llu files, %llu directories\n",
+                         static_cast<unsigned long long>(p.files),
+                         static_cast<unsigned long long>(p.directories));
+        }))
+        return kExitInterrupted;
+
+    IngestJob::Progress scan = scanner.GetProgress();
+
+    // Workers deliver batches in no particular order; sort so that repeated
+    // runs over the same tree produce the same plan
+    SortByPath(files);
+
+    // ----- Organize -----
+
+    StrategyKeys keys;
+    organizer.ComputeKeys(files, keys, parallel);
+
+    // What earlier runs learned about the contents of unchanged files
+    std::vector<ContentFacts> facts(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].indexRecord != kNoIndexRecord)
+            facts[i] = index.Facts(files[i].indexRecord);
+    }
+
+    if (uses(Strategy::ByRealType)) {
+        // Files sniffed before get an empty path and keep their result
+        const auto& byType = keys.Column(Strategy::ByType);
+        std::vector<CategoryId> byName(byType);
+        std::vector<std::string> paths;
+        paths.reserve(files.size());
+        for (size_t i = 0; i < files.size(); ++i)
+            paths.push_back(facts[i].Sniffed(byType[i], byName[i]) ? std::string() : files[i].NativePath());
+
+        ContentSniffer sniffer(std::move(paths), std::move(byName));
+        Completion sniffed;
+        sniffer.Start([&sniffed](bool cancelled) { sniffed.Finished(cancelled); });
+        if (!sniffed.Wait([&sniffer] { sniffer.Cancel(); }, [&sniffer, progress] {
+                if (!progress)
+                    return;
+                ContentSniffer::Progress p = sniffer.GetProgress();
+                std::fprintf(stderr, "checking contents: %llu of %llu files\n",
+                             static_cast<unsigned long long>(p.done),
+                             static_cast<unsigned long long>(p.files));
+            }))
+            return kExitInterrupted;
+
+        Organizer::SetSniffedCategories(keys, 0, sniffer.Results());
+        for (size_t i = 0; i < files.size(); ++i)
+            facts[i].SetSniffed(sniffer.Results()[i], byType[i]);
+    }
+
+    if (uses(Strategy::ByDuplicates)) {
+        std::vector<std::string> paths;
+        std::vector<uint64_t> sizes;
+        std::vector<uint64_t> known;
+        std::vector<int64_t> mtimes;
+        paths.reserve(files.size());
+        sizes.reserve(files.size());
+        known.reserve(files.size());
+        mtimes.reserve(files.size());
+        for (size_t i = 0; i < files.size(); ++i) {
+            paths.push_back(files[i].NativePath());
+            sizes.push_back(files[i].size.GetValue());
+            known.push_back(facts[i].contentHash);
+            mtimes.push_back(static_cast<int64_t>(files[i].modified.GetTicks()));
+        }
+
+        DuplicateFinder finder(std::move(paths), std::move(sizes), std::move(known),
+                               std::move(mtimes));
+        Completion searched;
+        finder.Start([&searched](bool cancelled) { searched.Finished(cancelled); });
+        if (!searched.Wait([&finder] { finder.Cancel(); }, [&finder, progress] {
+                if (!progress)
+                    return;
+                DuplicateFinder::Progress p = finder.GetProgress();
+                std::fprintf(stderr, "finding duplicates: stage %u, %llu of %llu files\n", p.stage,
+                             static_cast<unsigned long long>(p.done),
+                             static_cast<unsigned long long>(p.total));
+            }))
+            return kExitInterrupted;
+
+        uint64_t wasted = organizer.SetDuplicateCategories(keys, finder);
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (uint64_t hash = finder.ContentHash(i))
+                facts[i].contentHash = hash;
+        }
+        if (!quiet)
+            std::fprintf(stderr, "%zu duplicate sets, %.1f MiB reclaimable\n",
+                         finder.Sets().size(), MiB(wasted));
+    }
+
+    if (useIndex && !WriteMetadataIndex(indexFile, scanner.Root(), scanner.TakeDirectories(), files, facts))
+        std::fprintf(stderr, "medama-cli: cannot write %s\n", indexFile.utf8_string().c_str());
+
+    Grouping grouping;
+    PlanTree plan;
+    std::vector<CategoryId> order;
+    const bool nested = levels.size() > 1;
+    if (nested) {
+        plan.SetLevels(levels.size());
+        organizer.GroupPlan(keys, levels, plan, grouping, parallel);
+        order = organizer.SortedLeaves(plan, grouping);
+    } else {
+        organizer.Group(keys, strategy, grouping, parallel);
+        order = organizer.SortedCategories(grouping);
+    }
+
+    if (sortOrder.IsSorted()) {
+        NameKeys names;
+        if (sortOrder.column == SortColumn::Name)
+            names.Extend(files, parallel);
+        SortWithinCategories(grouping, order, sortOrder, names, keys, parallel);
+    }
+
+    if (!quiet) {
+        std::fprintf(stderr, "%zu files (%.1f MiB) in %zu categories (%s); scanned in %.2f s, "
+                             "%.0f entries/s, %llu errors",
+                     files.size(), MiB(scan.bytes), order.size(), planName.utf8_string().c_str(),
+                     scan.elapsedSeconds, scan.EntriesPerSecond(),
+                     static_cast<unsigned long long>(scan.errors));
+        if (useIndex)
+            std::fprintf(stderr, ", %llu files unchanged since the last run",
+                         static_cast<unsigned long long>(scan.reused));
+        std::fputc('\n', stderr);
+    }
+
+    // ----- Export -----
+
+    wxString title = wxString::Format("Directory Organization Plan (%s)", planName);
+    PlanExporter exporter;
+    PlanOutline outline;
+    if (nested)
+        outline.Build(plan, grouping, order, keys.sizes);
+
+    auto exportTo = [&](auto& target) {
+        return nested ? exporter.Export(target, format, title, files, grouping, plan, outline, order, categories)
+                      : exporter.Export(target, format, title, files, grouping, order, categories);
+    };
+
+    if (hasOutput) {
+        if (!exportTo(output)) {
+            std::fprintf(stderr, "medama-cli: cannot write %s\n", output.utf8_string().c_str());
+            return kExitFailure;
+        }
+    } else if (!apply) {
+#ifdef _WIN32
+        // CSV rows carry their own CRLF
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        wxFFile out(stdout);
+        bool ok = exportTo(out);
+        out.Detach();
+        if (!ok) {
+            std::fprintf(stderr, "medama-cli: cannot write the plan to standard output\n");
+            return kExitFailure;
+        }
+    }
+
+    // ----- Timings -----
+
+    if (parser.Found("timings"))
+        std::fprintf(stderr, "%s\n", Trace::Get().Summary().utf8_string().c_str());
+
+    wxString traceFile;
+    if (parser.Found("trace", &traceFile) && !Trace::Get().WriteChromeTrace(traceFile))
+        std::fprintf(stderr, "medama-cli: cannot write %s\n", traceFile.utf8_string().c_str());
+
+    // ----- Apply -----
+
+    if (!apply)
+        return kExitOk;
+    return RunApply(ApplyPlanJob::Mode::Apply, applyRoot,
+                    nested ? PlanMoves(files, grouping, plan, order, categories)
+                           : PlanMoves(files, grouping, order, categories),
+                    progress, quiet);
+}
@@ -0,0 +1,222 @@
+// diskusage.cpp
+
+#include "diskusage.h"
+#include "parallel.h"
+#include "pathstore.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace {
+
+// Below this many files per core the thread start-up costs more than it saves
+constexpr size_t kMinFilesPerWorker = 16 * 1024;
+
+// The files of one category in one run of a directory's files
+struct Record {
+    DirId      dir;
+    CategoryId category;
+    uint64_t   bytes;
+    uint64_t   files;
+};
+
+} // namespace
+
+void DiskUsage::Clear()
+{
+    m_nodes.clear();
+    m_children.clear();
+    m_rootCount = 0;
+    m_shares.clear();
+    m_categoryBytes.clear();
+    m_categoryFiles.clear();
+    m_totalBytes = 0;
+    m_totalFiles = 0;
+}
+
+void DiskUsage::Build(const std::vector<FileInfo>& files, std::span<const CategoryId> categoryOf,
+                      size_t categoryCount, bool parallel)
+{
+    const size_t n = std::min(files.size(), categoryOf.size());
+    PhaseScope phase("usage", n);
+    Clear();
+
+    const PathStore& store = PathStore::Get();
+    const size_t dirCount = store.DirectoryCount();
+
+    // Files arrive directory by directory, so each chunk sums a run of
+    // same-directory files per category and emits one record per category
+    // at the end of the run. Everything below works on the records, of
+    // which there are about as many as directories, not files.
+    unsigned chunks = parallel ? ParallelWorkerCount(n, kMinFilesPerWorker) : 1;
+    std::vector<std::vector<Record>> local(std::max(1u, chunks));
+    ParallelChunks(n, chunks, [&](unsigned c, size_t begin, size_t end) {
+        std::vector<Record>& out = local[c];
+        DirId run = kNoDir;
+        size_t runStart = 0;
+        size_t last = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const FileInfo& f = files[i];
+            if (f.dir >= dirCount || categoryOf[i] >= categoryCount)
+                continue;
+            if (f.dir != run) {
+                run = f.dir;
+                runStart = last = out.size();
+            }
+
+            // A directory's files mostly share a handful of categories
+            CategoryId category = categoryOf[i];
+            if (last >= out.size() || out[last].category != category) {
+                last = runStart;
+                while (last < out.size() && out[last].category != category)
+                    ++last;
+                if (last == out.size())
+                    out.push_back({run, category, 0, 0});
+            }
+            out[last].bytes += f.size.GetValue();
+            ++out[last].files;
+        }
+    });
+
+    // Own totals per directory, and the records counted by directory
+    std::vector<uint64_t> ownBytes(dirCount), ownFiles(dirCount);
+    std::vector<uint32_t> recordStart(dirCount + 1, 0);
+    m_categoryBytes.assign(categoryCount, 0);
+    m_categoryFiles.assign(categoryCount, 0);
+    for (const std::vector<Record>& records : local) {
+        for (const Record& r : records) {
+            ownBytes[r.dir] += r.bytes;
+            ownFiles[r.dir] += r.files;
+            ++recordStart[r.dir + 1];
+            m_categoryBytes[r.category] += r.bytes;
+            m_categoryFiles[r.category] += r.files;
+            m_totalBytes += r.bytes;
+            m_totalFiles += r.files;
+        }
+    }
+    for (size_t d = 0; d < dirCount; ++d)
+        recordStart[d + 1] += recordStart[d];
+
+    std::vector<Record> byDir(recordStart[dirCount]);
+    {
+        std::vector<uint32_t> cursor(recordStart.begin(), recordStart.end() - 1);
+        for (std::vector<Record>& records : local) {
+            for (const Record& r : records)
+                byDir[cursor[r.dir]++] = r;
+            std::vector<Record>().swap(records);
+        }
+    }
+
+    // Parents are interned before their children, so one backward sweep
+    // sums every subtree
+    std::vector<uint64_t> bytes(ownBytes), filesBelow(ownFiles);
+    for (size_t d = dirCount; d-- > 0;) {
+        DirId parent = store.Parent(static_cast<DirId>(d));
+        if (filesBelow[d] > 0 && parent < dirCount) {
+            bytes[parent] += bytes[d];
+            filesBelow[parent] += filesBelow[d];
+        }
+    }
+
+    std::vector<uint32_t> nodeOf(dirCount, kNoNode);
+    for (size_t d = 0; d < dirCount; ++d) {
+        if (filesBelow[d] == 0)
+            continue;
+        Node node;
+        node.dir = static_cast<DirId>(d);
+        DirId parent = store.Parent(node.dir);
+        node.parent = parent < dirCount ? nodeOf[parent] : kNoNode;
+        node.ownBytes = ownBytes[d];
+        node.ownFiles = ownFiles[d];
+        node.bytes = bytes[d];
+        node.files = filesBelow[d];
+        nodeOf[d] = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.push_back(node);
+    }
+
+    // Roots first, then every node's subdirectories, each list largest first
+    for (const Node& node : m_nodes) {
+        if (node.parent == kNoNode)
+            ++m_rootCount;
+        else
+            ++m_nodes[node.parent].childCount;
+    }
+    uint32_t next = static_cast<uint32_t>(m_rootCount);
+    for (Node& node : m_nodes) {
+        node.firstChild = next;
+        next += node.childCount;
+    }
+
+    m_children.resize(m_nodes.size());
+    {
+        std::vector<uint32_t> filled(m_nodes.size(), 0);
+        size_t roots = 0;
+        for (uint32_t j = 0; j < m_nodes.size(); ++j) {
+            uint32_t parent = m_nodes[j].parent;
+            if (parent == kNoNode)
+                m_children[roots++] = j;
+            else
+                m_children[m_nodes[parent].firstChild + filled[parent]++] = j;
+        }
+    }
+
+    auto largestFirst = [this](uint32_t a, uint32_t b) {
+        return m_nodes[a].bytes != m_nodes[b].bytes ? m_nodes[a].bytes > m_nodes[b].bytes : a < b;
+    };
+    std::sort(m_children.begin(), m_children.begin() + m_rootCount, largestFirst);
+    for (const Node& node : m_nodes) {
+        auto first = m_children.begin() + node.firstChild;
+        std::sort(first, first + node.childCount, largestFirst);
+    }
+
+    // Records of the same directory and category from different runs or
+    // chunks are merged into one share
+    for (Node& node : m_nodes) {
+        auto first = byDir.begin() + recordStart[node.dir];
+        auto last = byDir.begin() + recordStart[node.dir + 1];
+        std::sort(first, last, [](const Record& a, const Record& b) { return a.category < b.category; });
+
+        node.firstShare = static_cast<uint32_t>(m_shares.size());
+        for (auto r = first; r != last; ++r) {
+            if (m_shares.size() > node.firstShare && m_shares.back().category == r->category) {
+                m_shares.back().bytes += r->bytes;
+                m_shares.back().files += r->files;
+            } else {
+                m_shares.push_back({r->category, r->bytes, r->files});
+            }
+        }
+        node.shareCount = static_cast<uint32_t>(m_shares.size() - node.firstShare);
+
+        std::sort(m_shares.begin() + node.firstShare, m_shares.end(), [](const Share& a, const Share& b) {
+            return a.bytes != b.bytes ? a.bytes > b.bytes : a.category < b.category;
+        });
+    }
+
+    phase.AddBytes(m_totalBytes);
+}
+
+std::span<const uint32_t> DiskUsage::Children(uint32_t node) const
+{
+    if (node == kNoNode)
+        return std::span<const uint32_t>(m_children).first(m_rootCount);
+    return std::span<const uint32_t>(m_children).subspan(m_nodes[node].firstChild, m_nodes[node].childCount);
+}
+
+uint32_t DiskUsage::Top() const
+{
+    if (m_rootCount != 1)
+        return kNoNode;
+
+    // Skips the chain of empty directories above the scanned folder
+    uint32_t node = m_children[0];
+    while (m_nodes[node].ownFiles == 0 && m_nodes[node].childCount == 1)
+        node = m_children[m_nodes[node].firstChild];
+    return node;
+}
+
+uint32_t DiskUsage::NodeOf(DirId dir) const
+{
+    auto it = std::lower_bound(m_nodes.begin(), m_nodes.end(), dir,
+                               [](const Node& node, DirId value) { return node.dir < value; });
+    return it != m_nodes.end() && it->dir == dir ? static_cast<uint32_t>(it - m_nodes.begin()) : kNoNode;
+}
@@ -0,0 +1,89 @@
+// diskusage.h
+//
+// Where the space goes: byte and file totals for every directory that
+// holds files, summed bottom-up over the interned directory tree of
+// PathStore, plus the split of each directory's own files by category and
+// totals per category. One pass over the file list fills the directories
+// (on all cores for large lists); everything after that is per directory,
+// of which there are far fewer.
+
+#pragma once
+
+#include "classifier.h"
+#include "fileinfo.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class DiskUsage {
+public:
+    static constexpr uint32_t kNoNode = ~uint32_t(0);
+
+    // A directory with files somewhere below it
+    struct Node {
+        DirId    dir;
+        uint32_t parent = kNoNode;
+        uint32_t firstChild = 0;    // into Children()
+        uint32_t childCount = 0;
+        uint32_t firstShare = 0;    // into Shares()
+        uint32_t shareCount = 0;
+        uint64_t ownBytes = 0;      // files directly inside
+        uint64_t ownFiles = 0;
+        uint64_t bytes = 0;         // the whole subtree
+        uint64_t files = 0;
+    };
+
+    // Those of a directory's own files that are in one category
+    struct Share {
+        CategoryId category;
+        uint64_t   bytes;
+        uint64_t   files;
+    };
+
+    // Totals files[0, categoryOf.size()), file i being in category
+    // categoryOf[i] < categoryCount.
+    void Build(const std::vector<FileInfo>& files, std::span<const CategoryId> categoryOf,
+               size_t categoryCount, bool parallel);
+
+    void Clear();
+
+    bool   empty() const { return m_nodes.empty(); }
+    size_t NodeCount() const { return m_nodes.size(); }
+
+    const Node& operator[](uint32_t node) const { return m_nodes[node]; }
+
+    // Subdirectories of node, largest first; those of kNoNode are the
+    // outermost directories
+    std::span<const uint32_t> Children(uint32_t node) const;
+
+    // The categories of node's own files, largest first
+    std::span<const Share> Shares(uint32_t node) const
+    {
+        return std::span<const Share>(m_shares).subspan(m_nodes[node].firstShare, m_nodes[node].shareCount);
+    }
+
+    // Where a view starts: the outermost directory that holds files itself
+    // or branches, or kNoNode when there are several outermost directories
+    uint32_t Top() const;
+
+    // The node of dir, or kNoNode if no file is below it
+    uint32_t NodeOf(DirId dir) const;
+
+    uint64_t TotalBytes() const { return m_totalBytes; }
+    uint64_t TotalFiles() const { return m_totalFiles; }
+
+    // Totals per category, indexed by CategoryId
+    std::span<const uint64_t> CategoryBytes() const { return m_categoryBytes; }
+    std::span<const uint64_t> CategoryFiles() const { return m_categoryFiles; }
+
+private:
+    std::vector<Node>     m_nodes;          // in DirId order, so parents come first
+    std::vector<uint32_t> m_children;       // the roots, then every node's subdirectories
+    size_t                m_rootCount = 0;
+    std::vector<Share>    m_shares;
+    std::vector<uint64_t> m_categoryBytes;
+    std::vector<uint64_t> m_categoryFiles;
+    uint64_t              m_totalBytes = 0;
+    uint64_t              m_totalFiles = 0;
+};
@@ -0,0 +1,530 @@
+// duplicates.cpp
+
+#include "duplicates.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if __has_include(<xxhash.h>)
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#define MEDAMA_HAVE_XXHASH 1
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#endif
+
+namespace {
+
+// Stage 3 reads files front to back in blocks of this size
+constexpr size_t kReadBlock = size_t(1) << 20;
+
+// ------------------------------- Hashing -----------------------------------
+
+#ifdef MEDAMA_HAVE_XXHASH
+
+class StreamHasher {
+public:
+    explicit StreamHasher(uint64_t seed = 0) { XXH3_64bits_reset_withSeed(&m_state, seed); }
+
+    void     Update(const uint8_t* data, size_t len) { XXH3_64bits_update(&m_state, data, len); }
+    uint64_t Digest() const { return XXH3_64bits_digest(&m_state); }
+
+private:
+    XXH3_state_t m_state;
+};
+
+#else
+
+// The XXH64 construction: four independent multiply/rotate lanes over
+// 32-byte stripes, which the compiler keeps in registers and pipelines.
+class StreamHasher {
+public:
+    explicit StreamHasher(uint64_t seed = 0)
+        : m_seed(seed)
+        , m_lanes{seed + P1 + P2, seed + P2, seed, seed - P1}
+    {
+    }
+
+    void Update(const uint8_t* data, size_t len)
+    {
+        m_total += len;
+
+        if (m_pending) {
+            size_t take = std::min(len, sizeof(m_stripe) - m_pending);
+            std::memcpy(m_stripe + m_pending, data, take);
+            m_pending += take;
+            data += take;
+            len -= take;
+            if (m_pending < sizeof(m_stripe))
+                return;
+            Consume(m_stripe);
+            m_pending = 0;
+        }
+
+        for (; len >= sizeof(m_stripe); data += sizeof(m_stripe), len -= sizeof(m_stripe))
+            Consume(data);
+
+        std::memcpy(m_stripe, data, len);
+        m_pending = len;
+    }
+
+    uint64_t Digest() const
+    {
+        uint64_t h;
+        if (m_total >= sizeof(m_stripe)) {
+            h = Rotl(m_lanes[0], 1) + Rotl(m_lanes[1], 7) + Rotl(m_lanes[2], 12) + Rotl(m_lanes[3], 18);
+            for (uint64_t lane : m_lanes)
+                h = (h ^ Round(0, lane)) * P1 + P4;
+        } else {
+            h = m_seed + P5;
+        }
+        h += m_total;
+
+        const uint8_t* p = m_stripe;
+        size_t left = m_pending;
+        for (; left >= 8; p += 8, left -= 8)
+            h = Rotl(h ^ Round(0, Read64(p)), 27) * P1 + P4;
+        if (left >= 4) {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            h = Rotl(h ^ (v * P1), 23) * P2 + P3;
+            p += 4;
+            left -= 4;
+        }
+        for (; left; ++p, --left)
+            h = Rotl(h ^ (*p * P5), 11) * P1;
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t m_seed;
+    uint64_t m_lanes[4];
+    uint64_t m_total = 0;
+    uint8_t  m_stripe[32];
+    size_t   m_pending = 0;
+
+    static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t Read64(const uint8_t* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+
+    static uint64_t Round(uint64_t acc, uint64_t input)
+    {
+        return Rotl(acc + input * P2, 31) * P1;
+    }
+
+    void Consume(const uint8_t* stripe)
+    {
+        for (int i = 0; i < 4; ++i)
+            m_lanes[i] = Round(m_lanes[i], Read64(stripe + 8 * i));
+    }
+};
+
+#endif
+
+// ----------------------------- File access ---------------------------------
+
+#ifdef __linux__
+
+class InputFile {
+public:
+    ~InputFile()
+    {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    // sequential == false tells the kernel not to read ahead, since only
+    // the edges of the file are wanted.
+    bool Open(const std::string& path, bool sequential)
+    {
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+        if (m_fd < 0)
+            return false;
+        ::posix_fadvise(m_fd, 0, 0, sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+        return true;
+    }
+
+    // Reads exactly len bytes at offset; false on error or early EOF.
+    bool ReadAt(uint8_t* buf, size_t len, uint64_t offset)
+    {
+        while (len > 0) {
+            ssize_t got = ::pread(m_fd, buf, len, static_cast<off_t>(offset));
+            if (got <= 0)
+                return false;
+            buf += got;
+            len -= static_cast<size_t>(got);
+            offset += static_cast<uint64_t>(got);
+        }
+        return true;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+// Size and mtime (seconds since the epoch) of the file at path
+bool StatFile(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+    struct statx stx;
+    if (::statx(AT_FDCWD, path.c_str(), 0, STATX_SIZE | STATX_MTIME, &stx) != 0)
+        return false;
+    size = stx.stx_size;
+    mtime = stx.stx_mtime.tv_sec;
+    return true;
+}
+
+#else
+
+class InputFile {
+public:
+    bool Open(const std::string& path, bool /*sequential*/)
+    {
+        m_in.open(std::filesystem::path(std::u8string(path.begin(), path.end())), std::ios::binary);
+        return static_cast<bool>(m_in);
+    }
+
+    bool ReadAt(uint8_t* buf, size_t len, uint64_t offset)
+    {
+        m_in.seekg(static_cast<std::streamoff>(offset));
+        m_in.read(reinterpret_cast<char*>(buf), static_cast<std::streamsize>(len));
+        return static_cast<size_t>(m_in.gcount()) == len;
+    }
+
+private:
+    std::ifstream m_in;
+};
+
+bool StatFile(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+    std::filesystem::path p(std::u8string(path.begin(), path.end()));
+    std::error_code ec;
+    size = std::filesystem::file_size(p, ec);
+    if (ec)
+        return false;
+    auto t = std::filesystem::last_write_time(p, ec);
+    if (ec)
+        return false;
+    auto sys = std::chrono::file_clock::to_sys(t);
+    mtime = std::chrono::duration_cast<std::chrono::seconds>(sys.time_since_epoch()).count();
+    return true;
+}
+
+#endif
+
+} // namespace
+
+uint64_t HashBytes(std::span<const uint8_t> data, uint64_t seed)
+{
+    StreamHasher hasher(seed);
+    hasher.Update(data.data(), data.size());
+    return hasher.Digest();
+}
+
+uint32_t HashAlgorithm()
+{
+#ifdef MEDAMA_HAVE_XXHASH
+    return 1;   // XXH3-64
+#else
+    return 2;   // built-in XXH64-style
+#endif
+}
+
+// ---------------------------- DuplicateFinder ------------------------------
+
+DuplicateFinder::DuplicateFinder(std::vector<std::string> paths, std::vector<uint64_t> sizes,
+                                 std::vector<uint64_t> knownHashes, std::vector<int64_t> mtimes)
+    : m_paths(std::move(paths))
+    , m_sizes(std::move(sizes))
+    , m_known(std::move(knownHashes))
+    , m_mtimes(std::move(mtimes))
+{
+    m_sizes.resize(m_paths.size(), 0);
+    m_known.resize(m_paths.size(), 0);
+    if (m_mtimes.size() != m_paths.size())
+        m_known.assign(m_paths.size(), 0);
+}
+
+DuplicateFinder::~DuplicateFinder()
+{
+    Cancel();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void DuplicateFinder::Start(OnFinished onFinished)
+{
+    m_onFinished = std::move(onFinished);
+    m_running = true;
+    m_thread = std::jthread([this](std::stop_token stop) {
+        Run(stop);
+
+        bool cancelled = stop.stop_requested();
+        m_running = false;
+        if (m_onFinished)
+            m_onFinished(cancelled);
+    });
+}
+
+void DuplicateFinder::Cancel()
+{
+    m_thread.request_stop();
+}
+
+DuplicateFinder::Progress DuplicateFinder::GetProgress() const
+{
+    Progress p;
+    p.stage = m_stage.load(std::memory_order_relaxed);
+    p.done = m_done.load(std::memory_order_relaxed);
+    p.total = m_total.load(std::memory_order_relaxed);
+    p.bytes = m_bytes.load(std::memory_order_relaxed);
+    p.errors = m_errors.load(std::memory_order_relaxed);
+    return p;
+}
+
+void DuplicateFinder::Run(std::stop_token stop)
+{
+    const size_t n = m_paths.size();
+    m_hash.assign(n, 0);
+    m_failed.assign(n, 0);
+    m_final.assign(n, 0);
+    m_setOf.assign(n, 0);
+    m_sets.clear();
+
+    // Stage 1: only files sharing a size can be duplicates. Empty files are
+    // trivially identical and left out.
+    m_stage = 1;
+    m_total = n;
+
+    std::vector<uint32_t> files;
+    files.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (m_sizes[i] > 0)
+            files.push_back(static_cast<uint32_t>(i));
+    }
+
+    std::vector<std::vector<uint32_t>> runs = CollidingRuns(std::move(files), false);
+    m_done = n;
+
+    // Known hashes may come from an index that has not seen a file being
+    // rewritten in place (see metaindex.h), so a duplicate is never
+    // reported on one unless the file still has the size and mtime it was
+    // hashed with. One stat each, and only for files that share a size.
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> knownFiles;
+    for (const auto& run : runs) {
+        for (uint32_t file : run) {
+            if (m_known[file])
+                knownFiles.push_back(file);
+        }
+    }
+    RunStage(stop, 1, knownFiles, std::clamp(2 * hw, 4u, 16u), [this](uint32_t file, std::vector<uint8_t>&) {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (!StatFile(m_paths[file], size, mtime) || size != m_sizes[file] || mtime != m_mtimes[file])
+            m_known[file] = 0;
+        return true;
+    });
+
+    // Files with a known content hash skip stages 2 and 3. A size class that
+    // has one needs the final hash of every other member, not just the edges.
+    std::vector<uint32_t> edgeFiles;
+    std::vector<uint8_t>  sizeHasKnown(n, 0);
+    for (const auto& run : runs) {
+        bool anyKnown = false;
+        for (uint32_t file : run) {
+            if (m_known[file]) {
+                m_hash[file] = m_known[file];
+                m_final[file] = 1;
+                anyKnown = true;
+            } else {
+                edgeFiles.push_back(file);
+            }
+        }
+        if (anyKnown) {
+            for (uint32_t file : run)
+                sizeHasKnown[file] = 1;
+        }
+    }
+
+    // Stage 2: head and tail. Random access, so many reads in flight.
+    RunStage(stop, 2, edgeFiles, std::clamp(2 * hw, 4u, 16u),
+             [this](uint32_t file, std::vector<uint8_t>& buf) { return HashEdges(file, buf); });
+
+    std::vector<uint32_t> fullFiles;
+    for (uint32_t file : edgeFiles) {
+        if (!m_failed[file] && m_sizes[file] <= 2 * kEdgeBytes)
+            m_final[file] = 1;                   // stage 2 already saw every byte
+        else if (!m_failed[file] && sizeHasKnown[file])
+            fullFiles.push_back(file);
+    }
+    for (auto& run : CollidingRuns(std::move(edgeFiles), true)) {
+        if (m_sizes[run.front()] > 2 * kEdgeBytes && !sizeHasKnown[run.front()])
+            fullFiles.insert(fullFiles.end(), run.begin(), run.end());
+    }
+
+    // Stage 3: whole files, read sequentially. Few streams at a time, so a
+    // spinning disk is not forced to seek between them on every block.
+    RunStage(stop, 3, fullFiles, std::clamp(hw, 2u, 4u),
+             [this, &stop](uint32_t file, std::vector<uint8_t>& buf) { return HashContents(file, buf, stop); });
+
+    if (stop.stop_requested())
+        return;
+
+    for (uint32_t file : fullFiles) {
+        if (!m_failed[file])
+            m_final[file] = 1;
+    }
+
+    std::vector<uint32_t> finalFiles;
+    for (size_t i = 0; i < n; ++i) {
+        if (m_final[i])
+            finalFiles.push_back(static_cast<uint32_t>(i));
+    }
+    std::vector<std::vector<uint32_t>> sets = CollidingRuns(std::move(finalFiles), true);
+
+    std::sort(sets.begin(), sets.end(), [this](const auto& a, const auto& b) {
+        uint64_t wa = m_sizes[a.front()] * (a.size() - 1);
+        uint64_t wb = m_sizes[b.front()] * (b.size() - 1);
+        return wa != wb ? wa > wb : a.front() < b.front();
+    });
+
+    m_sets.reserve(sets.size());
+    for (const auto& run : sets) {
+        m_sets.push_back({m_sizes[run.front()], static_cast<uint32_t>(run.size())});
+        for (uint32_t file : run)
+            m_setOf[file] = static_cast<uint32_t>(m_sets.size());
+    }
+}
+
+template <typename Fn>
+void DuplicateFinder::RunStage(std::stop_token stop, unsigned stage, const std::vector<uint32_t>& files,
+                               unsigned threads, Fn fn)
+{
+    m_stage = stage;
+    m_done = 0;
+    m_total = files.size();
+    if (files.empty() || stop.stop_requested())
+        return;
+
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        std::vector<uint8_t> buf;
+        for (;;) {
+            size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= files.size() || stop.stop_requested())
+                break;
+
+            if (!fn(files[i], buf)) {
+                m_failed[files[i]] = 1;
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_done.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    threads = static_cast<unsigned>(std::min<size_t>(threads, files.size()));
+    std::vector<std::jthread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t)
+        workers.emplace_back(worker);
+    worker();
+}
+
+std::vector<std::vector<uint32_t>> DuplicateFinder::CollidingRuns(std::vector<uint32_t> files, bool useHash) const
+{
+    std::erase_if(files, [this](uint32_t f) { return m_failed[f] != 0; });
+
+    auto key = [&](uint32_t f) {
+        return std::make_pair(m_sizes[f], useHash ? m_hash[f] : 0);
+    };
+    std::sort(files.begin(), files.end(), [&](uint32_t a, uint32_t b) {
+        auto ka = key(a);
+        auto kb = key(b);
+        return ka != kb ? ka < kb : a < b;
+    });
+
+    std::vector<std::vector<uint32_t>> runs;
+    for (size_t begin = 0; begin < files.size();) {
+        size_t end = begin + 1;
+        while (end < files.size() && key(files[end]) == key(files[begin]))
+            ++end;
+        if (end - begin >= 2)
+            runs.emplace_back(files.begin() + begin, files.begin() + end);
+        begin = end;
+    }
+    return runs;
+}
+
+bool DuplicateFinder::HashEdges(uint32_t file, std::vector<uint8_t>& buf)
+{
+    const uint64_t size = m_sizes[file];
+
+    // Head and tail never overlap; for files up to 2 * kEdgeBytes they
+    // cover the whole content
+    size_t head = static_cast<size_t>(std::min<uint64_t>(size, kEdgeBytes));
+    uint64_t tailOffset = std::max<uint64_t>(head, size > kEdgeBytes ? size - kEdgeBytes : 0);
+    size_t tail = static_cast<size_t>(size - tailOffset);
+
+    InputFile in;
+    if (!in.Open(m_paths[file], false))
+        return false;
+
+    buf.resize(head + tail);
+    if (!in.ReadAt(buf.data(), head, 0) || (tail && !in.ReadAt(buf.data() + head, tail, tailOffset)))
+        return false;
+
+    m_hash[file] = HashBytes(buf);
+    m_bytes.fetch_add(head + tail, std::memory_order_relaxed);
+    return true;
+}
+
+bool DuplicateFinder::HashContents(uint32_t file, std::vector<uint8_t>& buf, std::stop_token stop)
+{
+    const uint64_t size = m_sizes[file];
+
+    InputFile in;
+    if (!in.Open(m_paths[file], true))
+        return false;
+
+    buf.resize(kReadBlock);
+    StreamHasher hasher;
+    for (uint64_t offset = 0; offset < size; offset += kReadBlock) {
+        if (stop.stop_requested())
+            return false;
+
+        size_t len = static_cast<size_t>(std::min<uint64_t>(kReadBlock, size - offset));
+        if (!in.ReadAt(buf.data(), len, offset))
+            return false;
+
+        hasher.Update(buf.data(), len);
+        m_bytes.fetch_add(len, std::memory_order_relaxed);
+    }
+
+    m_hash[file] = hasher.Digest();
+    return true;
+}
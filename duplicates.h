@@ -0,0 +1,119 @@
+// duplicates.h
+//
+// Duplicate detection for the "Find Duplicates" strategy. Files are
+// narrowed down in stages so that most of them are never read:
+//   1. equal size (and, for content hashes known from an earlier search,
+//      the same size and mtime as when they were computed),
+//   2. equal hash of the first and last kEdgeBytes,
+//   3. equal hash of the whole content.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 64-bit content hash: XXH3 when <xxhash.h> is available, otherwise a
+// built-in four-lane multiply/rotate hash. Stable within one build only.
+uint64_t HashBytes(std::span<const uint8_t> data, uint64_t seed = 0);
+
+// Identifies the hash function HashBytes() and content hashes use, so
+// persisted hashes from a different build can be told apart.
+uint32_t HashAlgorithm();
+
+class DuplicateFinder {
+public:
+    // Head and tail bytes hashed in stage 2. Files up to twice this size are
+    // fully covered by stage 2 and skip stage 3.
+    static constexpr size_t kEdgeBytes = 4096;
+
+    struct Progress {
+        unsigned stage = 1;        // 1..3
+        uint64_t done = 0;         // files hashed in the current stage
+        uint64_t total = 0;        // files to hash in the current stage
+        uint64_t bytes = 0;        // bytes read so far, all stages
+        uint64_t errors = 0;
+    };
+
+    // A set of identical files, all of size `size`
+    struct Set {
+        uint64_t size = 0;
+        uint32_t count = 0;
+
+        uint64_t WastedBytes() const { return size * (count - 1); }
+    };
+
+    // Called once on the finder's thread, after the last stage
+    using OnFinished = std::function<void(bool cancelled)>;
+
+    // paths are in ToFileSystem() form, sizes[i] is the size of paths[i].
+    // knownHashes[i], if non-zero, is a content hash of file i from an
+    // earlier search (see ContentHash()), computed when it had sizes[i] and
+    // mtimes[i] (seconds since the epoch). Such files are not read again
+    // once a stat shows they still have both; without mtimes, known hashes
+    // are not used.
+    DuplicateFinder(std::vector<std::string> paths, std::vector<uint64_t> sizes,
+                    std::vector<uint64_t> knownHashes = {}, std::vector<int64_t> mtimes = {});
+    ~DuplicateFinder();
+
+    DuplicateFinder(const DuplicateFinder&) = delete;
+    DuplicateFinder& operator=(const DuplicateFinder&) = delete;
+
+    void Start(OnFinished onFinished);
+    void Cancel();
+
+    bool     IsRunning() const { return m_running.load(); }
+    Progress GetProgress() const;
+
+    // Results, only valid once the job has finished without being
+    // cancelled. Sets are ordered by wasted bytes, largest first; SetOf(i)
+    // is 1 + the index of the set file i belongs to, or 0 if it is unique.
+    const std::vector<Set>& Sets() const { return m_sets; }
+    uint32_t                SetOf(size_t file) const { return m_setOf[file]; }
+    size_t                  FileCount() const { return m_paths.size(); }
+
+    // Hash of the whole content of file i, or 0 if the search did not need
+    // to compute it (e.g. its size is unique). Stable within one build.
+    uint64_t ContentHash(size_t file) const { return m_final[file] ? m_hash[file] : 0; }
+
+private:
+    std::vector<std::string> m_paths;
+    std::vector<uint64_t>    m_sizes;
+    std::vector<uint64_t>    m_hash;       // stage 2, then stage 3 hash per file
+    std::vector<uint8_t>     m_failed;     // unreadable or changed while hashing
+    std::vector<uint64_t>    m_known;      // from the caller, 0 if unknown
+    std::vector<int64_t>     m_mtimes;     // the known hashes are for
+    std::vector<uint8_t>     m_final;      // m_hash covers the whole content
+
+    std::vector<Set>      m_sets;
+    std::vector<uint32_t> m_setOf;
+
+    OnFinished            m_onFinished;
+    std::jthread          m_thread;
+    std::atomic<bool>     m_running{false};
+
+    std::atomic<unsigned> m_stage{1};
+    std::atomic<uint64_t> m_done{0};
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<uint64_t> m_errors{0};
+
+    void Run(std::stop_token stop);
+
+    // Calls fn(file) for every entry of files on `threads` workers that
+    // claim one file at a time, as file sizes vary wildly.
+    template <typename Fn>
+    void RunStage(std::stop_token stop, unsigned stage, const std::vector<uint32_t>& files,
+                  unsigned threads, Fn fn);
+
+    // Sorts files by (size, hash) and returns the runs of two or more equal
+    // keys, skipping failed files. With useHash == false only sizes count.
+    std::vector<std::vector<uint32_t>> CollidingRuns(std::vector<uint32_t> files, bool useHash) const;
+
+    bool HashEdges(uint32_t file, std::vector<uint8_t>& buf);
+    bool HashContents(uint32_t file, std::vector<uint8_t>& buf, std::stop_token stop);
+};
@@ -0,0 +1,84 @@
+// fileinfo.cpp
+
+#include "fileinfo.h"
+#include "ingest.h"
+
+#include <algorithm>
+
+std::string FileInfo::NativePath() const
+{
+    std::string path;
+    PathStore::Get().AppendPath(path, dir, NativeName());
+    return path;
+}
+
+wxString FileInfo::Name() const
+{
+    return FromFileSystem(NativeName());
+}
+
+wxString FileInfo::Path() const
+{
+    return FromFileSystem(NativePath());
+}
+
+void FileInfo::SetPath(std::string_view nativePath)
+{
+#ifdef _WIN32
+    size_t cut = nativePath.find_last_of("\\/");
+#else
+    size_t cut = nativePath.rfind('/');
+#endif
+    if (cut == std::string_view::npos)
+        SetLocation(kNoDir, nativePath);
+    else
+        SetLocation(PathStore::Get().InternDirectory(nativePath.substr(0, cut + 1)), nativePath.substr(cut + 1));
+}
+
+void FileInfo::SetLocation(DirId directory, std::string_view nativeName)
+{
+    dir = directory;
+    leaf = PathStore::Get().AddName(nativeName);
+}
+
+std::string FoldFileName(std::string_view nativeName)
+{
+    std::string folded(nativeName);
+    for (char& ch : folded) {
+        if (static_cast<unsigned char>(ch) >= 0x80)
+            return FromFileSystem(nativeName).Lower().utf8_string();
+        if (ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+    }
+    return folded;
+}
+
+void SortByPath(std::vector<FileInfo>& files)
+{
+    std::vector<std::string> paths(files.size());
+    std::vector<size_t> order(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        paths[i] = files[i].NativePath();
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&paths](size_t a, size_t b) { return paths[a] < paths[b]; });
+
+    std::vector<FileInfo> sorted;
+    sorted.reserve(files.size());
+    for (size_t i : order)
+        sorted.push_back(std::move(files[i]));
+    files = std::move(sorted);
+}
+
+wxString FormatFileSize(wxULongLong bytes)
+{
+    double b = static_cast<double>(bytes.GetValue());
+
+    if (b < 1024.0)
+        return wxString::Format("%.0f B", b);
+    if (b < 1024.0 * 1024.0)
+        return wxString::Format("%.1f KB", b / 1024.0);
+    if (b < 1024.0 * 1024.0 * 1024.0)
+        return wxString::Format("%.1f MB", b / (1024.0 * 1024.0));
+    return wxString::Format("%.1f GB", b / (1024.0 * 1024.0 * 1024.0));
+}
@@ -0,0 +1,56 @@
+// fileinfo.h
+//
+// Metadata Medama keeps for every ingested file.
+
+#pragma once
+
+#include "pathstore.h"
+
+#include <wx/string.h>
+#include <wx/longlong.h>
+#include <wx/datetime.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct FileInfo {
+    // Location in the PathStore: the directory and the leaf name, both in
+    // file-system form (see ToFileSystem())
+    DirId      dir = kNoDir;
+    NameRef    leaf;
+
+    wxULongLong size;
+    wxDateTime modified;
+
+    // Identity of the file, 0 where the platform has none
+    uint64_t   device = 0;
+    uint64_t   inode = 0;
+
+    // Record of this file in the MetadataIndex the scan used, if the
+    // record still describes it (see metaindex.h); ~0u otherwise
+    uint32_t   indexRecord = ~uint32_t(0);
+
+    std::string_view NativeName() const { return PathStore::Get().Name(leaf); }
+    std::string      NativePath() const;
+
+    // Both converted for display, so not for hot loops
+    wxString Name() const;
+    wxString Path() const;
+
+    // Points the record at a full path in file-system form
+    void SetPath(std::string_view nativePath);
+    void SetLocation(DirId directory, std::string_view nativeName);
+};
+
+// Lower-cased UTF-8 of a name in file-system form. ASCII names, the
+// common case, are folded in place of a round trip through wxString.
+std::string FoldFileName(std::string_view nativeName);
+
+// Sorts files by their full path in file-system form, building each path
+// once rather than once per comparison
+void SortByPath(std::vector<FileInfo>& files);
+
+// Human-readable size, e.g. "1.5 MB"
+wxString FormatFileSize(wxULongLong bytes);
@@ -0,0 +1,141 @@
+// grouping.cpp
+
+#include "grouping.h"
+
+#include <algorithm>
+
+std::vector<CategoryId> Grouping::NonEmptyCategories() const
+{
+    std::vector<CategoryId> ids;
+    for (size_t c = 0; c < CategoryCount(); ++c) {
+        if (GroupSize(static_cast<CategoryId>(c)) > 0)
+            ids.push_back(static_cast<CategoryId>(c));
+    }
+    return ids;
+}
+
+void Grouping::Clear()
+{
+    categoryOf.clear();
+    order.clear();
+    offsets.clear();
+}
+
+void BuildGrouping(Grouping& grouping, size_t categoryCount)
+{
+    const size_t n = grouping.categoryOf.size();
+
+    // Pass 1: histogram, shifted by one so the prefix sum yields start offsets
+    grouping.offsets.assign(categoryCount + 1, 0);
+    for (CategoryId c : grouping.categoryOf)
+        ++grouping.offsets[c + 1];
+
+    for (size_t c = 1; c <= categoryCount; ++c)
+        grouping.offsets[c] += grouping.offsets[c - 1];
+
+    // Pass 2: scatter, using a copy of the start offsets as write cursors
+    std::vector<uint32_t> cursor(grouping.offsets.begin(), grouping.offsets.end() - 1);
+    grouping.order.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        grouping.order[cursor[grouping.categoryOf[i]]++] = static_cast<FileIndex>(i);
+}
+
+std::vector<CategoryId> UpdateGrouping(Grouping& grouping, std::span<const CategoryId> column,
+                                       std::span<const FileIndex> remap, size_t categoryCount)
+{
+    const size_t n = column.size();
+    const size_t oldCount = grouping.categoryOf.size();
+    const size_t oldCategories = grouping.CategoryCount();
+    categoryCount = std::max(categoryCount, oldCategories);
+
+    auto newIndex = [&remap](size_t i) -> FileIndex {
+        return remap.empty() ? static_cast<FileIndex>(i) : remap[i];
+    };
+
+    // ----- Which categories gained or lost files, and which files moved in -----
+
+    std::vector<uint8_t> affected(categoryCount, 0);
+    std::vector<std::pair<CategoryId, FileIndex>> arrivals;   // (new category, new index)
+    size_t survivors = 0;
+
+    for (size_t i = 0; i < oldCount; ++i) {
+        CategoryId was = grouping.categoryOf[i];
+        FileIndex j = newIndex(i);
+        if (j == kRemovedFile) {
+            affected[was] = 1;
+            continue;
+        }
+        ++survivors;
+        if (column[j] != was) {
+            affected[was] = 1;
+            affected[column[j]] = 1;
+            arrivals.emplace_back(column[j], j);
+        }
+    }
+    for (size_t j = survivors; j < n; ++j) {
+        affected[column[j]] = 1;
+        arrivals.emplace_back(column[j], static_cast<FileIndex>(j));
+    }
+    std::sort(arrivals.begin(), arrivals.end());
+
+    // ----- New offsets: unaffected groups keep their size -----
+
+    std::vector<uint32_t> offsets(categoryCount + 1, 0);
+    for (const auto& [c, j] : arrivals)
+        ++offsets[c + 1];
+    for (size_t c = 0; c < oldCategories; ++c) {
+        if (!affected[c]) {
+            offsets[c + 1] += grouping.GroupSize(static_cast<CategoryId>(c));
+            continue;
+        }
+        for (uint32_t k = grouping.offsets[c]; k < grouping.offsets[c + 1]; ++k) {
+            FileIndex j = newIndex(grouping.order[k]);
+            if (j != kRemovedFile && column[j] == c)
+                ++offsets[c + 1];
+        }
+    }
+    for (size_t c = 1; c <= categoryCount; ++c)
+        offsets[c] += offsets[c - 1];
+
+    // ----- Rebuild order, merging stayers and arrivals by file index -----
+
+    std::vector<FileIndex> order(offsets.back());
+    auto arrival = arrivals.begin();
+    for (size_t c = 0; c < categoryCount; ++c) {
+        FileIndex* out = order.data() + offsets[c];
+        const FileIndex* in = c < oldCategories ? grouping.order.data() + grouping.offsets[c] : nullptr;
+        const FileIndex* inEnd = c < oldCategories ? grouping.order.data() + grouping.offsets[c + 1] : nullptr;
+
+        if (!affected[c]) {
+            if (remap.empty()) {
+                out = std::copy(in, inEnd, out);
+            } else {
+                for (; in != inEnd; ++in)
+                    *out++ = remap[*in];
+            }
+            continue;
+        }
+
+        for (; in != inEnd; ++in) {
+            FileIndex j = newIndex(*in);
+            if (j == kRemovedFile || column[j] != c)
+                continue;
+            for (; arrival != arrivals.end() && arrival->first == c && arrival->second < j; ++arrival)
+                *out++ = arrival->second;
+            *out++ = j;
+        }
+        for (; arrival != arrivals.end() && arrival->first == c; ++arrival)
+            *out++ = arrival->second;
+    }
+
+    grouping.categoryOf.assign(column.begin(), column.end());
+    grouping.order = std::move(order);
+    grouping.offsets = std::move(offsets);
+
+    std::vector<CategoryId> changed;
+    for (size_t c = 0; c < categoryCount; ++c) {
+        if (affected[c])
+            changed.push_back(static_cast<CategoryId>(c));
+    }
+    return changed;
+}
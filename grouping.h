@@ -0,0 +1,75 @@
+// grouping.h
+//
+// Result of organizing the file list: a category per file plus a counting
+// sort of file indices by category. Nothing is copied out of the file list.
+
+#pragma once
+
+#include "classifier.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+using FileIndex = uint32_t;
+
+// Marks a file that is gone in an index remapping (see UpdateGrouping())
+inline constexpr FileIndex kRemovedFile = ~FileIndex(0);
+
+struct Grouping {
+    // Category of each file, indexed in parallel with the file list
+    std::vector<CategoryId> categoryOf;
+
+    // File indices grouped by category, in file-list order inside each
+    // category unless SortWithinCategories() (sortkeys.h) reordered them.
+    // Category c owns order[offsets[c]] .. order[offsets[c + 1] - 1].
+    std::vector<FileIndex> order;
+    std::vector<uint32_t>  offsets;
+
+    bool   empty() const { return order.empty(); }
+    size_t FileCount() const { return order.size(); }
+    size_t CategoryCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    size_t GroupSize(CategoryId c) const { return offsets[c + 1] - offsets[c]; }
+
+    std::span<const FileIndex> Files(CategoryId c) const
+    {
+        return std::span<const FileIndex>(order).subspan(offsets[c], GroupSize(c));
+    }
+
+    // Categories that received at least one file, in ID order
+    std::vector<CategoryId> NonEmptyCategories() const;
+
+    void Clear();
+};
+
+// Fills order and offsets from categoryOf with a two-pass counting sort:
+// a histogram over the categories, then a stable scatter of file indices.
+// Every entry of categoryOf must be below categoryCount.
+void BuildGrouping(Grouping& grouping, size_t categoryCount);
+
+// Brings a grouping up to date with a changed category column without
+// regrouping from scratch. remap is empty, or maps every old file index to
+// its new one or kRemovedFile (survivors keep their relative order); files
+// beyond the survivors are new. Only the ranges of categories that gained or
+// lost files are rebuilt, the others are moved as a block. Returns those
+// categories in ID order; rebuilt ranges are in file-list order, so sorted
+// groupings need them sorted again.
+std::vector<CategoryId> UpdateGrouping(Grouping& grouping, std::span<const CategoryId> column,
+                                       std::span<const FileIndex> remap, size_t categoryCount);
+
+// Drops the removed elements of a per-file vector (see UpdateGrouping())
+template <typename T>
+void CompactByRemap(std::vector<T>& items, std::span<const FileIndex> remap)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < remap.size() && i < items.size(); ++i) {
+        if (remap[i] == kRemovedFile)
+            continue;
+        if (kept != i)
+            items[kept] = std::move(items[i]);
+        ++kept;
+    }
+    items.erase(items.begin() + kept, items.begin() + std::min(items.size(), remap.size()));
+}
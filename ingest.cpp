@@ -0,0 +1,245 @@
+// ingest.cpp
+
+#include "ingest.h"
+#include "trace.h"
+
+#include <wx/arrstr.h>
+#include <wx/filename.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace {
+
+// Batches are handed out at least this often while a worker is busy, so the
+// GUI sees steady progress even when stat calls are slow.
+constexpr auto kCoalesceInterval = std::chrono::milliseconds(100);
+
+// Paths claimed by a FileListIngester worker at a time
+constexpr size_t kPathChunk = 64;
+
+} // namespace
+
+#ifdef __linux__
+
+std::string ToFileSystem(const wxString& path)
+{
+    return std::string(path.fn_str());
+}
+
+wxString FromFileSystem(std::string_view bytes)
+{
+    return wxString(bytes.data(), *wxConvFileName, bytes.size());
+}
+
+bool StatFile(const wxString& path, FileInfo& info)
+{
+    std::string native = ToFileSystem(path);
+    struct statx stx;
+    if (::statx(AT_FDCWD, native.c_str(), 0,
+                STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) != 0)
+        return false;
+    if (!S_ISREG(stx.stx_mode))
+        return false;
+
+    info.SetPath(native);
+    info.size = stx.stx_size;
+    info.modified = wxDateTime(static_cast<time_t>(stx.stx_mtime.tv_sec));
+    info.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    info.inode = stx.stx_ino;
+    return true;
+}
+
+#else
+
+std::string ToFileSystem(const wxString& path)
+{
+    return path.utf8_string();
+}
+
+wxString FromFileSystem(std::string_view bytes)
+{
+    return wxString::FromUTF8(bytes.data(), bytes.size());
+}
+
+bool StatFile(const wxString& path, FileInfo& info)
+{
+    wxFileName fn(path);
+    if (!fn.FileExists())
+        return false;
+
+    wxDateTime mtime;
+    if (!fn.GetTimes(nullptr, &mtime, nullptr))
+        return false;
+
+    info.SetPath(ToFileSystem(fn.GetFullPath()));
+    info.size = fn.GetSize();
+    info.modified = mtime;
+    return info.size != wxInvalidSize;
+}
+
+#endif
+
+// ------------------------------ IngestJob -------------------------------
+
+IngestJob::IngestJob(unsigned threads, size_t batchSize)
+    : m_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+    , m_batchSize(std::max<size_t>(1, batchSize))
+{
+}
+
+IngestJob::~IngestJob()
+{
+    Shutdown();
+}
+
+void IngestJob::Shutdown()
+{
+    Cancel();
+    m_workers.clear();   // joins
+}
+
+void IngestJob::Start(OnBatch onBatch, OnFinished onFinished)
+{
+    wxCHECK_RET(m_workers.empty(), "IngestJob can only be started once");
+
+    m_onBatch = std::move(onBatch);
+    m_onFinished = std::move(onFinished);
+    m_startTime = std::chrono::steady_clock::now();
+
+    Prepare();
+
+    m_activeWorkers = m_threads;
+    for (unsigned i = 0; i < m_threads; ++i)
+        m_workers.emplace_back([this, i](std::stop_token stop) { RunWorker(stop, i); });
+}
+
+void IngestJob::Cancel()
+{
+    m_cancelled = true;
+    for (auto& worker : m_workers)
+        worker.request_stop();
+}
+
+IngestJob::Progress IngestJob::GetProgress() const
+{
+    Progress p;
+    p.files = m_files.load(std::memory_order_relaxed);
+    p.directories = m_dirs.load(std::memory_order_relaxed);
+    p.errors = m_errors.load(std::memory_order_relaxed);
+    p.bytes = m_bytes.load(std::memory_order_relaxed);
+    p.total = m_total.load(std::memory_order_relaxed);
+    p.reused = m_reused.load(std::memory_order_relaxed);
+
+    int64_t ns = m_elapsedNs.load();
+    if (ns < 0)
+        ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - m_startTime).count();
+    p.elapsedSeconds = ns / 1e9;
+    return p;
+}
+
+void IngestJob::RunWorker(std::stop_token stop, unsigned self)
+{
+    {
+        PhaseScope phase("ingest.worker");
+
+        Batch batch;
+        batch.items.reserve(m_batchSize);
+        batch.since = std::chrono::steady_clock::now();
+
+        WorkerMain(stop, self, batch);
+
+        if (!stop.stop_requested())
+            Flush(batch);
+
+        phase.AddItems(batch.emitted);
+        m_allocations.fetch_add(phase.Allocations(), std::memory_order_relaxed);
+    }
+
+    if (m_activeWorkers.fetch_sub(1) == 1) {
+        auto now = std::chrono::steady_clock::now();
+        m_elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_startTime).count();
+
+        // The whole job, from Start() to the last worker
+        TraceEvent event;
+        event.name = "ingest";
+        event.start = Trace::ToMicros(m_startTime);
+        event.duration = Trace::ToMicros(now) - event.start;
+        event.thread = Trace::CurrentThread();
+        event.items = m_files.load();
+        event.bytes = m_bytes.load();
+        event.allocations = m_allocations.load();
+        Trace::Get().Record(event);
+
+        if (m_onFinished)
+            m_onFinished(m_cancelled.load());
+    }
+}
+
+void IngestJob::Emit(FileInfo&& info, Batch& batch)
+{
+    m_files.fetch_add(1, std::memory_order_relaxed);
+    m_bytes.fetch_add(info.size.GetValue(), std::memory_order_relaxed);
+
+    ++batch.emitted;
+    batch.items.push_back(std::move(info));
+
+    // Only look at the clock every few records
+    if (batch.items.size() >= m_batchSize ||
+        (batch.items.size() % 32 == 0 &&
+         std::chrono::steady_clock::now() - batch.since >= kCoalesceInterval))
+        Flush(batch);
+}
+
+void IngestJob::Flush(Batch& batch)
+{
+    batch.since = std::chrono::steady_clock::now();
+    if (batch.items.empty())
+        return;
+
+    if (m_onBatch)
+        m_onBatch(std::move(batch.items));
+
+    batch.items.clear();
+    batch.items.reserve(m_batchSize);
+}
+
+// --------------------------- FileListIngester ---------------------------
+
+FileListIngester::FileListIngester(const wxArrayString& paths)
+    // Stat latency dominates on network mounts and spinning disks, so a few
+    // requests in flight help even on small machines.
+    : IngestJob(std::clamp(std::thread::hardware_concurrency(), 2u, 8u), 1024)
+    , m_paths(paths.begin(), paths.end())
+{
+    m_total = m_paths.size();
+}
+
+FileListIngester::~FileListIngester()
+{
+    Shutdown();
+}
+
+void FileListIngester::WorkerMain(std::stop_token stop, unsigned WXUNUSED(self), Batch& batch)
+{
+    while (!stop.stop_requested()) {
+        size_t begin = m_next.fetch_add(kPathChunk);
+        if (begin >= m_paths.size())
+            break;
+
+        size_t end = std::min(begin + kPathChunk, m_paths.size());
+        for (size_t i = begin; i < end && !stop.stop_requested(); ++i) {
+            FileInfo fi;
+            if (StatFile(m_paths[i], fi))
+                Emit(std::move(fi), batch);
+            else
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
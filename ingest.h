@@ -0,0 +1,131 @@
+// ingest.h
+//
+// Background metadata ingestion. An IngestJob produces FileInfo records on
+// worker threads and hands them out in batches, so the GUI thread never
+// blocks on stat calls.
+
+#pragma once
+
+#include "fileinfo.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class wxArrayString;
+
+// Path conversion for the syscall layer: native bytes on Linux, UTF-8 elsewhere.
+std::string ToFileSystem(const wxString& path);
+wxString    FromFileSystem(std::string_view bytes);
+
+// Reads size and modification time of a single path with one metadata call.
+// Returns false if the path cannot be stat'ed or is not a regular file.
+bool StatFile(const wxString& path, FileInfo& info);
+
+class IngestJob {
+public:
+    struct Progress {
+        uint64_t files = 0;
+        uint64_t directories = 0;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+        uint64_t total = 0;          // expected entries, 0 when unknown up front
+        uint64_t reused = 0;         // files taken unchanged from a metadata index
+        double   elapsedSeconds = 0.0;
+
+        uint64_t Processed() const { return files + errors; }
+
+        double EntriesPerSecond() const
+        {
+            return elapsedSeconds > 0.0 ? (files + directories) / elapsedSeconds : 0.0;
+        }
+    };
+
+    // Both callbacks run on a worker thread. OnBatch may be called
+    // concurrently from several workers; OnFinished is called exactly once,
+    // after the last batch, with cancelled = true if Cancel() stopped the job.
+    using OnBatch = std::function<void(std::vector<FileInfo>&& batch)>;
+    using OnFinished = std::function<void(bool cancelled)>;
+
+    virtual ~IngestJob();
+
+    IngestJob(const IngestJob&) = delete;
+    IngestJob& operator=(const IngestJob&) = delete;
+
+    // Starts the workers. A job runs once.
+    void Start(OnBatch onBatch, OnFinished onFinished);
+
+    // Asks the workers to stop; returns immediately.
+    void Cancel();
+
+    bool     IsRunning() const { return m_activeWorkers.load() > 0; }
+    Progress GetProgress() const;
+
+protected:
+    // Per-worker staging area for records that have not been handed out yet.
+    struct Batch {
+        std::vector<FileInfo>                 items;
+        std::chrono::steady_clock::time_point since;
+        uint64_t                              emitted = 0;   // by this worker, for the trace
+    };
+
+    // threads == 0 means one per hardware thread.
+    IngestJob(unsigned threads, size_t batchSize);
+
+    // Called on the GUI thread before the workers start, e.g. to seed queues.
+    virtual void Prepare() {}
+    virtual void WorkerMain(std::stop_token stop, unsigned self, Batch& batch) = 0;
+
+    // Stages a record and hands the batch out once it is full or has been
+    // held for longer than the coalescing interval.
+    void Emit(FileInfo&& info, Batch& batch);
+    void Flush(Batch& batch);
+
+    // Cancels and joins the workers. Derived destructors must call this
+    // before their own members, which the workers may still be using, go away.
+    void Shutdown();
+
+    unsigned ThreadCount() const { return m_threads; }
+    bool     IsCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+    std::atomic<uint64_t> m_files{0};
+    std::atomic<uint64_t> m_dirs{0};
+    std::atomic<uint64_t> m_errors{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_reused{0};
+
+private:
+    unsigned   m_threads;
+    size_t     m_batchSize;
+    OnBatch    m_onBatch;
+    OnFinished m_onFinished;
+
+    std::vector<std::jthread> m_workers;
+    std::atomic<unsigned>     m_activeWorkers{0};
+    std::atomic<bool>         m_cancelled{false};
+
+    std::chrono::steady_clock::time_point m_startTime;
+    std::atomic<int64_t>                  m_elapsedNs{-1};   // set once finished
+    std::atomic<uint64_t>                 m_allocations{0};  // of all workers, for the trace
+
+    void RunWorker(std::stop_token stop, unsigned self);
+};
+
+// Stats an explicit list of paths, e.g. the result of a file dialog.
+class FileListIngester : public IngestJob {
+public:
+    explicit FileListIngester(const wxArrayString& paths);
+    ~FileListIngester() override;
+
+private:
+    std::vector<wxString> m_paths;
+    std::atomic<size_t>   m_next{0};
+
+    void WorkerMain(std::stop_token stop, unsigned self, Batch& batch) override;
+};
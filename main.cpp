@@ -10,53 +10,234 @@
 #include <wx/filedlg.h>
 #include <wx/filename.h>
 #include <wx/datetime.h>
-#include <wx/textfile.h>
-#include <wx/scrolwin.h>
 #include <wx/simplebook.h>
 #include <wx/statline.h>
-#include <map>
+#include <wx/dirdlg.h>
+#include <wx/timer.h>
+#include <wx/gauge.h>
+#include <wx/stdpaths.h>
+#include <wx/stopwatch.h>
+#include <wx/srchctrl.h>
+#include <wx/image.h>
+#include "applyplan.h"
+#include "buckets.h"
+#include "classifier.h"
+#include "diskusage.h"
+#include "fileinfo.h"
+#include "grouping.h"
+#include "ingest.h"
+#include "metaindex.h"
+#include "nameindex.h"
+#include "organizedview.h"
+#include "organizer.h"
+#include "planexport.h"
+#include "plantree.h"
+#include "rules.h"
+#include "scanner.h"
+#include "similar.h"
+#include "sniffer.h"
+#include "sortkeys.h"
+#include "thumbcache.h"
+#include "duplicates.h"
+#include "trace.h"
+#include "treemapview.h"
+#include "watcher.h"
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <algorithm>
 
-struct FileInfo {
-    wxString   path;
-    wxString   name;
-    wxULongLong size;
-    wxDateTime modified;
-};
+// Report-mode list in wxLC_VIRTUAL mode over MainFrame::m_files. The native
+// control only knows the row count; cell text is produced on demand in
+// OnGetItemText, and the formatted size/date strings of the rows the control
+// announces through EVT_LIST_CACHE_HINT are kept in a small cache. While
+// the list is sorted or filtered, row r shows file (*rows)[r].
+class SelectedFilesList : public wxListCtrl {
+public:
+    SelectedFilesList(wxWindow* parent, const std::vector<FileInfo>& files);
+
+    // Rows to show, or nullptr for every file in file-list order. Takes
+    // effect with the next RefreshFromModel().
+    void SetRows(const std::vector<FileIndex>* rows) { m_rows = rows; }
+
+    // Resyncs the row count with the backing vector and drops the cache.
+    void RefreshFromModel();
+
+protected:
+    wxString OnGetItemText(long item, long column) const override;
+
+private:
+    struct CachedRow {
+        wxString size;
+        wxString modified;
+    };
 
-enum class Strategy {
-    ByType = 0,
-    ByDate,
-    BySize,
-    ByExtension
+    const std::vector<FileInfo>&  m_files;
+    const std::vector<FileIndex>* m_rows = nullptr;
+
+    long                   m_cacheFrom = 0;
+    std::vector<CachedRow> m_cache;
+
+    size_t RowCount() const { return m_rows ? m_rows->size() : m_files.size(); }
+
+    const FileInfo& FileAt(long item) const
+    {
+        return m_files[m_rows ? (*m_rows)[item] : static_cast<size_t>(item)];
+    }
+
+    void OnCacheHint(wxListEvent& evt);
 };
 
-class MainFrame : public wxFrame {
+class MainFrame : public wxFrame, public OrganizedViewModel {
 public:
     MainFrame();
+    ~MainFrame() override;
 
 private:
     // State
     std::vector<FileInfo> m_files;
-    std::map<wxString, std::vector<FileInfo>> m_organized;
+    Grouping m_grouping;                      // indices into m_files, by category
+    std::vector<CategoryId> m_groupOrder;     // non-empty categories, sorted by label
     Strategy m_strategy = Strategy::ByType;
+    bool     m_parallelOrganize = true;
+    long     m_groupMs = 0;                   // the last grouping, for the summary line
+
+    // Nested organization: with "then by" levels below m_strategy the
+    // grouping is over the leaves of m_plan, m_groupOrder lists the leaves
+    // and m_outline holds the headings above the shown ones.
+    std::vector<Strategy> m_thenBy;
+    PlanTree    m_plan;
+    PlanOutline m_outline;
+
+    // Sorting of the Selected Files list (a permutation of m_files, empty
+    // while unsorted) and of the files inside each organized category
+    SortOrder m_listSort;
+    std::vector<FileIndex> m_listOrder;
+    SortOrder m_groupSort;
+
+    // Name filter. m_filterMatches holds the files [0, m_filterCovered)
+    // whose folded name contains m_filterNeedle, ascending, and
+    // m_filterMask flags them. While a needle is set, the list shows
+    // m_listRows (or the matches themselves when unsorted) and the
+    // organized view shows m_filteredGrouping.
+    NameIndex   m_nameIndex;                 // extended with every ingest batch
+    std::string m_filterNeedle;
+    std::vector<FileIndex> m_filterMatches;
+    std::vector<uint8_t>   m_filterMask;
+    size_t      m_filterCovered = 0;
+    std::vector<FileIndex> m_listRows;
+    Grouping    m_filteredGrouping;
+    std::vector<CategoryId> m_filteredOrder;
+
+    CategoryRegistry    m_categories;
+    ExtensionClassifier m_classifier;
+    Organizer           m_organizer{m_categories, m_classifier};
+    StrategyKeys        m_keys;                // every strategy's category per file
+    NameKeys            m_nameKeys;            // built on the first sort by name
+    PlanExporter        m_planExporter;        // keeps its write buffer between exports
+    DiskUsage           m_usage;               // totals behind the Disk Usage page, built on demand
+
+    // Metadata index of the scanned folder (see metaindex.h), opened before
+    // the scan and rewritten whenever something new has been learned.
+    // m_facts runs parallel to m_files; m_scannedDirs is only set once a
+    // folder scan has finished, and nothing is written until then.
+    MetadataIndex m_index;
+    wxString      m_indexFile;
+    std::string   m_indexRoot;
+    std::vector<ScannedDirectory> m_scannedDirs;
+    std::vector<ContentFacts>     m_facts;
+
+    // Background ingestion (file picker or folder scan). Batches from an
+    // older generation are dropped on arrival.
+    std::unique_ptr<IngestJob> m_ingest;
+    unsigned m_ingestGeneration = 0;
+    bool     m_ingestScansFolder = false;
+    wxTimer  m_ingestTimer;
+
+    // Content sniffing for "By Real Type", covering files
+    // [m_sniffBegin, m_sniffBegin + job size) of m_files.
+    std::unique_ptr<ContentSniffer> m_sniffer;
+    size_t   m_sniffBegin = 0;
+    unsigned m_sniffGeneration = 0;
+
+    // Duplicate search for "Find Duplicates", always over all of m_files
+    std::unique_ptr<DuplicateFinder> m_duplicates;
+    unsigned m_duplicatesGeneration = 0;
+    uint64_t m_duplicateBytes = 0;          // reclaimable, from the last search
+
+    // Search for similar images for "Similar Images", always over all of
+    // m_files, with thumbnails and hashes cached across runs and folders
+    ThumbnailCache m_thumbnails;
+    std::unique_ptr<SimilarImageFinder> m_similar;
+    unsigned m_similarGeneration = 0;
+    uint64_t m_similarImages = 0;           // in groups, from the last search
+
+    wxTimer  m_analysisTimer;               // progress of the three jobs above
+
+    // Watch mode: follows the scanned folder and merges its changes into
+    // m_files and the grouping in place. m_pathIndex maps ToFileSystem()
+    // paths to m_files indices while the watcher runs.
+    DirectoryWatcher m_watcher;
+    unsigned m_watchGeneration = 0;
+    bool     m_watchEnabled = false;
+    std::unordered_map<std::string, FileIndex> m_pathIndex;
+
+    // Moving the files into category folders. While an Apply is in flight,
+    // m_applyFiles[k] is the m_files index of the job's k-th move; after an
+    // Apply or Resume, m_appliedFrom remembers the old locations so an Undo
+    // of the same run, m_appliedRun in m_appliedRoot, can restore them.
+    struct AppliedMove {
+        size_t    move;        // index of the move in the run
+        FileIndex file;
+        DirId     dir;
+        NameRef   leaf;
+    };
+    std::unique_ptr<ApplyPlanJob> m_apply;
+    unsigned  m_applyGeneration = 0;
+    wxString  m_applyRoot;
+    std::vector<FileIndex> m_applyFiles;
+    std::vector<AppliedMove> m_appliedFrom;
+    wxString  m_appliedRoot;
+    std::string m_appliedRun;
+    wxTimer   m_applyTimer;
+
+    // Phase summary in the status bar, redrawn when the trace has changed
+    wxTimer  m_traceTimer;
+    uint64_t m_traceGeneration = 0;
 
     // UI
     wxPanel*      m_mainPanel = nullptr;
     wxPanel*      m_headerPanel = nullptr;
     wxPanel*      m_settingsPanel = nullptr;
-    wxSimplebook* m_book = nullptr;          // switches between "welcome", "selected", "organized"
+    wxSearchCtrl* m_filterBox = nullptr;
+    wxSimplebook* m_book = nullptr;          // switches between "welcome", "selected", "organized", "usage"
 
     wxPanel*      m_pageWelcome = nullptr;
     wxPanel*      m_pageSelected = nullptr;
     wxPanel*      m_pageOrganized = nullptr;
+    wxPanel*      m_pageUsage = nullptr;
 
-    wxListCtrl*   m_selectedList = nullptr;
-    wxScrolledWindow* m_organizedScroll = nullptr;
+    SelectedFilesList* m_selectedList = nullptr;
+    OrganizedView* m_organizedView = nullptr;
     wxStaticText* m_organizedSummary = nullptr;
+    TreemapView*  m_treemap = nullptr;
+    wxStaticText* m_usageSummary = nullptr;
+    wxStaticText* m_applyStatus = nullptr;
+    wxButton*     m_applyButton = nullptr;
+    wxChoice*     m_groupSortChoice = nullptr;
+    wxBoxSizer*   m_ingestSizer = nullptr;
+    wxGauge*      m_ingestGauge = nullptr;
+    wxStaticText* m_ingestStatus = nullptr;
+    wxButton*     m_ingestCancel = nullptr;
 
     wxRadioBox*   m_strategyRadio = nullptr;
+    wxChoice*     m_thenByChoices[kMaxPlanLevels - 1] = {};
+    wxCheckBox*   m_parallelCheck = nullptr;
+    wxCheckBox*   m_watchCheck = nullptr;
+    wxTextCtrl*   m_sizeLimitsText = nullptr;
+    wxTextCtrl*   m_ageLimitsText = nullptr;
 
     bool          m_settingsVisible = false;
 
@@ -67,49 +248,181 @@ private:
     void BuildPages(wxBoxSizer* rootSizer);
 
     void RebuildSelectedList();
-    void RebuildOrganizedView();
 
-    // Logic from your React code
-    wxString GetCategoryForFile(const FileInfo& file) const;
-    wxString GetSizeCategory(wxULongLong bytes) const;
-    wxString GetDateCategory(const wxDateTime& dt) const;
-    wxString FormatFileSize(wxULongLong bytes) const;
+    void ResetFiles();
+    void StartIngest(std::unique_ptr<IngestJob> job, bool scansFolder);
+    void StopIngest();
+    void OnIngestBatch(unsigned generation, std::vector<FileInfo>& batch);
+    void OnIngestFinished(unsigned generation, bool cancelled);
+    void UpdateIngestStatus(bool finished, bool cancelled = false);
+    void SaveIndex();
+    void RebuildOrganizedView();
+    void Regroup();
+    void RefreshGrouping(std::span<const FileIndex> remap, std::span<const FileIndex> rewritten = {});
+    void PrepareSort(SortOrder order);
+    void SortGroups(std::span<const CategoryId> categories);
+
+    bool IsFiltering() const { return !m_filterNeedle.empty(); }
+    void ApplyFilterText();
+    void SetFilterMatches(std::vector<FileIndex> matches);
+    void ExtendFilterMatches();
+    void RefreshFilter();
+    void UpdateListRows();
+    void FilterGroups();
+    void OrderGroups();
+    void RefreshShownGroups();
+
+    bool IsNested() const { return !m_thenBy.empty(); }
+    bool Shows(Strategy strategy) const;
+    std::vector<Strategy> PlanLevels() const;
+    wxString PlanName() const;
+
+    const Grouping& ShownGrouping() const { return IsFiltering() ? m_filteredGrouping : m_grouping; }
+    const std::vector<CategoryId>& ShownGroups() const { return IsFiltering() ? m_filteredOrder : m_groupOrder; }
+    void StartAnalysis();
+    void UpdateOrganizedSummary();
+    void RefreshDiskUsage();
+
+    void StartFolderScan(const wxString& root);
+    void UpdateWatching();
+    void OnWatchChanges(unsigned generation, std::vector<WatchChange>& changes);
+
+    void StartSniffing();
+    void StopSniffing();
+    void OnSniffFinished(unsigned generation, bool cancelled);
+
+    void StartDuplicateSearch();
+    void StopDuplicateSearch();
+    void OnDuplicatesFinished(unsigned generation, bool cancelled);
+
+    void StartSimilarSearch();
+    void StopSimilarSearch();
+    void OnSimilarFinished(unsigned generation, bool cancelled);
+
+    void StartApply(ApplyPlanJob::Mode mode, const wxString& root);
+    void OnApplyFinished(unsigned generation, bool cancelled);
+    void UpdateApplyStatus(bool finished);
+
+    // OrganizedViewModel
+    size_t   GetGroupCount() const override;
+    size_t   GetGroupItemCount(size_t group) const override;
+    wxString GetGroupLabel(size_t group) const override;
+    wxString GetItemName(size_t group, size_t item) const override;
+    wxString GetItemDetail(size_t group, size_t item) const override;
+    size_t   GetNodeCount() const override;
+    size_t   GetRootCount() const override;
+    size_t   GetFirstChild(size_t node) const override;
+    size_t   GetChildCount(size_t node) const override;
+    size_t   GetNodeGroup(size_t node) const override;
+    wxString GetNodeLabel(size_t node) const override;
+    size_t   GetNodeFileCount(size_t node) const override;
+    wxString GetNodeDetail(size_t node) const override;
+
+    void LoadExtensionMappings();
+    void LoadDefaultRules();
+    bool LoadRules(const wxString& path);
 
     // Events
     void OnToggleSettings(wxCommandEvent& evt);
     void OnSelectFiles(wxCommandEvent& evt);
+    void OnScanFolder(wxCommandEvent& evt);
+    void OnCancelIngest(wxCommandEvent& evt);
+    void OnListColumnClick(wxListEvent& evt);
+    void OnFilterText(wxCommandEvent& evt);
+    void OnFilterCancel(wxCommandEvent& evt);
+    void OnGroupSortChanged(wxCommandEvent& evt);
+    void OnIngestTimer(wxTimerEvent& evt);
+    void OnAnalysisTimer(wxTimerEvent& evt);
     void OnClearFiles(wxCommandEvent& evt);
     void OnOrganize(wxCommandEvent& evt);
+    void OnDiskUsage(wxCommandEvent& evt);
+    void OnUsageBack(wxCommandEvent& evt);
     void OnExportPlan(wxCommandEvent& evt);
+    void OnApplyPlan(wxCommandEvent& evt);
+    void OnUndoApply(wxCommandEvent& evt);
+    void OnApplyTimer(wxTimerEvent& evt);
     void OnStrategyChanged(wxCommandEvent& evt);
+    void OnThenByChanged(wxCommandEvent& evt);
+    void ReadThenBy();
+    void OnParallelToggled(wxCommandEvent& evt);
+    void OnWatchToggled(wxCommandEvent& evt);
+    void OnLimitsEntered(wxCommandEvent& evt);
+    void OnSaveTrace(wxCommandEvent& evt);
+    void OnLoadRules(wxCommandEvent& evt);
+    void OnTraceTimer(wxTimerEvent& evt);
 
     wxDECLARE_EVENT_TABLE();
 };
 
 enum {
     ID_BTN_SETTINGS = wxID_HIGHEST + 1,
+    ID_TXT_FILTER,
     ID_BTN_SELECT_FILES,
+    ID_BTN_SCAN_FOLDER,
     ID_BTN_CLEAR_FILES,
+    ID_BTN_CANCEL_INGEST,
     ID_BTN_ORGANIZE,
+    ID_BTN_DISK_USAGE,
+    ID_BTN_USAGE_BACK,
     ID_BTN_EXPORT_PLAN,
-    ID_STRATEGY_RADIO
+    ID_BTN_APPLY_PLAN,
+    ID_BTN_UNDO_APPLY,
+    ID_BTN_SAVE_TRACE,
+    ID_BTN_LOAD_RULES,
+    ID_STRATEGY_RADIO,
+    ID_CHOICE_THEN_BY,
+    ID_CHOICE_THEN_BY_LAST = ID_CHOICE_THEN_BY + static_cast<int>(kMaxPlanLevels) - 2,
+    ID_CHOICE_GROUP_SORT,
+    ID_CHK_PARALLEL,
+    ID_CHK_WATCH,
+    ID_TXT_SIZE_LIMITS,
+    ID_TXT_AGE_LIMITS,
+    ID_TIMER_INGEST,
+    ID_TIMER_ANALYSIS,
+    ID_TIMER_APPLY,
+    ID_TIMER_TRACE
 };
 
 wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
     EVT_BUTTON(ID_BTN_SETTINGS,      MainFrame::OnToggleSettings)
+    EVT_TEXT(ID_TXT_FILTER,          MainFrame::OnFilterText)
+    EVT_SEARCHCTRL_CANCEL_BTN(ID_TXT_FILTER, MainFrame::OnFilterCancel)
     EVT_BUTTON(ID_BTN_SELECT_FILES,  MainFrame::OnSelectFiles)
+    EVT_BUTTON(ID_BTN_SCAN_FOLDER,   MainFrame::OnScanFolder)
     EVT_BUTTON(ID_BTN_CLEAR_FILES,   MainFrame::OnClearFiles)
+    EVT_BUTTON(ID_BTN_CANCEL_INGEST, MainFrame::OnCancelIngest)
     EVT_BUTTON(ID_BTN_ORGANIZE,      MainFrame::OnOrganize)
+    EVT_BUTTON(ID_BTN_DISK_USAGE,    MainFrame::OnDiskUsage)
+    EVT_BUTTON(ID_BTN_USAGE_BACK,    MainFrame::OnUsageBack)
     EVT_BUTTON(ID_BTN_EXPORT_PLAN,   MainFrame::OnExportPlan)
+    EVT_BUTTON(ID_BTN_APPLY_PLAN,    MainFrame::OnApplyPlan)
+    EVT_BUTTON(ID_BTN_UNDO_APPLY,    MainFrame::OnUndoApply)
+    EVT_BUTTON(ID_BTN_SAVE_TRACE,    MainFrame::OnSaveTrace)
+    EVT_BUTTON(ID_BTN_LOAD_RULES,    MainFrame::OnLoadRules)
     EVT_RADIOBOX(ID_STRATEGY_RADIO,  MainFrame::OnStrategyChanged)
+    EVT_COMMAND_RANGE(ID_CHOICE_THEN_BY, ID_CHOICE_THEN_BY_LAST, wxEVT_CHOICE, MainFrame::OnThenByChanged)
+    EVT_CHOICE(ID_CHOICE_GROUP_SORT, MainFrame::OnGroupSortChanged)
+    EVT_CHECKBOX(ID_CHK_PARALLEL,    MainFrame::OnParallelToggled)
+    EVT_CHECKBOX(ID_CHK_WATCH,       MainFrame::OnWatchToggled)
+    EVT_TEXT_ENTER(ID_TXT_SIZE_LIMITS, MainFrame::OnLimitsEntered)
+    EVT_TEXT_ENTER(ID_TXT_AGE_LIMITS,  MainFrame::OnLimitsEntered)
+    EVT_TIMER(ID_TIMER_INGEST,       MainFrame::OnIngestTimer)
+    EVT_TIMER(ID_TIMER_ANALYSIS,     MainFrame::OnAnalysisTimer)
+    EVT_TIMER(ID_TIMER_APPLY,        MainFrame::OnApplyTimer)
+    EVT_TIMER(ID_TIMER_TRACE,        MainFrame::OnTraceTimer)
 wxEND_EVENT_TABLE()
 
 class MedamaApp : public wxApp {
 public:
     bool OnInit() override {
+        SetAppName("medama");
+
         if (!wxApp::OnInit())
             return false;
 
+        // "Similar Images" decodes every format wxWidgets knows
+        wxInitAllImageHandlers();
+
         MainFrame* frame = new MainFrame();
         frame->Show(true);
         return true;
@@ -118,15 +431,100 @@ public:
 
 wxIMPLEMENT_APP(MedamaApp);
 
+// ------------------- SelectedFilesList implementation -------------------
+
+SelectedFilesList::SelectedFilesList(wxWindow* parent, const std::vector<FileInfo>& files)
+    : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+                 wxLC_REPORT | wxLC_SINGLE_SEL | wxLC_VIRTUAL)
+    , m_files(files)
+{
+    InsertColumn(0, "Name", wxLIST_FORMAT_LEFT, 400);
+    InsertColumn(1, "Size", wxLIST_FORMAT_LEFT, 120);
+    InsertColumn(2, "Modified", wxLIST_FORMAT_LEFT, 200);
+
+    Bind(wxEVT_LIST_CACHE_HINT, &SelectedFilesList::OnCacheHint, this);
+}
+
+void SelectedFilesList::RefreshFromModel()
+{
+    m_cache.clear();
+    m_cacheFrom = 0;
+
+    SetItemCount(static_cast<long>(RowCount()));
+    Refresh();
+}
+
+void SelectedFilesList::OnCacheHint(wxListEvent& evt)
+{
+    long from = evt.GetCacheFrom();
+    long to = std::min<long>(evt.GetCacheTo(), static_cast<long>(RowCount()) - 1);
+    if (from < 0 || to < from)
+        return;
+
+    // Already covered by the current window, e.g. a repaint without scrolling
+    long cachedTo = m_cacheFrom + static_cast<long>(m_cache.size()) - 1;
+    if (from >= m_cacheFrom && to <= cachedTo)
+        return;
+
+    m_cacheFrom = from;
+    m_cache.resize(static_cast<size_t>(to - from + 1));
+    for (long i = from; i <= to; ++i) {
+        const FileInfo& f = FileAt(i);
+        CachedRow& row = m_cache[static_cast<size_t>(i - from)];
+        row.size = FormatFileSize(f.size);
+        row.modified = f.modified.FormatISOCombined(' ');
+    }
+}
+
+wxString SelectedFilesList::OnGetItemText(long item, long column) const
+{
+    if (item < 0 || static_cast<size_t>(item) >= RowCount())
+        return wxEmptyString;
+
+    const FileInfo& f = FileAt(item);
+    if (column == 0)
+        return f.Name();
+
+    const CachedRow* row = nullptr;
+    if (item >= m_cacheFrom && static_cast<size_t>(item - m_cacheFrom) < m_cache.size())
+        row = &m_cache[static_cast<size_t>(item - m_cacheFrom)];
+
+    switch (column) {
+    case 1: return row ? row->size : FormatFileSize(f.size);
+    case 2: return row ? row->modified : f.modified.FormatISOCombined(' ');
+    }
+    return wxEmptyString;
+}
+
 // ---------------------- MainFrame implementation ----------------------
 
 MainFrame::MainFrame()
     : wxFrame(nullptr, wxID_ANY, "Medama - Intelligent Directory Organizer",
               wxDefaultPosition, wxSize(900, 600))
+    , m_ingestTimer(this, ID_TIMER_INGEST)
+    , m_analysisTimer(this, ID_TIMER_ANALYSIS)
+    , m_applyTimer(this, ID_TIMER_APPLY)
+    , m_traceTimer(this, ID_TIMER_TRACE)
 {
     SetBackgroundColour(wxColour(15, 15, 30));
+    LoadExtensionMappings();
+    LoadDefaultRules();
     BuildUI();
+    CreateStatusBar();
     Centre();
+
+    m_traceTimer.Start(1000);
+}
+
+MainFrame::~MainFrame()
+{
+    // Join the background workers while the frame can still receive CallAfter
+    m_watcher.Stop();
+    m_ingest.reset();
+    m_sniffer.reset();
+    m_duplicates.reset();
+    m_similar.reset();
+    m_apply.reset();
 }
 
 void MainFrame::BuildUI()
@@ -176,6 +574,13 @@ void MainFrame::BuildHeader(wxBoxSizer* rootSizer)
 
     sizer->Add(leftSizer, 1, wxALL | wxEXPAND, 10);
 
+    // Name filter for both file views
+    m_filterBox = new wxSearchCtrl(m_headerPanel, ID_TXT_FILTER, wxEmptyString,
+                                   wxDefaultPosition, wxSize(FromDIP(260), -1));
+    m_filterBox->SetDescriptiveText("Filter by name");
+    m_filterBox->ShowCancelButton(true);
+    sizer->Add(m_filterBox, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+
     // Right: Settings button
     auto* btnSettings = new wxButton(m_headerPanel, ID_BTN_SETTINGS, "Settings");
     sizer->Add(btnSettings, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
@@ -211,7 +616,11 @@ void MainFrame::BuildSettings(wxBoxSizer* rootSizer)
         "By File Type",
         "By Date Modified",
         "By File Size",
-        "By Extension"
+        "By Extension",
+        "By Real Type",
+        "Find Duplicates",
+        "By Rules",
+        "Similar Images"
     };
 
     m_strategyRadio = new wxRadioBox(
@@ -223,6 +632,71 @@ void MainFrame::BuildSettings(wxBoxSizer* rootSizer)
 
     sizer->Add(m_strategyRadio, 0, wxALL, 10);
 
+    // Further levels nest folders inside the strategy's, e.g. type, then date
+    auto* thenSizer = new wxBoxSizer(wxHORIZONTAL);
+    for (size_t k = 0; k < WXSIZEOF(m_thenByChoices); ++k) {
+        auto* thenLabel = new wxStaticText(m_settingsPanel, wxID_ANY, k == 0 ? "Then" : "then");
+        thenLabel->SetForegroundColour(wxColour(200, 200, 255));
+
+        m_thenByChoices[k] = new wxChoice(m_settingsPanel, ID_CHOICE_THEN_BY + static_cast<int>(k));
+        m_thenByChoices[k]->Append("(nothing)");
+        for (const wxString& choice : choices)
+            m_thenByChoices[k]->Append(choice);
+        m_thenByChoices[k]->SetSelection(0);
+
+        thenSizer->Add(thenLabel, 0, wxRIGHT | wxALIGN_CENTER_VERTICAL, 5);
+        thenSizer->Add(m_thenByChoices[k], 0, wxRIGHT | wxALIGN_CENTER_VERTICAL, 10);
+    }
+
+    sizer->Add(thenSizer, 0, wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+    m_parallelCheck = new wxCheckBox(m_settingsPanel, ID_CHK_PARALLEL, "Organize on all CPU cores");
+    m_parallelCheck->SetForegroundColour(wxColour(200, 200, 255));
+    m_parallelCheck->SetValue(m_parallelOrganize);
+
+    sizer->Add(m_parallelCheck, 0, wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+    m_watchCheck = new wxCheckBox(m_settingsPanel, ID_CHK_WATCH, "Keep a scanned folder organized as it changes");
+    m_watchCheck->SetForegroundColour(wxColour(200, 200, 255));
+    m_watchCheck->SetValue(m_watchEnabled);
+
+    sizer->Add(m_watchCheck, 0, wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+    // Bucket limits of "By File Size" and "By Date Modified", applied on Enter
+    auto* limitsSizer = new wxFlexGridSizer(2, 5, 8);
+    limitsSizer->AddGrowableCol(1);
+
+    auto* sizeLabel = new wxStaticText(m_settingsPanel, wxID_ANY, "Size buckets");
+    sizeLabel->SetForegroundColour(wxColour(200, 200, 255));
+    m_sizeLimitsText = new wxTextCtrl(m_settingsPanel, ID_TXT_SIZE_LIMITS,
+                                      wxString::FromUTF8(FormatSizeLimits(m_organizer.SizeBuckets().limits)),
+                                      wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
+    m_sizeLimitsText->SetToolTip("Sizes where a new bucket starts, e.g. 100K, 1M, 1.5G");
+
+    auto* ageLabel = new wxStaticText(m_settingsPanel, wxID_ANY, "Date buckets");
+    ageLabel->SetForegroundColour(wxColour(200, 200, 255));
+    m_ageLimitsText = new wxTextCtrl(m_settingsPanel, ID_TXT_AGE_LIMITS,
+                                     wxString::FromUTF8(FormatAgeLimits(m_organizer.AgeBuckets().limits)),
+                                     wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
+    m_ageLimitsText->SetToolTip("Ages where a new bucket starts, in days or with h, w, m or y, e.g. 1, 2w, 3m, 1y");
+
+    limitsSizer->Add(sizeLabel, 0, wxALIGN_CENTER_VERTICAL);
+    limitsSizer->Add(m_sizeLimitsText, 1, wxEXPAND);
+    limitsSizer->Add(ageLabel, 0, wxALIGN_CENTER_VERTICAL);
+    limitsSizer->Add(m_ageLimitsText, 1, wxEXPAND);
+
+    sizer->Add(limitsSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+    // Rules of "By Rules", see rules.h
+    auto* btnRules = new wxButton(m_settingsPanel, ID_BTN_LOAD_RULES, "Load Rules…");
+    btnRules->SetToolTip("Organize by a rules file, e.g. \"name *.log & age > 30d -> Archive/Logs\" lines");
+    sizer->Add(btnRules, 0, wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
+    // Phase timings of this session for bug reports, see trace.h
+    auto* btnTrace = new wxButton(m_settingsPanel, ID_BTN_SAVE_TRACE, "Save Trace…");
+    btnTrace->SetToolTip("Write the recent phase timings as a Chrome trace (chrome://tracing, Perfetto)");
+    sizer->Add(btnTrace, 0, wxLEFT | wxRIGHT | wxBOTTOM, 10);
+
     m_settingsPanel->SetSizer(sizer);
 
     m_settingsVisible = false;
@@ -252,17 +726,24 @@ void MainFrame::BuildPages(wxBoxSizer* rootSizer)
 
         auto* desc = new wxStaticText(
             m_pageWelcome, wxID_ANY,
-            "Choose multiple files and Medama will intelligently organize them for you."
+            "Choose multiple files or a whole folder and Medama will intelligently organize them for you."
         );
         desc->SetForegroundColour(wxColour(180, 140, 255));
         desc->SetFont(wxFontInfo(10));
         sizer->Add(desc, 0, wxALIGN_CENTER_HORIZONTAL | wxTOP | wxLEFT | wxRIGHT, 10);
 
+        auto* buttonSizer = new wxBoxSizer(wxHORIZONTAL);
         auto* btnSelect = new wxButton(
             m_pageWelcome, ID_BTN_SELECT_FILES,
             "Choose Files..."
         );
-        sizer->Add(btnSelect, 0, wxALIGN_CENTER_HORIZONTAL | wxTOP, 30);
+        auto* btnScan = new wxButton(
+            m_pageWelcome, ID_BTN_SCAN_FOLDER,
+            "Scan Folder..."
+        );
+        buttonSizer->Add(btnSelect, 0, wxRIGHT, 5);
+        buttonSizer->Add(btnScan, 0, wxLEFT, 5);
+        sizer->Add(buttonSizer, 0, wxALIGN_CENTER_HORIZONTAL | wxTOP, 30);
 
         m_pageWelcome->SetSizer(sizer);
     }
@@ -280,20 +761,35 @@ void MainFrame::BuildPages(wxBoxSizer* rootSizer)
         headerSizer->Add(title, 1, wxALIGN_CENTER_VERTICAL);
 
         auto* btnClear = new wxButton(m_pageSelected, ID_BTN_CLEAR_FILES, "Clear");
+        auto* btnUsage = new wxButton(m_pageSelected, ID_BTN_DISK_USAGE, "Disk Usage");
         auto* btnOrganize = new wxButton(m_pageSelected, ID_BTN_ORGANIZE, "Organize");
         headerSizer->Add(btnClear, 0, wxLEFT, 5);
+        headerSizer->Add(btnUsage, 0, wxLEFT, 5);
         headerSizer->Add(btnOrganize, 0, wxLEFT, 5);
 
         sizer->Add(headerSizer, 0, wxALL | wxEXPAND, 10);
 
-        m_selectedList = new wxListCtrl(
-            m_pageSelected, wxID_ANY, wxDefaultPosition, wxDefaultSize,
-            wxLC_REPORT | wxLC_SINGLE_SEL
-        );
+        // Ingest progress: gauge and Cancel are only shown while a job runs
+        m_ingestSizer = new wxBoxSizer(wxHORIZONTAL);
 
-        m_selectedList->InsertColumn(0, "Name", wxLIST_FORMAT_LEFT, 400);
-        m_selectedList->InsertColumn(1, "Size", wxLIST_FORMAT_LEFT, 120);
-        m_selectedList->InsertColumn(2, "Modified", wxLIST_FORMAT_LEFT, 200);
+        m_ingestGauge = new wxGauge(m_pageSelected, wxID_ANY, 1000,
+                                    wxDefaultPosition, wxSize(200, -1),
+                                    wxGA_HORIZONTAL | wxGA_SMOOTH);
+        m_ingestStatus = new wxStaticText(m_pageSelected, wxID_ANY, "");
+        m_ingestStatus->SetForegroundColour(wxColour(180, 140, 255));
+        m_ingestStatus->SetFont(wxFontInfo(10));
+        m_ingestCancel = new wxButton(m_pageSelected, ID_BTN_CANCEL_INGEST, "Cancel");
+
+        m_ingestSizer->Add(m_ingestGauge, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+        m_ingestSizer->Add(m_ingestStatus, 1, wxALIGN_CENTER_VERTICAL);
+        m_ingestSizer->Add(m_ingestCancel, 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 5);
+        m_ingestSizer->Show(m_ingestGauge, false);
+        m_ingestSizer->Show(m_ingestCancel, false);
+
+        sizer->Add(m_ingestSizer, 0, wxLEFT | wxRIGHT | wxEXPAND, 10);
+
+        m_selectedList = new SelectedFilesList(m_pageSelected, m_files);
+        m_selectedList->Bind(wxEVT_LIST_COL_CLICK, &MainFrame::OnListColumnClick, this);
 
         sizer->Add(m_selectedList, 1, wxALL | wxEXPAND, 10);
 
@@ -314,27 +810,76 @@ void MainFrame::BuildPages(wxBoxSizer* rootSizer)
 
         headerSizer->Add(m_organizedSummary, 1, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
 
+        // Order of the files inside each category, see kGroupSorts
+        wxString sortChoices[] = {
+            "Original order",
+            "Name (A–Z)",
+            "Name (Z–A)",
+            "Smallest first",
+            "Largest first",
+            "Oldest first",
+            "Newest first"
+        };
+        m_groupSortChoice = new wxChoice(m_pageOrganized, ID_CHOICE_GROUP_SORT,
+                                         wxDefaultPosition, wxDefaultSize,
+                                         WXSIZEOF(sortChoices), sortChoices);
+        m_groupSortChoice->SetSelection(0);
+        m_groupSortChoice->SetToolTip("Order of the files inside each category");
+        headerSizer->Add(m_groupSortChoice, 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 5);
+
+        m_applyButton = new wxButton(m_pageOrganized, ID_BTN_APPLY_PLAN, "Apply Plan…");
+        auto* btnUndo = new wxButton(m_pageOrganized, ID_BTN_UNDO_APPLY, "Undo Apply…");
         auto* btnExport = new wxButton(m_pageOrganized, ID_BTN_EXPORT_PLAN, "Export Plan");
+        auto* btnUsage = new wxButton(m_pageOrganized, ID_BTN_DISK_USAGE, "Disk Usage");
         auto* btnNew = new wxButton(m_pageOrganized, ID_BTN_CLEAR_FILES, "New Organization");
+        headerSizer->Add(m_applyButton, 0, wxLEFT, 5);
+        headerSizer->Add(btnUndo, 0, wxLEFT, 5);
         headerSizer->Add(btnExport, 0, wxLEFT, 5);
+        headerSizer->Add(btnUsage, 0, wxLEFT, 5);
         headerSizer->Add(btnNew, 0, wxLEFT, 5);
 
         vbox->Add(headerSizer, 0, wxALL | wxEXPAND, 10);
 
-        m_organizedScroll = new wxScrolledWindow(m_pageOrganized, wxID_ANY,
-                                                 wxDefaultPosition, wxDefaultSize,
-                                                 wxVSCROLL);
-        m_organizedScroll->SetScrollRate(0, 10);
-        m_organizedScroll->SetBackgroundColour(wxColour(10, 10, 25));
+        m_applyStatus = new wxStaticText(m_pageOrganized, wxID_ANY, "");
+        m_applyStatus->SetForegroundColour(wxColour(200, 200, 255));
+        vbox->Add(m_applyStatus, 0, wxLEFT | wxRIGHT | wxEXPAND, 10);
+
+        m_organizedView = new OrganizedView(m_pageOrganized);
 
-        vbox->Add(m_organizedScroll, 1, wxALL | wxEXPAND, 10);
+        vbox->Add(m_organizedView, 1, wxALL | wxEXPAND, 10);
 
         m_pageOrganized->SetSizer(vbox);
     }
 
+    // Page 3: Disk usage treemap
+    m_pageUsage = new wxPanel(m_book);
+    {
+        m_pageUsage->SetBackgroundColour(wxColour(15, 15, 30));
+        auto* vbox = new wxBoxSizer(wxVERTICAL);
+
+        auto* headerSizer = new wxBoxSizer(wxHORIZONTAL);
+
+        m_usageSummary = new wxStaticText(m_pageUsage, wxID_ANY, "");
+        m_usageSummary->SetForegroundColour(wxColour(180, 140, 255));
+        m_usageSummary->SetFont(wxFontInfo(10));
+        headerSizer->Add(m_usageSummary, 1, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+
+        auto* btnBack = new wxButton(m_pageUsage, ID_BTN_USAGE_BACK, "Back");
+        headerSizer->Add(btnBack, 0, wxLEFT, 5);
+
+        vbox->Add(headerSizer, 0, wxALL | wxEXPAND, 10);
+
+        m_treemap = new TreemapView(m_pageUsage);
+
+        vbox->Add(m_treemap, 1, wxALL | wxEXPAND, 10);
+
+        m_pageUsage->SetSizer(vbox);
+    }
+
     m_book->AddPage(m_pageWelcome, "Welcome");
     m_book->AddPage(m_pageSelected, "Selected");
     m_book->AddPage(m_pageOrganized, "Organized");
+    m_book->AddPage(m_pageUsage, "Usage");
 
     m_book->SetSelection(0);
 
@@ -343,149 +888,292 @@ void MainFrame::BuildPages(wxBoxSizer* rootSizer)
 
 // -------------------- Helper logic (ported from React) --------------------
 
-wxString MainFrame::FormatFileSize(wxULongLong bytes) const
+void MainFrame::LoadExtensionMappings()
 {
-    double b = static_cast<double>(bytes.GetValue());
+    // Optional "ext[, ext...] = Category" overrides, e.g. ~/.medama/extensions.conf
+    wxFileName fn(wxStandardPaths::Get().GetUserDataDir(), "extensions.conf");
+    if (fn.FileExists())
+        m_classifier.LoadMappings(fn.GetFullPath(), m_categories);
+}
 
-    if (b < 1024.0)
-        return wxString::Format("%.0f B", b);
-    if (b < 1024.0 * 1024.0)
-        return wxString::Format("%.1f KB", b / 1024.0);
-    if (b < 1024.0 * 1024.0 * 1024.0)
-        return wxString::Format("%.1f MB", b / (1024.0 * 1024.0));
-    return wxString::Format("%.1f GB", b / (1024.0 * 1024.0 * 1024.0));
+void MainFrame::LoadDefaultRules()
+{
+    // Optional rules for "By Rules", e.g. ~/.medama/rules.conf. Reported
+    // once the window is up, as a mistake there is easy to overlook.
+    wxFileName fn(wxStandardPaths::Get().GetUserDataDir(), "rules.conf");
+    if (fn.FileExists())
+        CallAfter([this, path = fn.GetFullPath()]() { LoadRules(path); });
 }
 
-wxString MainFrame::GetSizeCategory(wxULongLong bytes) const
+bool MainFrame::LoadRules(const wxString& path)
 {
-    double b = static_cast<double>(bytes.GetValue());
+    RuleSet rules;
+    std::string error;
+    if (!rules.Load(path, m_categories, error)) {
+        wxMessageBox(wxString::FromUTF8(error), "Medama: " + wxFileName(path).GetFullName(),
+                     wxOK | wxICON_WARNING, this);
+        return false;
+    }
 
-    if (b < 1024.0 * 100.0)              return "Tiny (< 100KB)";
-    if (b < 1024.0 * 1024.0)             return "Small (< 1MB)";
-    if (b < 1024.0 * 1024.0 * 10.0)      return "Medium (< 10MB)";
-    if (b < 1024.0 * 1024.0 * 100.0)     return "Large (< 100MB)";
-    return "Very Large (> 100MB)";
+    m_organizer.SetRules(std::move(rules));
+    m_organizer.ApplyRules(m_files, m_keys, m_parallelOrganize);
+    return true;
 }
 
-wxString MainFrame::GetDateCategory(const wxDateTime& dt) const
-{
-    wxDateTime now = wxDateTime::Now();
-    wxTimeSpan diff = now - dt;
-    long diffDays = diff.GetDays();
+// ----------------------------- UI updates -----------------------------
 
-    if (diffDays == 0)         return "Today";
-    if (diffDays == 1)         return "Yesterday";
-    if (diffDays < 7)          return "This Week";
-    if (diffDays < 30)         return "This Month";
-    if (diffDays < 90)         return "Last 3 Months";
-    if (diffDays < 365)        return "This Year";
-    return "Older";
+void MainFrame::RebuildSelectedList()
+{
+    // Files that arrived since the last call are merged into the sorted
+    // order; clearing m_listOrder first sorts from scratch
+    if (m_listSort.IsSorted()) {
+        PrepareSort(m_listSort);
+        AppendSorted(m_listOrder, m_files.size(), m_listSort, m_nameKeys, m_keys, m_parallelOrganize);
+    }
+    UpdateListRows();
+    m_selectedList->RefreshFromModel();
 }
 
-wxString MainFrame::GetCategoryForFile(const FileInfo& file) const
+void MainFrame::UpdateListRows()
 {
-    wxString ext = wxFileName(file.name).GetExt().Lower();
+    if (!IsFiltering()) {
+        m_selectedList->SetRows(m_listSort.IsSorted() ? &m_listOrder : nullptr);
+        return;
+    }
+    if (!m_listSort.IsSorted()) {
+        m_selectedList->SetRows(&m_filterMatches);
+        return;
+    }
 
-    // Images
-    if (ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "gif" ||
-        ext == "bmp" || ext == "svg"  || ext == "webp" || ext == "ico")
-        return "Images";
+    // The sorted order, minus the files that do not match
+    m_listRows.clear();
+    m_listRows.reserve(m_filterMatches.size());
+    for (FileIndex i : m_listOrder) {
+        if (i < m_filterMask.size() && m_filterMask[i])
+            m_listRows.push_back(i);
+    }
+    m_selectedList->SetRows(&m_listRows);
+}
 
-    // Audio
-    if (ext == "mp3" || ext == "wav" || ext == "flac" || ext == "aac" ||
-        ext == "m4a" || ext == "ogg" || ext == "wma")
-        return "Audio";
+void MainFrame::PrepareSort(SortOrder order)
+{
+    if (order.column == SortColumn::Name)
+        m_nameKeys.Extend(m_files, m_parallelOrganize);
+}
 
-    // Video
-    if (ext == "mp4" || ext == "avi" || ext == "mkv" || ext == "mov" ||
-        ext == "wmv" || ext == "flv" || ext == "webm" || ext == "mpeg")
-        return "Videos";
+void MainFrame::SortGroups(std::span<const CategoryId> categories)
+{
+    PrepareSort(m_groupSort);
+    SortWithinCategories(m_grouping, categories, m_groupSort, m_nameKeys, m_keys, m_parallelOrganize);
+}
 
-    // Code
-    if (ext == "js" || ext == "jsx" || ext == "ts"   || ext == "tsx" ||
-        ext == "py" || ext == "java"|| ext == "cpp" || ext == "c"   ||
-        ext == "h"  || ext == "cs"  || ext == "php" || ext == "rb"  ||
-        ext == "go" || ext == "rs"  || ext == "swift" ||
-        ext == "html" || ext == "css" || ext == "json" || ext == "xml")
-        return "Code";
+void MainFrame::RebuildOrganizedView()
+{
+    OrderGroups();
+    RefreshShownGroups();
 
-    // Archives
-    if (ext == "zip" || ext == "rar" || ext == "7z" || ext == "tar" ||
-        ext == "gz"  || ext == "bz2" || ext == "xz")
-        return "Archives";
+    m_organizedView->SetModel(this);
+}
 
-    // Documents
-    if (ext == "txt" || ext == "doc" || ext == "docx" || ext == "pdf" ||
-        ext == "rtf" || ext == "odt" || ext == "pages")
-        return "Documents";
+void MainFrame::OrderGroups()
+{
+    if (IsNested())
+        m_groupOrder = m_organizer.SortedLeaves(m_plan, m_grouping);
+    else
+        m_groupOrder = m_organizer.SortedCategories(m_grouping);
+}
 
-    // Spreadsheets
-    if (ext == "xls" || ext == "xlsx" || ext == "csv" || ext == "ods" || ext == "numbers")
-        return "Spreadsheets";
+void MainFrame::RefreshShownGroups()
+{
+    if (IsFiltering())
+        FilterGroups();
+
+    // Headings total only what is shown
+    if (IsNested())
+        m_outline.Build(m_plan, ShownGrouping(), ShownGroups(), m_keys.sizes);
+    else
+        m_outline.Clear();
+}
 
-    // Presentations
-    if (ext == "ppt" || ext == "pptx" || ext == "odp" || ext == "key")
-        return "Presentations";
+bool MainFrame::Shows(Strategy strategy) const
+{
+    return m_strategy == strategy || std::find(m_thenBy.begin(), m_thenBy.end(), strategy) != m_thenBy.end();
+}
 
-    return "Other";
+std::vector<Strategy> MainFrame::PlanLevels() const
+{
+    std::vector<Strategy> levels{m_strategy};
+    levels.insert(levels.end(), m_thenBy.begin(), m_thenBy.end());
+    return levels;
 }
 
-// ----------------------------- UI updates -----------------------------
+wxString MainFrame::PlanName() const
+{
+    wxString name = StrategyName(m_strategy);
+    for (Strategy level : m_thenBy)
+        name += wxString(" → ") + StrategyName(level);
+    return name;
+}
 
-void MainFrame::RebuildSelectedList()
+void MainFrame::FilterGroups()
 {
-    m_selectedList->DeleteAllItems();
+    // Same categories and in-category order as m_grouping; the order array
+    // is laid out by category ID, so this is one pass over it
+    const size_t categories = m_grouping.CategoryCount();
+    m_filteredGrouping.order.clear();
+    m_filteredGrouping.offsets.assign(categories + 1, 0);
+    for (size_t c = 0; c < categories; ++c) {
+        for (FileIndex i : m_grouping.Files(static_cast<CategoryId>(c))) {
+            if (i < m_filterMask.size() && m_filterMask[i])
+                m_filteredGrouping.order.push_back(i);
+        }
+        m_filteredGrouping.offsets[c + 1] = static_cast<uint32_t>(m_filteredGrouping.order.size());
+    }
 
-    for (size_t i = 0; i < m_files.size(); ++i) {
-        const FileInfo& f = m_files[i];
-        long index = m_selectedList->InsertItem(i, f.name);
-        m_selectedList->SetItem(index, 1, FormatFileSize(f.size));
-        m_selectedList->SetItem(index, 2, f.modified.FormatISOCombined(' '));
+    m_filteredOrder.clear();
+    for (CategoryId c : m_groupOrder) {
+        if (m_filteredGrouping.GroupSize(c) > 0)
+            m_filteredOrder.push_back(c);
     }
 }
 
-void MainFrame::RebuildOrganizedView()
+size_t MainFrame::GetGroupCount() const
+{
+    return ShownGroups().size();
+}
+
+size_t MainFrame::GetGroupItemCount(size_t group) const
+{
+    return ShownGrouping().GroupSize(ShownGroups()[group]);
+}
+
+wxString MainFrame::GetGroupLabel(size_t group) const
 {
-    m_organizedScroll->DestroyChildren();
+    CategoryId id = ShownGroups()[group];
+    return m_categories.Label(IsNested() ? m_plan.Category(id, m_plan.Levels() - 1) : id);
+}
 
-    auto* vbox = new wxBoxSizer(wxVERTICAL);
+wxString MainFrame::GetItemName(size_t group, size_t item) const
+{
+    return m_files[ShownGrouping().Files(ShownGroups()[group])[item]].Name();
+}
 
-    // Sort categories alphabetically
-    std::vector<wxString> keys;
-    keys.reserve(m_organized.size());
-    for (const auto& kv : m_organized)
-        keys.push_back(kv.first);
-    std::sort(keys.begin(), keys.end());
+wxString MainFrame::GetItemDetail(size_t group, size_t item) const
+{
+    return FormatFileSize(m_files[ShownGrouping().Files(ShownGroups()[group])[item]].size);
+}
 
-    for (const wxString& key : keys) {
-        const auto& files = m_organized[key];
+// A flat plan is a list of groups; a nested one shows m_outline
 
-        auto* box = new wxStaticBox(m_organizedScroll, wxID_ANY,
-                                    wxString::Format("%s (%zu files)", key, files.size()));
-        box->SetForegroundColour(*wxWHITE);
-        auto* boxSizer = new wxStaticBoxSizer(box, wxVERTICAL);
+size_t MainFrame::GetNodeCount() const
+{
+    return IsNested() ? m_outline.nodes.size() : GetGroupCount();
+}
 
-        for (const auto& f : files) {
-            auto* row = new wxBoxSizer(wxHORIZONTAL);
+size_t MainFrame::GetRootCount() const
+{
+    return IsNested() ? m_outline.roots : GetGroupCount();
+}
 
-            auto* nameText = new wxStaticText(box, wxID_ANY, f.name);
-            nameText->SetForegroundColour(*wxWHITE);
+size_t MainFrame::GetFirstChild(size_t node) const
+{
+    return IsNested() ? m_outline.nodes[node].firstChild : 0;
+}
 
-            auto* sizeText = new wxStaticText(box, wxID_ANY, FormatFileSize(f.size));
-            sizeText->SetForegroundColour(wxColour(180, 140, 255));
+size_t MainFrame::GetChildCount(size_t node) const
+{
+    return IsNested() ? m_outline.nodes[node].childCount : 0;
+}
 
-            row->Add(nameText, 1, wxRIGHT, 10);
-            row->Add(sizeText, 0);
+size_t MainFrame::GetNodeGroup(size_t node) const
+{
+    if (!IsNested())
+        return node;
+    uint32_t group = m_outline.nodes[node].group;
+    return group == PlanOutline::kNoGroup ? SIZE_MAX : group;
+}
 
-            boxSizer->Add(row, 0, wxTOP | wxBOTTOM | wxEXPAND, 2);
-        }
+wxString MainFrame::GetNodeLabel(size_t node) const
+{
+    return IsNested() ? m_categories.Label(m_outline.nodes[node].category) : GetGroupLabel(node);
+}
+
+size_t MainFrame::GetNodeFileCount(size_t node) const
+{
+    return IsNested() ? m_outline.nodes[node].files : GetGroupItemCount(node);
+}
+
+wxString MainFrame::GetNodeDetail(size_t node) const
+{
+    return IsNested() ? FormatFileSize(m_outline.nodes[node].bytes) : wxString();
+}
+
+// ------------------------------ Name filter ------------------------------
+
+void MainFrame::OnFilterText(wxCommandEvent& WXUNUSED(evt))
+{
+    ApplyFilterText();
+}
+
+void MainFrame::OnFilterCancel(wxCommandEvent& WXUNUSED(evt))
+{
+    m_filterBox->ChangeValue(wxEmptyString);
+    ApplyFilterText();
+}
+
+void MainFrame::ApplyFilterText()
+{
+    std::string needle = FoldForSearch(m_filterBox->GetValue());
+    if (needle == m_filterNeedle)
+        return;
+
+    if (needle.empty()) {
+        m_filterNeedle.clear();
+        SetFilterMatches({});
+    } else if (IsFiltering() && needle.find(m_filterNeedle) != std::string::npos &&
+               m_filterCovered == m_nameIndex.size()) {
+        // Typing on only narrows the previous matches
+        m_filterNeedle = std::move(needle);
+        SetFilterMatches(m_nameIndex.Refine(m_filterMatches, m_filterNeedle));
+    } else {
+        m_filterNeedle = std::move(needle);
+        SetFilterMatches(m_nameIndex.Find(m_filterNeedle, m_parallelOrganize));
+    }
 
-        vbox->Add(boxSizer, 0, wxALL | wxEXPAND, 5);
+    RebuildSelectedList();
+    if (!m_grouping.empty()) {
+        RefreshShownGroups();
+        m_organizedView->SetModel(this);
+        UpdateOrganizedSummary();
     }
+}
+
+void MainFrame::SetFilterMatches(std::vector<FileIndex> matches)
+{
+    m_filterMatches = std::move(matches);
+    m_filterCovered = IsFiltering() ? m_nameIndex.size() : 0;
+    m_filterMask.assign(m_filterCovered, 0);
+    for (FileIndex i : m_filterMatches)
+        m_filterMask[i] = 1;
+}
+
+void MainFrame::ExtendFilterMatches()
+{
+    if (!IsFiltering())
+        return;
 
-    m_organizedScroll->SetSizer(vbox);
-    vbox->FitInside(m_organizedScroll);
-    m_organizedScroll->Layout();
+    size_t first = m_filterMatches.size();
+    m_nameIndex.AppendMatches(m_filterMatches, m_filterCovered, m_filterNeedle, m_parallelOrganize);
+    m_filterCovered = m_nameIndex.size();
+    m_filterMask.resize(m_filterCovered, 0);
+    for (size_t k = first; k < m_filterMatches.size(); ++k)
+        m_filterMask[m_filterMatches[k]] = 1;
+}
+
+void MainFrame::RefreshFilter()
+{
+    if (IsFiltering())
+        SetFilterMatches(m_nameIndex.Find(m_filterNeedle, m_parallelOrganize));
 }
 
 // ----------------------------- Events --------------------------------
@@ -512,37 +1200,371 @@ void MainFrame::OnSelectFiles(wxCommandEvent& WXUNUSED(evt))
     wxArrayString paths;
     dlg.GetPaths(paths);
 
+    StartIngest(std::make_unique<FileListIngester>(paths), false);
+}
+
+void MainFrame::OnScanFolder(wxCommandEvent& WXUNUSED(evt))
+{
+    wxDirDialog dlg(this, "Select folder to scan", wxEmptyString,
+                    wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+
+    if (dlg.ShowModal() != wxID_OK)
+        return;
+
+    StartFolderScan(dlg.GetPath());
+}
+
+void MainFrame::StartFolderScan(const wxString& root)
+{
+    // The previous scan may still be reading the index
+    ResetFiles();
+
+    auto scanner = std::make_unique<DirectoryScanner>(root, 0, &m_index);
+    wxFileName indexFile(wxStandardPaths::Get().GetUserLocalDataDir(), IndexFileName(root));
+    indexFile.AppendDir("index");
+    m_indexFile = indexFile.GetFullPath();
+    m_indexRoot = scanner->Root();
+    m_index.Open(m_indexFile, m_indexRoot);
+
+    StartIngest(std::move(scanner), true);
+}
+
+void MainFrame::ResetFiles()
+{
+    m_scannedDirs.clear();
+    UpdateWatching();
+    StopIngest();
+    StopSniffing();
+    StopDuplicateSearch();
+    StopSimilarSearch();
+
+    if (m_organizedView)
+        m_organizedView->SetModel(nullptr);
+    if (m_treemap)
+        m_treemap->SetUsage(nullptr, nullptr);
+    m_usage.Clear();
+
+    // A running Apply carries on, but its results no longer map onto m_files
+    m_applyFiles.clear();
+    m_appliedFrom.clear();
+
     m_files.clear();
-    m_organized.clear();
+    m_facts.clear();
+    m_keys.Clear();
+
+    // Every job that adds paths has been joined, and no FileInfo is left
+    PathStore::Get().Clear();
+    m_nameKeys.Clear();
+    m_listOrder.clear();
+    m_nameIndex.Clear();
+    SetFilterMatches({});
+    m_listRows.clear();
+    m_filteredGrouping.Clear();
+    m_filteredOrder.clear();
+    m_grouping.Clear();
+    m_groupOrder.clear();
+    m_plan.Clear();
+    m_outline.Clear();
+
+    // The status bar sums up the phases of the new file set only
+    Trace::Get().ResetTotals();
 
-    for (unsigned i = 0; i < paths.size(); ++i) {
-        FileInfo fi;
-        fi.path = paths[i];
-        wxFileName fn(paths[i]);
-        fi.name = fn.GetFullName();
-        fi.size = fn.GetSize();
+    if (m_selectedList)
+        m_selectedList->RefreshFromModel();
+}
+
+void MainFrame::StartIngest(std::unique_ptr<IngestJob> job, bool scansFolder)
+{
+    ResetFiles();
+    m_book->SetSelection(1); // Selected files page
 
-        wxDateTime atime, mtime, ctime;
-        fn.GetTimes(&atime, &mtime, &ctime);
-        fi.modified = mtime.IsValid() ? mtime : wxDateTime::Now();
+    // Batches are posted to the GUI thread as they fill up. The vector is
+    // moved into a shared_ptr because CallAfter copies its functor.
+    unsigned generation = ++m_ingestGeneration;
+    m_ingest = std::move(job);
+    m_ingestScansFolder = scansFolder;
+    m_ingest->Start(
+        [this, generation](std::vector<FileInfo>&& batch) {
+            auto shared = std::make_shared<std::vector<FileInfo>>(std::move(batch));
+            CallAfter([this, generation, shared]() { OnIngestBatch(generation, *shared); });
+        },
+        [this, generation](bool cancelled) {
+            CallAfter([this, generation, cancelled]() { OnIngestFinished(generation, cancelled); });
+        });
+
+    m_ingestGauge->SetValue(0);
+    m_ingestSizer->Show(m_ingestGauge, true);
+    m_ingestSizer->Show(m_ingestCancel, true);
+    m_pageSelected->Layout();
+
+    UpdateIngestStatus(false);
+    m_ingestTimer.Start(250);
+}
 
-        m_files.push_back(fi);
+void MainFrame::StopIngest()
+{
+    ++m_ingestGeneration;
+    m_ingestTimer.Stop();
+    m_ingest.reset();   // cancels and joins the workers
+
+    if (m_ingestSizer) {
+        m_ingestSizer->Show(m_ingestGauge, false);
+        m_ingestSizer->Show(m_ingestCancel, false);
+        m_ingestStatus->SetLabel("");
+        m_pageSelected->Layout();
     }
+}
 
+void MainFrame::OnIngestBatch(unsigned generation, std::vector<FileInfo>& batch)
+{
+    if (generation != m_ingestGeneration)
+        return;
+
+    for (const FileInfo& f : batch)
+        m_facts.push_back(f.indexRecord != kNoIndexRecord ? m_index.Facts(f.indexRecord) : ContentFacts());
+    m_files.insert(m_files.end(),
+                   std::make_move_iterator(batch.begin()),
+                   std::make_move_iterator(batch.end()));
+    m_organizer.ComputeKeys(m_files, m_keys, m_parallelOrganize);
+    m_nameIndex.Extend(m_files);
+    ExtendFilterMatches();
     RebuildSelectedList();
-    m_book->SetSelection(1); // Selected files page
 }
 
-void MainFrame::OnClearFiles(wxCommandEvent& WXUNUSED(evt))
+void MainFrame::OnIngestFinished(unsigned generation, bool cancelled)
 {
-    m_files.clear();
-    m_organized.clear();
+    if (generation != m_ingestGeneration)
+        return;
 
-    if (m_selectedList)
-        m_selectedList->DeleteAllItems();
+    m_ingestTimer.Stop();
+    UpdateIngestStatus(true, cancelled);
+
+    m_ingestSizer->Show(m_ingestGauge, false);
+    m_ingestSizer->Show(m_ingestCancel, false);
+    m_pageSelected->Layout();
+
+    if (m_ingestScansFolder && !cancelled) {
+        m_scannedDirs = static_cast<DirectoryScanner&>(*m_ingest).TakeDirectories();
+        SaveIndex();
+        UpdateWatching();
+    }
+    RefreshDiskUsage();
+}
 
-    if (m_organizedScroll)
-        m_organizedScroll->DestroyChildren();
+void MainFrame::SaveIndex()
+{
+    if (m_scannedDirs.empty())
+        return;
+
+    // Not being able to write it only costs the next scan its head start
+    wxFileName::Mkdir(wxFileName(m_indexFile).GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    WriteMetadataIndex(m_indexFile, m_indexRoot, m_scannedDirs, m_files, m_facts);
+}
+
+// ------------------------------ Watch mode ------------------------------
+
+void MainFrame::UpdateWatching()
+{
+    // Only a finished folder scan can be followed, and not while an Apply
+    // is moving its files around
+    bool wanted = m_watchEnabled && !m_scannedDirs.empty() && !m_apply;
+    if (wanted == m_watcher.IsRunning())
+        return;
+
+    ++m_watchGeneration;
+    m_watcher.Stop();
+    m_pathIndex.clear();
+
+    if (wanted) {
+        // Files an Apply moved out of the scanned directories are followed too
+        std::vector<ScannedDirectory> dirs = m_scannedDirs;
+        std::unordered_set<std::string> known;
+        for (const ScannedDirectory& dir : dirs)
+            known.insert(dir.path);
+
+        m_pathIndex.reserve(m_files.size());
+        for (size_t i = 0; i < m_files.size(); ++i) {
+            std::string path = m_files[i].NativePath();
+            std::string dir = path.substr(0, std::max<size_t>(path.rfind('/'), 1));
+            if (known.insert(dir).second)
+                dirs.push_back({dir});
+            m_pathIndex.emplace(std::move(path), i);
+        }
+
+        unsigned generation = m_watchGeneration;
+        bool started = m_watcher.Start(dirs, [this, generation](std::vector<WatchChange>&& changes) {
+            auto shared = std::make_shared<std::vector<WatchChange>>(std::move(changes));
+            CallAfter([this, generation, shared]() { OnWatchChanges(generation, *shared); });
+        });
+        if (!started)
+            m_pathIndex.clear();
+    }
+
+    if (!m_grouping.empty())
+        UpdateOrganizedSummary();
+}
+
+void MainFrame::OnWatchChanges(unsigned generation, std::vector<WatchChange>& changes)
+{
+    if (generation != m_watchGeneration || changes.empty())
+        return;
+
+    // Events were lost; a rescan is cheap with the index
+    if (changes.front().kind == WatchChange::Kind::Overflow) {
+        StartFolderScan(FromFileSystem(m_indexRoot));
+        return;
+    }
+
+    // ----- Sort the batch into removed, rewritten and new files -----
+    std::vector<FileIndex> removed;
+    std::vector<std::pair<FileIndex, FileInfo>> modified;
+    std::vector<FileInfo> added;
+
+    for (WatchChange& change : changes) {
+        if (change.kind == WatchChange::Kind::RemovedTree) {
+            const std::string& dir = change.path;
+            for (auto it = m_pathIndex.begin(); it != m_pathIndex.end();) {
+                const std::string& path = it->first;
+                if (path.size() > dir.size() && path.starts_with(dir) && path[dir.size()] == '/') {
+                    removed.push_back(it->second);
+                    it = m_pathIndex.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            continue;
+        }
+
+        auto it = m_pathIndex.find(change.path);
+        if (change.kind == WatchChange::Kind::Removed) {
+            if (it != m_pathIndex.end()) {
+                removed.push_back(it->second);
+                m_pathIndex.erase(it);
+            }
+        } else if (change.kind == WatchChange::Kind::Changed) {
+            if (it == m_pathIndex.end()) {
+                added.push_back(std::move(change.info));
+            } else {
+                const FileInfo& f = m_files[it->second];
+                if (f.size != change.info.size || f.modified != change.info.modified)
+                    modified.emplace_back(it->second, std::move(change.info));
+            }
+        }
+    }
+
+    if (removed.empty() && modified.empty() && added.empty())
+        return;
+
+    // The analysis jobs work on file indices, which are about to shift
+    StopSniffing();
+    StopDuplicateSearch();
+    StopSimilarSearch();
+
+    // ----- Rewritten files: new metadata, contents unknown again -----
+    std::vector<FileIndex> changed;
+    if (!modified.empty()) {
+        changed.reserve(modified.size());
+        for (auto& [i, info] : modified) {
+            m_files[i] = std::move(info);
+            m_facts[i] = ContentFacts();
+            changed.push_back(i);
+        }
+        m_organizer.UpdateKeys(m_files, m_keys, changed);
+    }
+
+    // ----- Removed files: compact every per-file vector -----
+    std::vector<FileIndex> remap;
+    if (!removed.empty()) {
+        remap.assign(m_files.size(), 0);
+        for (FileIndex i : removed)
+            remap[i] = kRemovedFile;
+        FileIndex next = 0;
+        for (FileIndex& r : remap)
+            r = r == kRemovedFile ? kRemovedFile : next++;
+
+        CompactByRemap(m_files, remap);
+        CompactByRemap(m_facts, remap);
+        Organizer::RemoveKeys(m_keys, remap);
+        m_nameKeys.Remove(remap);
+        m_nameIndex.Remove(remap);
+
+        std::erase_if(changed, [&remap](FileIndex& i) {
+            i = remap[i];
+            return i == kRemovedFile;
+        });
+
+        for (auto& [path, i] : m_pathIndex)
+            i = remap[i];
+        std::erase_if(m_appliedFrom, [&remap](AppliedMove& move) {
+            move.file = remap[move.file];
+            return move.file == kRemovedFile;
+        });
+    }
+
+    // ----- New files: appended like an ingest batch -----
+    for (FileInfo& f : added) {
+        m_pathIndex.emplace(f.NativePath(), m_files.size());
+        m_facts.push_back(ContentFacts());
+        m_files.push_back(std::move(f));
+    }
+    m_organizer.ComputeKeys(m_files, m_keys, m_parallelOrganize);
+    m_nameIndex.Extend(m_files);
+    RefreshFilter();
+
+    // Removed and rewritten files break the sorted order, so sort afresh
+    m_listOrder.clear();
+    RebuildSelectedList();
+    if (!m_grouping.empty())
+        RefreshGrouping(remap, changed);
+    RefreshDiskUsage();
+}
+
+void MainFrame::OnCancelIngest(wxCommandEvent& WXUNUSED(evt))
+{
+    // Keep what has arrived so far; OnIngestFinished reports the outcome
+    if (m_ingest)
+        m_ingest->Cancel();
+}
+
+void MainFrame::OnIngestTimer(wxTimerEvent& WXUNUSED(evt))
+{
+    UpdateIngestStatus(false);
+}
+
+void MainFrame::UpdateIngestStatus(bool finished, bool cancelled)
+{
+    if (!m_ingest)
+        return;
+
+    IngestJob::Progress p = m_ingest->GetProgress();
+
+    if (p.total > 0)
+        m_ingestGauge->SetValue(static_cast<int>(p.Processed() * 1000 / p.total));
+    else if (!finished)
+        m_ingestGauge->Pulse();
+
+    const char* state = cancelled ? "Cancelled after"
+                      : finished  ? (m_ingestScansFolder ? "Scanned" : "Loaded")
+                                  : (m_ingestScansFolder ? "Scanning…" : "Loading…");
+
+    wxString text = wxString::Format("%s %llu", state, static_cast<unsigned long long>(p.files));
+    if (p.total > 0)
+        text += wxString::Format(" of %llu", static_cast<unsigned long long>(p.total));
+    text += " files";
+    if (m_ingestScansFolder)
+        text += wxString::Format(" in %llu folders", static_cast<unsigned long long>(p.directories));
+    text += wxString::Format(" (%s) • %.0f entries/s", FormatFileSize(p.bytes), p.EntriesPerSecond());
+    if (p.reused)
+        text += wxString::Format(" • %llu unchanged since the last scan", static_cast<unsigned long long>(p.reused));
+    if (p.errors)
+        text += wxString::Format(" • %llu unreadable", static_cast<unsigned long long>(p.errors));
+
+    m_ingestStatus->SetLabel(text);
+}
+
+void MainFrame::OnClearFiles(wxCommandEvent& WXUNUSED(evt))
+{
+    ResetFiles();
 
     m_organizedSummary->SetLabel("");
     m_book->SetSelection(0); // Back to welcome
@@ -553,108 +1575,673 @@ void MainFrame::OnOrganize(wxCommandEvent& WXUNUSED(evt))
     if (m_files.empty())
         return;
 
-    m_organized.clear();
-
-    for (const auto& f : m_files) {
-        wxString category;
-
-        switch (m_strategy) {
-        case Strategy::ByType:
-            category = GetCategoryForFile(f);
-            break;
-        case Strategy::ByDate:
-            category = GetDateCategory(f.modified);
-            break;
-        case Strategy::BySize:
-            category = GetSizeCategory(f.size);
-            break;
-        case Strategy::ByExtension: {
-            wxString ext = wxFileName(f.name).GetExt().Lower();
-            if (!ext.IsEmpty())
-                category = "." + ext;
+    // Every run buckets dates against its own reading of the clock
+    m_organizer.Rebucket(m_keys, m_parallelOrganize);
+    Regroup();
+    m_book->SetSelection(2); // Organized page
+}
+
+void MainFrame::OnDiskUsage(wxCommandEvent& WXUNUSED(evt))
+{
+    if (m_files.empty())
+        return;
+
+    m_book->SetSelection(3); // Disk usage page
+    RefreshDiskUsage();
+}
+
+void MainFrame::OnUsageBack(wxCommandEvent& WXUNUSED(evt))
+{
+    m_book->SetSelection(m_grouping.empty() ? 1 : 2);
+}
+
+void MainFrame::RefreshDiskUsage()
+{
+    // Only kept current while on display; the button builds it afresh
+    if (m_book->GetSelection() != 3)
+        return;
+
+    wxBusyCursor busy;
+    wxStopWatch timer;
+
+    // Files are coloured by their category under the current strategy
+    const auto& column = m_keys.Column(m_strategy);
+    m_usage.Build(m_files, column, m_categories.size(), m_parallelOrganize);
+    m_treemap->SetUsage(&m_usage, &m_categories);
+
+    // The three categories that take the most space
+    std::vector<CategoryId> largest;
+    for (size_t c = 0; c < m_usage.CategoryBytes().size(); ++c) {
+        if (m_usage.CategoryBytes()[c] > 0)
+            largest.push_back(static_cast<CategoryId>(c));
+    }
+    size_t shown = std::min<size_t>(3, largest.size());
+    std::partial_sort(largest.begin(), largest.begin() + shown, largest.end(), [this](CategoryId a, CategoryId b) {
+        return m_usage.CategoryBytes()[a] > m_usage.CategoryBytes()[b];
+    });
+
+    wxString text = wxString::Format("%s in %llu files (%s) • totalled in %ld ms",
+                                     FormatFileSize(m_usage.TotalBytes()),
+                                     static_cast<unsigned long long>(m_usage.TotalFiles()),
+                                     StrategyName(m_strategy), timer.Time());
+    for (size_t k = 0; k < shown; ++k)
+        text += wxString::Format(" • %s %s", m_categories.Label(largest[k]),
+                                 FormatFileSize(m_usage.CategoryBytes()[largest[k]]));
+    m_usageSummary->SetLabel(text);
+}
+
+void MainFrame::Regroup()
+{
+    m_organizedView->SetModel(nullptr);
+
+    // Only groups a precomputed column, see StrategyKeys
+    wxStopWatch timer;
+    if (IsNested()) {
+        std::vector<Strategy> levels = PlanLevels();
+        m_plan.SetLevels(levels.size());
+        m_organizer.GroupPlan(m_keys, levels, m_plan, m_grouping, m_parallelOrganize);
+    } else {
+        m_organizer.Group(m_keys, m_strategy, m_grouping, m_parallelOrganize);
+    }
+    if (m_groupSort.IsSorted())
+        SortGroups(m_grouping.NonEmptyCategories());
+    m_groupMs = timer.Time();
+
+    RebuildOrganizedView();
+    StartAnalysis();
+    UpdateOrganizedSummary();
+}
+
+void MainFrame::RefreshGrouping(std::span<const FileIndex> remap, std::span<const FileIndex> rewritten)
+{
+    wxStopWatch timer;
+
+    // A nested plan keeps its leaves, so its leaf column updates the same way
+    std::vector<CategoryId> leaves;
+    if (IsNested())
+        m_organizer.AssignLeaves(m_keys, PlanLevels(), m_plan, leaves, m_parallelOrganize);
+    std::span<const CategoryId> column = IsNested() ? std::span<const CategoryId>(leaves)
+                                                    : m_keys.Column(m_strategy);
+    size_t count = IsNested() ? m_plan.LeafCount() : m_categories.size();
+    std::vector<CategoryId> affected = UpdateGrouping(m_grouping, column, remap, count);
+
+    // Rewritten files show a new size and may sort elsewhere in their category
+    if (!rewritten.empty()) {
+        for (FileIndex i : rewritten)
+            affected.push_back(column[i]);
+        std::sort(affected.begin(), affected.end());
+        affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+    }
+    if (m_groupSort.IsSorted())
+        SortGroups(affected);
+
+    std::vector<CategoryId> oldOrder = std::move(m_groupOrder);
+    OrderGroups();
+    m_groupMs = timer.Time();
+
+    // Filtered groups come and go with their matches, and nested ones can
+    // bring new headings; lay them out afresh
+    if (IsFiltering() || IsNested()) {
+        RefreshShownGroups();
+        m_organizedView->ModelChanged();
+        StartAnalysis();
+        UpdateOrganizedSummary();
+        return;
+    }
+
+    // Where each group was, and which ones gained or lost files
+    std::vector<size_t> oldPosition(count, SIZE_MAX);
+    for (size_t g = 0; g < oldOrder.size(); ++g)
+        oldPosition[oldOrder[g]] = g;
+
+    std::vector<size_t> previous(m_groupOrder.size());
+    std::vector<size_t> changed;
+    for (size_t g = 0; g < m_groupOrder.size(); ++g) {
+        previous[g] = oldPosition[m_groupOrder[g]];
+        if (std::binary_search(affected.begin(), affected.end(), m_groupOrder[g]))
+            changed.push_back(g);
+    }
+    m_organizedView->GroupsChanged(previous, changed);
+
+    StartAnalysis();
+    UpdateOrganizedSummary();
+}
+
+void MainFrame::StartAnalysis()
+{
+    // Until the contents have been read, files sit in their by-name category
+    if (Shows(Strategy::ByRealType))
+        StartSniffing();
+    if (Shows(Strategy::ByDuplicates))
+        StartDuplicateSearch();
+    if (Shows(Strategy::BySimilarImages))
+        StartSimilarSearch();
+}
+
+void MainFrame::UpdateOrganizedSummary()
+{
+    wxString text = wxString::Format("%zu categories • %zu files organized (%s) in %ld ms, %s",
+                                     m_groupOrder.size(), m_grouping.FileCount(), PlanName(),
+                                     m_groupMs, m_parallelOrganize ? "parallel" : "serial");
+
+    if (m_sniffer && Shows(Strategy::ByRealType)) {
+        ContentSniffer::Progress p = m_sniffer->GetProgress();
+        text += wxString::Format(" • checking contents %llu of %llu…",
+                                 static_cast<unsigned long long>(p.done),
+                                 static_cast<unsigned long long>(p.files));
+    }
+
+    if (Shows(Strategy::ByDuplicates)) {
+        if (m_duplicates) {
+            DuplicateFinder::Progress p = m_duplicates->GetProgress();
+            text += wxString::Format(" • hashing, stage %u of 3: %llu of %llu files (%s read)…",
+                                     p.stage,
+                                     static_cast<unsigned long long>(p.done),
+                                     static_cast<unsigned long long>(p.total),
+                                     FormatFileSize(p.bytes));
+        } else if (m_keys.deduplicated > 0) {
+            text += " • " + FormatFileSize(m_duplicateBytes) + " reclaimable";
+        }
+    }
+
+    if (Shows(Strategy::BySimilarImages)) {
+        if (m_similar) {
+            SimilarImageFinder::Progress p = m_similar->GetProgress();
+            if (p.clustering)
+                text += " • grouping similar images…";
             else
-                category = "No Extension";
-            break;
+                text += wxString::Format(" • comparing images: %llu of %llu (%llu decoded)…",
+                                         static_cast<unsigned long long>(p.done),
+                                         static_cast<unsigned long long>(p.total),
+                                         static_cast<unsigned long long>(p.decoded));
+        } else if (m_keys.compared > 0) {
+            text += wxString::Format(" • %llu similar images",
+                                     static_cast<unsigned long long>(m_similarImages));
         }
+    }
+
+    if (IsFiltering())
+        text += wxString::Format(" • %zu matching \"%s\"", m_filteredGrouping.FileCount(), m_filterBox->GetValue());
+
+    if (m_watcher.IsRunning())
+        text += wxString::Format(" • watching %zu folders", m_watcher.WatchCount());
+
+    m_organizedSummary->SetLabel(text);
+}
+
+// --------------------------- Content sniffing ---------------------------
+
+void MainFrame::StartSniffing()
+{
+    if (m_sniffer || m_keys.sniffed >= m_files.size())
+        return;
+
+    // The job gets its own copy of the paths, since ingestion may still be
+    // appending to (and reallocating) m_files while it runs.
+    m_sniffBegin = m_keys.sniffed;
+    const auto& byType = m_keys.Column(Strategy::ByType);
+
+    // Files sniffed in an earlier session get an empty path and their old result
+    std::vector<CategoryId> byName(byType.begin() + m_sniffBegin, byType.begin() + m_files.size());
+    std::vector<std::string> paths;
+    paths.reserve(m_files.size() - m_sniffBegin);
+    for (size_t i = m_sniffBegin; i < m_files.size(); ++i) {
+        bool known = m_facts[i].Sniffed(byType[i], byName[i - m_sniffBegin]);
+        paths.push_back(known ? std::string() : m_files[i].NativePath());
+    }
+
+    unsigned generation = ++m_sniffGeneration;
+    m_sniffer = std::make_unique<ContentSniffer>(std::move(paths), std::move(byName));
+    m_sniffer->Start([this, generation](bool cancelled) {
+        CallAfter([this, generation, cancelled]() { OnSniffFinished(generation, cancelled); });
+    });
+
+    m_analysisTimer.Start(250);
+}
+
+void MainFrame::StopSniffing()
+{
+    ++m_sniffGeneration;
+    m_sniffer.reset();   // cancels and joins the workers
+    if (!m_duplicates && !m_similar)
+        m_analysisTimer.Stop();
+}
+
+void MainFrame::OnSniffFinished(unsigned generation, bool cancelled)
+{
+    if (generation != m_sniffGeneration)
+        return;
+
+    if (!m_duplicates && !m_similar)
+        m_analysisTimer.Stop();
+
+    if (!cancelled) {
+        const auto& results = m_sniffer->Results();
+        const auto& byType = m_keys.Column(Strategy::ByType);
+        Organizer::SetSniffedCategories(m_keys, m_sniffBegin, results);
+        for (size_t k = 0; k < results.size(); ++k)
+            m_facts[m_sniffBegin + k].SetSniffed(results[k], byType[m_sniffBegin + k]);
+        SaveIndex();
+    }
+    m_sniffer.reset();
+
+    // Moves the files whose type changed and sniffs files that arrived meanwhile
+    if (!cancelled && Shows(Strategy::ByRealType) && !m_grouping.empty())
+        RefreshGrouping({});
+}
+
+// --------------------------- Duplicate search ---------------------------
+
+void MainFrame::StartDuplicateSearch()
+{
+    if (m_duplicates || m_keys.deduplicated >= m_files.size())
+        return;
+
+    // Duplicates span the whole list, so files that arrive later mean a new
+    // search rather than an incremental one. Paths are copied for the same
+    // reason as in StartSniffing().
+    std::vector<std::string> paths;
+    std::vector<uint64_t> sizes;
+    std::vector<uint64_t> known;
+    std::vector<int64_t> mtimes;
+    paths.reserve(m_files.size());
+    sizes.reserve(m_files.size());
+    known.reserve(m_files.size());
+    mtimes.reserve(m_files.size());
+    for (size_t i = 0; i < m_files.size(); ++i) {
+        paths.push_back(m_files[i].NativePath());
+        sizes.push_back(m_files[i].size.GetValue());
+        known.push_back(m_facts[i].contentHash);
+        mtimes.push_back(static_cast<int64_t>(m_files[i].modified.GetTicks()));
+    }
+
+    unsigned generation = ++m_duplicatesGeneration;
+    m_duplicates = std::make_unique<DuplicateFinder>(std::move(paths), std::move(sizes), std::move(known),
+                                                     std::move(mtimes));
+    m_duplicates->Start([this, generation](bool cancelled) {
+        CallAfter([this, generation, cancelled]() { OnDuplicatesFinished(generation, cancelled); });
+    });
+
+    m_analysisTimer.Start(250);
+}
+
+void MainFrame::StopDuplicateSearch()
+{
+    ++m_duplicatesGeneration;
+    m_duplicates.reset();   // cancels and joins the workers
+    if (!m_sniffer && !m_similar)
+        m_analysisTimer.Stop();
+}
+
+void MainFrame::OnDuplicatesFinished(unsigned generation, bool cancelled)
+{
+    if (generation != m_duplicatesGeneration)
+        return;
+
+    if (!m_sniffer && !m_similar)
+        m_analysisTimer.Stop();
+
+    if (!cancelled) {
+        m_duplicateBytes = m_organizer.SetDuplicateCategories(m_keys, *m_duplicates);
+        for (size_t i = 0; i < m_duplicates->FileCount(); ++i) {
+            if (uint64_t hash = m_duplicates->ContentHash(i))
+                m_facts[i].contentHash = hash;
         }
+        SaveIndex();
+    }
+    m_duplicates.reset();
+
+    // Shows the sets and searches again if files arrived meanwhile
+    if (!cancelled && Shows(Strategy::ByDuplicates) && !m_grouping.empty())
+        RefreshGrouping({});
+}
+
+// ------------------------ Similar image search --------------------------
+
+void MainFrame::StartSimilarSearch()
+{
+    if (m_similar || m_keys.compared >= m_files.size())
+        return;
 
-        m_organized[category].push_back(f);
+    // Without the cache every run decodes every image again, which is
+    // slower but still works
+    if (!m_thumbnails.IsOpen()) {
+        wxFileName cacheFile(wxStandardPaths::Get().GetUserLocalDataDir(), "thumbnails");
+        wxFileName::Mkdir(cacheFile.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+        m_thumbnails.Open(cacheFile.GetFullPath());
     }
 
-    wxString strategyText;
-    switch (m_strategy) {
-    case Strategy::ByType:      strategyText = "By File Type"; break;
-    case Strategy::ByDate:      strategyText = "By Date Modified"; break;
-    case Strategy::BySize:      strategyText = "By File Size"; break;
-    case Strategy::ByExtension: strategyText = "By Extension"; break;
+    // Only images are compared; everything else gets an empty path. Paths
+    // are copied for the same reason as in StartSniffing().
+    const auto& byType = m_keys.Column(Strategy::ByType);
+    std::vector<std::string> paths;
+    std::vector<ThumbnailKey> keys;
+    paths.reserve(m_files.size());
+    keys.reserve(m_files.size());
+    for (size_t i = 0; i < m_files.size(); ++i) {
+        bool image = byType[i] == Category::Images;
+        paths.push_back(image ? m_files[i].NativePath() : std::string());
+        keys.push_back(image ? ThumbnailKeyOf(m_files[i]) : ThumbnailKey());
     }
 
-    m_organizedSummary->SetLabel(
-        wxString::Format("%zu categories • %zu files organized (%s)",
-                         m_organized.size(), m_files.size(), strategyText)
-    );
+    // Runs on the finder's workers. JPEGs are decoded at a fraction of
+    // their size to begin with and other formats are shrunk as soon as they
+    // are loaded, so no full-size image outlives the call.
+    auto decode = [](const std::string& path, std::vector<uint8_t>& thumbnail) {
+        constexpr int kMaxSide = 256;
+        wxLogNull quiet;     // damaged images are simply left out
+        wxImage image;
+        image.SetOption(wxIMAGE_OPTION_MAX_WIDTH, kMaxSide);
+        image.SetOption(wxIMAGE_OPTION_MAX_HEIGHT, kMaxSide);
+        if (!image.LoadFile(FromFileSystem(path)) || !image.IsOk())
+            return false;
+        MakeThumbnail(image.GetData(), image.GetWidth(), image.GetHeight(), thumbnail);
+        return true;
+    };
 
-    RebuildOrganizedView();
-    m_book->SetSelection(2); // Organized page
+    unsigned generation = ++m_similarGeneration;
+    m_similar = std::make_unique<SimilarImageFinder>(std::move(paths), std::move(keys), decode,
+                                                     m_thumbnails.IsOpen() ? &m_thumbnails : nullptr);
+    m_similar->Start([this, generation](bool cancelled) {
+        CallAfter([this, generation, cancelled]() { OnSimilarFinished(generation, cancelled); });
+    });
+
+    m_analysisTimer.Start(250);
+}
+
+void MainFrame::StopSimilarSearch()
+{
+    ++m_similarGeneration;
+    m_similar.reset();   // cancels and joins the workers
+    if (!m_sniffer && !m_duplicates)
+        m_analysisTimer.Stop();
+}
+
+void MainFrame::OnSimilarFinished(unsigned generation, bool cancelled)
+{
+    if (generation != m_similarGeneration)
+        return;
+
+    if (!m_sniffer && !m_duplicates)
+        m_analysisTimer.Stop();
+
+    if (!cancelled)
+        m_similarImages = m_organizer.SetSimilarCategories(m_keys, *m_similar);
+    m_similar.reset();
+
+    // Shows the groups and searches again if files arrived meanwhile
+    if (!cancelled && Shows(Strategy::BySimilarImages) && !m_grouping.empty())
+        RefreshGrouping({});
+}
+
+void MainFrame::OnAnalysisTimer(wxTimerEvent& WXUNUSED(evt))
+{
+    UpdateOrganizedSummary();
 }
 
 void MainFrame::OnExportPlan(wxCommandEvent& WXUNUSED(evt))
 {
-    if (m_organized.empty())
+    if (m_grouping.empty())
         return;
 
     wxFileDialog dlg(
         this, "Save organization plan",
         wxEmptyString, "organization-plan.txt",
-        "Text files (*.txt)|*.txt|All files (*.*)|*.*",
+        "Text files (*.txt)|*.txt|JSON Lines (*.jsonl)|*.jsonl|CSV files (*.csv)|*.csv|"
+        "All files (*.*)|*.*",
         wxFD_SAVE | wxFD_OVERWRITE_PROMPT
     );
 
     if (dlg.ShowModal() != wxID_OK)
         return;
 
-    wxString filename = dlg.GetPath();
+    // The filter picks the format; "All files" goes by the extension
+    PlanFormat format = PlanFormat::Tree;
+    switch (dlg.GetFilterIndex()) {
+    case 1: format = PlanFormat::JsonLines; break;
+    case 2: format = PlanFormat::Csv; break;
+    case 3: format = PlanFormatFromFileName(dlg.GetPath()); break;
+    }
 
-    wxTextFile tf;
-    if (wxFileExists(filename)) {
-        tf.Open(filename);
-        tf.Clear();
+    wxBusyCursor busy;
+    wxString title = wxString::Format("Directory Organization Plan (%s)", PlanName());
+    bool ok;
+    if (IsNested()) {
+        // The whole plan, whatever the filter shows
+        PlanOutline outline;
+        outline.Build(m_plan, m_grouping, m_groupOrder, m_keys.sizes);
+        ok = m_planExporter.Export(dlg.GetPath(), format, title, m_files, m_grouping, m_plan, outline,
+                                   m_groupOrder, m_categories);
     } else {
-        tf.Create(filename);
+        ok = m_planExporter.Export(dlg.GetPath(), format, title, m_files, m_grouping, m_groupOrder,
+                                   m_categories);
     }
 
-    wxString strategyText;
-    switch (m_strategy) {
-    case Strategy::ByType:      strategyText = "By File Type"; break;
-    case Strategy::ByDate:      strategyText = "By Date Modified"; break;
-    case Strategy::BySize:      strategyText = "By File Size"; break;
-    case Strategy::ByExtension: strategyText = "By Extension"; break;
+    if (ok)
+        wxMessageBox("Organization plan exported successfully.", "Medama",
+                     wxOK | wxICON_INFORMATION, this);
+    else
+        wxMessageBox("The organization plan could not be written.", "Medama",
+                     wxOK | wxICON_ERROR, this);
+}
+
+// ------------------------------ Apply plan ------------------------------
+
+void MainFrame::OnApplyPlan(wxCommandEvent& WXUNUSED(evt))
+{
+    // The button doubles as Cancel while a run is in flight
+    if (m_apply) {
+        m_apply->Cancel();
+        return;
     }
+    if (m_grouping.empty())
+        return;
+    if (m_ingest && m_ingest->IsRunning()) {
+        wxMessageBox("Wait for the file list to finish loading first.", "Medama",
+                     wxOK | wxICON_INFORMATION, this);
+        return;
+    }
+
+    wxDirDialog dlg(this, "Choose where to create the category folders", m_applyRoot,
+                    wxDD_DEFAULT_STYLE);
+    if (dlg.ShowModal() != wxID_OK)
+        return;
 
-    tf.AddLine("Directory Organization Plan (" + strategyText + ")");
-    tf.AddLine(wxString('=', 60));
-    tf.AddLine("");
+    wxString root = dlg.GetPath();
+    ApplyPlanJob::JournalState journal = ApplyPlanJob::ReadJournalState(ToFileSystem(root));
+
+    if (journal.pending > 0) {
+        int answer = wxMessageBox(
+            wxString::Format("A previous run in this folder was interrupted with %zu of %zu moves "
+                             "left.\n\nYes: resume it\nNo: undo it\nCancel: do nothing",
+                             journal.pending, journal.planned),
+            "Medama", wxYES_NO | wxCANCEL | wxICON_QUESTION, this);
+        if (answer == wxYES)
+            StartApply(ApplyPlanJob::Mode::Resume, root);
+        else if (answer == wxNO)
+            StartApply(ApplyPlanJob::Mode::Undo, root);
+        return;
+    }
 
-    std::vector<wxString> keys;
-    keys.reserve(m_organized.size());
-    for (const auto& kv : m_organized)
-        keys.push_back(kv.first);
-    std::sort(keys.begin(), keys.end());
+    int answer = wxMessageBox(
+        wxString::Format("Move %zu files into %zu category folders in\n%s?",
+                         m_grouping.FileCount(), m_groupOrder.size(), root),
+        "Medama", wxYES_NO | wxICON_QUESTION, this);
+    if (answer == wxYES)
+        StartApply(ApplyPlanJob::Mode::Apply, root);
+}
 
-    for (const wxString& key : keys) {
-        const auto& files = m_organized[key];
-        tf.AddLine(wxString::Format("📁 %s/ (%zu files)", key, files.size()));
-        for (const auto& f : files) {
-            tf.AddLine("   └─ " + f.name + " (" + FormatFileSize(f.size) + ")");
+void MainFrame::OnUndoApply(wxCommandEvent& WXUNUSED(evt))
+{
+    if (m_apply)
+        return;
+
+    wxDirDialog dlg(this, "Choose the folder the plan was applied to", m_applyRoot,
+                    wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+    if (dlg.ShowModal() != wxID_OK)
+        return;
+
+    wxString root = dlg.GetPath();
+    ApplyPlanJob::JournalState journal = ApplyPlanJob::ReadJournalState(ToFileSystem(root));
+    if (journal.done == 0 && journal.pending == 0) {
+        wxMessageBox("There is nothing to undo in this folder.", "Medama",
+                     wxOK | wxICON_INFORMATION, this);
+        return;
+    }
+
+    int answer = wxMessageBox(
+        wxString::Format("Move %zu files back to where they came from?", journal.done),
+        "Medama", wxYES_NO | wxICON_QUESTION, this);
+    if (answer == wxYES)
+        StartApply(ApplyPlanJob::Mode::Undo, root);
+}
+
+void MainFrame::StartApply(ApplyPlanJob::Mode mode, const wxString& root)
+{
+    // The jobs below read files by path, which is about to change
+    StopSniffing();
+    StopDuplicateSearch();
+    StopSimilarSearch();
+
+    std::vector<PlannedMove> moves;
+    m_applyFiles.clear();
+
+    if (mode == ApplyPlanJob::Mode::Apply)
+        moves = IsNested() ? PlanMoves(m_files, m_grouping, m_plan, m_groupOrder, m_categories, &m_applyFiles)
+                           : PlanMoves(m_files, m_grouping, m_groupOrder, m_categories, &m_applyFiles);
+
+    unsigned generation = ++m_applyGeneration;
+    m_applyRoot = root;
+    m_apply = std::make_unique<ApplyPlanJob>(mode, ToFileSystem(root), std::move(moves));
+    m_apply->Start([this, generation](bool cancelled) {
+        CallAfter([this, generation, cancelled]() { OnApplyFinished(generation, cancelled); });
+    });
+    UpdateWatching();   // stops it; the moves are not changes to follow
+
+    m_applyButton->SetLabel("Cancel");
+    UpdateApplyStatus(false);
+    m_applyTimer.Start(250);
+}
+
+void MainFrame::OnApplyFinished(unsigned generation, bool WXUNUSED(cancelled))
+{
+    if (generation != m_applyGeneration)
+        return;
+
+    m_applyTimer.Stop();
+    m_applyButton->SetLabel("Apply Plan…");
+    UpdateApplyStatus(true);
+
+    if (!m_apply->Error().empty()) {
+        wxMessageBox(wxString::FromUTF8(m_apply->Error()), "Medama", wxOK | wxICON_ERROR, this);
+
+        // Files may still have moved before the journal failed
+        if (m_apply->Destinations().empty()) {
+            m_apply.reset();
+            UpdateWatching();
+            return;
+        }
+    }
+
+    ApplyPlanJob::Mode mode = m_apply->GetMode();
+    const auto& destinations = m_apply->Destinations();
+    const bool sameRun = m_applyRoot == m_appliedRoot && m_apply->RunId() == m_appliedRun &&
+                         !m_appliedRun.empty();
+
+    if (mode == ApplyPlanJob::Mode::Apply) {
+        // Point the moved files at their new location
+        m_appliedFrom.clear();
+        m_appliedRoot = m_applyRoot;
+        m_appliedRun = m_apply->RunId();
+        for (size_t k = 0; k < destinations.size() && k < m_applyFiles.size(); ++k) {
+            if (destinations[k].empty())
+                continue;
+            FileInfo& f = m_files[m_applyFiles[k]];
+            m_appliedFrom.push_back({k, m_applyFiles[k], f.dir, f.leaf});
+            f.SetPath(destinations[k]);
+        }
+    } else if (mode == ApplyPlanJob::Mode::Resume) {
+        // The run may be one this session never saw; its files are found
+        // by the paths they were moved from
+        if (!sameRun) {
+            m_appliedFrom.clear();
+            m_appliedRoot = m_applyRoot;
+            m_appliedRun = m_apply->RunId();
         }
-        tf.AddLine("");
+        const auto& sources = m_apply->Sources();
+        std::unordered_map<std::string_view, size_t> moved;
+        for (size_t k = 0; k < destinations.size(); ++k) {
+            if (!destinations[k].empty())
+                moved.emplace(sources[k], k);
+        }
+        for (FileIndex i = 0; i < m_files.size() && !moved.empty(); ++i) {
+            auto it = moved.find(m_files[i].NativePath());
+            if (it == moved.end())
+                continue;
+            FileInfo& f = m_files[i];
+            m_appliedFrom.push_back({it->second, i, f.dir, f.leaf});
+            f.SetPath(destinations[it->second]);
+            moved.erase(it);
+        }
+    } else if (mode == ApplyPlanJob::Mode::Undo && sameRun) {
+        // Only the files that came back get their old names, which are
+        // still in the PathStore; the rest stay where the run put them.
+        // An Undo of any other run leaves m_files alone.
+        std::erase_if(m_appliedFrom, [&](const AppliedMove& move) {
+            if (move.move >= destinations.size() || destinations[move.move].empty())
+                return false;
+            m_files[move.file].dir = move.dir;
+            m_files[move.file].leaf = move.leaf;
+            return true;
+        });
     }
 
-    tf.Write();
-    tf.Close();
+    m_apply.reset();
+
+    // Moved files can have new names, which re-sorts and re-filters them
+    m_nameKeys.Clear();
+    m_nameIndex.Clear();
+    m_nameIndex.Extend(m_files);
+    RefreshFilter();
+    m_listOrder.clear();
+    RebuildSelectedList();
+    if (m_groupSort.column == SortColumn::Name)
+        SortGroups(m_grouping.NonEmptyCategories());
+    RefreshShownGroups();
+    m_organizedView->ModelChanged();
+    RefreshDiskUsage();
+    UpdateWatching();
+}
+
+void MainFrame::UpdateApplyStatus(bool finished)
+{
+    if (!m_apply)
+        return;
 
-    wxMessageBox("Organization plan exported successfully.", "Medama",
-                 wxOK | wxICON_INFORMATION, this);
+    ApplyPlanJob::Progress p = m_apply->GetProgress();
+    bool undo = m_apply->GetMode() == ApplyPlanJob::Mode::Undo;
+
+    wxString text = finished ? (undo ? "Moved back" : "Moved") : (undo ? "Moving back…" : "Moving…");
+    text += wxString::Format(" %llu of %llu files",
+                             static_cast<unsigned long long>(p.renamed + p.copied),
+                             static_cast<unsigned long long>(p.files));
+    if (p.copied)
+        text += wxString::Format(" (%llu copied across filesystems, %s)",
+                                 static_cast<unsigned long long>(p.copied), FormatFileSize(p.bytesCopied));
+    text += wxString::Format(" • %.0f files/s", p.FilesPerSecond());
+    if (p.bytesCopied)
+        text += " • " + FormatFileSize(static_cast<wxULongLong_t>(p.BytesPerSecond())) + "/s";
+    if (p.skipped)
+        text += wxString::Format(" • %llu skipped", static_cast<unsigned long long>(p.skipped));
+    if (p.errors)
+        text += wxString::Format(" • %llu failed", static_cast<unsigned long long>(p.errors));
+
+    m_applyStatus->SetLabel(text);
+}
+
+void MainFrame::OnApplyTimer(wxTimerEvent& WXUNUSED(evt))
+{
+    UpdateApplyStatus(false);
 }
 
 void MainFrame::OnStrategyChanged(wxCommandEvent& evt)
@@ -666,5 +2253,181 @@ void MainFrame::OnStrategyChanged(wxCommandEvent& evt)
     case 1: m_strategy = Strategy::ByDate;      break;
     case 2: m_strategy = Strategy::BySize;      break;
     case 3: m_strategy = Strategy::ByExtension; break;
+    case 4: m_strategy = Strategy::ByRealType;  break;
+    case 5: m_strategy = Strategy::ByDuplicates; break;
+    case 6: m_strategy = Strategy::ByRules;     break;
+    case 7: m_strategy = Strategy::BySimilarImages; break;
+    }
+    ReadThenBy();
+
+    // Switching is cheap enough to apply right away
+    if (!m_grouping.empty() && !m_files.empty())
+        Regroup();
+}
+
+void MainFrame::OnThenByChanged(wxCommandEvent& WXUNUSED(evt))
+{
+    ReadThenBy();
+    if (!m_grouping.empty() && !m_files.empty())
+        Regroup();
+}
+
+void MainFrame::ReadThenBy()
+{
+    // Choice k is "(nothing)" followed by the strategies in enum order;
+    // repeating a level would only nest every folder in a copy of itself
+    m_thenBy.clear();
+    for (wxChoice* choice : m_thenByChoices) {
+        int sel = choice->GetSelection();
+        if (sel <= 0)
+            continue;
+        Strategy level = static_cast<Strategy>(sel - 1);
+        if (!Shows(level))
+            m_thenBy.push_back(level);
+    }
+}
+
+void MainFrame::OnListColumnClick(wxListEvent& evt)
+{
+    static const SortColumn kColumns[] = { SortColumn::Name, SortColumn::Size, SortColumn::Modified };
+
+    int col = evt.GetColumn();
+    if (col < 0 || col >= static_cast<int>(WXSIZEOF(kColumns)))
+        return;
+
+    // A second click on the header reverses the order, a third restores
+    // file-list order
+    SortColumn column = kColumns[col];
+    if (m_listSort.column != column)
+        m_listSort = {column, false};
+    else if (!m_listSort.descending)
+        m_listSort.descending = true;
+    else
+        m_listSort = {};
+
+    wxBusyCursor busy;
+    m_listOrder.clear();
+    RebuildSelectedList();
+
+    if (m_listSort.IsSorted())
+        m_selectedList->ShowSortIndicator(col, !m_listSort.descending);
+    else
+        m_selectedList->RemoveSortIndicator();
+}
+
+void MainFrame::OnGroupSortChanged(wxCommandEvent& evt)
+{
+    // In the order of the choices built in BuildPages()
+    static const SortOrder kGroupSorts[] = {
+        {SortColumn::None, false},
+        {SortColumn::Name, false},
+        {SortColumn::Name, true},
+        {SortColumn::Size, false},
+        {SortColumn::Size, true},
+        {SortColumn::Modified, false},
+        {SortColumn::Modified, true},
+    };
+
+    int sel = evt.GetSelection();
+    if (sel < 0 || sel >= static_cast<int>(WXSIZEOF(kGroupSorts)))
+        return;
+    m_groupSort = kGroupSorts[sel];
+
+    // Original order is a sort by file index, so it needs no regrouping either
+    if (!m_grouping.empty()) {
+        wxBusyCursor busy;
+        SortGroups(m_grouping.NonEmptyCategories());
+        RefreshShownGroups();
+        m_organizedView->ModelChanged();
+    }
+}
+
+void MainFrame::OnParallelToggled(wxCommandEvent& evt)
+{
+    m_parallelOrganize = evt.IsChecked();
+}
+
+void MainFrame::OnWatchToggled(wxCommandEvent& evt)
+{
+    m_watchEnabled = evt.IsChecked();
+    UpdateWatching();
+}
+
+void MainFrame::OnLimitsEntered(wxCommandEvent& evt)
+{
+    bool sizes = evt.GetId() == ID_TXT_SIZE_LIMITS;
+    wxTextCtrl* text = sizes ? m_sizeLimitsText : m_ageLimitsText;
+
+    std::vector<uint64_t> limits;
+    std::string value = text->GetValue().utf8_string();
+    if (!(sizes ? ParseSizeLimits(value, limits) : ParseAgeLimits(value, limits))) {
+        wxMessageBox(sizes ? "Enter the sizes where a new bucket starts, e.g. \"100K, 1M, 1.5G\"."
+                           : "Enter the ages where a new bucket starts, in days or with h, w, m or y, "
+                             "e.g. \"1, 2w, 3m, 1y\".",
+                     "Medama", wxOK | wxICON_WARNING, this);
+        return;
     }
+
+    if (sizes) {
+        m_organizer.SetSizeLimits(limits);
+        text->ChangeValue(wxString::FromUTF8(FormatSizeLimits(limits)));
+    } else {
+        m_organizer.SetAgeLimits(limits);
+        text->ChangeValue(wxString::FromUTF8(FormatAgeLimits(limits)));
+    }
+
+    // Only two kernel passes over the raw columns
+    m_organizer.Rebucket(m_keys, m_parallelOrganize);
+    if (!m_grouping.empty() && (Shows(Strategy::BySize) || Shows(Strategy::ByDate)))
+        Regroup();
+}
+
+void MainFrame::OnLoadRules(wxCommandEvent& WXUNUSED(evt))
+{
+    wxFileDialog dlg(
+        this, "Load rules",
+        wxStandardPaths::Get().GetUserDataDir(), "rules.conf",
+        "Rules files (*.conf;*.rules)|*.conf;*.rules|All files (*.*)|*.*",
+        wxFD_OPEN | wxFD_FILE_MUST_EXIST
+    );
+
+    if (dlg.ShowModal() != wxID_OK)
+        return;
+
+    wxBusyCursor busy;
+    if (!LoadRules(dlg.GetPath()))
+        return;
+
+    // Loading rules means organizing by them
+    m_strategyRadio->SetSelection(static_cast<int>(Strategy::ByRules));
+    m_strategy = Strategy::ByRules;
+    ReadThenBy();
+    if (!m_grouping.empty() && !m_files.empty())
+        Regroup();
+}
+
+void MainFrame::OnSaveTrace(wxCommandEvent& WXUNUSED(evt))
+{
+    wxFileDialog dlg(
+        this, "Save trace",
+        wxEmptyString, "medama-trace.json",
+        "Chrome trace files (*.json)|*.json|All files (*.*)|*.*",
+        wxFD_SAVE | wxFD_OVERWRITE_PROMPT
+    );
+
+    if (dlg.ShowModal() != wxID_OK)
+        return;
+
+    if (!Trace::Get().WriteChromeTrace(dlg.GetPath()))
+        wxMessageBox("The trace could not be written.", "Medama", wxOK | wxICON_ERROR, this);
+}
+
+void MainFrame::OnTraceTimer(wxTimerEvent& WXUNUSED(evt))
+{
+    uint64_t generation = Trace::Get().Generation();
+    if (generation == m_traceGeneration)
+        return;
+
+    m_traceGeneration = generation;
+    SetStatusText(Trace::Get().Summary());
 }
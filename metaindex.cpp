@@ -0,0 +1,394 @@
+// metaindex.cpp
+
+#include "metaindex.h"
+#include "duplicates.h"
+#include "ingest.h"
+#include "trace.h"
+
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(IndexHeader) == 40);
+static_assert(sizeof(IndexedDirectory) == 48);
+static_assert(sizeof(IndexedFile) == 56);
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'E', 'D', 'A', 'M', 'A', 'I', 'X'};
+
+// FNV-1a; unlike HashBytes() the same in every build, so index names are too
+uint64_t HashName(std::string_view s)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+bool Fits(uint64_t offset, uint64_t length, uint64_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+// Parent directory of a path, "/" for "/name"
+std::string_view ParentOf(std::string_view path)
+{
+    size_t slash = path.rfind('/');
+    if (slash == std::string_view::npos)
+        return {};
+    return slash == 0 ? path.substr(0, 1) : path.substr(0, slash);
+}
+
+} // namespace
+
+// ---------------------------- Content facts ----------------------------
+
+void ContentFacts::SetSniffed(CategoryId result, CategoryId byName)
+{
+    if (result == byName)
+        sniffed = kSniffedAsNamed;
+    else if (result < Category::BuiltinCount)
+        sniffed = result;
+    else
+        sniffed = kNotSniffed;   // sniffing only ever picks built-in types
+}
+
+bool ContentFacts::Sniffed(CategoryId byName, CategoryId& result) const
+{
+    if (sniffed == kSniffedAsNamed) {
+        result = byName;
+        return true;
+    }
+    if (sniffed >= Category::BuiltinCount)
+        return false;
+    result = sniffed;
+    return true;
+}
+
+// ------------------------------- Reading --------------------------------
+
+MetadataIndex::~MetadataIndex()
+{
+    Close();
+}
+
+void MetadataIndex::Close()
+{
+#ifdef __linux__
+    if (m_mapped)
+        ::munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+    m_mapped = false;
+    m_data = nullptr;
+    m_size = 0;
+    m_buffer.clear();
+    m_header = nullptr;
+    m_byPath.clear();
+    m_childBegin.clear();
+    m_children.clear();
+}
+
+bool MetadataIndex::Open(const wxString& filename, const std::string& root)
+{
+    Close();
+
+#ifdef __linux__
+    int fd = ::open(ToFileSystem(filename).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(IndexHeader))) {
+        void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            m_data = static_cast<const uint8_t*>(p);
+            m_size = static_cast<size_t>(st.st_size);
+            m_mapped = true;
+        }
+    }
+    ::close(fd);
+#else
+    wxFFile file(filename, "rb");
+    if (file.IsOpened()) {
+        wxFileOffset length = file.Length();
+        if (length >= static_cast<wxFileOffset>(sizeof(IndexHeader))) {
+            m_buffer.resize(static_cast<size_t>(length));
+            if (file.Read(m_buffer.data(), m_buffer.size()) == m_buffer.size()) {
+                m_data = m_buffer.data();
+                m_size = m_buffer.size();
+            }
+        }
+    }
+#endif
+    if (!m_data)
+        return false;
+
+    // ----- Validate everything up front, so lookups need no checks -----
+
+    const auto* header = reinterpret_cast<const IndexHeader*>(m_data);
+    uint64_t dirBytes = uint64_t(header->dirCount) * sizeof(IndexedDirectory);
+    uint64_t fileBytes = uint64_t(header->fileCount) * sizeof(IndexedFile);
+    uint64_t heapBegin = sizeof(IndexHeader) + dirBytes + fileBytes;
+
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+        header->version != kIndexVersion || header->byteOrder != kIndexByteOrder ||
+        header->dirCount == 0 || !Fits(heapBegin, header->heapSize, m_size)) {
+        Close();
+        return false;
+    }
+
+    m_dirs = reinterpret_cast<const IndexedDirectory*>(m_data + sizeof(IndexHeader));
+    m_files = reinterpret_cast<const IndexedFile*>(m_data + sizeof(IndexHeader) + dirBytes);
+    m_heap = reinterpret_cast<const char*>(m_data + heapBegin);
+
+    const uint32_t dirCount = header->dirCount;
+    for (uint32_t d = 0; d < dirCount; ++d) {
+        const IndexedDirectory& dir = m_dirs[d];
+        bool ok = Fits(dir.pathOffset, dir.pathLength, header->heapSize)
+               && Fits(dir.firstFile, dir.fileCount, header->fileCount)
+               && (d == 0 ? dir.parent == kNoIndexRecord : dir.parent < dirCount);
+        for (uint32_t f = 0; ok && f < dir.fileCount; ++f) {
+            const IndexedFile& file = m_files[dir.firstFile + f];
+            ok = Fits(file.nameOffset, file.nameLength, header->heapSize);
+        }
+        if (!ok) {
+            Close();
+            return false;
+        }
+    }
+
+    // Each directory must sit directly below its parent, which also rules
+    // out cycles for the scanner to walk into
+    bool ok = Path(m_dirs[0]) == root;
+    for (uint32_t d = 1; ok && d < dirCount; ++d)
+        ok = ParentOf(Path(m_dirs[d])) == Path(m_dirs[m_dirs[d].parent]);
+    if (!ok) {
+        Close();
+        return false;
+    }
+
+    m_header = header;
+    m_hashesValid = header->hashAlgorithm == HashAlgorithm();
+
+    // Lookup by path, and children by parent (a counting sort)
+    m_byPath.reserve(dirCount);
+    m_childBegin.assign(dirCount + 1, 0);
+    for (uint32_t d = 0; d < dirCount; ++d) {
+        m_byPath.emplace(Path(m_dirs[d]), d);
+        if (d > 0)
+            ++m_childBegin[m_dirs[d].parent + 1];
+    }
+    for (uint32_t d = 0; d < dirCount; ++d)
+        m_childBegin[d + 1] += m_childBegin[d];
+
+    m_children.resize(dirCount - 1);
+    std::vector<uint32_t> fill(m_childBegin.begin(), m_childBegin.end() - 1);
+    for (uint32_t d = 1; d < dirCount; ++d)
+        m_children[fill[m_dirs[d].parent]++] = d;
+
+    return true;
+}
+
+const IndexedDirectory* MetadataIndex::FindDirectory(std::string_view path) const
+{
+    auto it = m_byPath.find(path);
+    return it != m_byPath.end() ? &m_dirs[it->second] : nullptr;
+}
+
+std::span<const IndexedFile> MetadataIndex::FilesOf(const IndexedDirectory& dir) const
+{
+    return {m_files + dir.firstFile, dir.fileCount};
+}
+
+std::span<const uint32_t> MetadataIndex::ChildrenOf(const IndexedDirectory& dir) const
+{
+    size_t d = static_cast<size_t>(&dir - m_dirs);
+    return std::span<const uint32_t>(m_children).subspan(m_childBegin[d], m_childBegin[d + 1] - m_childBegin[d]);
+}
+
+const IndexedFile* MetadataIndex::FindFile(const IndexedDirectory& dir, std::string_view name) const
+{
+    auto files = FilesOf(dir);
+    auto it = std::lower_bound(files.begin(), files.end(), name,
+                               [this](const IndexedFile& f, std::string_view n) { return Name(f) < n; });
+    return it != files.end() && Name(*it) == name ? &*it : nullptr;
+}
+
+std::string_view MetadataIndex::Path(const IndexedDirectory& dir) const
+{
+    return {m_heap + dir.pathOffset, dir.pathLength};
+}
+
+std::string_view MetadataIndex::Name(const IndexedFile& file) const
+{
+    return {m_heap + file.nameOffset, file.nameLength};
+}
+
+ContentFacts MetadataIndex::Facts(uint32_t fileRecord) const
+{
+    const IndexedFile& file = m_files[fileRecord];
+
+    ContentFacts facts;
+    facts.sniffed = file.sniffed;
+    facts.contentHash = m_hashesValid ? file.contentHash : 0;
+    return facts;
+}
+
+// ------------------------------- Writing --------------------------------
+
+wxString IndexFileName(const wxString& root)
+{
+    return wxString::Format("%016llx.idx", static_cast<unsigned long long>(HashName(ToFileSystem(root))));
+}
+
+bool WriteMetadataIndex(const wxString& filename, const std::string& root,
+                        std::span<const ScannedDirectory> dirs,
+                        const std::vector<FileInfo>& files, std::span<const ContentFacts> facts)
+{
+    PhaseScope phase("index.write", files.size());
+
+    // ----- Directories, the root first -----
+
+    std::unordered_map<std::string_view, uint32_t> byPath;
+    byPath.reserve(dirs.size());
+    for (const ScannedDirectory& d : dirs)
+        byPath.emplace(d.path, 0);
+    if (!byPath.contains(root))
+        return false;
+
+    // Every directory but the root was found in its parent, so this only
+    // drops oddities such as a directory scanned twice under two spellings
+    std::vector<const ScannedDirectory*> order;
+    order.reserve(dirs.size());
+    for (const ScannedDirectory& d : dirs) {
+        if (d.path == root)
+            order.insert(order.begin(), &d);
+        else if (byPath.contains(ParentOf(d.path)))
+            order.push_back(&d);
+    }
+    if (order.front()->path != root)
+        return false;
+
+    byPath.clear();
+    for (uint32_t d = 0; d < order.size(); ++d)
+        byPath.emplace(order[d]->path, d);
+
+    std::string heap;
+    std::vector<IndexedDirectory> dirRecords(order.size());
+    for (uint32_t d = 0; d < order.size(); ++d) {
+        const ScannedDirectory& sd = *order[d];
+        IndexedDirectory& rec = dirRecords[d];
+        rec = {};
+        rec.device = sd.device;
+        rec.inode = sd.inode;
+        rec.mtimeNs = sd.complete ? sd.mtimeNs : kStaleMtime;
+        rec.pathOffset = static_cast<uint32_t>(heap.size());
+        rec.pathLength = static_cast<uint32_t>(sd.path.size());
+        heap += sd.path;
+
+        rec.parent = d > 0 ? byPath.at(ParentOf(sd.path)) : kNoIndexRecord;
+    }
+
+    // ----- Files, grouped by directory and sorted by name -----
+
+    struct Entry {
+        uint32_t dir;
+        uint32_t file;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+    std::vector<Entry> entries;
+    entries.reserve(files.size());
+
+    // Files of one directory arrive together, so its lookup is reused
+    std::string path;
+    DirId lastDir = kNoDir;
+    auto it = byPath.end();
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (i == 0 || files[i].dir != lastDir) {
+            lastDir = files[i].dir;
+            path.clear();
+            PathStore::Get().AppendPath(path, lastDir);
+            it = byPath.find(path);
+        }
+        if (it == byPath.end())
+            continue;
+
+        std::string_view name = files[i].NativeName();
+        entries.push_back({it->second, static_cast<uint32_t>(i),
+                           static_cast<uint32_t>(heap.size()), static_cast<uint32_t>(name.size())});
+        heap += name;
+    }
+
+    // Offsets are 32-bit
+    if (heap.size() > UINT32_MAX || files.size() > UINT32_MAX)
+        return false;
+
+    std::sort(entries.begin(), entries.end(), [&heap](const Entry& a, const Entry& b) {
+        if (a.dir != b.dir)
+            return a.dir < b.dir;
+        return std::string_view(heap).substr(a.nameOffset, a.nameLength) <
+               std::string_view(heap).substr(b.nameOffset, b.nameLength);
+    });
+
+    std::vector<IndexedFile> fileRecords(entries.size());
+    for (uint32_t k = 0; k < entries.size(); ++k) {
+        const Entry& e = entries[k];
+        const FileInfo& f = files[e.file];
+        IndexedDirectory& dir = dirRecords[e.dir];
+        if (dir.fileCount++ == 0)
+            dir.firstFile = k;
+
+        IndexedFile& rec = fileRecords[k];
+        rec = {};
+        rec.device = f.device;
+        rec.inode = f.inode;
+        rec.size = f.size.GetValue();
+        rec.mtime = f.modified.IsValid() ? static_cast<int64_t>(f.modified.GetTicks()) : 0;
+        rec.contentHash = e.file < facts.size() ? facts[e.file].contentHash : 0;
+        rec.nameOffset = e.nameOffset;
+        rec.nameLength = e.nameLength;
+        rec.sniffed = e.file < facts.size() ? facts[e.file].sniffed : ContentFacts::kNotSniffed;
+    }
+
+    // ----- Header, then everything in one go -----
+
+    IndexHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kIndexVersion;
+    header.byteOrder = kIndexByteOrder;
+    header.hashAlgorithm = HashAlgorithm();
+    header.dirCount = static_cast<uint32_t>(dirRecords.size());
+    header.fileCount = static_cast<uint32_t>(fileRecords.size());
+    header.heapSize = heap.size();
+
+    wxString temp = filename + ".tmp";
+    {
+        wxFFile file(temp, "wb");
+        if (!file.IsOpened())
+            return false;
+
+        bool ok = file.Write(&header, sizeof(header)) == sizeof(header)
+               && file.Write(dirRecords.data(), dirRecords.size() * sizeof(IndexedDirectory))
+                      == dirRecords.size() * sizeof(IndexedDirectory)
+               && file.Write(fileRecords.data(), fileRecords.size() * sizeof(IndexedFile))
+                      == fileRecords.size() * sizeof(IndexedFile)
+               && file.Write(heap.data(), heap.size()) == heap.size();
+        if (!file.Close() || !ok) {
+            wxRemoveFile(temp);
+            return false;
+        }
+    }
+    return wxRenameFile(temp, filename, true);
+}
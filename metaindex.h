@@ -0,0 +1,168 @@
+// metaindex.h
+//
+// Persistent metadata index for incremental rescans. After a folder scan,
+// the directory tree, every file's metadata and what was learned about its
+// contents (sniffed type, content hash) are written to one file: a header,
+// fixed-width directory and file records, and a heap for the strings. The
+// next scan of the same folder maps that file and skips every directory
+// whose mtime has not changed; its files come from the index without a
+// single stat call.
+//
+// A directory's mtime only changes when entries are added, removed or
+// renamed, so files rewritten in place inside an unchanged directory keep
+// their indexed size and mtime until the directory itself changes.
+
+#pragma once
+
+#include "classifier.h"
+#include "fileinfo.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+inline constexpr uint32_t kNoIndexRecord = ~uint32_t(0);
+
+// ----------------------------- File format -----------------------------
+
+struct IndexHeader {
+    char     magic[8];        // "MEDAMAIX"
+    uint32_t version;
+    uint32_t byteOrder;       // kIndexByteOrder as written by the producer
+    uint32_t hashAlgorithm;   // HashAlgorithm() of the content hashes
+    uint32_t dirCount;
+    uint32_t fileCount;
+    uint32_t reserved;
+    uint64_t heapSize;
+};
+
+// Directory 0 is the scanned root. Its files are
+// [firstFile, firstFile + fileCount), sorted by name.
+struct IndexedDirectory {
+    uint64_t device;
+    uint64_t inode;
+    int64_t  mtimeNs;          // kStaleMtime if it was not read completely
+    uint32_t pathOffset;       // full path, ToFileSystem() form
+    uint32_t pathLength;
+    uint32_t parent;           // kNoIndexRecord for the root
+    uint32_t firstFile;
+    uint32_t fileCount;
+    uint32_t reserved;
+};
+
+struct IndexedFile {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t  mtime;            // seconds since the epoch
+    uint64_t contentHash;      // 0 if unknown
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t sniffed;          // see ContentFacts
+    uint32_t reserved;
+};
+
+// Bump when the layout changes, or when SniffCategory() starts to classify
+// differently, which makes the cached sniffed types stale
+inline constexpr uint32_t kIndexVersion = 1;
+inline constexpr uint32_t kIndexByteOrder = 0x01020304;
+inline constexpr int64_t  kStaleMtime = INT64_MIN;
+
+// ---------------------------- Content facts ----------------------------
+
+// What is known about a file's contents. Only these are cached: the other
+// strategies' categories are a table lookup away and depend on the current
+// mappings and date, so they are recomputed on load.
+struct ContentFacts {
+    static constexpr uint32_t kNotSniffed = ~uint32_t(0);
+    static constexpr uint32_t kSniffedAsNamed = ~uint32_t(0) - 1;
+
+    // kNotSniffed, kSniffedAsNamed (the content agreed with the extension,
+    // or nothing matched) or a built-in category
+    uint32_t sniffed = kNotSniffed;
+    uint64_t contentHash = 0;  // DuplicateFinder::ContentHash(), 0 if unknown
+
+    // Records the sniffed category of a file whose extension category is byName.
+    void SetSniffed(CategoryId result, CategoryId byName);
+
+    // The sniffed category given the current extension category, or false
+    // if the file has not been sniffed.
+    bool Sniffed(CategoryId byName, CategoryId& result) const;
+};
+
+// --------------------------------- Index --------------------------------
+
+// A loaded index. Read-only once open, so scanner workers share it freely.
+class MetadataIndex {
+public:
+    MetadataIndex() = default;
+    ~MetadataIndex();
+
+    MetadataIndex(const MetadataIndex&) = delete;
+    MetadataIndex& operator=(const MetadataIndex&) = delete;
+
+    // Maps filename. Fails if it is missing or damaged, was written by
+    // another version or for a different root than root (ToFileSystem() form).
+    bool Open(const wxString& filename, const std::string& root);
+
+    bool IsOpen() const { return m_header != nullptr; }
+
+    // The record for a directory path, or nullptr
+    const IndexedDirectory* FindDirectory(std::string_view path) const;
+
+    std::span<const IndexedFile> FilesOf(const IndexedDirectory& dir) const;
+    std::span<const uint32_t>    ChildrenOf(const IndexedDirectory& dir) const;
+    const IndexedDirectory&      Directory(uint32_t record) const { return m_dirs[record]; }
+
+    // The file called name in dir, or nullptr
+    const IndexedFile* FindFile(const IndexedDirectory& dir, std::string_view name) const;
+
+    std::string_view Path(const IndexedDirectory& dir) const;
+    std::string_view Name(const IndexedFile& file) const;
+
+    uint32_t     RecordOf(const IndexedFile& file) const { return static_cast<uint32_t>(&file - m_files); }
+    ContentFacts Facts(uint32_t fileRecord) const;
+
+private:
+    const uint8_t*          m_data = nullptr;
+    size_t                  m_size = 0;
+    std::vector<uint8_t>    m_buffer;      // when the file could not be mapped
+    bool                    m_mapped = false;
+
+    const IndexHeader*      m_header = nullptr;
+    const IndexedDirectory* m_dirs = nullptr;
+    const IndexedFile*      m_files = nullptr;
+    const char*             m_heap = nullptr;
+    bool                    m_hashesValid = false;
+
+    std::unordered_map<std::string_view, uint32_t> m_byPath;
+    std::vector<uint32_t>   m_childBegin;  // children of dir d: [m_childBegin[d], m_childBegin[d + 1])
+    std::vector<uint32_t>   m_children;
+
+    void Close();
+};
+
+// ------------------------------- Writing --------------------------------
+
+// A directory as a scan found it
+struct ScannedDirectory {
+    std::string path;          // ToFileSystem() form
+    uint64_t    device = 0;
+    uint64_t    inode = 0;
+    int64_t     mtimeNs = 0;
+    bool        complete = true;   // every entry was read and stat'ed
+};
+
+// Index file name for a scanned root, e.g. "3f2a...c1.idx"
+wxString IndexFileName(const wxString& root);
+
+// Writes the index of a finished scan of root. dirs are the scan's
+// directories and files[i] has the content facts facts[i]; files outside
+// dirs (moved since the scan, say) are left out. The file is replaced
+// atomically, so a reader never sees a partial index.
+bool WriteMetadataIndex(const wxString& filename, const std::string& root,
+                        std::span<const ScannedDirectory> dirs,
+                        const std::vector<FileInfo>& files, std::span<const ContentFacts> facts);
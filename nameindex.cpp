@@ -0,0 +1,209 @@
+// nameindex.cpp
+
+#include "nameindex.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Names checked per worker below which a scan stays on one thread
+constexpr size_t kMinNamesPerWorker = 64 * 1024;
+
+// Candidates few enough to check one by one rather than intersecting
+// further posting lists
+constexpr size_t kCheckBelow = 256;
+
+uint32_t Trigram(std::string_view s, size_t at)
+{
+    return (uint32_t(uint8_t(s[at])) << 16) | (uint32_t(uint8_t(s[at + 1])) << 8) | uint8_t(s[at + 2]);
+}
+
+// Sorted intersection; walks the long list by binary search when the other
+// one is much shorter
+std::vector<FileIndex> Intersect(std::span<const FileIndex> a, std::span<const FileIndex> b)
+{
+    if (a.size() > b.size())
+        std::swap(a, b);
+
+    std::vector<FileIndex> out;
+    out.reserve(a.size());
+    if (b.size() / 16 > a.size()) {
+        auto it = b.begin();
+        for (FileIndex i : a) {
+            it = std::lower_bound(it, b.end(), i);
+            if (it == b.end())
+                break;
+            if (*it == i)
+                out.push_back(i);
+        }
+    } else {
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+    }
+    return out;
+}
+
+} // namespace
+
+std::string FoldForSearch(const wxString& text)
+{
+    return text.Lower().utf8_string();
+}
+
+// ------------------------------- Building -------------------------------
+
+void NameIndex::Extend(const std::vector<FileInfo>& files)
+{
+    const size_t begin = size();
+    if (begin >= files.size())
+        return;
+
+    PhaseScope phase("filter.index", files.size() - begin);
+
+    m_ends.reserve(files.size());
+    std::vector<uint32_t> trigrams;
+    for (size_t i = begin; i < files.size(); ++i) {
+        size_t start = m_names.size();
+        m_names += FoldFileName(files[i].NativeName());
+        m_ends.push_back(static_cast<uint32_t>(m_names.size()));
+
+        std::string_view name = std::string_view(m_names).substr(start);
+        trigrams.clear();
+        for (size_t k = 0; k + 3 <= name.size(); ++k)
+            trigrams.push_back(Trigram(name, k));
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+        // Files are appended in index order, so every list stays sorted
+        for (uint32_t t : trigrams)
+            m_postings[t].push_back(static_cast<FileIndex>(i));
+    }
+}
+
+void NameIndex::Remove(std::span<const FileIndex> remap)
+{
+    std::string names;
+    names.reserve(m_names.size());
+    std::vector<uint32_t> ends;
+    ends.reserve(m_ends.size());
+
+    for (size_t i = 0; i < m_ends.size() && i < remap.size(); ++i) {
+        if (remap[i] == kRemovedFile)
+            continue;
+        names += Name(static_cast<FileIndex>(i));
+        ends.push_back(static_cast<uint32_t>(names.size()));
+    }
+    m_names = std::move(names);
+    m_ends = std::move(ends);
+
+    // Survivors keep their relative order, so the lists stay sorted
+    for (auto it = m_postings.begin(); it != m_postings.end();) {
+        std::vector<FileIndex>& list = it->second;
+        std::erase_if(list, [&remap](FileIndex& i) {
+            i = i < remap.size() ? remap[i] : kRemovedFile;
+            return i == kRemovedFile;
+        });
+        it = list.empty() ? m_postings.erase(it) : std::next(it);
+    }
+}
+
+void NameIndex::Clear()
+{
+    m_names.clear();
+    m_ends.clear();
+    m_postings.clear();
+}
+
+// -------------------------------- Queries -------------------------------
+
+bool NameIndex::Postings(std::string_view needle,
+                         std::vector<const std::vector<FileIndex>*>& lists) const
+{
+    lists.clear();
+    for (size_t k = 0; k + 3 <= needle.size(); ++k) {
+        auto it = m_postings.find(Trigram(needle, k));
+        if (it == m_postings.end())
+            return false;
+        lists.push_back(&it->second);
+    }
+
+    std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+    return true;
+}
+
+std::vector<FileIndex> NameIndex::Find(std::string_view needle, bool parallel) const
+{
+    std::vector<FileIndex> result;
+    if (needle.size() < 3) {
+        AppendMatches(result, 0, needle, parallel);
+        return result;
+    }
+
+    PhaseScope phase("filter", size());
+
+    std::vector<const std::vector<FileIndex>*> lists;
+    if (!Postings(needle, lists))
+        return result;
+
+    std::vector<FileIndex> candidates = *lists.front();
+    for (size_t k = 1; k < lists.size() && candidates.size() > kCheckBelow; ++k)
+        candidates = Intersect(candidates, *lists[k]);
+
+    // Trigrams say nothing about where they occur, so every candidate is
+    // checked against the whole needle
+    for (FileIndex i : candidates) {
+        if (Matches(i, needle))
+            result.push_back(i);
+    }
+    return result;
+}
+
+std::vector<FileIndex> NameIndex::Refine(std::span<const FileIndex> candidates, std::string_view needle) const
+{
+    PhaseScope phase("filter", candidates.size());
+
+    // A rare trigram of the needle can rule out most candidates at once
+    std::vector<FileIndex> narrowed;
+    std::vector<const std::vector<FileIndex>*> lists;
+    if (needle.size() >= 3) {
+        if (!Postings(needle, lists))
+            return {};
+        if (lists.front()->size() < candidates.size()) {
+            narrowed = Intersect(candidates, *lists.front());
+            candidates = narrowed;
+        }
+    }
+
+    std::vector<FileIndex> result;
+    for (FileIndex i : candidates) {
+        if (Matches(i, needle))
+            result.push_back(i);
+    }
+    return result;
+}
+
+void NameIndex::AppendMatches(std::vector<FileIndex>& result, size_t from, std::string_view needle,
+                              bool parallel) const
+{
+    if (from >= size())
+        return;
+
+    PhaseScope phase("filter", size() - from);
+
+    const size_t n = size() - from;
+    unsigned chunks = parallel ? ParallelWorkerCount(n, kMinNamesPerWorker) : 1;
+    std::vector<std::vector<FileIndex>> found(chunks);
+
+    ParallelChunks(n, chunks, [&](unsigned c, size_t begin, size_t end) {
+        for (size_t i = from + begin; i < from + end; ++i) {
+            if (Matches(static_cast<FileIndex>(i), needle))
+                found[c].push_back(static_cast<FileIndex>(i));
+        }
+    });
+
+    for (const auto& part : found)
+        result.insert(result.end(), part.begin(), part.end());
+}
@@ -0,0 +1,69 @@
+// nameindex.h
+//
+// Substring search over file names for the filter box. Every name is kept
+// lower-cased in one UTF-8 byte heap, and a trigram index maps each run of
+// three bytes to the ascending list of files whose name contains it. A
+// query intersects the lists of the needle's trigrams, rarest first, and
+// only checks the few names that survive; needles too short to have a
+// trigram are matched with a straight scan of the heap.
+
+#pragma once
+
+#include "fileinfo.h"
+#include "grouping.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The form needles are compared to names in: lower-cased UTF-8, as
+// FoldFileName() produces
+std::string FoldForSearch(const wxString& text);
+
+class NameIndex {
+public:
+    size_t size() const { return m_ends.size(); }
+
+    // Indexes the names of files[size()] .. files.back()
+    void Extend(const std::vector<FileInfo>& files);
+
+    // Drops removed files; remap as for CompactByRemap()
+    void Remove(std::span<const FileIndex> remap);
+
+    void Clear();
+
+    // Files whose name contains the folded needle, ascending. An empty
+    // needle matches every file.
+    std::vector<FileIndex> Find(std::string_view needle, bool parallel) const;
+
+    // Same, but only among candidates (ascending), e.g. the matches of a
+    // needle this one extends: whatever contains "invoi" also contains "invo".
+    std::vector<FileIndex> Refine(std::span<const FileIndex> candidates, std::string_view needle) const;
+
+    // Appends the matches among files [from, size()) to result
+    void AppendMatches(std::vector<FileIndex>& result, size_t from, std::string_view needle,
+                       bool parallel) const;
+
+private:
+    std::string           m_names;     // folded names, back to back
+    std::vector<uint32_t> m_ends;      // end of file i's name in m_names
+    std::unordered_map<uint32_t, std::vector<FileIndex>> m_postings;
+
+    std::string_view Name(FileIndex i) const
+    {
+        uint32_t begin = i ? m_ends[i - 1] : 0;
+        return std::string_view(m_names).substr(begin, m_ends[i] - begin);
+    }
+
+    bool Matches(FileIndex i, std::string_view needle) const
+    {
+        return Name(i).find(needle) != std::string_view::npos;
+    }
+
+    // Posting lists of the needle's trigrams, shortest first. False if one
+    // of them occurs in no name at all.
+    bool Postings(std::string_view needle, std::vector<const std::vector<FileIndex>*>& lists) const;
+};
@@ -0,0 +1,278 @@
+// organizedview.cpp
+
+#include "organizedview.h"
+#include "trace.h"
+
+#include <wx/dcbuffer.h>
+#include <algorithm>
+
+namespace {
+
+const wxColour kBackground(10, 10, 25);
+const wxColour kHeaderBackground(25, 25, 50);
+const wxColour kHeaderText(255, 255, 255);
+const wxColour kItemText(255, 255, 255);
+const wxColour kDetailText(180, 140, 255);
+
+} // namespace
+
+OrganizedView::OrganizedView(wxWindow* parent, wxWindowID id)
+    : wxScrolledCanvas(parent, id, wxDefaultPosition, wxDefaultSize,
+                       wxVSCROLL | wxFULL_REPAINT_ON_RESIZE)
+{
+    SetBackgroundStyle(wxBG_STYLE_PAINT);
+    SetBackgroundColour(kBackground);
+
+    m_rowHeight = GetCharHeight() + FromDIP(6);
+    m_headerHeight = GetCharHeight() + FromDIP(12);
+    m_groupGap = FromDIP(6);
+    m_margin = FromDIP(5);
+    m_indent = FromDIP(16);
+
+    // Pixel-granular positions; a wheel notch moves about one and a half rows.
+    SetScrollRate(0, std::max(1, m_rowHeight / 2));
+
+    Bind(wxEVT_PAINT, &OrganizedView::OnPaint, this);
+    Bind(wxEVT_SIZE, &OrganizedView::OnSize, this);
+    Bind(wxEVT_LEFT_DOWN, &OrganizedView::OnLeftDown, this);
+    Bind(wxEVT_LEFT_DCLICK, &OrganizedView::OnLeftDown, this);
+    Bind(wxEVT_MOTION, &OrganizedView::OnMotion, this);
+}
+
+void OrganizedView::SetModel(const OrganizedViewModel* model)
+{
+    m_model = model;
+    m_toggled.assign(m_model ? m_model->GetNodeCount() : 0, false);
+
+    UpdateLayout();
+    Scroll(0, 0);
+    Refresh();
+}
+
+void OrganizedView::ModelChanged()
+{
+    m_toggled.resize(m_model ? m_model->GetNodeCount() : 0, false);
+
+    UpdateLayout();
+    Refresh();
+}
+
+void OrganizedView::GroupsChanged(std::span<const size_t> previous, std::span<const size_t> changed)
+{
+    std::vector<bool> toggled(previous.size(), false);
+    for (size_t g = 0; g < previous.size(); ++g) {
+        if (previous[g] < m_toggled.size())
+            toggled[g] = m_toggled[previous[g]];
+    }
+    m_toggled = std::move(toggled);
+
+    std::vector<int> oldTop(m_rows.size());
+    for (size_t r = 0; r < m_rows.size(); ++r)
+        oldTop[r] = m_rows[r].top;
+    UpdateLayout();
+
+    // Groups above the first one that changed, moved or was added look the same
+    size_t first = previous.size();
+    for (size_t g : changed)
+        first = std::min(first, g);
+    for (size_t g = 0; g < first; ++g) {
+        if (previous[g] != g || g + 1 >= oldTop.size() || oldTop[g + 1] != m_rows[g + 1].top) {
+            first = g;
+            break;
+        }
+    }
+
+    int top = 0;
+    CalcScrolledPosition(0, m_rows[first].top, nullptr, &top);
+    top = std::max(0, top);
+    wxSize client = GetClientSize();
+    if (top < client.y)
+        RefreshRect(wxRect(0, top, client.x, client.y - top));
+}
+
+bool OrganizedView::IsExpanded(size_t node) const
+{
+    // Groups start expanded, headings collapsed
+    bool heading = m_model->GetChildCount(node) > 0;
+    return heading == (node < m_toggled.size() && m_toggled[node]);
+}
+
+void OrganizedView::UpdateLayout()
+{
+    PhaseScope phase("render.layout");
+
+    m_rows.clear();
+    int y = m_margin;
+
+    // Depth first through the expanded nodes only
+    auto add = [&](auto& self, size_t node, int depth) -> void {
+        m_rows.push_back({node, depth, y});
+        y += m_headerHeight;
+        if (IsExpanded(node)) {
+            size_t children = m_model->GetChildCount(node);
+            size_t firstChild = children > 0 ? m_model->GetFirstChild(node) : 0;
+            for (size_t c = 0; c < children; ++c)
+                self(self, firstChild + c, depth + 1);
+            size_t group = m_model->GetNodeGroup(node);
+            if (children == 0 && group < m_model->GetGroupCount())
+                y += static_cast<int>(m_model->GetGroupItemCount(group)) * m_rowHeight;
+        }
+        if (depth == 0)
+            y += m_groupGap;
+    };
+
+    size_t roots = m_model ? m_model->GetRootCount() : 0;
+    for (size_t r = 0; r < roots; ++r)
+        add(add, r, 0);
+    m_rows.push_back({SIZE_MAX, 0, y + m_margin});
+    phase.AddItems(m_rows.size() - 1);
+
+    SetVirtualSize(0, m_rows.back().top);
+}
+
+size_t OrganizedView::RowAt(int y) const
+{
+    size_t count = m_rows.empty() ? 0 : m_rows.size() - 1;
+    if (count == 0 || y < m_rows.front().top || y >= m_rows.back().top)
+        return count;
+
+    auto it = std::upper_bound(m_rows.begin(), m_rows.end() - 1, y,
+                               [](int value, const Row& row) { return value < row.top; });
+    return static_cast<size_t>(it - m_rows.begin()) - 1;
+}
+
+bool OrganizedView::IsOnHeader(size_t row, int y) const
+{
+    return y >= m_rows[row].top && y < m_rows[row].top + m_headerHeight;
+}
+
+// ----------------------------- Painting --------------------------------
+
+void OrganizedView::DrawHeader(wxDC& dc, const Row& row, const wxRect& rect) const
+{
+    dc.SetBrush(wxBrush(kHeaderBackground));
+    dc.SetPen(*wxTRANSPARENT_PEN);
+    dc.DrawRoundedRectangle(rect, 4);
+
+    size_t n = m_model->GetNodeFileCount(row.node);
+    wxString label = wxString::Format("%s %s (%zu files)",
+                                      IsExpanded(row.node) ? "▾" : "▸",
+                                      m_model->GetNodeLabel(row.node), n);
+    int textY = rect.y + (rect.height - dc.GetCharHeight()) / 2;
+
+    wxString detail = m_model->GetNodeDetail(row.node);
+    if (!detail.empty()) {
+        dc.SetTextForeground(kDetailText);
+        dc.DrawText(detail, rect.GetRight() - m_margin - dc.GetTextExtent(detail).x, textY);
+    }
+
+    dc.SetTextForeground(kHeaderText);
+    dc.SetFont(GetFont().Bold());
+    dc.DrawText(label, rect.x + m_margin, textY);
+    dc.SetFont(GetFont());
+}
+
+void OrganizedView::DrawItem(wxDC& dc, size_t group, size_t item, const wxRect& rect) const
+{
+    int textY = rect.y + (rect.height - dc.GetCharHeight()) / 2;
+
+    wxString detail = m_model->GetItemDetail(group, item);
+    wxSize detailSize = dc.GetTextExtent(detail);
+    int detailX = rect.GetRight() - m_margin - detailSize.x;
+
+    dc.SetTextForeground(kDetailText);
+    dc.DrawText(detail, detailX, textY);
+
+    // Long names are clipped before the detail column instead of overlapping it
+    int nameX = rect.x + 3 * m_margin;
+    dc.SetClippingRegion(wxRect(nameX, rect.y, std::max(0, detailX - nameX - 10), rect.height));
+    dc.SetTextForeground(kItemText);
+    dc.DrawText(m_model->GetItemName(group, item), nameX, textY);
+    dc.DestroyClippingRegion();
+}
+
+void OrganizedView::OnPaint(wxPaintEvent& WXUNUSED(evt))
+{
+    PhaseScope phase("render");
+
+    wxAutoBufferedPaintDC dc(this);
+    DoPrepareDC(dc);
+
+    dc.SetBackground(wxBrush(GetBackgroundColour()));
+    dc.Clear();
+
+    if (!m_model)
+        return;
+
+    dc.SetFont(GetFont());
+
+    int clientW = 0, clientH = 0;
+    GetClientSize(&clientW, &clientH);
+
+    int top = 0;
+    CalcUnscrolledPosition(0, 0, nullptr, &top);
+    int bottom = top + clientH;
+
+    size_t count = m_rows.size() - 1;
+
+    // First row that reaches into the viewport; everything above is skipped
+    for (size_t r = RowAt(std::max(top, m_margin)); r < count && m_rows[r].top < bottom; ++r) {
+        const Row& row = m_rows[r];
+        int x = m_margin + row.depth * m_indent;
+        int width = clientW - m_margin - x;
+        DrawHeader(dc, row, wxRect(x, row.top, width, m_headerHeight));
+
+        size_t g = m_model->GetNodeGroup(row.node);
+        if (!IsExpanded(row.node) || m_model->GetChildCount(row.node) > 0 || g >= m_model->GetGroupCount())
+            continue;
+
+        size_t n = m_model->GetGroupItemCount(g);
+        int itemsTop = row.top + m_headerHeight;
+        size_t first = top > itemsTop ? static_cast<size_t>(top - itemsTop) / m_rowHeight : 0;
+
+        for (size_t i = first; i < n; ++i) {
+            int rowY = itemsTop + static_cast<int>(i) * m_rowHeight;
+            if (rowY >= bottom)
+                break;
+            DrawItem(dc, g, i, wxRect(x, rowY, width, m_rowHeight));
+            phase.AddItems(1);
+        }
+    }
+}
+
+// ------------------------------ Events ---------------------------------
+
+void OrganizedView::OnSize(wxSizeEvent& evt)
+{
+    Refresh();
+    evt.Skip();
+}
+
+void OrganizedView::OnLeftDown(wxMouseEvent& evt)
+{
+    if (!m_model)
+        return;
+
+    int y = 0;
+    CalcUnscrolledPosition(0, evt.GetY(), nullptr, &y);
+
+    size_t r = RowAt(y);
+    if (r + 1 >= m_rows.size() || !IsOnHeader(r, y) || m_rows[r].node >= m_toggled.size())
+        return;
+
+    m_toggled[m_rows[r].node] = !m_toggled[m_rows[r].node];
+    UpdateLayout();
+    Refresh();
+}
+
+void OrganizedView::OnMotion(wxMouseEvent& evt)
+{
+    int y = 0;
+    CalcUnscrolledPosition(0, evt.GetY(), nullptr, &y);
+
+    size_t r = RowAt(y);
+    bool onHeader = m_model && r + 1 < m_rows.size() && IsOnHeader(r, y);
+    SetCursor(wxCursor(onHeader ? wxCURSOR_HAND : wxCURSOR_ARROW));
+
+    evt.Skip();
+}
@@ -0,0 +1,99 @@
+// organizedview.h
+//
+// Owner-drawn, virtualized grouped list used by the "Organized" page.
+// Only the category headers and file rows that intersect the viewport are
+// painted; no child windows are created per group or per file. Groups can
+// be nested under headings for hierarchical plans, and a heading's children
+// are only laid out once it is expanded.
+
+#pragma once
+
+#include <wx/wx.h>
+#include <wx/scrolwin.h>
+#include <span>
+#include <vector>
+
+// Data source for OrganizedView. Groups and their items are addressed by
+// index, and the view only asks for the rows it is about to paint.
+class OrganizedViewModel {
+public:
+    virtual ~OrganizedViewModel() = default;
+
+    virtual size_t   GetGroupCount() const = 0;
+    virtual size_t   GetGroupItemCount(size_t group) const = 0;
+    virtual wxString GetGroupLabel(size_t group) const = 0;
+    virtual wxString GetItemName(size_t group, size_t item) const = 0;
+    virtual wxString GetItemDetail(size_t group, size_t item) const = 0;
+
+    // Nesting. Nodes are numbered by the model: the top level is
+    // 0 .. GetRootCount() - 1 and the children of a node are consecutive. A
+    // node either has children or shows the items of one group. The view
+    // asks for the children of a node only once the node is expanded. The
+    // defaults describe the flat list, in which every group is a top-level
+    // node of its own.
+    virtual size_t   GetNodeCount() const { return GetGroupCount(); }
+    virtual size_t   GetRootCount() const { return GetGroupCount(); }
+    virtual size_t   GetFirstChild(size_t WXUNUSED(node)) const { return 0; }
+    virtual size_t   GetChildCount(size_t WXUNUSED(node)) const { return 0; }
+    virtual size_t   GetNodeGroup(size_t node) const { return node; }
+    virtual wxString GetNodeLabel(size_t node) const { return GetGroupLabel(GetNodeGroup(node)); }
+    virtual size_t   GetNodeFileCount(size_t node) const { return GetGroupItemCount(GetNodeGroup(node)); }
+    virtual wxString GetNodeDetail(size_t WXUNUSED(node)) const { return wxEmptyString; }
+};
+
+class OrganizedView : public wxScrolledCanvas {
+public:
+    explicit OrganizedView(wxWindow* parent, wxWindowID id = wxID_ANY);
+
+    // Attaches a model (or detaches with nullptr). All groups start expanded,
+    // headings collapsed, and the view scrolls back to the top.
+    void SetModel(const OrganizedViewModel* model);
+
+    // Recomputes the layout after the attached model changed its contents.
+    void ModelChanged();
+
+    // Same, for small edits of a flat model: previous[g] is the index group
+    // g had before (or any value >= the old count for a new group) and
+    // changed lists the groups whose items changed. Collapsed state and
+    // scroll position are kept, and only the part of the window from the
+    // first changed or moved group down is repainted.
+    void GroupsChanged(std::span<const size_t> previous, std::span<const size_t> changed);
+
+private:
+    // A header on display, at virtual y `top`
+    struct Row {
+        size_t node;
+        int    depth;
+        int    top;
+    };
+
+    const OrganizedViewModel* m_model = nullptr;
+
+    // Layout state is per visible header, never per file: one row for every
+    // node whose parents are all expanded, and a last entry whose top is the
+    // total height. For a flat model, row g is group g.
+    std::vector<Row>  m_rows;
+    std::vector<bool> m_toggled;    // by node: not in its initial state
+
+    int m_headerHeight = 0;
+    int m_rowHeight = 0;
+    int m_groupGap = 0;
+    int m_margin = 0;
+    int m_indent = 0;
+
+    bool IsExpanded(size_t node) const;
+    void UpdateLayout();
+
+    // Index of the row whose vertical span contains the virtual y, or the
+    // number of rows when there is none.
+    size_t RowAt(int y) const;
+    bool   IsOnHeader(size_t row, int y) const;
+
+    void DrawHeader(wxDC& dc, const Row& row, const wxRect& rect) const;
+    void DrawItem(wxDC& dc, size_t group, size_t item, const wxRect& rect) const;
+
+    void OnPaint(wxPaintEvent& evt);
+    void OnSize(wxSizeEvent& evt);
+    void OnLeftDown(wxMouseEvent& evt);
+    void OnMotion(wxMouseEvent& evt);
+};
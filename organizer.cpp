@@ -0,0 +1,487 @@
+// organizer.cpp
+
+#include "organizer.h"
+#include "duplicates.h"
+#include "parallel.h"
+#include "similar.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// Below this many files per core the thread start-up costs more than it saves
+constexpr size_t kMinFilesPerWorker = 16 * 1024;
+
+// Chunk-local numbering of the "By Extension" groups a worker has seen.
+// Entries are kept in first-appearance order together with the first file
+// that produced them, so the merge can intern them in exactly the order the
+// serial pass would.
+class LocalExtensionIds {
+public:
+    CategoryId Get(const FileInfo& file, FileIndex index)
+    {
+        std::string_view name = file.NativeName();
+        uint64_t key = PackExtension(name.data(), name.size());
+        if (key != kUnpackableExtension) {
+            auto [it, inserted] = m_byKey.try_emplace(key, static_cast<CategoryId>(m_firstFile.size()));
+            if (inserted)
+                m_firstFile.push_back(index);
+            return it->second;
+        }
+
+        std::string ext = file.Name().AfterLast('.').Lower().utf8_string();
+        auto [it, inserted] = m_byLabel.try_emplace(std::move(ext), static_cast<CategoryId>(m_firstFile.size()));
+        if (inserted)
+            m_firstFile.push_back(index);
+        return it->second;
+    }
+
+    const std::vector<FileIndex>& FirstFiles() const { return m_firstFile; }
+
+private:
+    std::unordered_map<uint64_t, CategoryId>    m_byKey;
+    std::unordered_map<std::string, CategoryId> m_byLabel;
+    std::vector<FileIndex>                      m_firstFile;
+};
+
+int64_t ModifiedTime(const FileInfo& file)
+{
+    return file.modified.IsValid() ? static_cast<int64_t>(file.modified.GetTicks()) : 0;
+}
+
+} // namespace
+
+const char* StrategyName(Strategy strategy)
+{
+    switch (strategy) {
+    case Strategy::ByType:      return "By File Type";
+    case Strategy::ByDate:      return "By Date Modified";
+    case Strategy::BySize:      return "By File Size";
+    case Strategy::ByExtension: return "By Extension";
+    case Strategy::ByRealType:  return "By Real Type";
+    case Strategy::ByDuplicates: return "Find Duplicates";
+    case Strategy::ByRules:     return "By Rules";
+    case Strategy::BySimilarImages: return "Similar Images";
+    }
+    return "";
+}
+
+Organizer::Organizer(CategoryRegistry& categories, const ExtensionClassifier& classifier)
+    : m_categories(categories)
+    , m_classifier(classifier)
+    , m_sizeBuckets(MakeSizeBuckets(kDefaultSizeLimits, categories))
+    , m_ageBuckets(MakeAgeBuckets(kDefaultAgeLimits, categories))
+{
+}
+
+void Organizer::SetSizeLimits(std::span<const uint64_t> limits)
+{
+    m_sizeBuckets = MakeSizeBuckets(limits.empty() ? kDefaultSizeLimits : limits, m_categories);
+}
+
+void Organizer::SetAgeLimits(std::span<const uint64_t> limits)
+{
+    m_ageBuckets = MakeAgeBuckets(limits.empty() ? kDefaultAgeLimits : limits, m_categories);
+}
+
+// ---------------------------- Per-file rules -------------------------------
+
+CategoryId Organizer::TypeCategory(const FileInfo& file) const
+{
+    // Perfect-hash lookup on the name's extension, see classifier.h
+    return m_classifier.Classify(file.NativeName());
+}
+
+// Single-file versions of the bucketing kernels, see buckets.h
+CategoryId Organizer::SizeCategory(uint64_t bytes) const
+{
+    return m_sizeBuckets.categories[m_sizeBuckets.IndexOf(bytes)];
+}
+
+CategoryId Organizer::DateCategory(int64_t mtime, int64_t now) const
+{
+    // Files from the future count as brand new
+    int64_t age = now - mtime;
+    return m_ageBuckets.categories[age < 0 ? 0 : m_ageBuckets.IndexOf(static_cast<uint64_t>(age))];
+}
+
+// ------------------------------ Pipelines ----------------------------------
+
+void StrategyKeys::Clear()
+{
+    for (auto& column : columns)
+        column.clear();
+    sizes.clear();
+    mtimes.clear();
+    sniffed = 0;
+    deduplicated = 0;
+    compared = 0;
+}
+
+void Organizer::ComputeKeys(const std::vector<FileInfo>& files, StrategyKeys& keys, bool parallel)
+{
+    const size_t begin = keys.size();
+    if (begin >= files.size())
+        return;
+
+    PhaseScope phase("classify", files.size() - begin);
+
+    // One clock reading per key set, so every file is bucketed against the
+    // same instant however many batches it arrives in
+    if (begin == 0)
+        keys.now = wxDateTime::Now().GetTicks();
+
+    for (auto& column : keys.columns)
+        column.resize(files.size());
+    keys.sizes.resize(files.size());
+    keys.mtimes.resize(files.size());
+
+    unsigned chunks = parallel ? ParallelWorkerCount(files.size() - begin, kMinFilesPerWorker) : 1;
+    if (chunks > 1) {
+        ComputeKeysParallel(files, begin, keys, chunks);
+        return;
+    }
+
+    auto& byType = keys.columns[static_cast<size_t>(Strategy::ByType)];
+    auto& byExt  = keys.columns[static_cast<size_t>(Strategy::ByExtension)];
+    auto& byReal = keys.columns[static_cast<size_t>(Strategy::ByRealType)];
+    auto& byDupe = keys.columns[static_cast<size_t>(Strategy::ByDuplicates)];
+    auto& bySimilar = keys.columns[static_cast<size_t>(Strategy::BySimilarImages)];
+
+    for (size_t i = begin; i < files.size(); ++i) {
+        const FileInfo& f = files[i];
+        keys.sizes[i]  = f.size.GetValue();
+        keys.mtimes[i] = ModifiedTime(f);
+        byType[i] = TypeCategory(f);
+        byExt[i]  = m_categories.ExtensionCategory(f.NativeName());
+        byReal[i] = byType[i];
+        byDupe[i] = Category::Unique;
+        bySimilar[i] = byType[i];
+    }
+    BucketRange(keys, begin, files.size());
+    RuleRange(files, keys, begin, files.size());
+}
+
+void Organizer::ComputeKeysParallel(const std::vector<FileInfo>& files, size_t begin,
+                                    StrategyKeys& keys, unsigned chunks)
+{
+    const size_t n = files.size() - begin;
+
+    auto& byType = keys.columns[static_cast<size_t>(Strategy::ByType)];
+    auto& byExt  = keys.columns[static_cast<size_t>(Strategy::ByExtension)];
+    auto& byReal = keys.columns[static_cast<size_t>(Strategy::ByRealType)];
+    auto& byDupe = keys.columns[static_cast<size_t>(Strategy::ByDuplicates)];
+    auto& bySimilar = keys.columns[static_cast<size_t>(Strategy::BySimilarImages)];
+
+    // Pass 1: classify each chunk. Extension groups get chunk-local IDs so
+    // the shared registry is never touched from a worker.
+    std::vector<LocalExtensionIds> local(chunks);
+
+    ParallelChunks(n, chunks, [&](unsigned c, size_t from, size_t to) {
+        for (size_t i = begin + from; i < begin + to; ++i) {
+            const FileInfo& f = files[i];
+            keys.sizes[i]  = f.size.GetValue();
+            keys.mtimes[i] = ModifiedTime(f);
+            byType[i] = TypeCategory(f);
+            byExt[i]  = local[c].Get(f, static_cast<FileIndex>(i));
+            byReal[i] = byType[i];
+            byDupe[i] = Category::Unique;
+            bySimilar[i] = byType[i];
+        }
+        BucketRange(keys, begin + from, begin + to);
+        RuleRange(files, keys, begin + from, begin + to);
+    });
+
+    // Merge the local numberings in chunk order, which interns new groups in
+    // the same order as a single pass over the whole list would.
+    std::vector<std::vector<CategoryId>> remap(chunks);
+    for (unsigned c = 0; c < chunks; ++c) {
+        for (FileIndex first : local[c].FirstFiles())
+            remap[c].push_back(m_categories.ExtensionCategory(files[first].NativeName()));
+    }
+
+    // Pass 2: translate local IDs
+    ParallelChunks(n, chunks, [&](unsigned c, size_t from, size_t to) {
+        for (size_t i = begin + from; i < begin + to; ++i)
+            byExt[i] = remap[c][byExt[i]];
+    });
+}
+
+void Organizer::UpdateKeys(const std::vector<FileInfo>& files, StrategyKeys& keys,
+                           std::span<const FileIndex> changed)
+{
+    for (FileIndex i : changed) {
+        const FileInfo& f = files[i];
+        CategoryId type = TypeCategory(f);
+        keys.sizes[i]  = f.size.GetValue();
+        keys.mtimes[i] = ModifiedTime(f);
+        keys.columns[static_cast<size_t>(Strategy::ByType)][i] = type;
+        keys.columns[static_cast<size_t>(Strategy::ByDate)][i] = DateCategory(keys.mtimes[i], keys.now);
+        keys.columns[static_cast<size_t>(Strategy::BySize)][i] = SizeCategory(keys.sizes[i]);
+        keys.columns[static_cast<size_t>(Strategy::ByExtension)][i] = m_categories.ExtensionCategory(f.NativeName());
+        keys.columns[static_cast<size_t>(Strategy::ByRealType)][i] = type;
+        keys.columns[static_cast<size_t>(Strategy::ByDuplicates)][i] = Category::Unique;
+        keys.columns[static_cast<size_t>(Strategy::BySimilarImages)][i] = type;
+        RuleRange(files, keys, i, i + 1);
+
+        keys.sniffed = std::min<size_t>(keys.sniffed, i);
+    }
+
+    // Duplicate sets and similar images span the whole list
+    if (!changed.empty()) {
+        keys.deduplicated = 0;
+        keys.compared = 0;
+    }
+}
+
+void Organizer::RemoveKeys(StrategyKeys& keys, std::span<const FileIndex> remap)
+{
+    size_t sniffed = 0;
+    bool removed = false;
+    for (size_t i = 0; i < remap.size(); ++i) {
+        removed |= remap[i] == kRemovedFile;
+        if (i < keys.sniffed && remap[i] != kRemovedFile)
+            ++sniffed;
+    }
+
+    for (auto& column : keys.columns)
+        CompactByRemap(column, remap);
+    CompactByRemap(keys.sizes, remap);
+    CompactByRemap(keys.mtimes, remap);
+    keys.sniffed = sniffed;
+    if (removed) {
+        keys.deduplicated = 0;
+        keys.compared = 0;
+    }
+}
+
+void Organizer::Rebucket(StrategyKeys& keys, bool parallel) const
+{
+    PhaseScope phase("bucket", keys.size());
+    keys.now = wxDateTime::Now().GetTicks();
+
+    const size_t n = keys.size();
+    unsigned chunks = parallel ? ParallelWorkerCount(n, kMinFilesPerWorker) : 1;
+    ParallelChunks(n, chunks, [&](unsigned, size_t from, size_t to) { BucketRange(keys, from, to); });
+}
+
+void Organizer::BucketRange(StrategyKeys& keys, size_t begin, size_t end) const
+{
+    auto& byDate = keys.columns[static_cast<size_t>(Strategy::ByDate)];
+    auto& bySize = keys.columns[static_cast<size_t>(Strategy::BySize)];
+
+    BucketSizes(std::span(keys.sizes).subspan(begin, end - begin), m_sizeBuckets,
+                std::span(bySize).subspan(begin, end - begin));
+    BucketAges(std::span(keys.mtimes).subspan(begin, end - begin), keys.now, m_ageBuckets,
+               std::span(byDate).subspan(begin, end - begin));
+}
+
+void Organizer::ApplyRules(const std::vector<FileInfo>& files, StrategyKeys& keys, bool parallel) const
+{
+    PhaseScope phase("classify.rules", keys.size());
+
+    const size_t n = std::min(files.size(), keys.size());
+    unsigned chunks = parallel ? ParallelWorkerCount(n, kMinFilesPerWorker) : 1;
+    ParallelChunks(n, chunks, [&](unsigned, size_t from, size_t to) { RuleRange(files, keys, from, to); });
+}
+
+void Organizer::RuleRange(const std::vector<FileInfo>& files, StrategyKeys& keys, size_t begin, size_t end) const
+{
+    auto& byRules = keys.columns[static_cast<size_t>(Strategy::ByRules)];
+
+    m_rules.Classify(std::span(files).subspan(begin, end - begin),
+                     std::span(keys.sizes).subspan(begin, end - begin),
+                     std::span(keys.mtimes).subspan(begin, end - begin), keys.now,
+                     std::span(byRules).subspan(begin, end - begin));
+}
+
+void Organizer::Group(const StrategyKeys& keys, Strategy strategy, Grouping& grouping, bool parallel) const
+{
+    PhaseScope phase("group", keys.size());
+    grouping.categoryOf = keys.Column(strategy);
+
+    unsigned chunks = parallel ? ParallelWorkerCount(grouping.categoryOf.size(), kMinFilesPerWorker) : 1;
+    if (chunks > 1)
+        GroupParallel(grouping, m_categories.size(), chunks);
+    else
+        BuildGrouping(grouping, m_categories.size());
+}
+
+void Organizer::GroupPlan(const StrategyKeys& keys, std::span<const Strategy> levels, PlanTree& plan,
+                          Grouping& grouping, bool parallel) const
+{
+    PhaseScope phase("group", keys.size());
+
+    AssignLeaves(keys, levels, plan, grouping.categoryOf, parallel);
+
+    unsigned chunks = parallel ? ParallelWorkerCount(grouping.categoryOf.size(), kMinFilesPerWorker) : 1;
+    if (chunks > 1)
+        GroupParallel(grouping, plan.LeafCount(), chunks);
+    else
+        BuildGrouping(grouping, plan.LeafCount());
+}
+
+void Organizer::AssignLeaves(const StrategyKeys& keys, std::span<const Strategy> levels, PlanTree& plan,
+                             std::vector<CategoryId>& leafOf, bool parallel) const
+{
+    std::vector<std::span<const CategoryId>> columns;
+    for (Strategy level : levels)
+        columns.push_back(keys.Column(level));
+    plan.Assign(columns, leafOf, parallel);
+}
+
+std::vector<CategoryId> Organizer::SortedCategories(const Grouping& grouping) const
+{
+    PhaseScope phase("group.sort");
+    std::vector<CategoryId> ids = grouping.NonEmptyCategories();
+    std::sort(ids.begin(), ids.end(), [this](CategoryId a, CategoryId b) {
+        return m_categories.Label(a) < m_categories.Label(b);
+    });
+    return ids;
+}
+
+std::vector<CategoryId> Organizer::SortedLeaves(const PlanTree& plan, const Grouping& grouping) const
+{
+    PhaseScope phase("group.sort");
+    std::vector<CategoryId> leaves = grouping.NonEmptyCategories();
+
+    // Every category a leaf uses, ranked by label once
+    std::vector<uint32_t> rank(m_categories.size(), 0);
+    std::vector<CategoryId> used;
+    for (CategoryId leaf : leaves) {
+        for (size_t k = 0; k < plan.Levels(); ++k) {
+            CategoryId c = plan.Category(leaf, k);
+            if (rank[c] == 0) {
+                rank[c] = 1;
+                used.push_back(c);
+            }
+        }
+    }
+    std::sort(used.begin(), used.end(), [this](CategoryId a, CategoryId b) {
+        return m_categories.Label(a) < m_categories.Label(b);
+    });
+    for (size_t r = 0; r < used.size(); ++r)
+        rank[used[r]] = static_cast<uint32_t>(r);
+
+    std::sort(leaves.begin(), leaves.end(), [&plan, &rank](CategoryId a, CategoryId b) {
+        for (size_t k = 0; k < plan.Levels(); ++k) {
+            uint32_t ra = rank[plan.Category(a, k)];
+            uint32_t rb = rank[plan.Category(b, k)];
+            if (ra != rb)
+                return ra < rb;
+        }
+        return false;
+    });
+    return leaves;
+}
+
+void Organizer::SetSniffedCategories(StrategyKeys& keys, size_t begin,
+                                     std::span<const CategoryId> results)
+{
+    auto& byReal = keys.columns[static_cast<size_t>(Strategy::ByRealType)];
+    std::copy(results.begin(), results.end(), byReal.begin() + begin);
+    keys.sniffed = begin + results.size();
+}
+
+CategoryId Organizer::RankedCategory(std::vector<CategoryId>& ranks, size_t rank, const wxString& label)
+{
+    std::string utf8 = label.utf8_string();
+    if (rank < ranks.size()) {
+        m_categories.Relabel(ranks[rank], utf8);
+        return ranks[rank];
+    }
+    ranks.push_back(m_categories.Add(utf8));
+    return ranks.back();
+}
+
+uint64_t Organizer::SetDuplicateCategories(StrategyKeys& keys, const DuplicateFinder& finder)
+{
+    // One category per set. Sets come largest waste first and the
+    // zero-padded rank keeps that order under the label sort.
+    const auto& sets = finder.Sets();
+    int width = static_cast<int>(wxString::Format("%zu", sets.size()).length());
+
+    std::vector<CategoryId> setCategory(sets.size());
+    uint64_t wasted = 0;
+    for (size_t k = 0; k < sets.size(); ++k) {
+        wxString label = wxString::Format("Duplicates %0*zu: %u × %s", width, k + 1,
+                                          sets[k].count, FormatFileSize(sets[k].size));
+        setCategory[k] = RankedCategory(m_duplicateSets, k, label);
+        wasted += sets[k].WastedBytes();
+    }
+
+    auto& column = keys.columns[static_cast<size_t>(Strategy::ByDuplicates)];
+    for (size_t i = 0; i < finder.FileCount(); ++i) {
+        uint32_t set = finder.SetOf(i);
+        column[i] = set ? setCategory[set - 1] : Category::Unique;
+    }
+    keys.deduplicated = finder.FileCount();
+    return wasted;
+}
+
+uint64_t Organizer::SetSimilarCategories(StrategyKeys& keys, const SimilarImageFinder& finder)
+{
+    // As for duplicates: largest group first, and kept first by the rank
+    const auto& sets = finder.Sets();
+    int width = static_cast<int>(wxString::Format("%zu", sets.size()).length());
+
+    std::vector<CategoryId> setCategory(sets.size());
+    uint64_t grouped = 0;
+    for (size_t k = 0; k < sets.size(); ++k) {
+        wxString label = wxString::Format("Similar %0*zu: %u images, %s", width, k + 1,
+                                          sets[k].count, FormatFileSize(sets[k].bytes));
+        setCategory[k] = RankedCategory(m_similarSets, k, label);
+        grouped += sets[k].count;
+    }
+
+    const auto& byType = keys.columns[static_cast<size_t>(Strategy::ByType)];
+    auto& column = keys.columns[static_cast<size_t>(Strategy::BySimilarImages)];
+    for (size_t i = 0; i < finder.FileCount(); ++i) {
+        uint32_t set = finder.SetOf(i);
+        column[i] = set ? setCategory[set - 1] : byType[i];
+    }
+    keys.compared = finder.FileCount();
+    return grouped;
+}
+
+void Organizer::GroupParallel(Grouping& grouping, size_t categoryCount, unsigned chunks)
+{
+    const size_t n = grouping.categoryOf.size();
+
+    // One histogram per chunk
+    std::vector<std::vector<uint32_t>> histogram(chunks);
+
+    ParallelChunks(n, chunks, [&](unsigned c, size_t begin, size_t end) {
+        std::vector<uint32_t>& counts = histogram[c];
+        counts.assign(categoryCount, 0);
+        for (size_t i = begin; i < end; ++i)
+            ++counts[grouping.categoryOf[i]];
+    });
+
+    // Offsets: categories in ID order and, inside a category, chunks in file
+    // order. Each chunk's histogram becomes its private write cursors, so the
+    // scatter below needs no synchronisation and is as stable as BuildGrouping.
+    grouping.offsets.assign(categoryCount + 1, 0);
+    uint32_t running = 0;
+    for (size_t cat = 0; cat < categoryCount; ++cat) {
+        grouping.offsets[cat] = running;
+        for (unsigned c = 0; c < chunks; ++c) {
+            uint32_t count = histogram[c][cat];
+            histogram[c][cat] = running;
+            running += count;
+        }
+    }
+    grouping.offsets[categoryCount] = running;
+
+    // Scatter file indices into disjoint ranges
+    grouping.order.resize(n);
+
+    ParallelChunks(n, chunks, [&](unsigned c, size_t begin, size_t end) {
+        std::vector<uint32_t>& cursor = histogram[c];
+        for (size_t i = begin; i < end; ++i)
+            grouping.order[cursor[grouping.categoryOf[i]]++] = static_cast<FileIndex>(i);
+    });
+}
@@ -0,0 +1,171 @@
+// organizer.h
+//
+// Organization strategies. Every file's category under each strategy is
+// computed once, when the file is loaded, into StrategyKeys; organizing then
+// only groups one of those columns, so switching strategy is a counting sort.
+
+#pragma once
+
+#include "buckets.h"
+#include "classifier.h"
+#include "fileinfo.h"
+#include "grouping.h"
+#include "plantree.h"
+#include "rules.h"
+
+#include <span>
+#include <vector>
+
+class DuplicateFinder;
+class SimilarImageFinder;
+
+enum class Strategy {
+    ByType = 0,
+    ByDate,
+    BySize,
+    ByExtension,
+    ByRealType,
+    ByDuplicates,
+    ByRules,
+    BySimilarImages
+};
+
+inline constexpr size_t kStrategyCount = 8;
+
+// Display name, e.g. "By File Type"
+const char* StrategyName(Strategy strategy);
+
+// One category column per strategy, indexed in parallel with the file list,
+// plus the raw sizes and mtimes the size and date columns are bucketed from.
+// Dates are bucketed relative to `now`, read once when the first file is
+// keyed (or by Organizer::Rebucket()), so a run never straddles midnight.
+// The ByRealType column starts out as a copy of ByType; content sniffing
+// (see sniffer.h) then corrects it for files [0, sniffed). ByDuplicates
+// holds Category::Unique until a duplicate search over files
+// [0, deduplicated) fills in the sets (see duplicates.h). ByRules holds the
+// verdicts of the organizer's RuleSet (see rules.h), ages counted from `now`.
+// BySimilarImages starts out as a copy of ByType until a search for similar
+// images over files [0, compared) fills in the groups (see similar.h).
+struct StrategyKeys {
+    std::vector<CategoryId> columns[kStrategyCount];
+    std::vector<uint64_t>   sizes;      // bytes
+    std::vector<int64_t>    mtimes;     // seconds since the epoch
+    int64_t                 now = 0;    // seconds since the epoch
+    size_t                  sniffed = 0;
+    size_t                  deduplicated = 0;
+    size_t                  compared = 0;
+
+    size_t size() const { return columns[0].size(); }
+
+    const std::vector<CategoryId>& Column(Strategy strategy) const
+    {
+        return columns[static_cast<size_t>(strategy)];
+    }
+
+    void Clear();
+};
+
+class Organizer {
+public:
+    // The registry receives the per-extension groups of Strategy::ByExtension.
+    Organizer(CategoryRegistry& categories, const ExtensionClassifier& classifier);
+
+    // Appends the keys of files[keys.size()] .. files.back(). The parallel
+    // pipeline splits the new files into one contiguous chunk per core and
+    // produces exactly the same keys (and registers the same category IDs)
+    // as the serial one.
+    void ComputeKeys(const std::vector<FileInfo>& files, StrategyKeys& keys, bool parallel);
+
+    // Recomputes the keys of files changed in place (same path, new size or
+    // mtime). Their content-derived keys start over, so the sniffed,
+    // deduplicated and compared prefixes shrink to exclude them.
+    void UpdateKeys(const std::vector<FileInfo>& files, StrategyKeys& keys,
+                    std::span<const FileIndex> changed);
+
+    // Drops the keys of removed files; remap as for CompactByRemap().
+    static void RemoveKeys(StrategyKeys& keys, std::span<const FileIndex> remap);
+
+    // Bucket limits of "By File Size" (bytes) and "By Date Modified" (age in
+    // seconds), ascending; empty restores the defaults. Keys computed earlier
+    // keep their buckets until Rebucket().
+    void SetSizeLimits(std::span<const uint64_t> limits);
+    void SetAgeLimits(std::span<const uint64_t> limits);
+
+    const Buckets& SizeBuckets() const { return m_sizeBuckets; }
+    const Buckets& AgeBuckets() const { return m_ageBuckets; }
+
+    // Rules of "By Rules". Keys computed earlier keep their verdicts until
+    // ApplyRules().
+    void SetRules(RuleSet rules) { m_rules = std::move(rules); }
+    const RuleSet& Rules() const { return m_rules; }
+
+    // Classifies every file by the current rules again
+    void ApplyRules(const std::vector<FileInfo>& files, StrategyKeys& keys, bool parallel) const;
+
+    // Buckets the size and date columns of every file again, against the
+    // current limits and a fresh `now`.
+    void Rebucket(StrategyKeys& keys, bool parallel) const;
+
+    // Groups the files by one precomputed column.
+    void Group(const StrategyKeys& keys, Strategy strategy, Grouping& grouping, bool parallel) const;
+
+    // Groups the files by several columns at once, outermost first: the
+    // grouping is over the leaves of plan (see plantree.h), which keeps the
+    // leaves it already had.
+    void GroupPlan(const StrategyKeys& keys, std::span<const Strategy> levels, PlanTree& plan,
+                   Grouping& grouping, bool parallel) const;
+
+    // The leaf of every file under plan, as GroupPlan() files them, for
+    // UpdateGrouping() after the keys changed
+    void AssignLeaves(const StrategyKeys& keys, std::span<const Strategy> levels, PlanTree& plan,
+                      std::vector<CategoryId>& leafOf, bool parallel) const;
+
+    // Non-empty categories of a grouping, sorted by label
+    std::vector<CategoryId> SortedCategories(const Grouping& grouping) const;
+
+    // Non-empty leaves of a grouping over plan, sorted by label level by level
+    std::vector<CategoryId> SortedLeaves(const PlanTree& plan, const Grouping& grouping) const;
+
+    // Stores the categories a ContentSniffer found for files
+    // [begin, begin + results.size()) in the ByRealType column.
+    static void SetSniffedCategories(StrategyKeys& keys, size_t begin,
+                                     std::span<const CategoryId> results);
+
+    // Turns the sets of a finished duplicate search over files
+    // [0, finder.FileCount()) into one category per set, e.g.
+    // "Duplicates 01: 3 × 1.5 MB". Returns the reclaimable bytes. Sets of
+    // the same rank keep their category from search to search, relabelled,
+    // so repeated searches do not grow the registry; the same goes for
+    // SetSimilarCategories().
+    uint64_t SetDuplicateCategories(StrategyKeys& keys, const DuplicateFinder& finder);
+
+    // Turns the groups of a finished search for similar images over files
+    // [0, finder.FileCount()) into one category per group, e.g.
+    // "Similar 01: 4 images"; images without a match keep their type.
+    // Returns the number of images in groups.
+    uint64_t SetSimilarCategories(StrategyKeys& keys, const SimilarImageFinder& finder);
+
+    // Pure per-file rules
+    CategoryId TypeCategory(const FileInfo& file) const;
+    CategoryId SizeCategory(uint64_t bytes) const;
+    CategoryId DateCategory(int64_t mtime, int64_t now) const;
+
+private:
+    CategoryRegistry&          m_categories;
+    const ExtensionClassifier& m_classifier;
+    Buckets                    m_sizeBuckets;
+    Buckets                    m_ageBuckets;
+    RuleSet                    m_rules;
+
+    // The categories of duplicate and similar-image sets by rank
+    std::vector<CategoryId>    m_duplicateSets;
+    std::vector<CategoryId>    m_similarSets;
+
+    CategoryId RankedCategory(std::vector<CategoryId>& ranks, size_t rank, const wxString& label);
+
+    void ComputeKeysParallel(const std::vector<FileInfo>& files, size_t begin,
+                             StrategyKeys& keys, unsigned chunks);
+    void BucketRange(StrategyKeys& keys, size_t begin, size_t end) const;
+    void RuleRange(const std::vector<FileInfo>& files, StrategyKeys& keys, size_t begin, size_t end) const;
+    static void GroupParallel(Grouping& grouping, size_t categoryCount, unsigned chunks);
+};
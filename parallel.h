@@ -0,0 +1,46 @@
+// parallel.h
+//
+// Minimal fork/join helper for data-parallel passes over index ranges.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of workers worth using for n items when each should get at least
+// minPerWorker of them.
+inline unsigned ParallelWorkerCount(size_t n, size_t minPerWorker)
+{
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    size_t byWork = std::max<size_t>(1, n / std::max<size_t>(1, minPerWorker));
+    return static_cast<unsigned>(std::min(hw, byWork));
+}
+
+// Bounds of chunk c when [0, n) is split into `chunks` contiguous slices.
+inline size_t ChunkBegin(size_t n, unsigned chunks, unsigned c)
+{
+    return n * c / chunks;
+}
+
+// Calls fn(chunk, begin, end) for each of the `chunks` slices of [0, n),
+// one thread per slice (the calling thread takes the first), and returns
+// once all have finished.
+template <typename Fn>
+void ParallelChunks(size_t n, unsigned chunks, Fn&& fn)
+{
+    if (chunks <= 1) {
+        fn(0u, size_t(0), n);
+        return;
+    }
+
+    std::vector<std::jthread> workers;
+    workers.reserve(chunks - 1);
+    for (unsigned c = 1; c < chunks; ++c)
+        workers.emplace_back([&fn, n, chunks, c] {
+            fn(c, ChunkBegin(n, chunks, c), ChunkBegin(n, chunks, c + 1));
+        });
+
+    fn(0u, size_t(0), ChunkBegin(n, chunks, 1));
+}
@@ -0,0 +1,169 @@
+// pathstore.cpp
+
+#include "pathstore.h"
+
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+#ifdef _WIN32
+constexpr char kSeparator = '\\';
+bool IsSeparator(char c) { return c == '\\' || c == '/'; }
+#else
+constexpr char kSeparator = '/';
+bool IsSeparator(char c) { return c == '/'; }
+#endif
+
+} // namespace
+
+thread_local PathStore::Slice PathStore::t_slice;
+
+PathStore& PathStore::Get()
+{
+    static PathStore store;
+    return store;
+}
+
+uint32_t PathStore::ReserveLocked(size_t bytes)
+{
+    // Nothing spans two blocks
+    uint64_t at = m_used;
+    if ((at & (kBlockBytes - 1)) + bytes > kBlockBytes)
+        at = (at + kBlockBytes - 1) & ~uint64_t(kBlockBytes - 1);
+    if (at + bytes > uint64_t(kMaxBlocks) * kBlockBytes || bytes > kBlockBytes)
+        throw std::bad_alloc();
+
+    std::unique_ptr<char[]>& block = m_blocks[at >> kBlockBits];
+    if (!block)
+        block = std::make_unique<char[]>(kBlockBytes);
+    m_used = at + bytes;
+    return static_cast<uint32_t>(at);
+}
+
+NameRef PathStore::AddName(std::string_view name)
+{
+    // Each thread fills a slice of its own, so adding a name takes no lock
+    Slice& slice = t_slice;
+    if (slice.generation != m_generation.load(std::memory_order_acquire) || slice.end - slice.at < name.size()) {
+        std::lock_guard lock(m_mutex);
+        size_t bytes = std::max(kSliceBytes, name.size());
+        slice.at = ReserveLocked(bytes);
+        slice.end = static_cast<uint32_t>(slice.at + bytes);
+        slice.generation = m_generation.load(std::memory_order_relaxed);
+    }
+
+    NameRef ref{slice.at, static_cast<uint32_t>(name.size())};
+    std::memcpy(m_blocks[ref.offset >> kBlockBits].get() + (ref.offset & (kBlockBytes - 1)), name.data(), name.size());
+    slice.at += ref.length;
+    return ref;
+}
+
+DirId PathStore::ChildLocked(DirId parent, std::string_view name)
+{
+    std::string key(reinterpret_cast<const char*>(&parent), sizeof(parent));
+    key += name;
+    auto [it, inserted] = m_dirIds.try_emplace(std::move(key), static_cast<DirId>(m_dirCount.load()));
+    if (!inserted)
+        return it->second;
+
+    DirId dir = it->second;
+    if ((dir >> kDirBlockBits) >= kMaxDirBlocks)
+        throw std::bad_alloc();
+    std::unique_ptr<DirEntry[]>& block = m_dirs[dir >> kDirBlockBits];
+    if (!block)
+        block = std::make_unique<DirEntry[]>(kDirBlockSize);
+
+    NameRef ref{ReserveLocked(name.size()), static_cast<uint32_t>(name.size())};
+    std::memcpy(m_blocks[ref.offset >> kBlockBits].get() + (ref.offset & (kBlockBytes - 1)), name.data(), name.size());
+    block[dir & (kDirBlockSize - 1)] = DirEntry{parent, ref};
+    m_dirCount.store(dir + 1, std::memory_order_release);
+    return dir;
+}
+
+DirId PathStore::InternDirectory(std::string_view path)
+{
+    std::lock_guard lock(m_mutex);
+
+    // The root component keeps its separators: "/", "//server" or "C:\"
+    size_t i = 0;
+    while (i < path.size() && IsSeparator(path[i]))
+        ++i;
+#ifdef _WIN32
+    if (i == 0 && path.size() >= 2 && path[1] == ':') {
+        i = 2;
+        while (i < path.size() && IsSeparator(path[i]))
+            ++i;
+    }
+#endif
+    DirId dir = i > 0 ? ChildLocked(kNoDir, path.substr(0, i)) : kNoDir;
+
+    while (i < path.size()) {
+        size_t end = i;
+        while (end < path.size() && !IsSeparator(path[end]))
+            ++end;
+        if (end > i)
+            dir = ChildLocked(dir, path.substr(i, end - i));
+        i = end + 1;
+    }
+    return dir;
+}
+
+void PathStore::AppendPath(std::string& out, DirId dir, std::string_view name) const
+{
+    // Innermost first, then appended outermost first
+    DirId chain[256];
+    std::vector<DirId> deep;
+    size_t depth = 0;
+    for (DirId d = dir; d != kNoDir; d = Parent(d)) {
+        if (depth < std::size(chain))
+            chain[depth] = d;
+        else
+            deep.push_back(d);
+        ++depth;
+    }
+
+    for (size_t k = depth; k-- > 0;) {
+        DirId d = k < std::size(chain) ? chain[k] : deep[k - std::size(chain)];
+        if (!out.empty() && !IsSeparator(out.back()))
+            out += kSeparator;
+        out += DirectoryName(d);
+    }
+    if (!name.empty()) {
+        if (!out.empty() && !IsSeparator(out.back()))
+            out += kSeparator;
+        out += name;
+    }
+}
+
+size_t PathStore::MemoryUsage() const
+{
+    std::lock_guard lock(m_mutex);
+    size_t blocks = 0;
+    for (const auto& block : m_blocks)
+        blocks += block ? 1 : 0;
+    size_t dirBlocks = (m_dirCount.load() + kDirBlockSize - 1) / kDirBlockSize;
+
+    // Lookup entries: key, ID and node overhead
+    size_t lookup = 0;
+    for (const auto& [key, id] : m_dirIds)
+        lookup += key.capacity() + 48;
+
+    return blocks * kBlockBytes + dirBlocks * kDirBlockSize * sizeof(DirEntry) + lookup;
+}
+
+void PathStore::Clear()
+{
+    std::lock_guard lock(m_mutex);
+    for (auto& block : m_blocks)
+        block.reset();
+    for (auto& block : m_dirs)
+        block.reset();
+    m_dirIds.clear();
+    m_used = 0;
+    m_dirCount.store(0);
+
+    // Invalidates the slices threads still hold
+    m_generation.fetch_add(1);
+}
@@ -0,0 +1,105 @@
+// pathstore.h
+//
+// Compact storage behind FileInfo's paths. Directories are interned once
+// into a table of (parent, name) entries, and the leaf name of every file
+// is packed into a shared byte arena, so a file record carries two small
+// references instead of two wide strings. Names are kept in file-system
+// form (see ToFileSystem()): UTF-8, or on Linux the bytes the kernel gave.
+// Full paths are only rebuilt when something needs them.
+//
+// Adding is thread-safe and stored bytes never move, so the GUI thread can
+// read the files it was handed while scanner threads keep adding more.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using DirId = uint32_t;
+inline constexpr DirId kNoDir = ~DirId(0);
+
+// Bytes [offset, offset + length) of the name arena
+struct NameRef {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+class PathStore {
+public:
+    // The store of every FileInfo in the process
+    static PathStore& Get();
+
+    // Interns a directory and its ancestors, e.g. "/home/me/Photos"; a
+    // trailing separator is ignored, so "/home/me/" is the same directory.
+    DirId InternDirectory(std::string_view path);
+
+    NameRef AddName(std::string_view name);
+
+    std::string_view Name(NameRef ref) const
+    {
+        return std::string_view(m_blocks[ref.offset >> kBlockBits].get() + (ref.offset & (kBlockBytes - 1)),
+                                ref.length);
+    }
+
+    DirId            Parent(DirId dir) const { return Directory(dir).parent; }
+    std::string_view DirectoryName(DirId dir) const { return Name(Directory(dir).name); }
+
+    // Appends the full path of dir, then of name inside it when given
+    void AppendPath(std::string& out, DirId dir, std::string_view name = {}) const;
+
+    size_t DirectoryCount() const { return m_dirCount.load(std::memory_order_acquire); }
+
+    // Bytes held for names and directories
+    size_t MemoryUsage() const;
+
+    // Forgets everything. Only while no FileInfo refers to the store and
+    // nothing adds to it.
+    void Clear();
+
+private:
+    static constexpr unsigned kBlockBits = 22;                  // 4 MiB of names per block
+    static constexpr size_t   kBlockBytes = size_t(1) << kBlockBits;
+    static constexpr size_t   kMaxBlocks = size_t(1) << (32 - kBlockBits);
+    static constexpr size_t   kSliceBytes = 64 * 1024;          // taken by one thread at a time
+
+    static constexpr unsigned kDirBlockBits = 14;
+    static constexpr size_t   kDirBlockSize = size_t(1) << kDirBlockBits;
+    static constexpr size_t   kMaxDirBlocks = size_t(1) << 14;
+
+    struct DirEntry {
+        DirId   parent;
+        NameRef name;
+    };
+
+    struct Slice {
+        uint64_t generation = 0;
+        uint32_t at = 0;
+        uint32_t end = 0;
+    };
+
+    // Fixed tables of blocks, so that readers never see them move
+    std::array<std::unique_ptr<char[]>, kMaxBlocks>        m_blocks;
+    std::array<std::unique_ptr<DirEntry[]>, kMaxDirBlocks> m_dirs;
+
+    mutable std::mutex m_mutex;     // guards everything below and block allocation
+    uint64_t           m_used = 0;  // arena bytes handed out
+    std::atomic<size_t>   m_dirCount{0};
+    std::atomic<uint64_t> m_generation{1};
+    std::unordered_map<std::string, DirId> m_dirIds;   // parent ID bytes + name
+
+    static thread_local Slice t_slice;
+
+    const DirEntry& Directory(DirId dir) const
+    {
+        return m_dirs[dir >> kDirBlockBits][dir & (kDirBlockSize - 1)];
+    }
+
+    uint32_t ReserveLocked(size_t bytes);
+    DirId    ChildLocked(DirId parent, std::string_view name);
+};
@@ -0,0 +1,441 @@
+// planexport.cpp
+
+#include "planexport.h"
+#include "trace.h"
+
+#include <wx/ffile.h>
+#include <wx/filename.h>
+
+#include <charconv>
+#include <cstdio>
+#include <string_view>
+
+namespace {
+
+void EncodeUtf8(char32_t cp, std::string& out)
+{
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Calls fn(code point) for every character of s. Works on the string's
+// wide representation, which needs no conversion in wxWidgets' default
+// builds; UTF-16 surrogate pairs are combined and lone ones replaced.
+template <typename Fn>
+void ForEachCodePoint(const wxString& s, Fn fn)
+{
+    const wchar_t* p = s.wc_str();
+    const wchar_t* end = p + s.length();
+    while (p < end) {
+        char32_t cp = static_cast<char32_t>(*p++);
+        if constexpr (sizeof(wchar_t) == 2) {
+            if (cp >= 0xD800 && cp < 0xDC00 && p < end && *p >= 0xDC00 && *p < 0xE000)
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (static_cast<char32_t>(*p++) - 0xDC00);
+        }
+        if ((cp >= 0xD800 && cp < 0xE000) || cp > 0x10FFFF)
+            cp = 0xFFFD;
+        fn(cp);
+    }
+}
+
+void AppendUtf8(std::string& out, const wxString& s)
+{
+    ForEachCodePoint(s, [&out](char32_t cp) { EncodeUtf8(cp, out); });
+}
+
+void AppendJsonString(std::string& out, const wxString& s)
+{
+    static constexpr char kHex[] = "0123456789abcdef";
+
+    out += '"';
+    ForEachCodePoint(s, [&out](char32_t cp) {
+        if (cp == '"' || cp == '\\') {
+            out += '\\';
+            out += static_cast<char>(cp);
+        } else if (cp < 0x20) {
+            out += "\\u00";
+            out += kHex[cp >> 4];
+            out += kHex[cp & 0xF];
+        } else {
+            EncodeUtf8(cp, out);
+        }
+    });
+    out += '"';
+}
+
+// Length of the well-formed UTF-8 sequence s starts with, or 0
+size_t Utf8SequenceLength(std::string_view s)
+{
+    auto byte = [&s](size_t k) { return static_cast<unsigned char>(s[k]); };
+    auto trail = [&](size_t k, unsigned char lo = 0x80, unsigned char hi = 0xBF) {
+        return k < s.size() && byte(k) >= lo && byte(k) <= hi;
+    };
+
+    unsigned char lead = byte(0);
+    if (lead < 0x80)
+        return 1;
+    if (lead >= 0xC2 && lead <= 0xDF)
+        return trail(1) ? 2 : 0;
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        // No overlong forms, no surrogates
+        bool second = lead == 0xE0 ? trail(1, 0xA0) : lead == 0xED ? trail(1, 0x80, 0x9F) : trail(1);
+        return second && trail(2) ? 3 : 0;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        bool second = lead == 0xF0 ? trail(1, 0x90) : lead == 0xF4 ? trail(1, 0x80, 0x8F) : trail(1);
+        return second && trail(2) && trail(3) ? 4 : 0;
+    }
+    return 0;
+}
+
+// Appends file-system bytes (see ToFileSystem()) as UTF-8, passing every
+// ASCII character through ascii(out, ch) and copying the rest unchanged.
+// Bytes that are not UTF-8, which Linux allows in names, become U+FFFD.
+template <typename Fn>
+void AppendNative(std::string& out, std::string_view bytes, Fn ascii)
+{
+    size_t i = 0;
+    while (i < bytes.size()) {
+        if (static_cast<unsigned char>(bytes[i]) < 0x80) {
+            ascii(out, bytes[i++]);
+            continue;
+        }
+        size_t n = Utf8SequenceLength(bytes.substr(i));
+        if (n == 0) {
+            out += "\xEF\xBF\xBD";
+            ++i;
+        } else {
+            out.append(bytes.data() + i, n);
+            i += n;
+        }
+    }
+}
+
+void AppendNativeUtf8(std::string& out, std::string_view bytes)
+{
+    AppendNative(out, bytes, [](std::string& o, char ch) { o += ch; });
+}
+
+void AppendNativeJsonString(std::string& out, std::string_view bytes)
+{
+    static constexpr char kHex[] = "0123456789abcdef";
+
+    out += '"';
+    AppendNative(out, bytes, [](std::string& o, char ch) {
+        if (ch == '"' || ch == '\\') {
+            o += '\\';
+            o += ch;
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            o += "\\u00";
+            o += kHex[ch >> 4];
+            o += kHex[ch & 0xF];
+        } else {
+            o += ch;
+        }
+    });
+    out += '"';
+}
+
+void AppendNativeCsvField(std::string& out, std::string_view bytes)
+{
+    if (bytes.find_first_of(",\"\r\n") == std::string_view::npos) {
+        AppendNativeUtf8(out, bytes);
+        return;
+    }
+
+    out += '"';
+    AppendNative(out, bytes, [](std::string& o, char ch) {
+        if (ch == '"')
+            o += '"';
+        o += ch;
+    });
+    out += '"';
+}
+
+// Quotes the field only when it needs it
+void AppendCsvField(std::string& out, const wxString& s)
+{
+    bool quote = false;
+    ForEachCodePoint(s, [&quote](char32_t cp) {
+        quote |= cp == ',' || cp == '"' || cp == '\r' || cp == '\n';
+    });
+    if (!quote) {
+        AppendUtf8(out, s);
+        return;
+    }
+
+    out += '"';
+    ForEachCodePoint(s, [&out](char32_t cp) {
+        if (cp == '"')
+            out += '"';
+        EncodeUtf8(cp, out);
+    });
+    out += '"';
+}
+
+template <typename Int>
+void AppendInteger(std::string& out, Int value)
+{
+    char digits[24];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, end);
+}
+
+void AppendHumanSize(std::string& out, uint64_t bytes)
+{
+    // Same rendering as FormatFileSize() in the GUI
+    double b = static_cast<double>(bytes);
+    char text[32];
+    int n;
+    if (b < 1024.0)
+        n = std::snprintf(text, sizeof(text), "%.0f B", b);
+    else if (b < 1024.0 * 1024.0)
+        n = std::snprintf(text, sizeof(text), "%.1f KB", b / 1024.0);
+    else if (b < 1024.0 * 1024.0 * 1024.0)
+        n = std::snprintf(text, sizeof(text), "%.1f MB", b / (1024.0 * 1024.0));
+    else
+        n = std::snprintf(text, sizeof(text), "%.1f GB", b / (1024.0 * 1024.0 * 1024.0));
+    out.append(text, n);
+}
+
+} // namespace
+
+PlanFormat PlanFormatFromFileName(const wxString& filename)
+{
+    wxString ext = wxFileName(filename).GetExt().Lower();
+    if (ext == "jsonl" || ext == "ndjson")
+        return PlanFormat::JsonLines;
+    if (ext == "csv")
+        return PlanFormat::Csv;
+    return PlanFormat::Tree;
+}
+
+bool PlanExporter::Export(const wxString& filename, PlanFormat format, const wxString& title,
+                          const std::vector<FileInfo>& files, const Grouping& grouping,
+                          std::span<const CategoryId> order, const CategoryRegistry& categories)
+{
+    wxFFile file(filename, "wb");
+    if (!file.IsOpened())
+        return false;
+
+    bool ok = Export(file, format, title, files, grouping, order, categories);
+    return file.Close() && ok;
+}
+
+bool PlanExporter::Export(const wxString& filename, PlanFormat format, const wxString& title,
+                          const std::vector<FileInfo>& files, const Grouping& grouping, const PlanTree& tree,
+                          const PlanOutline& outline, std::span<const CategoryId> leaves,
+                          const CategoryRegistry& categories)
+{
+    wxFFile file(filename, "wb");
+    if (!file.IsOpened())
+        return false;
+
+    bool ok = Export(file, format, title, files, grouping, tree, outline, leaves, categories);
+    return file.Close() && ok;
+}
+
+bool PlanExporter::Export(wxFFile& file, PlanFormat format, const wxString& title,
+                          const std::vector<FileInfo>& files, const Grouping& grouping,
+                          std::span<const CategoryId> order, const CategoryRegistry& categories)
+{
+    PhaseScope phase("export", grouping.FileCount());
+
+    Begin(file, format, title, 1);
+    for (CategoryId id : order) {
+        if (format == PlanFormat::Tree)
+            AppendHeading(categories.Label(id), grouping.GroupSize(id), nullptr, 0);
+        AppendGroup(format, files, grouping.Files(id), std::span<const CategoryId>(&id, 1), 1, categories);
+        if (format == PlanFormat::Tree)
+            m_buf += '\n';
+    }
+    return End(file, phase);
+}
+
+bool PlanExporter::Export(wxFFile& file, PlanFormat format, const wxString& title,
+                          const std::vector<FileInfo>& files, const Grouping& grouping, const PlanTree& tree,
+                          const PlanOutline& outline, std::span<const CategoryId> leaves,
+                          const CategoryRegistry& categories)
+{
+    PhaseScope phase("export", grouping.FileCount());
+
+    const size_t levels = tree.Levels();
+    Begin(file, format, title, levels);
+
+    // Depth first, from the top level down
+    std::vector<CategoryId> path(levels);
+    auto visit = [&](auto& self, const PlanOutline::Node& node) -> void {
+        if (format == PlanFormat::Tree)
+            AppendHeading(categories.Label(node.category), node.files, &node.bytes, node.level);
+        if (node.group != PlanOutline::kNoGroup) {
+            CategoryId leaf = leaves[node.group];
+            for (size_t k = 0; k < levels; ++k)
+                path[k] = tree.Category(leaf, k);
+            AppendGroup(format, files, grouping.Files(leaf), path, node.level + 1, categories);
+        }
+        for (const PlanOutline::Node& child : outline.Children(node))
+            self(self, child);
+    };
+    for (size_t r = 0; r < outline.roots; ++r) {
+        visit(visit, outline.nodes[r]);
+        if (format == PlanFormat::Tree)
+            m_buf += '\n';
+    }
+    return End(file, phase);
+}
+
+void PlanExporter::Begin(wxFFile& file, PlanFormat format, const wxString& title, size_t levels)
+{
+    m_file = &file;
+    m_ok = true;
+    m_written = 0;
+    m_buf.clear();
+    m_buf.reserve(kFlushBytes + 64 * 1024);
+
+    switch (format) {
+    case PlanFormat::Tree:
+        AppendUtf8(m_buf, title);
+        m_buf += '\n';
+        m_buf.append(60, '=');
+        m_buf += "\n\n";
+        break;
+
+    case PlanFormat::JsonLines:
+        break;
+
+    case PlanFormat::Csv:
+        m_buf += "path,";
+        if (levels == 1) {
+            m_buf += "category,";
+        } else {
+            for (size_t k = 1; k <= levels; ++k) {
+                m_buf += "category_";
+                AppendInteger(m_buf, k);
+                m_buf += ',';
+            }
+        }
+        m_buf += "size,mtime\r\n";
+        break;
+    }
+}
+
+bool PlanExporter::End(wxFFile& file, PhaseScope& phase)
+{
+    Flush();
+    m_file = nullptr;
+    phase.AddBytes(m_written);
+    return file.Flush() && m_ok;
+}
+
+void PlanExporter::AppendHeading(const wxString& label, uint64_t files, const uint64_t* bytes, size_t depth)
+{
+    m_buf.append(3 * depth, ' ');
+    m_buf += "📁 ";
+    AppendUtf8(m_buf, label);
+    m_buf += "/ (";
+    AppendInteger(m_buf, files);
+    m_buf += " files";
+    if (bytes) {
+        m_buf += ", ";
+        AppendHumanSize(m_buf, *bytes);
+    }
+    m_buf += ")\n";
+}
+
+void PlanExporter::AppendGroup(PlanFormat format, const std::vector<FileInfo>& files,
+                               std::span<const FileIndex> group, std::span<const CategoryId> path,
+                               size_t depth, const CategoryRegistry& categories)
+{
+    switch (format) {
+    case PlanFormat::Tree:
+        for (FileIndex i : group) {
+            const FileInfo& f = files[i];
+            m_buf.append(3 * depth, ' ');
+            m_buf += "└─ ";
+            AppendNativeUtf8(m_buf, f.NativeName());
+            m_buf += " (";
+            AppendHumanSize(m_buf, f.size.GetValue());
+            m_buf += ")\n";
+            MaybeFlush();
+        }
+        break;
+
+    case PlanFormat::JsonLines:
+        // The labels are escaped once per group, not once per file
+        m_label = ",\"category\":";
+        if (path.size() == 1) {
+            AppendJsonString(m_label, categories.Label(path[0]));
+        } else {
+            m_label += '[';
+            for (size_t k = 0; k < path.size(); ++k) {
+                if (k > 0)
+                    m_label += ',';
+                AppendJsonString(m_label, categories.Label(path[k]));
+            }
+            m_label += ']';
+        }
+        m_label += ",\"size\":";
+
+        for (FileIndex i : group) {
+            const FileInfo& f = files[i];
+            m_path.clear();
+            PathStore::Get().AppendPath(m_path, f.dir, f.NativeName());
+            m_buf += "{\"path\":";
+            AppendNativeJsonString(m_buf, m_path);
+            m_buf += m_label;
+            AppendInteger(m_buf, f.size.GetValue());
+            m_buf += ",\"mtime\":";
+            if (f.modified.IsValid())
+                AppendInteger(m_buf, f.modified.GetTicks());
+            else
+                m_buf += "null";
+            m_buf += "}\n";
+            MaybeFlush();
+        }
+        break;
+
+    case PlanFormat::Csv:
+        m_label.clear();
+        for (CategoryId id : path) {
+            m_label += ',';
+            AppendCsvField(m_label, categories.Label(id));
+        }
+        m_label += ',';
+
+        for (FileIndex i : group) {
+            const FileInfo& f = files[i];
+            m_path.clear();
+            PathStore::Get().AppendPath(m_path, f.dir, f.NativeName());
+            AppendNativeCsvField(m_buf, m_path);
+            m_buf += m_label;
+            AppendInteger(m_buf, f.size.GetValue());
+            m_buf += ',';
+            if (f.modified.IsValid())
+                AppendInteger(m_buf, f.modified.GetTicks());
+            m_buf += "\r\n";
+            MaybeFlush();
+        }
+        break;
+    }
+}
+
+void PlanExporter::Flush()
+{
+    if (m_ok && !m_buf.empty() && m_file->Write(m_buf.data(), m_buf.size()) != m_buf.size())
+        m_ok = false;
+    m_written += m_buf.size();
+    m_buf.clear();
+}
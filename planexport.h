@@ -0,0 +1,87 @@
+// planexport.h
+//
+// Writes an organization plan to a file as it walks the grouping. Records
+// are formatted straight into one large buffer that is flushed whenever it
+// fills up, so no line is ever held as a wxString and memory stays flat
+// regardless of the plan's size. Paths are copied from the PathStore as
+// the bytes they are stored in; only category labels go through wxString.
+
+#pragma once
+
+#include "classifier.h"
+#include "fileinfo.h"
+#include "grouping.h"
+#include "plantree.h"
+
+#include <span>
+#include <string>
+#include <vector>
+
+class PhaseScope;
+class wxFFile;
+
+enum class PlanFormat {
+    Tree,           // the human-readable folder tree
+    JsonLines,      // {"path", "category", "size", "mtime"} per line
+    Csv             // path,category,size,mtime with a header row (RFC 4180)
+};
+
+// The format a file name's extension asks for: .jsonl/.ndjson, .csv, and
+// Tree for anything else
+PlanFormat PlanFormatFromFileName(const wxString& filename);
+
+class PlanExporter {
+public:
+    // Buffered bytes that trigger a write to the file
+    static constexpr size_t kFlushBytes = 1 << 20;
+
+    // Writes the files of every category in `order`, in that order, to
+    // `filename`, replacing it. mtime is in seconds since the epoch, empty
+    // (CSV) or null (JSON) for unknown dates. Returns false if the file
+    // could not be written.
+    bool Export(const wxString& filename, PlanFormat format, const wxString& title,
+                const std::vector<FileInfo>& files, const Grouping& grouping,
+                std::span<const CategoryId> order, const CategoryRegistry& categories);
+
+    // Same, to an open file such as standard output, which is left open
+    bool Export(wxFFile& file, PlanFormat format, const wxString& title,
+                const std::vector<FileInfo>& files, const Grouping& grouping,
+                std::span<const CategoryId> order, const CategoryRegistry& categories);
+
+    // Same for a hierarchical plan (see plantree.h): grouping is over the
+    // leaves of tree, which are written in the order of outline. The tree
+    // format nests the folders and totals every one of them, JSON Lines
+    // gives "category" as an array of labels, outermost first, and CSV has
+    // the columns category_1 .. category_N instead of category.
+    bool Export(const wxString& filename, PlanFormat format, const wxString& title,
+                const std::vector<FileInfo>& files, const Grouping& grouping, const PlanTree& tree,
+                const PlanOutline& outline, std::span<const CategoryId> leaves,
+                const CategoryRegistry& categories);
+
+    bool Export(wxFFile& file, PlanFormat format, const wxString& title,
+                const std::vector<FileInfo>& files, const Grouping& grouping, const PlanTree& tree,
+                const PlanOutline& outline, std::span<const CategoryId> leaves,
+                const CategoryRegistry& categories);
+
+private:
+    // Kept across exports so the buffer is allocated once
+    std::string m_buf;
+    std::string m_label;
+    std::string m_path;
+    wxFFile*    m_file = nullptr;
+    uint64_t    m_written = 0;
+    bool        m_ok = true;
+
+    void Begin(wxFFile& file, PlanFormat format, const wxString& title, size_t levels);
+    bool End(wxFFile& file, PhaseScope& phase);
+
+    // A folder line of the tree format, totalled in bytes too if given
+    void AppendHeading(const wxString& label, uint64_t files, const uint64_t* bytes, size_t depth);
+
+    // The files of one group, filed under the categories of path
+    void AppendGroup(PlanFormat format, const std::vector<FileInfo>& files, std::span<const FileIndex> group,
+                     std::span<const CategoryId> path, size_t depth, const CategoryRegistry& categories);
+
+    void Flush();
+    void MaybeFlush() { if (m_buf.size() >= kFlushBytes) Flush(); }
+};
@@ -0,0 +1,161 @@
+// plantree.cpp
+
+#include "plantree.h"
+#include "parallel.h"
+#include "trace.h"
+
+namespace {
+
+// Below this many files per core the thread start-up costs more than it saves
+constexpr size_t kMinFilesPerWorker = 16 * 1024;
+
+} // namespace
+
+// ------------------------------- PlanTree -------------------------------
+
+void PlanTree::SetLevels(size_t levels)
+{
+    Clear();
+    m_levels = std::clamp<size_t>(levels, 1, kMaxPlanLevels);
+}
+
+void PlanTree::Clear()
+{
+    m_paths.clear();
+    m_leafOf.clear();
+}
+
+CategoryId PlanTree::Intern(const Key& key)
+{
+    auto [it, inserted] = m_leafOf.try_emplace(key, static_cast<CategoryId>(LeafCount()));
+    if (inserted)
+        m_paths.insert(m_paths.end(), key.ids, key.ids + m_levels);
+    return it->second;
+}
+
+void PlanTree::Assign(std::span<const std::span<const CategoryId>> columns, std::vector<CategoryId>& leafOf,
+                      bool parallel)
+{
+    const size_t n = columns.empty() ? 0 : columns[0].size();
+    PhaseScope phase("group.plan", n);
+
+    const size_t levels = std::min(m_levels, columns.size());
+    auto keyOf = [&columns, levels](size_t i) {
+        Key key;
+        for (size_t k = 0; k < levels; ++k)
+            key.ids[k] = columns[k][i];
+        return key;
+    };
+
+    leafOf.resize(n);
+    unsigned chunks = parallel ? ParallelWorkerCount(n, kMinFilesPerWorker) : 1;
+    if (chunks <= 1) {
+        // Neighbouring files tend to share a combination
+        Key last;
+        CategoryId lastLeaf = 0;
+        for (size_t i = 0; i < n; ++i) {
+            Key key = keyOf(i);
+            if (i == 0 || !(key == last)) {
+                last = key;
+                lastLeaf = Intern(key);
+            }
+            leafOf[i] = lastLeaf;
+        }
+        return;
+    }
+
+    // Chunk-local numbering in first-appearance order, so that interning
+    // the chunks' combinations in chunk order matches the serial pass
+    std::vector<std::vector<Key>> local(chunks);
+    ParallelChunks(n, chunks, [&](unsigned c, size_t begin, size_t end) {
+        LeafMap ids;
+        Key last;
+        CategoryId lastId = 0;
+        for (size_t i = begin; i < end; ++i) {
+            Key key = keyOf(i);
+            if (i == begin || !(key == last)) {
+                last = key;
+                auto [it, inserted] = ids.try_emplace(key, static_cast<CategoryId>(local[c].size()));
+                if (inserted)
+                    local[c].push_back(key);
+                lastId = it->second;
+            }
+            leafOf[i] = lastId;
+        }
+    });
+
+    std::vector<std::vector<CategoryId>> remap(chunks);
+    for (unsigned c = 0; c < chunks; ++c) {
+        remap[c].reserve(local[c].size());
+        for (const Key& key : local[c])
+            remap[c].push_back(Intern(key));
+    }
+
+    ParallelChunks(n, chunks, [&](unsigned c, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            leafOf[i] = remap[c][leafOf[i]];
+    });
+}
+
+// ------------------------------ PlanOutline ------------------------------
+
+void PlanOutline::Clear()
+{
+    nodes.clear();
+    roots = 0;
+}
+
+void PlanOutline::Build(const PlanTree& tree, const Grouping& grouping, std::span<const CategoryId> leaves,
+                        std::span<const uint64_t> sizes)
+{
+    PhaseScope phase("group.outline", grouping.FileCount());
+    Clear();
+
+    const size_t levels = tree.Levels();
+
+    // Level by level: a node starts wherever the prefix up to its level
+    // differs from the previous leaf's. Leaves come in plan order, so each
+    // level's nodes come out grouped by parent and in the parent's order.
+    std::vector<uint32_t> nodeOf(leaves.size());
+    for (size_t level = 0; level < levels; ++level) {
+        for (size_t j = 0; j < leaves.size(); ++j) {
+            bool same = j > 0;
+            for (size_t k = 0; same && k <= level; ++k)
+                same = tree.Category(leaves[j], k) == tree.Category(leaves[j - 1], k);
+            if (same) {
+                nodeOf[j] = nodeOf[j - 1];
+                continue;
+            }
+
+            Node node;
+            node.category = tree.Category(leaves[j], level);
+            node.level = static_cast<uint32_t>(level);
+            uint32_t id = static_cast<uint32_t>(nodes.size());
+            if (level > 0) {
+                Node& parent = nodes[nodeOf[j]];
+                if (parent.childCount++ == 0)
+                    parent.firstChild = id;
+            }
+            nodes.push_back(node);
+            nodeOf[j] = id;
+        }
+        if (level == 0)
+            roots = nodes.size();
+    }
+
+    // Leaves, then the totals bottom-up: every parent comes before its children
+    for (size_t j = 0; j < leaves.size(); ++j) {
+        Node& leaf = nodes[nodeOf[j]];
+        leaf.group = static_cast<uint32_t>(j);
+        leaf.files = grouping.GroupSize(leaves[j]);
+        for (FileIndex i : grouping.Files(leaves[j]))
+            leaf.bytes += sizes[i];
+    }
+    for (size_t id = nodes.size(); id-- > 0;) {
+        const Node& node = nodes[id];
+        for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+            nodes[id].files += nodes[c].files;
+            nodes[id].bytes += nodes[c].bytes;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+// plantree.h
+//
+// Hierarchical organization, e.g. by type, then by date, then by size.
+// Every distinct combination of the levels' categories is a leaf, numbered
+// once in order of first appearance, and a leaf ID takes the place of a
+// category ID in an ordinary Grouping. So a nested plan is grouped, updated
+// in place, sorted and filtered by the same code as a flat one, and only
+// the outline of headings above the leaves is new: one node per distinct
+// prefix, with file counts and byte totals summed bottom-up from the leaves.
+
+#pragma once
+
+#include "classifier.h"
+#include "grouping.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+inline constexpr size_t kMaxPlanLevels = 3;
+
+class PlanTree {
+public:
+    // Starts over with `levels` levels, 1 .. kMaxPlanLevels
+    void SetLevels(size_t levels);
+
+    size_t Levels() const { return m_levels; }
+    size_t LeafCount() const { return m_paths.size() / std::max<size_t>(1, m_levels); }
+
+    // Category of a leaf at a level, the outermost level being 0
+    CategoryId Category(CategoryId leaf, size_t level) const { return m_paths[leaf * m_levels + level]; }
+
+    // leafOf[i] = the leaf of file i, whose category at level k is
+    // columns[k][i]. Combinations seen before keep their leaf; new ones are
+    // numbered in file order, by the parallel pass too.
+    void Assign(std::span<const std::span<const CategoryId>> columns, std::vector<CategoryId>& leafOf,
+                bool parallel);
+
+    void Clear();
+
+private:
+    struct Key {
+        CategoryId ids[kMaxPlanLevels] = {};
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const
+        {
+            uint64_t h = 0;
+            for (CategoryId id : key.ids)
+                h = (h ^ id) * 0x9e3779b97f4a7c15ull;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    using LeafMap = std::unordered_map<Key, CategoryId, KeyHash>;
+
+    size_t                  m_levels = 1;
+    std::vector<CategoryId> m_paths;     // m_levels categories per leaf
+    LeafMap                 m_leafOf;
+
+    CategoryId Intern(const Key& key);
+};
+
+// The headings of a grouping over leaves. Nodes are numbered level by
+// level, so the top level is 0 .. roots - 1 and the children of every node
+// are consecutive.
+struct PlanOutline {
+    static constexpr uint32_t kNoGroup = ~uint32_t(0);
+
+    struct Node {
+        CategoryId category;        // at the node's level
+        uint32_t   level;
+        uint32_t   firstChild = 0;
+        uint32_t   childCount = 0;
+        uint32_t   group = kNoGroup;   // leaves: index into the leaf order
+        uint64_t   files = 0;
+        uint64_t   bytes = 0;
+    };
+
+    std::vector<Node> nodes;
+    size_t            roots = 0;
+
+    std::span<const Node> Children(const Node& node) const
+    {
+        return std::span<const Node>(nodes).subspan(node.firstChild, node.childCount);
+    }
+
+    // Outlines leaves, the non-empty leaves of grouping in the order of the
+    // plan (see Organizer::SortedLeaves()), with the byte totals of sizes.
+    void Build(const PlanTree& tree, const Grouping& grouping, std::span<const CategoryId> leaves,
+               std::span<const uint64_t> sizes);
+
+    void Clear();
+};
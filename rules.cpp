@@ -0,0 +1,1101 @@
+// rules.cpp
+
+#include "rules.h"
+#include "buckets.h"
+#include "ingest.h"
+
+#include <wx/filefn.h>
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstdlib>
+#include <cwctype>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+// Subset construction gives up beyond this rather than exhaust memory on
+// patterns whose combination explodes
+constexpr size_t kMaxDfaStates = 4096;
+
+// Cut points per kind, so that a file's ranges fit the 16 bits of the
+// decision key
+constexpr size_t kMaxCuts = 0xffff;
+
+using ByteSet = std::bitset<256>;
+
+std::string_view Trim(std::string_view s)
+{
+    const char* ws = " \t\r\n";
+    size_t b = s.find_first_not_of(ws);
+    if (b == std::string_view::npos)
+        return {};
+    size_t e = s.find_last_not_of(ws);
+    return s.substr(b, e - b + 1);
+}
+
+// ----------------------------- UTF-8 ------------------------------------
+
+uint32_t FoldChar(uint32_t c)
+{
+    if (c < 0x80)
+        return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    return static_cast<uint32_t>(std::towlower(static_cast<wint_t>(c)));
+}
+
+size_t EncodeUtf8(uint32_t c, uint8_t* out)
+{
+    if (c < 0x80) {
+        out[0] = static_cast<uint8_t>(c);
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = static_cast<uint8_t>(0xc0 | (c >> 6));
+        out[1] = static_cast<uint8_t>(0x80 | (c & 0x3f));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = static_cast<uint8_t>(0xe0 | (c >> 12));
+        out[1] = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f));
+        out[2] = static_cast<uint8_t>(0x80 | (c & 0x3f));
+        return 3;
+    }
+    out[0] = static_cast<uint8_t>(0xf0 | (c >> 18));
+    out[1] = static_cast<uint8_t>(0x80 | ((c >> 12) & 0x3f));
+    out[2] = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f));
+    out[3] = static_cast<uint8_t>(0x80 | (c & 0x3f));
+    return 4;
+}
+
+// Decodes the character at text[pos] and moves past it; malformed input
+// decodes to U+FFFD
+uint32_t DecodeUtf8(std::string_view text, size_t& pos)
+{
+    uint8_t lead = static_cast<uint8_t>(text[pos++]);
+    if (lead < 0x80)
+        return lead;
+
+    size_t more = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : 0;
+    uint32_t c = lead & (0x3f >> more);
+    if (more == 0 || pos + more > text.size())
+        return 0xfffd;
+    for (size_t k = 0; k < more; ++k) {
+        uint8_t b = static_cast<uint8_t>(text[pos++]);
+        if ((b & 0xc0) != 0x80)
+            return 0xfffd;
+        c = (c << 6) | (b & 0x3f);
+    }
+    return c;
+}
+
+// -------------------------- Pattern syntax ------------------------------
+
+struct Node {
+    enum Kind : uint8_t { Bytes, Concat, Alt, Star, Plus, Opt };
+
+    Kind              kind = Concat;
+    ByteSet           bytes;          // for Bytes: one byte out of these
+    std::vector<Node> children;
+};
+
+Node MakeBytes(const ByteSet& bytes)
+{
+    Node n;
+    n.kind = Node::Bytes;
+    n.bytes = bytes;
+    return n;
+}
+
+Node MakeRange(unsigned lo, unsigned hi)
+{
+    ByteSet bytes;
+    for (unsigned b = lo; b <= hi; ++b)
+        bytes.set(b);
+    return MakeBytes(bytes);
+}
+
+Node Make(Node::Kind kind, std::vector<Node> children)
+{
+    Node n;
+    n.kind = kind;
+    n.children = std::move(children);
+    return n;
+}
+
+ByteSet AsciiSet()
+{
+    ByteSet bytes;
+    for (unsigned b = 0; b < 0x80; ++b)
+        bytes.set(b);
+    return bytes;
+}
+
+ByteSet AllBytes()
+{
+    return ByteSet().set();
+}
+
+// Input is folded before matching, so a set only needs its lower-case letters
+void FoldSet(ByteSet& bytes)
+{
+    for (unsigned c = 'A'; c <= 'Z'; ++c) {
+        if (bytes[c])
+            bytes.set(c + ('a' - 'A'));
+    }
+}
+
+// One character made of the given ASCII bytes or, if `others`, any
+// character outside ASCII
+Node CharClass(const ByteSet& ascii, bool others)
+{
+    if (!others)
+        return MakeBytes(ascii);
+
+    Node cont = MakeRange(0x80, 0xbf);
+    return Make(Node::Alt, {
+        MakeBytes(ascii),
+        Make(Node::Concat, {MakeRange(0xc0, 0xdf), cont}),
+        Make(Node::Concat, {MakeRange(0xe0, 0xef), cont, cont}),
+        Make(Node::Concat, {MakeRange(0xf0, 0xf7), cont, cont, cont}),
+    });
+}
+
+Node Literal(uint32_t c)
+{
+    uint8_t bytes[4];
+    size_t len = EncodeUtf8(FoldChar(c), bytes);
+
+    std::vector<Node> children;
+    for (size_t k = 0; k < len; ++k)
+        children.push_back(MakeRange(bytes[k], bytes[k]));
+    return len == 1 ? std::move(children.front()) : Make(Node::Concat, std::move(children));
+}
+
+// Parses globs and regular expressions into syntax trees over folded UTF-8
+class PatternParser {
+public:
+    explicit PatternParser(std::string_view text) : m_text(text) {}
+
+    bool ParseGlob(Node& out);
+    bool ParseRegex(Node& out);
+
+    const std::string& Error() const { return m_error; }
+
+private:
+    std::string_view m_text;
+    size_t           m_pos = 0;
+    bool             m_glob = false;
+    std::string      m_error;
+
+    bool AtEnd() const { return m_pos >= m_text.size(); }
+    char Peek() const { return m_text[m_pos]; }
+
+    Node Fail(const char* message)
+    {
+        if (m_error.empty())
+            m_error = message;
+        return Node();
+    }
+
+    Node Alternation();
+    Node Sequence();
+    Node Repetition();
+    Node Atom();
+    Node Escape();
+    Node Class();
+
+    // \d, \w and \s, upper case for their complements; false for others
+    static bool ShorthandClass(char c, ByteSet& bytes, bool& negated);
+};
+
+bool PatternParser::ParseGlob(Node& out)
+{
+    m_glob = true;
+    const ByteSet notSlash = AsciiSet().reset('/');
+
+    out = Make(Node::Concat, {});
+    while (!AtEnd() && m_error.empty()) {
+        char c = Peek();
+        if (c == '*' && m_text.substr(m_pos, 3) == "**/") {
+            // "a/**/b" also matches "a/b"
+            m_pos += 3;
+            out.children.push_back(Make(Node::Opt, {Make(Node::Concat, {
+                Make(Node::Star, {CharClass(AsciiSet(), true)}), Literal('/')})}));
+        } else if (c == '*' && m_text.substr(m_pos, 2) == "**") {
+            m_pos += 2;
+            out.children.push_back(Make(Node::Star, {CharClass(AsciiSet(), true)}));
+        } else if (c == '*') {
+            ++m_pos;
+            out.children.push_back(Make(Node::Star, {CharClass(notSlash, true)}));
+        } else if (c == '?') {
+            ++m_pos;
+            out.children.push_back(CharClass(notSlash, true));
+        } else if (c == '[') {
+            ++m_pos;
+            out.children.push_back(Class());
+        } else if (c == '\\') {
+            ++m_pos;
+            if (AtEnd()) {
+                Fail("trailing backslash");
+                return false;
+            }
+            out.children.push_back(Literal(DecodeUtf8(m_text, m_pos)));
+        } else {
+            out.children.push_back(Literal(DecodeUtf8(m_text, m_pos)));
+        }
+    }
+    return m_error.empty();
+}
+
+bool PatternParser::ParseRegex(Node& out)
+{
+    bool anchorStart = !m_text.empty() && m_text.front() == '^';
+    if (anchorStart)
+        m_text.remove_prefix(1);
+
+    // A trailing '$' anchors unless it is escaped
+    size_t backslashes = 0;
+    while (backslashes + 1 < m_text.size() && m_text[m_text.size() - 2 - backslashes] == '\\')
+        ++backslashes;
+    bool anchorEnd = !m_text.empty() && m_text.back() == '$' && backslashes % 2 == 0;
+    if (anchorEnd)
+        m_text.remove_suffix(1);
+
+    Node body = Alternation();
+    if (m_error.empty() && !AtEnd())
+        Fail("unbalanced ')'");
+    if (!m_error.empty())
+        return false;
+
+    // Searching is matching with anything around the pattern
+    out = Make(Node::Concat, {});
+    if (!anchorStart)
+        out.children.push_back(Make(Node::Star, {MakeBytes(AllBytes())}));
+    out.children.push_back(std::move(body));
+    if (!anchorEnd)
+        out.children.push_back(Make(Node::Star, {MakeBytes(AllBytes())}));
+    return true;
+}
+
+Node PatternParser::Alternation()
+{
+    std::vector<Node> branches;
+    branches.push_back(Sequence());
+    while (!AtEnd() && Peek() == '|' && m_error.empty()) {
+        ++m_pos;
+        branches.push_back(Sequence());
+    }
+    return branches.size() == 1 ? std::move(branches.front()) : Make(Node::Alt, std::move(branches));
+}
+
+Node PatternParser::Sequence()
+{
+    Node seq = Make(Node::Concat, {});
+    while (!AtEnd() && Peek() != '|' && Peek() != ')' && m_error.empty())
+        seq.children.push_back(Repetition());
+    return seq;
+}
+
+Node PatternParser::Repetition()
+{
+    Node atom = Atom();
+    while (!AtEnd() && m_error.empty()) {
+        char c = Peek();
+        if (c == '{')
+            return Fail("counted repetition {m,n} is not supported");
+        if (c != '*' && c != '+' && c != '?')
+            break;
+        ++m_pos;
+        atom = Make(c == '*' ? Node::Star : c == '+' ? Node::Plus : Node::Opt, {std::move(atom)});
+    }
+    return atom;
+}
+
+Node PatternParser::Atom()
+{
+    char c = Peek();
+    switch (c) {
+    case '(': {
+        ++m_pos;
+        Node inner = Alternation();
+        if (AtEnd() || Peek() != ')')
+            return Fail("missing ')'");
+        ++m_pos;
+        return inner;
+    }
+    case '*':
+    case '+':
+    case '?':
+        return Fail("nothing to repeat");
+    case '^':
+    case '$':
+        return Fail("'^' and '$' only anchor the whole pattern");
+    case '.':
+        ++m_pos;
+        return CharClass(AsciiSet(), true);
+    case '[':
+        ++m_pos;
+        return Class();
+    case '\\':
+        ++m_pos;
+        return Escape();
+    default:
+        return Literal(DecodeUtf8(m_text, m_pos));
+    }
+}
+
+bool PatternParser::ShorthandClass(char c, ByteSet& bytes, bool& negated)
+{
+    bytes.reset();
+    switch (c | 0x20) {
+    case 'd':
+        for (unsigned b = '0'; b <= '9'; ++b)
+            bytes.set(b);
+        break;
+    case 'w':
+        for (unsigned b = '0'; b <= '9'; ++b)
+            bytes.set(b);
+        for (unsigned b = 'a'; b <= 'z'; ++b)
+            bytes.set(b);
+        bytes.set('_');
+        break;
+    case 's':
+        for (char b : {' ', '\t', '\r', '\n', '\f', '\v'})
+            bytes.set(static_cast<uint8_t>(b));
+        break;
+    default:
+        return false;
+    }
+    negated = c >= 'A' && c <= 'Z';
+    return true;
+}
+
+Node PatternParser::Escape()
+{
+    if (AtEnd())
+        return Fail("trailing backslash");
+
+    char c = Peek();
+    ByteSet bytes;
+    bool negated = false;
+    if (ShorthandClass(c, bytes, negated)) {
+        ++m_pos;
+        return negated ? CharClass(AsciiSet() & ~bytes, true) : MakeBytes(bytes);
+    }
+
+    switch (c) {
+    case 'n': ++m_pos; return Literal('\n');
+    case 't': ++m_pos; return Literal('\t');
+    case 'r': ++m_pos; return Literal('\r');
+    default:
+        break;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        return Fail("unknown escape");
+    return Literal(DecodeUtf8(m_text, m_pos));
+}
+
+Node PatternParser::Class()
+{
+    bool negated = false;
+    if (!AtEnd() && (Peek() == '^' || (m_glob && Peek() == '!'))) {
+        negated = true;
+        ++m_pos;
+    }
+
+    // Reads one member character, escaped or not
+    auto member = [this](uint8_t& out) {
+        if (Peek() == '\\') {
+            ++m_pos;
+            if (AtEnd()) {
+                Fail("missing ']'");
+                return false;
+            }
+        }
+        out = static_cast<uint8_t>(Peek());
+        if (out >= 0x80) {
+            Fail("classes take ASCII characters only");
+            return false;
+        }
+        ++m_pos;
+        return true;
+    };
+
+    ByteSet bytes;
+    for (bool first = true;; first = false) {
+        if (AtEnd())
+            return Fail("missing ']'");
+        if (Peek() == ']' && !first) {
+            ++m_pos;
+            break;
+        }
+
+        ByteSet shorthand;
+        bool shorthandNegated = false;
+        if (!m_glob && Peek() == '\\' && m_pos + 1 < m_text.size() &&
+            ShorthandClass(m_text[m_pos + 1], shorthand, shorthandNegated)) {
+            if (shorthandNegated)
+                return Fail("\\D, \\W and \\S are not supported inside [...]");
+            m_pos += 2;
+            bytes |= shorthand;
+            continue;
+        }
+
+        uint8_t lo = 0;
+        if (!member(lo))
+            return Node();
+        uint8_t hi = lo;
+        if (m_pos + 1 < m_text.size() && Peek() == '-' && m_text[m_pos + 1] != ']') {
+            ++m_pos;
+            if (!member(hi))
+                return Node();
+            if (hi < lo)
+                return Fail("reversed range in [...]");
+        }
+        for (unsigned b = lo; b <= hi; ++b)
+            bytes.set(b);
+    }
+
+    FoldSet(bytes);
+    if (!negated)
+        return MakeBytes(bytes);
+
+    // A negated glob class still stays inside one path component
+    ByteSet complement = AsciiSet() & ~bytes;
+    if (m_glob)
+        complement.reset('/');
+    return CharClass(complement, true);
+}
+
+// --------------------------- Thompson NFA -------------------------------
+
+struct NfaState {
+    ByteSet          bytes;          // consumed on the way to next
+    int              next = -1;
+    std::vector<int> epsilon;
+    int              accept = -1;    // pattern matched on reaching this state
+};
+
+class Nfa {
+public:
+    std::vector<NfaState> states;
+
+    int Add()
+    {
+        states.emplace_back();
+        return static_cast<int>(states.size() - 1);
+    }
+
+    // Adds the states for n, starting at `from`; returns the state reached
+    // after it. Loops only ever return to states created here, so `from`
+    // can be shared with whatever else leaves it.
+    int Build(const Node& n, int from)
+    {
+        switch (n.kind) {
+        case Node::Bytes: {
+            int a = Add();
+            int b = Add();
+            states[from].epsilon.push_back(a);
+            states[a].bytes = n.bytes;
+            states[a].next = b;
+            return b;
+        }
+        case Node::Concat: {
+            int at = from;
+            for (const Node& child : n.children)
+                at = Build(child, at);
+            return at;
+        }
+        case Node::Alt: {
+            int end = Add();
+            for (const Node& child : n.children) {
+                int e = Build(child, from);
+                states[e].epsilon.push_back(end);
+            }
+            return end;
+        }
+        case Node::Star: {
+            int loop = Add();
+            states[from].epsilon.push_back(loop);
+            int e = Build(n.children.front(), loop);
+            states[e].epsilon.push_back(loop);
+            int out = Add();
+            states[loop].epsilon.push_back(out);
+            return out;
+        }
+        case Node::Plus: {
+            int start = Add();
+            states[from].epsilon.push_back(start);
+            int e = Build(n.children.front(), start);
+            states[e].epsilon.push_back(start);
+            int out = Add();
+            states[e].epsilon.push_back(out);
+            return out;
+        }
+        case Node::Opt: {
+            int e = Build(n.children.front(), from);
+            int out = Add();
+            states[from].epsilon.push_back(out);
+            states[e].epsilon.push_back(out);
+            return out;
+        }
+        }
+        return from;
+    }
+};
+
+// Combines the patterns into one DFA by subset construction. False if it
+// would need more than kMaxDfaStates states.
+bool BuildDfa(const std::vector<Node>& patterns, RuleSet::Dfa& dfa)
+{
+    dfa = RuleSet::Dfa();
+    if (patterns.empty())
+        return true;
+
+    Nfa nfa;
+    const int root = nfa.Add();
+    for (size_t p = 0; p < patterns.size(); ++p) {
+        int end = nfa.Build(patterns[p], root);
+        if (end == root) {
+            end = nfa.Add();
+            nfa.states[root].epsilon.push_back(end);
+        }
+        nfa.states[end].accept = static_cast<int>(p);
+    }
+
+    // Byte classes: split every class by every byte set the NFA consumes
+    dfa.classes = 1;
+    for (const NfaState& s : nfa.states) {
+        if (s.next < 0)
+            continue;
+        int split[512];
+        std::fill(std::begin(split), std::end(split), -1);
+        uint32_t count = 0;
+        for (unsigned b = 0; b < 256; ++b) {
+            int& id = split[dfa.classOf[b] * 2 + s.bytes[b]];
+            if (id < 0)
+                id = static_cast<int>(count++);
+            dfa.classOf[b] = static_cast<uint8_t>(id);
+        }
+        dfa.classes = count;
+    }
+
+    std::vector<uint8_t> representative(dfa.classes);
+    for (unsigned b = 256; b-- > 0;)
+        representative[dfa.classOf[b]] = static_cast<uint8_t>(b);
+
+    // Epsilon closures, sorted so that equal sets compare equal
+    std::vector<uint32_t> mark(nfa.states.size(), 0);
+    uint32_t generation = 0;
+    auto close = [&](std::vector<int>& set) {
+        ++generation;
+        std::vector<int> stack(set);
+        for (int s : set)
+            mark[s] = generation;
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            for (int t : nfa.states[s].epsilon) {
+                if (mark[t] != generation) {
+                    mark[t] = generation;
+                    set.push_back(t);
+                    stack.push_back(t);
+                }
+            }
+        }
+        std::sort(set.begin(), set.end());
+    };
+
+    std::map<std::vector<int>, uint32_t> ids;
+    std::vector<std::vector<int>> sets;
+    auto intern = [&](std::vector<int>&& set) {
+        auto [it, inserted] = ids.try_emplace(std::move(set), static_cast<uint32_t>(sets.size()));
+        if (inserted)
+            sets.push_back(it->first);
+        return it->second;
+    };
+
+    std::vector<int> first{root};
+    close(first);
+    dfa.start = intern(std::move(first));
+
+    for (size_t d = 0; d < sets.size(); ++d) {
+        const std::vector<int> current = sets[d];
+        for (uint32_t c = 0; c < dfa.classes; ++c) {
+            ++generation;
+            std::vector<int> moved;
+            for (int s : current) {
+                const NfaState& state = nfa.states[s];
+                if (state.next >= 0 && state.bytes[representative[c]] && mark[state.next] != generation) {
+                    mark[state.next] = generation;
+                    moved.push_back(state.next);
+                }
+            }
+            close(moved);
+            dfa.next.push_back(intern(std::move(moved)));
+            if (sets.size() > kMaxDfaStates)
+                return false;
+        }
+    }
+
+    dfa.words = (patterns.size() + 63) / 64;
+    dfa.accepts.assign(sets.size() * dfa.words, 0);
+    for (size_t d = 0; d < sets.size(); ++d) {
+        for (int s : sets[d]) {
+            if (int p = nfa.states[s].accept; p >= 0)
+                dfa.accepts[d * dfa.words + p / 64] |= uint64_t(1) << (p % 64);
+        }
+    }
+
+    auto dead = ids.find(std::vector<int>());
+    if (dead != ids.end())
+        dfa.dead = dead->second;
+    return true;
+}
+
+// ---------------------------- Rules text --------------------------------
+
+struct Token {
+    std::string text;
+    bool        quoted = false;
+};
+
+bool Is(const Token& token, std::string_view word)
+{
+    return !token.quoted && token.text == word;
+}
+
+bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Splits a line into the tokens before "->" and the category after it.
+// A blank or comment line gives neither.
+bool SplitRule(std::string_view line, std::vector<Token>& tokens, std::string& category, std::string& error)
+{
+    size_t i = 0;
+    for (;;) {
+        while (i < line.size() && IsSpace(line[i]))
+            ++i;
+        if (i == line.size() || line[i] == '#')
+            break;
+
+        Token token;
+        if (line[i] == '"') {
+            token.quoted = true;
+            for (++i;; ++i) {
+                if (i == line.size()) {
+                    error = "missing closing quote";
+                    return false;
+                }
+                if (line[i] == '"') {
+                    ++i;
+                    break;
+                }
+                if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == '"')
+                    ++i;
+                token.text += line[i];
+            }
+        } else {
+            size_t start = i;
+            while (i < line.size() && !IsSpace(line[i]))
+                ++i;
+            token.text = line.substr(start, i - start);
+        }
+
+        if (Is(token, "->")) {
+            std::string_view rest = line.substr(i);
+            category = Trim(rest.substr(0, rest.find('#')));
+            if (category.empty()) {
+                error = "missing category after '->'";
+                return false;
+            }
+            return true;
+        }
+        tokens.push_back(std::move(token));
+    }
+
+    if (!tokens.empty()) {
+        error = "missing '-> Category'";
+        return false;
+    }
+    return true;
+}
+
+// What a condition looks at, in the order of RuleSet::Test
+enum class Subject : uint8_t { Name, Path, Size, Age };
+
+struct ParsedCondition {
+    Subject  subject = Subject::Name;
+    bool     negate = false;
+    Node     pattern;         // Name, Path
+    uint64_t cut = 0;         // Size, Age: holds for values >= cut
+};
+
+struct ParsedRule {
+    std::vector<ParsedCondition> conditions;
+    long                         priority = 0;
+    std::string                  category;
+};
+
+bool ParsePattern(std::string_view text, bool regex, Node& out, std::string& error)
+{
+    if (text.empty()) {
+        error = "empty pattern";
+        return false;
+    }
+    PatternParser parser(text);
+    if (regex ? parser.ParseRegex(out) : parser.ParseGlob(out))
+        return true;
+    error = parser.Error() + " in '" + std::string(text) + "'";
+    return false;
+}
+
+// "size > 10M", "age<=2w": a size or age comparison with the tokens of the
+// condition run together
+bool ParseComparison(std::string_view text, ParsedCondition& condition, std::string& error)
+{
+    const bool size = text.substr(0, 4) == "size";
+    condition.subject = size ? Subject::Size : Subject::Age;
+    text.remove_prefix(size ? 4 : 3);
+
+    const bool less = !text.empty() && text.front() == '<';
+    if (text.empty() || (text.front() != '<' && text.front() != '>')) {
+        error = std::string("expected <, <=, > or >= after '") + (size ? "size" : "age") + "'";
+        return false;
+    }
+    text.remove_prefix(1);
+    const bool orEqual = !text.empty() && text.front() == '=';
+    if (orEqual)
+        text.remove_prefix(1);
+
+    std::vector<uint64_t> values;
+    bool ok = !text.empty() && text.find(',') == std::string_view::npos &&
+              (size ? ParseSizeLimits(text, values) : ParseAgeLimits(text, values)) && values.size() == 1;
+    if (!ok) {
+        error = "invalid amount '" + std::string(text) + "'";
+        return false;
+    }
+
+    // value >= v, value > v, value < v and value <= v as cut points
+    uint64_t v = values.front();
+    condition.cut = orEqual == less ? v + 1 : v;
+    condition.negate = less;
+    return true;
+}
+
+// One condition of a rule; "priority" sets the rule's priority instead
+bool ParseCondition(std::vector<Token> tokens, ParsedRule& rule, std::string& error)
+{
+    ParsedCondition condition;
+    if (Is(tokens.front(), "!")) {
+        condition.negate = true;
+        tokens.erase(tokens.begin());
+    } else if (!tokens.front().quoted && tokens.front().text.size() > 1 && tokens.front().text[0] == '!') {
+        condition.negate = true;
+        tokens.front().text.erase(0, 1);
+    }
+    if (tokens.empty()) {
+        error = "expected a condition after '!'";
+        return false;
+    }
+
+    const Token& word = tokens.front();
+    const std::string_view keyword = word.quoted ? std::string_view() : std::string_view(word.text);
+    auto comparison = [&keyword](std::string_view name) {
+        return keyword.substr(0, name.size()) == name &&
+               (keyword.size() == name.size() || keyword[name.size()] == '<' || keyword[name.size()] == '>');
+    };
+
+    if (keyword == "name" || keyword == "path") {
+        condition.subject = keyword == "name" ? Subject::Name : Subject::Path;
+        bool regex = tokens.size() == 3 && Is(tokens[1], "~");
+        if (!regex && tokens.size() != 2) {
+            error = "expected a pattern after '" + word.text + "'";
+            return false;
+        }
+        if (!ParsePattern(tokens.back().text, regex, condition.pattern, error))
+            return false;
+    } else if (keyword == "ext") {
+        if (tokens.size() != 2) {
+            error = "expected extensions after 'ext'";
+            return false;
+        }
+        // ext a,b is the regular expression \.(a|b)$
+        std::string regex = "\\.(";
+        std::string_view list = tokens[1].text;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view ext = Trim(list.substr(0, comma));
+            if (!ext.empty() && ext.front() == '.')
+                ext.remove_prefix(1);
+            if (ext.empty()) {
+                error = "empty extension in '" + tokens[1].text + "'";
+                return false;
+            }
+            if (regex.back() != '(')
+                regex += '|';
+            for (char c : ext) {
+                if (static_cast<uint8_t>(c) < 0x80 && !std::isalnum(static_cast<unsigned char>(c)))
+                    regex += '\\';
+                regex += c;
+            }
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        }
+        regex += ")$";
+        if (!ParsePattern(regex, true, condition.pattern, error))
+            return false;
+    } else if (comparison("size") || comparison("age")) {
+        std::string joined;
+        for (const Token& t : tokens)
+            joined += t.text;
+        bool negate = condition.negate;
+        if (!ParseComparison(joined, condition, error))
+            return false;
+        condition.negate = condition.negate != negate;
+    } else if (keyword == "priority") {
+        char* end = nullptr;
+        long priority = tokens.size() == 2 ? std::strtol(tokens[1].text.c_str(), &end, 10) : 0;
+        if (tokens.size() != 2 || tokens[1].text.empty() || *end != '\0' || condition.negate) {
+            error = "expected 'priority' and a whole number";
+            return false;
+        }
+        rule.priority = priority;
+        return true;
+    } else {
+        // A bare glob on the name
+        if (tokens.size() != 1) {
+            error = "unexpected '" + tokens[1].text + "'";
+            return false;
+        }
+        if (!ParsePattern(word.text, false, condition.pattern, error))
+            return false;
+    }
+
+    rule.conditions.push_back(std::move(condition));
+    return true;
+}
+
+bool ParseRule(std::vector<Token>& tokens, ParsedRule& rule, std::string& error)
+{
+    size_t begin = 0;
+    for (size_t k = 0; k <= tokens.size(); ++k) {
+        if (k < tokens.size() && !Is(tokens[k], "&"))
+            continue;
+        if (k == begin && !(k == tokens.size() && begin == 0)) {
+            error = "empty condition around '&'";
+            return false;
+        }
+        if (k > begin &&
+            !ParseCondition(std::vector<Token>(tokens.begin() + begin, tokens.begin() + k), rule, error))
+            return false;
+        begin = k + 1;
+    }
+    return true;
+}
+
+} // namespace
+
+// ------------------------------ Compiling -------------------------------
+
+bool RuleSet::Compile(std::string_view text, CategoryRegistry& registry, std::string& error)
+{
+    // Parse everything first, so a mistake leaves the registry alone
+    std::vector<ParsedRule> parsed;
+    size_t lineNumber = 0;
+    while (!text.empty()) {
+        size_t eol = text.find('\n');
+        std::string_view line = text.substr(0, eol);
+        text = eol == std::string_view::npos ? std::string_view() : text.substr(eol + 1);
+        ++lineNumber;
+
+        std::vector<Token> tokens;
+        ParsedRule rule;
+        std::string message;
+        if (!SplitRule(line, tokens, rule.category, message) ||
+            (!rule.category.empty() && !ParseRule(tokens, rule, message))) {
+            error = "line " + std::to_string(lineNumber) + ": " + message;
+            return false;
+        }
+        if (!rule.category.empty())
+            parsed.push_back(std::move(rule));
+    }
+
+    // Higher priorities first, file order among equals
+    std::stable_sort(parsed.begin(), parsed.end(),
+                     [](const ParsedRule& a, const ParsedRule& b) { return a.priority > b.priority; });
+
+    RuleSet compiled;
+    std::vector<Node> names;
+    std::vector<Node> paths;
+    for (const ParsedRule& rule : parsed) {
+        for (const ParsedCondition& c : rule.conditions) {
+            if (c.subject == Subject::Size)
+                compiled.m_sizeCuts.push_back(c.cut);
+            else if (c.subject == Subject::Age)
+                compiled.m_ageCuts.push_back(c.cut);
+        }
+    }
+    for (auto* cuts : {&compiled.m_sizeCuts, &compiled.m_ageCuts}) {
+        std::sort(cuts->begin(), cuts->end());
+        cuts->erase(std::unique(cuts->begin(), cuts->end()), cuts->end());
+        if (cuts->size() > kMaxCuts) {
+            error = "too many different sizes or ages";
+            return false;
+        }
+    }
+
+    for (ParsedRule& rule : parsed) {
+        Rule& out = compiled.m_rules.emplace_back();
+        for (ParsedCondition& c : rule.conditions) {
+            Condition condition{static_cast<Test>(c.subject), c.negate, 0};
+            switch (c.subject) {
+            case Subject::Name:
+                condition.index = static_cast<uint32_t>(names.size());
+                names.push_back(std::move(c.pattern));
+                break;
+            case Subject::Path:
+                condition.index = static_cast<uint32_t>(paths.size());
+                paths.push_back(std::move(c.pattern));
+                break;
+            case Subject::Size:
+            case Subject::Age: {
+                const auto& cuts = c.subject == Subject::Size ? compiled.m_sizeCuts : compiled.m_ageCuts;
+                condition.index = static_cast<uint32_t>(std::lower_bound(cuts.begin(), cuts.end(), c.cut) - cuts.begin());
+                break;
+            }
+            }
+            out.conditions.push_back(condition);
+        }
+    }
+
+    if (!BuildDfa(names, compiled.m_names) || !BuildDfa(paths, compiled.m_paths)) {
+        error = "the patterns are too complex to combine; try fewer regular expressions";
+        return false;
+    }
+
+    for (size_t r = 0; r < parsed.size(); ++r)
+        compiled.m_rules[r].category = registry.Intern(parsed[r].category);
+
+    *this = std::move(compiled);
+    return true;
+}
+
+bool RuleSet::Load(const wxString& path, CategoryRegistry& registry, std::string& error)
+{
+    std::ifstream in(ToFileSystem(path), std::ios::binary);
+    if (!in) {
+        error = "cannot read " + path.utf8_string();
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    return Compile(text.str(), registry, error);
+}
+
+// ----------------------------- Classifying ------------------------------
+
+uint32_t RuleSet::Dfa::Run(uint32_t state, std::string_view text, bool path) const
+{
+    auto step = [this, &state](uint8_t b) { state = next[state * classes + classOf[b]]; };
+
+    // Folds on the fly rather than building a lower-cased copy
+    for (size_t k = 0; k < text.size() && state != dead;) {
+        uint32_t c = static_cast<uint8_t>(text[k]);
+        if (c < 0x80) {
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            else if (path && c == static_cast<uint32_t>(wxFILE_SEP_PATH))
+                c = '/';
+            step(static_cast<uint8_t>(c));
+            ++k;
+            continue;
+        }
+
+        uint8_t bytes[4];
+        size_t len = EncodeUtf8(FoldChar(DecodeUtf8(text, k)), bytes);
+        for (size_t b = 0; b < len; ++b)
+            step(bytes[b]);
+    }
+    return state;
+}
+
+CategoryId RuleSet::Decide(uint32_t name, uint32_t path, size_t sizeRange, size_t ageRange) const
+{
+    for (const Rule& rule : m_rules) {
+        bool holds = std::all_of(rule.conditions.begin(), rule.conditions.end(), [&](const Condition& c) {
+            bool result = false;
+            switch (c.test) {
+            case Test::Name: result = m_names.Accepts(name, c.index); break;
+            case Test::Path: result = m_paths.Accepts(path, c.index); break;
+            case Test::Size: result = sizeRange > c.index; break;
+            case Test::Age:  result = ageRange > c.index; break;
+            }
+            return result != c.negate;
+        });
+        if (holds)
+            return rule.category;
+    }
+    return Category::Other;
+}
+
+void RuleSet::Classify(std::span<const FileInfo> files, std::span<const uint64_t> sizes,
+                       std::span<const int64_t> mtimes, int64_t now, std::span<CategoryId> out) const
+{
+    if (m_rules.empty()) {
+        std::fill(out.begin(), out.end(), Category::Other);
+        return;
+    }
+
+    // Files that end in the same DFA states and ranges share a decision, and
+    // there are few such combinations however many files there are
+    std::unordered_map<uint64_t, CategoryId> decided;
+
+    // Path DFA state after each directory and its trailing separator, so a
+    // directory is read once rather than once for every file in it
+    const PathStore& store = PathStore::Get();
+    std::unordered_map<DirId, uint32_t> dirStates;
+    std::vector<DirId> chain;
+    auto dirState = [&](DirId dir) {
+        chain.clear();
+        uint32_t state = m_paths.start;
+        for (DirId d = dir; d != kNoDir; d = store.Parent(d)) {
+            auto it = dirStates.find(d);
+            if (it != dirStates.end()) {
+                state = it->second;
+                break;
+            }
+            chain.push_back(d);
+        }
+        for (size_t k = chain.size(); k-- > 0;) {
+            std::string_view name = store.DirectoryName(chain[k]);
+            state = m_paths.Run(state, name, true);
+            if (!name.empty() && name.back() != '/' && name.back() != wxFILE_SEP_PATH)
+                state = m_paths.Run(state, "/", true);
+            dirStates.emplace(chain[k], state);
+        }
+        return state;
+    };
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string_view leaf = files[i].NativeName();
+        uint32_t name = m_names.empty() ? 0 : m_names.Run(m_names.start, leaf, false);
+        uint32_t path = m_paths.empty() ? 0 : m_paths.Run(dirState(files[i].dir), leaf, true);
+        size_t sizeRange = std::upper_bound(m_sizeCuts.begin(), m_sizeCuts.end(), sizes[i]) - m_sizeCuts.begin();
+
+        // Files from the future count as brand new
+        uint64_t age = now > mtimes[i] ? static_cast<uint64_t>(now - mtimes[i]) : 0;
+        size_t ageRange = std::upper_bound(m_ageCuts.begin(), m_ageCuts.end(), age) - m_ageCuts.begin();
+
+        uint64_t key = (uint64_t(name) << 48) | (uint64_t(path) << 32) | (uint64_t(sizeRange) << 16) | ageRange;
+        auto [it, inserted] = decided.try_emplace(key, Category::Other);
+        if (inserted)
+            it->second = Decide(name, path, sizeRange, ageRange);
+        out[i] = it->second;
+    }
+}
@@ -0,0 +1,113 @@
+// rules.h
+//
+// User-defined organization rules behind the "By Rules" strategy, e.g.
+//
+//     name *.log & age > 30d & size > 10M   -> Archive/Logs
+//     path ~ "/work/project-y/"             -> Project Y
+//     ext jpg,png,heic & priority 10        -> Photos
+//
+// A file lands in the category of the first rule whose conditions all hold,
+// rules with a higher priority first; files no rule takes go to
+// Category::Other. Rules are compiled when loaded rather than tried in turn:
+// every name pattern, glob or regular expression, becomes part of one DFA
+// over the file name and every path pattern part of one over the path,
+// while size and age conditions become cut points. Classifying a file is
+// then one DFA pass per text and two binary searches, and the resulting
+// combination of DFA states and ranges is decided once per worker and
+// looked up for every other file that shares it.
+//
+// Syntax, one rule per line, '#' starts a comment:
+//
+//     rule      = [condition {"&" condition}] "->" category
+//     condition = ["!"] ( ["name"] glob | "path" glob
+//                       | ("name" | "path") "~" regex
+//                       | "ext" ext{,ext}
+//                       | ("size" | "age") ("<" | "<=" | ">" | ">=") amount
+//                       | "priority" integer )
+//
+// Globs match the whole text; '*' and '?' stay inside one path component,
+// '**' does not, and [a-z] and [^a-z] are classes. Regular expressions are
+// searched for and support literals, '.', classes, \d \w \s and their
+// negations, groups, '|', '*', '+', '?' and the anchors '^' and '$'.
+// Matching ignores case and sees paths with '/' separators. Amounts are
+// written as in the bucket limits (buckets.h); a bare age is in days.
+// Tokens are separated by spaces, and patterns containing spaces are
+// quoted: "My Documents/**". A rule without conditions takes every file.
+
+#pragma once
+
+#include "classifier.h"
+#include "fileinfo.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RuleSet {
+public:
+    bool   empty() const { return m_rules.empty(); }
+    size_t size() const { return m_rules.size(); }
+
+    // Replaces the rules with the ones in text and interns their categories
+    // into registry. On a syntax error, or patterns too complex to combine,
+    // returns false with the rules unchanged and the problem in error, e.g.
+    // "line 3: unknown unit in '10Q'".
+    bool Compile(std::string_view text, CategoryRegistry& registry, std::string& error);
+
+    // Same for a rules file
+    bool Load(const wxString& path, CategoryRegistry& registry, std::string& error);
+
+    // out[i] = the category of files[i], whose size and mtime (seconds since
+    // the epoch) are sizes[i] and mtimes[i]; ages count from now. Safe to
+    // call on disjoint ranges from several threads.
+    void Classify(std::span<const FileInfo> files, std::span<const uint64_t> sizes,
+                  std::span<const int64_t> mtimes, int64_t now, std::span<CategoryId> out) const;
+
+    // A DFA over folded UTF-8 bytes whose states know which of the combined
+    // patterns have matched the text read so far. Public for rules.cpp.
+    struct Dfa {
+        std::array<uint8_t, 256> classOf{};   // bytes no pattern tells apart share a class
+        uint32_t                 classes = 0;
+        uint32_t                 start = 0;
+        uint32_t                 dead = ~uint32_t(0);
+        std::vector<uint32_t>    next;        // next[state * classes + class]
+        std::vector<uint64_t>    accepts;     // bitset of patterns per state
+        size_t                   words = 0;   // accepts words per state
+
+        bool empty() const { return next.empty(); }
+
+        bool Accepts(uint32_t state, uint32_t pattern) const
+        {
+            return (accepts[state * words + pattern / 64] >> (pattern % 64)) & 1;
+        }
+
+        // State reached from state after the folded text, a name or path
+        // in file-system form
+        uint32_t Run(uint32_t state, std::string_view text, bool path) const;
+    };
+
+private:
+    enum class Test : uint8_t { Name, Path, Size, Age };
+
+    struct Condition {
+        Test     test;
+        bool     negate;
+        uint32_t index;     // pattern of the DFA, or cut point: value >= cut
+    };
+
+    struct Rule {
+        std::vector<Condition> conditions;
+        CategoryId             category;
+    };
+
+    std::vector<Rule>     m_rules;       // in evaluation order
+    Dfa                   m_names;
+    Dfa                   m_paths;
+    std::vector<uint64_t> m_sizeCuts;    // ascending
+    std::vector<uint64_t> m_ageCuts;     // ascending, seconds
+
+    CategoryId Decide(uint32_t name, uint32_t path, size_t sizeRange, size_t ageRange) const;
+};
@@ -0,0 +1,344 @@
+// scanner.cpp
+
+#include "scanner.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <string_view>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifndef __linux__
+std::string ToUtf8(const std::filesystem::path& path)
+{
+    std::u8string s = path.u8string();
+    return std::string(s.begin(), s.end());
+}
+#endif
+
+std::string JoinPath(const std::string& dir, std::string_view name)
+{
+    std::string path;
+    path.reserve(dir.size() + name.size() + 1);
+    path += dir;
+    if (path.empty() || path.back() != '/')
+        path += '/';
+    path += name;
+    return path;
+}
+
+#ifdef __linux__
+
+// Layout returned by the getdents64 syscall
+struct LinuxDirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+bool IsDotOrDotDot(const char* name)
+{
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+#endif
+
+} // namespace
+
+DirectoryScanner::DirectoryScanner(const wxString& root, unsigned threads,
+                                   const MetadataIndex* index)
+    : IngestJob(threads, 4096)
+    , m_root(root)
+    , m_rootPath(ToFileSystem(root))
+    , m_index(index)
+    , m_scanned(ThreadCount())
+{
+    // Paths below the root are built by appending "/name", so an index
+    // written for "dir/" is the one for "dir"
+    while (m_rootPath.size() > 1 && m_rootPath.back() == '/')
+        m_rootPath.pop_back();
+
+    for (unsigned i = 0; i < ThreadCount(); ++i)
+        m_queues.push_back(std::make_unique<WorkQueue>());
+}
+
+DirectoryScanner::~DirectoryScanner()
+{
+    Shutdown();
+}
+
+void DirectoryScanner::Prepare()
+{
+    // The index may be opened between construction and Start()
+    if (m_index && !m_index->IsOpen())
+        m_index = nullptr;
+
+    PushDir(0, m_rootPath);
+}
+
+std::vector<ScannedDirectory> DirectoryScanner::TakeDirectories()
+{
+    std::vector<ScannedDirectory> all;
+    for (auto& scanned : m_scanned) {
+        all.insert(all.end(), std::make_move_iterator(scanned.begin()),
+                   std::make_move_iterator(scanned.end()));
+        scanned.clear();
+    }
+    return all;
+}
+
+// ------------------------------ Workers --------------------------------
+
+void DirectoryScanner::PushDir(unsigned self, std::string dir)
+{
+    m_pendingDirs.fetch_add(1);
+
+    WorkQueue& q = *m_queues[self];
+    std::lock_guard lock(q.mutex);
+    q.dirs.push_back(std::move(dir));
+}
+
+bool DirectoryScanner::PopOrSteal(unsigned self, std::string& dir)
+{
+    // Own queue is used LIFO so a worker stays depth-first in its subtree...
+    {
+        WorkQueue& q = *m_queues[self];
+        std::lock_guard lock(q.mutex);
+        if (!q.dirs.empty()) {
+            dir = std::move(q.dirs.back());
+            q.dirs.pop_back();
+            return true;
+        }
+    }
+
+    // ...while thieves take the oldest, typically shallowest, directory,
+    // which carries the most remaining work.
+    size_t n = m_queues.size();
+    for (size_t k = 1; k < n; ++k) {
+        WorkQueue& victim = *m_queues[(self + k) % n];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.dirs.empty()) {
+            dir = std::move(victim.dirs.front());
+            victim.dirs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void DirectoryScanner::WorkerMain(std::stop_token stop, unsigned self, Batch& batch)
+{
+    std::string dir;
+    unsigned idleSpins = 0;
+
+    while (!stop.stop_requested()) {
+        if (PopOrSteal(self, dir)) {
+            idleSpins = 0;
+            ScanDirectory(self, dir, batch);
+            m_pendingDirs.fetch_sub(1);
+            continue;
+        }
+
+        // Nothing to do right now; hand over what we have before idling
+        Flush(batch);
+
+        if (m_pendingDirs.load() == 0)
+            break;
+
+        if (++idleSpins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+#ifdef __linux__
+
+void DirectoryScanner::ScanDirectory(unsigned self, const std::string& dir, Batch& batch)
+{
+    // Identity and mtime of the directory itself, for the index
+    struct statx dstx;
+    if (::statx(AT_FDCWD, dir.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                STATX_TYPE | STATX_MTIME | STATX_INO, &dstx) != 0 || !S_ISDIR(dstx.stx_mode)) {
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ScannedDirectory scanned;
+    scanned.path = dir;
+    scanned.device = makedev(dstx.stx_dev_major, dstx.stx_dev_minor);
+    scanned.inode = dstx.stx_ino;
+    scanned.mtimeNs = static_cast<int64_t>(dstx.stx_mtime.tv_sec) * 1'000'000'000 + dstx.stx_mtime.tv_nsec;
+
+    const IndexedDirectory* previous = m_index ? m_index->FindDirectory(dir) : nullptr;
+    if (previous && previous->device == scanned.device && previous->inode == scanned.inode &&
+        previous->mtimeNs == scanned.mtimeNs) {
+        m_dirs.fetch_add(1, std::memory_order_relaxed);
+        m_scanned[self].push_back(std::move(scanned));
+        EmitIndexed(self, dir, *previous, batch);
+        return;
+    }
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_dirs.fetch_add(1, std::memory_order_relaxed);
+
+    // Interned once for all files of the directory
+    const DirId dirId = PathStore::Get().InternDirectory(dir);
+
+    alignas(LinuxDirent64) char buf[64 * 1024];
+
+    for (;;) {
+        long n = ::syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0) {
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+                scanned.complete = false;
+            }
+            break;
+        }
+
+        for (long off = 0; off < n;) {
+            auto* d = reinterpret_cast<LinuxDirent64*>(buf + off);
+            off += d->d_reclen;
+
+            if (IsDotOrDotDot(d->d_name))
+                continue;
+
+            if (d->d_type == DT_DIR) {
+                PushDir(self, JoinPath(dir, d->d_name));
+                continue;
+            }
+            if (d->d_type != DT_REG && d->d_type != DT_UNKNOWN)
+                continue;   // symlinks, sockets, devices, ...
+
+            // The single metadata call for this entry
+            struct statx stx;
+            if (::statx(fd, d->d_name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                        STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) != 0) {
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+                scanned.complete = false;
+                continue;
+            }
+
+            if (S_ISDIR(stx.stx_mode)) {
+                PushDir(self, JoinPath(dir, d->d_name));
+                continue;
+            }
+            if (!S_ISREG(stx.stx_mode))
+                continue;
+
+            FileInfo fi;
+            fi.SetLocation(dirId, d->d_name);
+            fi.size = stx.stx_size;
+            fi.modified = wxDateTime(static_cast<time_t>(stx.stx_mtime.tv_sec));
+            fi.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            fi.inode = stx.stx_ino;
+
+            // The directory changed, but this file may not have
+            if (previous) {
+                const IndexedFile* rec = m_index->FindFile(*previous, d->d_name);
+                if (rec && rec->device == fi.device && rec->inode == fi.inode &&
+                    rec->size == stx.stx_size && rec->mtime == stx.stx_mtime.tv_sec)
+                    fi.indexRecord = m_index->RecordOf(*rec);
+            }
+            Emit(std::move(fi), batch);
+        }
+    }
+
+    ::close(fd);
+    m_scanned[self].push_back(std::move(scanned));
+}
+
+void DirectoryScanner::EmitIndexed(unsigned self, const std::string& dir,
+                                   const IndexedDirectory& cached, Batch& batch)
+{
+    for (uint32_t child : m_index->ChildrenOf(cached))
+        PushDir(self, std::string(m_index->Path(m_index->Directory(child))));
+
+    const DirId dirId = PathStore::Get().InternDirectory(dir);
+    for (const IndexedFile& f : m_index->FilesOf(cached)) {
+        FileInfo fi;
+        fi.SetLocation(dirId, m_index->Name(f));
+        fi.size = f.size;
+        fi.modified = wxDateTime(static_cast<time_t>(f.mtime));
+        fi.device = f.device;
+        fi.inode = f.inode;
+        fi.indexRecord = m_index->RecordOf(f);
+        Emit(std::move(fi), batch);
+    }
+    m_reused.fetch_add(m_index->FilesOf(cached).size(), std::memory_order_relaxed);
+}
+
+#else
+
+void DirectoryScanner::EmitIndexed(unsigned WXUNUSED(self), const std::string& WXUNUSED(dir),
+                                   const IndexedDirectory& WXUNUSED(cached), Batch& WXUNUSED(batch))
+{
+    // Never called: ScanDirectory() below does not consult the index
+}
+
+void DirectoryScanner::ScanDirectory(unsigned self, const std::string& dir, Batch& batch)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    fs::directory_iterator it(fs::path(std::u8string(dir.begin(), dir.end())),
+                              fs::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_dirs.fetch_add(1, std::memory_order_relaxed);
+
+    const DirId dirId = PathStore::Get().InternDirectory(dir);
+
+    for (; it != fs::directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            m_errors.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+
+        const fs::directory_entry& entry = *it;
+        if (entry.is_symlink(ec))
+            continue;
+        if (entry.is_directory(ec)) {
+            PushDir(self, ToUtf8(entry.path()));
+            continue;
+        }
+        if (!entry.is_regular_file(ec))
+            continue;
+
+        uintmax_t size = entry.file_size(ec);
+        auto mtime = entry.last_write_time(ec);
+        if (ec) {
+            m_errors.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        FileInfo fi;
+        fi.SetLocation(dirId, ToUtf8(entry.path().filename()));
+        fi.size = static_cast<wxULongLong_t>(size);
+        fi.modified = wxDateTime(static_cast<time_t>(std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::file_clock::to_sys(mtime).time_since_epoch()).count()));
+        Emit(std::move(fi), batch);
+    }
+}
+
+#endif
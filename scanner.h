@@ -0,0 +1,61 @@
+// scanner.h
+//
+// Recursive, multi-threaded directory scanner. Directories are distributed
+// over a small work-stealing pool; on Linux each directory is read with
+// getdents64 and every entry costs exactly one statx call.
+//
+// With a MetadataIndex from an earlier scan, a directory whose device, inode
+// and mtime still match its record is not read at all: its files and
+// subdirectories come from the index (Linux only; elsewhere the index is
+// ignored).
+
+#pragma once
+
+#include "ingest.h"
+#include "metaindex.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+class DirectoryScanner : public IngestJob {
+public:
+    // threads == 0 means one per hardware thread. index, if given, must
+    // outlive the scanner; it is used if it is open by the time of Start().
+    explicit DirectoryScanner(const wxString& root, unsigned threads = 0,
+                              const MetadataIndex* index = nullptr);
+    ~DirectoryScanner() override;
+
+    // The root as scanned, in ToFileSystem() form without trailing slashes
+    const std::string& Root() const { return m_rootPath; }
+
+    // Every directory read or taken from the index, for WriteMetadataIndex().
+    // Only valid once the job has finished; empty where unsupported.
+    std::vector<ScannedDirectory> TakeDirectories();
+
+private:
+    struct WorkQueue {
+        std::mutex              mutex;
+        std::deque<std::string> dirs;
+    };
+
+    wxString             m_root;
+    std::string          m_rootPath;
+    const MetadataIndex* m_index;
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::atomic<size_t>                     m_pendingDirs{0};   // queued or being read
+    std::vector<std::vector<ScannedDirectory>> m_scanned;      // per worker
+
+    void Prepare() override;
+    void WorkerMain(std::stop_token stop, unsigned self, Batch& batch) override;
+
+    bool PopOrSteal(unsigned self, std::string& dir);
+    void PushDir(unsigned self, std::string dir);
+
+    // Reads one directory, queueing subdirectories and emitting regular files.
+    void ScanDirectory(unsigned self, const std::string& dir, Batch& batch);
+
+    // Same for an unchanged directory, from its index record
+    void EmitIndexed(unsigned self, const std::string& dir, const IndexedDirectory& cached, Batch& batch);
+};
@@ -0,0 +1,450 @@
+// similar.cpp
+
+#include "similar.h"
+#include "thumbcache.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+
+namespace {
+
+// dHash compares neighbours in a grid one column wider than it is tall
+constexpr unsigned kDiffColumns = 9;
+constexpr unsigned kDiffRows = 8;
+
+// pHash keeps the lowest kDctSide² frequencies
+constexpr unsigned kDctSide = 8;
+
+constexpr uint32_t kNone = ~uint32_t(0);
+
+// ITU-R BT.601 luma in 8-bit fixed point
+inline uint32_t Luma(const uint8_t* rgb)
+{
+    return (77u * rgb[0] + 150u * rgb[1] + 29u * rgb[2]) >> 8;
+}
+
+// cos((2x + 1) u π / 2N) for the lowest kDctSide frequencies u of an
+// N = kThumbnailSide point DCT-II
+const std::array<float, kDctSide * kThumbnailSide>& DctTable()
+{
+    static const auto table = [] {
+        std::array<float, kDctSide * kThumbnailSide> t{};
+        for (unsigned u = 0; u < kDctSide; ++u) {
+            for (unsigned x = 0; x < kThumbnailSide; ++x)
+                t[u * kThumbnailSide + x] = static_cast<float>(
+                    std::cos((2 * x + 1) * u * std::numbers::pi / (2 * kThumbnailSide)));
+        }
+        return t;
+    }();
+    return table;
+}
+
+uint64_t DifferenceHash(std::span<const uint8_t> thumbnail)
+{
+    // Area sums over a kDiffColumns × kDiffRows grid, then one bit per
+    // horizontal neighbour pair: is the right cell brighter?
+    uint32_t sums[kDiffRows][kDiffColumns] = {};
+    uint32_t widths[kDiffColumns];
+    for (unsigned c = 0; c < kDiffColumns; ++c)
+        widths[c] = (c + 1) * kThumbnailSide / kDiffColumns - c * kThumbnailSide / kDiffColumns;
+
+    for (unsigned y = 0; y < kThumbnailSide; ++y) {
+        const uint8_t* row = thumbnail.data() + y * kThumbnailSide;
+        uint32_t* cells = sums[y * kDiffRows / kThumbnailSide];
+        for (unsigned x = 0; x < kThumbnailSide; ++x)
+            cells[x * kDiffColumns / kThumbnailSide] += row[x];
+    }
+
+    uint64_t hash = 0;
+    for (unsigned r = 0; r < kDiffRows; ++r) {
+        for (unsigned c = 0; c + 1 < kDiffColumns; ++c) {
+            // Cells differ in width, so compare averages
+            bool brighter = uint64_t(sums[r][c + 1]) * widths[c] > uint64_t(sums[r][c]) * widths[c + 1];
+            hash = (hash << 1) | (brighter ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+uint64_t DctHash(std::span<const uint8_t> thumbnail)
+{
+    const auto& cosines = DctTable();
+
+    // Separable DCT, computing only the frequencies that are kept: rows first...
+    float rows[kThumbnailSide][kDctSide];
+    for (unsigned y = 0; y < kThumbnailSide; ++y) {
+        const uint8_t* row = thumbnail.data() + y * kThumbnailSide;
+        for (unsigned v = 0; v < kDctSide; ++v) {
+            const float* c = &cosines[v * kThumbnailSide];
+            float sum = 0;
+            for (unsigned x = 0; x < kThumbnailSide; ++x)
+                sum += row[x] * c[x];
+            rows[y][v] = sum;
+        }
+    }
+
+    // ...then columns
+    float coefficients[kDctSide * kDctSide];
+    for (unsigned u = 0; u < kDctSide; ++u) {
+        const float* c = &cosines[u * kThumbnailSide];
+        for (unsigned v = 0; v < kDctSide; ++v) {
+            float sum = 0;
+            for (unsigned y = 0; y < kThumbnailSide; ++y)
+                sum += rows[y][v] * c[y];
+            coefficients[u * kDctSide + v] = sum;
+        }
+    }
+
+    // One bit per coefficient above the median, leaving out the average
+    // brightness (the DC term), which says nothing about the picture
+    float ac[kDctSide * kDctSide - 1];
+    std::copy(coefficients + 1, std::end(coefficients), ac);
+    std::nth_element(ac, ac + std::size(ac) / 2, std::end(ac));
+    const float median = ac[std::size(ac) / 2];
+
+    uint64_t hash = 0;
+    for (unsigned k = 1; k < kDctSide * kDctSide; ++k) {
+        if (coefficients[k] > median)
+            hash |= uint64_t(1) << k;
+    }
+    return hash;
+}
+
+// Metric tree over Hamming distances: a node's children hang off it by
+// their distance to it, so by the triangle inequality a search within
+// radius r of a value at distance d only descends into children at
+// [d - r, d + r].
+class BkTree {
+public:
+    explicit BkTree(std::span<const ImageHashes> values) : m_values(values) {}
+
+    void Add(uint32_t item)
+    {
+        uint32_t added = static_cast<uint32_t>(m_nodes.size());
+        if (m_nodes.empty()) {
+            m_nodes.push_back({item, kNone, kNone, 0});
+            return;
+        }
+
+        uint32_t node = 0;
+        for (;;) {
+            unsigned d = HammingDistance(m_values[item], m_values[m_nodes[node].item]);
+            uint32_t child = m_nodes[node].firstChild;
+            while (child != kNone && m_nodes[child].distance != d)
+                child = m_nodes[child].next;
+            if (child == kNone) {
+                m_nodes.push_back({item, kNone, m_nodes[node].firstChild, d});
+                m_nodes[node].firstChild = added;
+                return;
+            }
+            node = child;
+        }
+    }
+
+    // Calls fn(item) for every item within radius of value
+    template <typename Fn>
+    void Find(const ImageHashes& value, unsigned radius, Fn fn)
+    {
+        if (m_nodes.empty())
+            return;
+
+        m_stack.assign(1, 0);
+        while (!m_stack.empty()) {
+            const Node& node = m_nodes[m_stack.back()];
+            m_stack.pop_back();
+
+            unsigned d = HammingDistance(value, m_values[node.item]);
+            if (d <= radius)
+                fn(node.item);
+            for (uint32_t child = node.firstChild; child != kNone; child = m_nodes[child].next) {
+                unsigned at = m_nodes[child].distance;
+                if (at + radius >= d && at <= d + radius)
+                    m_stack.push_back(child);
+            }
+        }
+    }
+
+private:
+    struct Node {
+        uint32_t item;
+        uint32_t firstChild;
+        uint32_t next;         // sibling
+        unsigned distance;     // to the parent
+    };
+
+    std::span<const ImageHashes> m_values;
+    std::vector<Node>            m_nodes;
+    std::vector<uint32_t>        m_stack;
+};
+
+uint32_t FindRoot(std::vector<uint32_t>& parent, uint32_t x)
+{
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+} // namespace
+
+// ------------------------------- Hashing -----------------------------------
+
+void MakeThumbnail(const uint8_t* rgb, unsigned width, unsigned height, std::vector<uint8_t>& thumbnail)
+{
+    thumbnail.assign(kThumbnailPixels, 0);
+    if (width == 0 || height == 0)
+        return;
+
+    // Source columns [columnStart[x], columnEnd[x]) make thumbnail column x;
+    // images smaller than a thumbnail repeat their pixels
+    uint32_t columnStart[kThumbnailSide], columnEnd[kThumbnailSide];
+    for (unsigned x = 0; x < kThumbnailSide; ++x) {
+        columnStart[x] = static_cast<uint32_t>(uint64_t(x) * width / kThumbnailSide);
+        columnEnd[x] = std::max(columnStart[x] + 1, static_cast<uint32_t>(uint64_t(x + 1) * width / kThumbnailSide));
+    }
+
+    uint64_t sums[kThumbnailSide];
+    for (unsigned y = 0; y < kThumbnailSide; ++y) {
+        uint32_t rowStart = static_cast<uint32_t>(uint64_t(y) * height / kThumbnailSide);
+        uint32_t rowEnd = std::max(rowStart + 1, static_cast<uint32_t>(uint64_t(y + 1) * height / kThumbnailSide));
+
+        std::fill(std::begin(sums), std::end(sums), 0);
+        for (uint32_t sy = rowStart; sy < rowEnd; ++sy) {
+            const uint8_t* row = rgb + size_t(sy) * width * 3;
+            for (unsigned x = 0; x < kThumbnailSide; ++x) {
+                uint64_t sum = 0;
+                for (uint32_t sx = columnStart[x]; sx < columnEnd[x]; ++sx)
+                    sum += Luma(row + size_t(sx) * 3);
+                sums[x] += sum;
+            }
+        }
+
+        for (unsigned x = 0; x < kThumbnailSide; ++x) {
+            uint64_t area = uint64_t(rowEnd - rowStart) * (columnEnd[x] - columnStart[x]);
+            thumbnail[y * kThumbnailSide + x] = static_cast<uint8_t>(sums[x] / area);
+        }
+    }
+}
+
+ImageHashes HashThumbnail(std::span<const uint8_t> thumbnail)
+{
+    if (thumbnail.size() != kThumbnailPixels)
+        return {};
+    return {DifferenceHash(thumbnail), DctHash(thumbnail)};
+}
+
+// ------------------------------ Clustering ---------------------------------
+
+std::vector<std::vector<uint32_t>> ClusterSimilar(std::span<const ImageHashes> hashes, unsigned maxDistance)
+{
+    PhaseScope phase("similar.cluster", hashes.size());
+    const size_t n = hashes.size();
+
+    // Copies of one picture often hash alike, and only distinct values go
+    // into the tree
+    std::vector<uint32_t> order(n);
+    for (uint32_t i = 0; i < n; ++i)
+        order[i] = i;
+    auto key = [&](uint32_t i) { return std::make_pair(hashes[i].dhash, hashes[i].phash); };
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+
+    std::vector<ImageHashes> values;
+    std::vector<uint32_t> valueOf(n);
+    for (size_t k = 0; k < n; ++k) {
+        if (values.empty() || !(values.back() == hashes[order[k]]))
+            values.push_back(hashes[order[k]]);
+        valueOf[order[k]] = static_cast<uint32_t>(values.size() - 1);
+    }
+
+    // Searching before adding finds each close pair once, from its later value
+    std::vector<uint32_t> parent(values.size());
+    for (uint32_t v = 0; v < values.size(); ++v)
+        parent[v] = v;
+
+    BkTree tree(values);
+    for (uint32_t v = 0; v < values.size(); ++v) {
+        tree.Find(values[v], maxDistance, [&](uint32_t other) {
+            uint32_t a = FindRoot(parent, v);
+            uint32_t b = FindRoot(parent, other);
+            if (a != b)
+                parent[std::max(a, b)] = std::min(a, b);
+        });
+        tree.Add(v);
+    }
+
+    // Groups in order of their first image; singles are dropped at the end
+    std::vector<uint32_t> groupOf(values.size(), kNone);
+    std::vector<std::vector<uint32_t>> groups;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t root = FindRoot(parent, valueOf[i]);
+        if (groupOf[root] == kNone) {
+            groupOf[root] = static_cast<uint32_t>(groups.size());
+            groups.emplace_back();
+        }
+        groups[groupOf[root]].push_back(i);
+    }
+    std::erase_if(groups, [](const std::vector<uint32_t>& g) { return g.size() < 2; });
+    return groups;
+}
+
+// -------------------------- SimilarImageFinder -----------------------------
+
+SimilarImageFinder::SimilarImageFinder(std::vector<std::string> paths, std::vector<ThumbnailKey> keys,
+                                       Decoder decoder, ThumbnailCache* cache)
+    : m_paths(std::move(paths))
+    , m_keys(std::move(keys))
+    , m_decoder(std::move(decoder))
+    , m_cache(cache)
+{
+    m_keys.resize(m_paths.size());
+}
+
+SimilarImageFinder::~SimilarImageFinder()
+{
+    Cancel();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void SimilarImageFinder::Start(OnFinished onFinished)
+{
+    m_onFinished = std::move(onFinished);
+    m_running = true;
+    m_thread = std::jthread([this](std::stop_token stop) {
+        Run(stop);
+
+        bool cancelled = stop.stop_requested();
+        m_running = false;
+        if (m_onFinished)
+            m_onFinished(cancelled);
+    });
+}
+
+void SimilarImageFinder::Cancel()
+{
+    m_thread.request_stop();
+}
+
+SimilarImageFinder::Progress SimilarImageFinder::GetProgress() const
+{
+    Progress p;
+    p.clustering = m_clustering.load(std::memory_order_relaxed);
+    p.done = m_done.load(std::memory_order_relaxed);
+    p.total = m_total.load(std::memory_order_relaxed);
+    p.decoded = m_decoded.load(std::memory_order_relaxed);
+    p.errors = m_errors.load(std::memory_order_relaxed);
+    return p;
+}
+
+void SimilarImageFinder::Run(std::stop_token stop)
+{
+    const size_t n = m_paths.size();
+    m_hashes.assign(n, ImageHashes());
+    m_hashed.assign(n, 0);
+    m_setOf.assign(n, 0);
+    m_sets.clear();
+
+    std::vector<uint32_t> images;
+    for (size_t i = 0; i < n; ++i) {
+        if (!m_paths[i].empty())
+            images.push_back(static_cast<uint32_t>(i));
+    }
+    m_total = images.size();
+
+    {
+        PhaseScope phase("similar.hash", images.size());
+
+        // Workers claim one image at a time, as decoding times vary with
+        // format and size
+        std::atomic<size_t> next{0};
+        auto worker = [&] {
+            std::vector<uint8_t> thumbnail;
+            for (;;) {
+                size_t k = next.fetch_add(1, std::memory_order_relaxed);
+                if (k >= images.size() || stop.stop_requested())
+                    break;
+
+                uint32_t file = images[k];
+                if (Hash(file, thumbnail))
+                    m_hashed[file] = 1;
+                else
+                    m_errors.fetch_add(1, std::memory_order_relaxed);
+                m_done.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        unsigned threads = static_cast<unsigned>(std::min<size_t>(std::min(hw, kMaxWorkers), images.size()));
+        std::vector<std::jthread> workers;
+        if (threads > 1)
+            workers.reserve(threads - 1);
+        for (unsigned t = 1; t < threads; ++t)
+            workers.emplace_back(worker);
+        worker();
+    }
+
+    // Even a cancelled run keeps what it decoded for next time
+    if (m_cache)
+        m_cache->Flush();
+    if (stop.stop_requested())
+        return;
+
+    m_clustering = true;
+    std::vector<uint32_t> hashedFiles;
+    std::vector<ImageHashes> hashes;
+    for (uint32_t file : images) {
+        if (m_hashed[file]) {
+            hashedFiles.push_back(file);
+            hashes.push_back(m_hashes[file]);
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> groups = ClusterSimilar(hashes, kMaxDistance);
+    std::vector<Set> sets(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g) {
+        for (uint32_t& member : groups[g]) {
+            member = hashedFiles[member];
+            sets[g].bytes += m_keys[member].size;
+        }
+        sets[g].count = static_cast<uint32_t>(groups[g].size());
+    }
+
+    std::vector<uint32_t> order(groups.size());
+    for (uint32_t g = 0; g < order.size(); ++g)
+        order[g] = g;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (sets[a].count != sets[b].count)
+            return sets[a].count > sets[b].count;
+        return sets[a].bytes != sets[b].bytes ? sets[a].bytes > sets[b].bytes : a < b;
+    });
+
+    m_sets.reserve(order.size());
+    for (uint32_t g : order) {
+        m_sets.push_back(sets[g]);
+        for (uint32_t file : groups[g])
+            m_setOf[file] = static_cast<uint32_t>(m_sets.size());
+    }
+}
+
+bool SimilarImageFinder::Hash(uint32_t file, std::vector<uint8_t>& thumbnail)
+{
+    const ThumbnailKey& key = m_keys[file];
+    if (m_cache && m_cache->Find(key, m_hashes[file]))
+        return true;
+
+    // A cached thumbnail with stale hashes still saves the decoding
+    if (!m_cache || !m_cache->Thumbnail(key, thumbnail)) {
+        if (!m_decoder || !m_decoder(m_paths[file], thumbnail) || thumbnail.size() != kThumbnailPixels)
+            return false;
+        m_decoded.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_hashes[file] = HashThumbnail(thumbnail);
+    if (m_cache)
+        m_cache->Store(key, thumbnail, m_hashes[file]);
+    return true;
+}
@@ -0,0 +1,146 @@
+// similar.h
+//
+// Near-duplicate images for the "Similar Images" strategy. Every image is
+// reduced to a small grayscale thumbnail and two 64-bit perceptual hashes
+// of it: a difference hash (dHash, brightness gradients) and a DCT hash
+// (pHash, low frequencies). Resized or re-encoded copies of a picture land
+// a few bits apart, so images are grouped by Hamming distance through a
+// BK-tree, which only visits the branches that can hold a close hash
+// instead of comparing every pair.
+//
+// Decoding is left to the caller (wxImage lives in wxCore, which this
+// library does not link), and the thumbnails and hashes are cached on disk
+// (see thumbcache.h) so a repeat run only decodes new or changed images.
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ThumbnailCache;
+
+// Thumbnails are kThumbnailSide² 8-bit gray levels, rows top to bottom
+inline constexpr unsigned kThumbnailSide = 32;
+inline constexpr size_t   kThumbnailPixels = size_t(kThumbnailSide) * kThumbnailSide;
+
+// Bump when HashThumbnail() starts to hash differently, which makes cached
+// hashes stale (the cached thumbnails stay usable)
+inline constexpr uint32_t kImageHashVersion = 1;
+
+struct ImageHashes {
+    uint64_t dhash = 0;
+    uint64_t phash = 0;
+
+    bool operator==(const ImageHashes&) const = default;
+};
+
+// Bits that differ between two images, over both hashes (0..128)
+inline unsigned HammingDistance(const ImageHashes& a, const ImageHashes& b)
+{
+    return static_cast<unsigned>(std::popcount(a.dhash ^ b.dhash) + std::popcount(a.phash ^ b.phash));
+}
+
+// Area-averages an image of packed 8-bit RGB pixels down to a thumbnail.
+// The aspect ratio is not kept: a stretched copy should still match.
+void MakeThumbnail(const uint8_t* rgb, unsigned width, unsigned height, std::vector<uint8_t>& thumbnail);
+
+ImageHashes HashThumbnail(std::span<const uint8_t> thumbnail);
+
+// Groups images whose hashes are at most maxDistance apart, directly or
+// through a chain of such images. Returns the groups of two or more, as
+// ascending indices into hashes, ordered by their first index.
+std::vector<std::vector<uint32_t>> ClusterSimilar(std::span<const ImageHashes> hashes, unsigned maxDistance);
+
+// The cache key of a file: what it is and which version of it
+struct ThumbnailKey {
+    uint64_t device = 0;
+    uint64_t inode = 0;        // a hash of the path where there are no inodes
+    uint64_t size = 0;
+    int64_t  mtime = 0;        // seconds since the epoch
+};
+
+class SimilarImageFinder {
+public:
+    // Bits apart, out of 128, that still count as the same picture.
+    // Re-encoding and resizing typically cost fewer than eight.
+    static constexpr unsigned kMaxDistance = 16;
+
+    // Decoding holds a whole image in memory, so at most this many at once
+    static constexpr unsigned kMaxWorkers = 8;
+
+    struct Progress {
+        bool     clustering = false;
+        uint64_t done = 0;         // images hashed or failed
+        uint64_t total = 0;        // images to hash
+        uint64_t decoded = 0;      // of done, decoded rather than cached
+        uint64_t errors = 0;
+    };
+
+    // A group of similar images
+    struct Set {
+        uint32_t count = 0;
+        uint64_t bytes = 0;        // all of them together
+    };
+
+    // Decodes the image at path (ToFileSystem() form) into a thumbnail (see
+    // MakeThumbnail()); false if it is not a readable image. Called from
+    // several workers at once.
+    using Decoder = std::function<bool(const std::string& path, std::vector<uint8_t>& thumbnail)>;
+
+    // Called once on the finder's thread, after clustering
+    using OnFinished = std::function<void(bool cancelled)>;
+
+    // paths are in ToFileSystem() form; an empty path is not an image and is
+    // left out. keys[i] identifies file i in cache, which may be null and
+    // must outlive the job.
+    SimilarImageFinder(std::vector<std::string> paths, std::vector<ThumbnailKey> keys, Decoder decoder,
+                       ThumbnailCache* cache = nullptr);
+    ~SimilarImageFinder();
+
+    SimilarImageFinder(const SimilarImageFinder&) = delete;
+    SimilarImageFinder& operator=(const SimilarImageFinder&) = delete;
+
+    void Start(OnFinished onFinished);
+    void Cancel();
+
+    bool     IsRunning() const { return m_running.load(); }
+    Progress GetProgress() const;
+
+    // Results, only valid once the job has finished without being
+    // cancelled. Sets are ordered by size, largest first; SetOf(i) is 1 +
+    // the index of the set file i belongs to, or 0 if it has no match.
+    const std::vector<Set>& Sets() const { return m_sets; }
+    uint32_t                SetOf(size_t file) const { return m_setOf[file]; }
+    size_t                  FileCount() const { return m_paths.size(); }
+
+private:
+    std::vector<std::string>  m_paths;
+    std::vector<ThumbnailKey> m_keys;
+    Decoder                   m_decoder;
+    ThumbnailCache*           m_cache;
+
+    std::vector<ImageHashes> m_hashes;
+    std::vector<uint8_t>     m_hashed;     // m_hashes[i] is valid
+
+    std::vector<Set>      m_sets;
+    std::vector<uint32_t> m_setOf;
+
+    OnFinished            m_onFinished;
+    std::jthread          m_thread;
+    std::atomic<bool>     m_running{false};
+
+    std::atomic<bool>     m_clustering{false};
+    std::atomic<uint64_t> m_done{0};
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_decoded{0};
+    std::atomic<uint64_t> m_errors{0};
+
+    void Run(std::stop_token stop);
+    bool Hash(uint32_t file, std::vector<uint8_t>& thumbnail);
+};
@@ -0,0 +1,292 @@
+// sniffer.cpp
+
+#include "sniffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <filesystem>
+#include <fstream>
+#endif
+
+using namespace std::string_view_literals;
+
+namespace {
+
+// Consecutive paths claimed by a worker at a time. Scanned trees list the
+// files of a directory together, so a run mostly shares one parent.
+constexpr size_t kRunLength = 64;
+
+constexpr uint32_t Bit(CategoryId c) { return uint32_t(1) << c; }
+
+constexpr uint32_t kOfficeCategories =
+    Bit(Category::Documents) | Bit(Category::Spreadsheets) | Bit(Category::Presentations);
+constexpr uint32_t kMediaCategories =
+    Bit(Category::Images) | Bit(Category::Audio) | Bit(Category::Videos);
+
+struct Signature {
+    uint16_t         offset;
+    std::string_view magic;
+    CategoryId       category;
+    uint32_t         keep = 0;      // name-based categories the format is a container for
+    uint16_t         offset2 = 0;   // optional second magic, e.g. the RIFF form type
+    std::string_view magic2 = {};
+};
+
+// First match wins, so more specific entries come first.
+constexpr Signature kSignatures[] = {
+    // Images
+    {0, "\x89PNG\r\n\x1a\n"sv,           Category::Images},
+    {0, "\xff\xd8\xff"sv,                Category::Images},
+    {0, "GIF8"sv,                        Category::Images},
+    {0, "RIFF"sv,                        Category::Images, 0, 8, "WEBP"sv},
+    {0, "II*\0"sv,                       Category::Images},
+    {0, "MM\0*"sv,                       Category::Images},
+    {0, "8BPS"sv,                        Category::Images},
+    {0, "BM"sv,                          Category::Images, 0, 6, "\0\0\0\0"sv},
+    {4, "ftypheic"sv,                    Category::Images},
+    {4, "ftypavif"sv,                    Category::Images},
+    {4, "ftypmif1"sv,                    Category::Images},
+
+    // Audio
+    {0, "ID3"sv,                         Category::Audio},
+    {0, "fLaC"sv,                        Category::Audio},
+    {0, "RIFF"sv,                        Category::Audio, 0, 8, "WAVE"sv},
+    {0, "FORM"sv,                        Category::Audio, 0, 8, "AIFF"sv},
+    {0, "OggS"sv,                        Category::Audio, kMediaCategories},
+    {0, "MThd"sv,                        Category::Audio},
+    {0, "#!AMR"sv,                       Category::Audio},
+    {4, "ftypM4A "sv,                    Category::Audio},
+    {0, "\xff\xfb"sv,                    Category::Audio},
+    {0, "\xff\xf3"sv,                    Category::Audio},
+    {0, "\xff\xf2"sv,                    Category::Audio},
+
+    // Videos
+    {4, "ftyp"sv,                        Category::Videos, kMediaCategories},
+    {0, "\x1a\x45\xdf\xa3"sv,            Category::Videos, kMediaCategories},
+    {0, "RIFF"sv,                        Category::Videos, 0, 8, "AVI "sv},
+    {0, "FLV\x01"sv,                     Category::Videos},
+    {0, "\0\0\x01\xba"sv,                Category::Videos},
+    {0, "\x30\x26\xb2\x75\x8e\x66\xcf\x11"sv, Category::Videos, kMediaCategories},
+
+    // Archives; ZIP also carries OOXML, ODF and iWork documents
+    {0, "PK\x03\x04"sv,                  Category::Archives, kOfficeCategories},
+    {0, "PK\x05\x06"sv,                  Category::Archives, kOfficeCategories},
+    {0, "Rar!\x1a\x07"sv,                Category::Archives},
+    {0, "7z\xbc\xaf\x27\x1c"sv,          Category::Archives},
+    {0, "\x1f\x8b"sv,                    Category::Archives},
+    {0, "BZh"sv,                         Category::Archives},
+    {0, "\xfd" "7zXZ\0"sv,               Category::Archives},
+    {0, "\x28\xb5\x2f\xfd"sv,            Category::Archives},
+    {0, "MSCF"sv,                        Category::Archives},
+    {257, "ustar"sv,                     Category::Archives},
+
+    // Documents; OLE compound files are the legacy Office formats
+    {0, "%PDF-"sv,                       Category::Documents},
+    {0, "{\\rtf"sv,                      Category::Documents},
+    {0, "%!PS"sv,                        Category::Documents},
+    {0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1"sv, Category::Documents, kOfficeCategories},
+
+    // Executables
+    {0, "\x7f" "ELF"sv,                  Category::Executables},
+    {0, "\xfe\xed\xfa\xce"sv,            Category::Executables},
+    {0, "\xfe\xed\xfa\xcf"sv,            Category::Executables},
+    {0, "\xce\xfa\xed\xfe"sv,            Category::Executables},
+    {0, "\xcf\xfa\xed\xfe"sv,            Category::Executables},
+    {0, "\xca\xfe\xba\xbe"sv,            Category::Executables},
+    {0, "\0asm"sv,                       Category::Executables},
+    {0, "MZ"sv,                          Category::Executables},
+
+    // Scripts
+    {0, "#!"sv,                          Category::Code},
+};
+
+static_assert(std::ranges::all_of(kSignatures, [](const Signature& s) {
+    return s.offset + s.magic.size() <= kSniffBudget &&
+           s.offset2 + s.magic2.size() <= kSniffBudget;
+}), "signature outside the sniff budget");
+
+bool MatchesAt(std::span<const uint8_t> head, size_t offset, std::string_view magic)
+{
+    return head.size() >= offset + magic.size() &&
+           std::memcmp(head.data() + offset, magic.data(), magic.size()) == 0;
+}
+
+} // namespace
+
+CategoryId SniffCategory(std::span<const uint8_t> head, CategoryId byName)
+{
+    for (const Signature& sig : kSignatures) {
+        if (!MatchesAt(head, sig.offset, sig.magic))
+            continue;
+        if (!sig.magic2.empty() && !MatchesAt(head, sig.offset2, sig.magic2))
+            continue;
+
+        bool container = byName < 32 && (sig.keep & Bit(byName));
+        return container ? byName : sig.category;
+    }
+    return byName;
+}
+
+// ---------------------------- ContentSniffer ------------------------------
+
+ContentSniffer::ContentSniffer(std::vector<std::string> paths, std::vector<CategoryId> byName,
+                               unsigned threads)
+    : m_paths(std::move(paths))
+    , m_results(std::move(byName))
+    // Latency-bound: more reads in flight than cores, but not so many that
+    // a spinning disk thrashes
+    , m_threads(threads ? threads : std::clamp(2 * std::thread::hardware_concurrency(), 4u, 16u))
+{
+    m_results.resize(m_paths.size(), Category::Other);
+}
+
+ContentSniffer::~ContentSniffer()
+{
+    Cancel();
+    m_workers.clear();   // joins
+}
+
+void ContentSniffer::Start(OnFinished onFinished)
+{
+    m_onFinished = std::move(onFinished);
+
+    m_activeWorkers = m_threads;
+    for (unsigned i = 0; i < m_threads; ++i) {
+        m_workers.emplace_back([this](std::stop_token stop) {
+            WorkerMain(stop);
+            if (m_activeWorkers.fetch_sub(1) == 1 && m_onFinished)
+                m_onFinished(m_cancelled.load());
+        });
+    }
+}
+
+void ContentSniffer::Cancel()
+{
+    m_cancelled = true;
+    for (auto& worker : m_workers)
+        worker.request_stop();
+}
+
+ContentSniffer::Progress ContentSniffer::GetProgress() const
+{
+    Progress p;
+    p.files = m_paths.size();
+    p.done = m_done.load(std::memory_order_relaxed);
+    p.errors = m_errors.load(std::memory_order_relaxed);
+    p.bytes = m_bytes.load(std::memory_order_relaxed);
+    return p;
+}
+
+#ifdef __linux__
+
+void ContentSniffer::WorkerMain(std::stop_token stop)
+{
+    uint8_t buf[kSniffBudget];
+
+    // Parent directory of the previous file; its leaf names are opened
+    // relative to it so the kernel resolves the directory path only once.
+    std::string dirPath;
+    int dirFd = -1;
+    bool noAtime = true;   // dropped after the first EPERM (files we don't own)
+
+    const size_t n = m_paths.size();
+    while (!stop.stop_requested()) {
+        size_t begin = m_next.fetch_add(kRunLength);
+        if (begin >= n)
+            break;
+        size_t end = std::min(n, begin + kRunLength);
+
+        for (size_t i = begin; i < end && !stop.stop_requested(); ++i) {
+            const std::string& path = m_paths[i];
+            if (path.empty()) {
+                m_done.fetch_add(1, std::memory_order_relaxed);
+                continue;   // result already known
+            }
+
+            size_t slash = path.rfind('/');
+            const char* leaf = path.c_str();
+            int at = AT_FDCWD;
+            if (slash != std::string::npos) {
+                std::string_view parent(path.data(), slash ? slash : 1);
+                if (parent != dirPath) {
+                    if (dirFd >= 0)
+                        ::close(dirFd);
+                    dirPath.assign(parent);
+                    dirFd = ::open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                }
+                if (dirFd >= 0) {
+                    at = dirFd;
+                    leaf = path.c_str() + slash + 1;
+                }
+            }
+
+            // O_NONBLOCK keeps a FIFO that replaced a regular file from hanging us
+            int flags = O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK;
+            int fd = ::openat(at, leaf, flags | (noAtime ? O_NOATIME : 0));
+            if (fd < 0 && noAtime && errno == EPERM) {
+                noAtime = false;
+                fd = ::openat(at, leaf, flags);
+            }
+
+            ssize_t got = fd >= 0 ? ::pread(fd, buf, sizeof(buf), 0) : -1;
+            if (fd >= 0)
+                ::close(fd);
+
+            if (got < 0) {
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                m_results[i] = SniffCategory(std::span<const uint8_t>(buf, got), m_results[i]);
+                m_bytes.fetch_add(got, std::memory_order_relaxed);
+            }
+            m_done.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (dirFd >= 0)
+        ::close(dirFd);
+}
+
+#else
+
+void ContentSniffer::WorkerMain(std::stop_token stop)
+{
+    char buf[kSniffBudget];
+
+    const size_t n = m_paths.size();
+    while (!stop.stop_requested()) {
+        size_t begin = m_next.fetch_add(kRunLength);
+        if (begin >= n)
+            break;
+        size_t end = std::min(n, begin + kRunLength);
+
+        for (size_t i = begin; i < end && !stop.stop_requested(); ++i) {
+            const std::string& path = m_paths[i];
+            if (path.empty()) {
+                m_done.fetch_add(1, std::memory_order_relaxed);
+                continue;   // result already known
+            }
+            std::ifstream in(std::filesystem::path(std::u8string(path.begin(), path.end())),
+                             std::ios::binary);
+
+            if (!in) {
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                in.read(buf, sizeof(buf));
+                size_t got = static_cast<size_t>(in.gcount());
+                m_results[i] = SniffCategory(
+                    std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buf), got), m_results[i]);
+                m_bytes.fetch_add(got, std::memory_order_relaxed);
+            }
+            m_done.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,80 @@
+// sniffer.h
+//
+// Content sniffing for the "By Real Type" strategy: the first bytes of each
+// file are matched against a table of format signatures, so misnamed and
+// extension-less files still land in the right category.
+
+#pragma once
+
+#include "classifier.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bytes read from the start of each file. Covers every signature in the
+// table, the deepest being the tar magic at offset 257.
+inline constexpr size_t kSniffBudget = 512;
+
+// Category for a file whose first bytes are head. byName is the category its
+// extension suggests; it is returned when no signature matches, and kept
+// when a container signature (ZIP, OLE, ISO media) is consistent with it,
+// e.g. a .docx is a ZIP but stays a document.
+CategoryId SniffCategory(std::span<const uint8_t> head, CategoryId byName);
+
+// Reads the head of many files on a small pool of threads. Each worker
+// claims runs of consecutive paths and reuses the parent directory handle
+// across a run, so a scanned tree costs one openat/pread/close per file.
+class ContentSniffer {
+public:
+    struct Progress {
+        uint64_t files = 0;
+        uint64_t done = 0;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Called once on a worker thread, after the last file
+    using OnFinished = std::function<void(bool cancelled)>;
+
+    // paths are in ToFileSystem() form; byName[i] is the extension category
+    // of paths[i]. An empty path is not read and keeps byName[i] as its
+    // result, for files sniffed before. threads == 0 picks a count suited
+    // to I/O-bound work.
+    ContentSniffer(std::vector<std::string> paths, std::vector<CategoryId> byName,
+                   unsigned threads = 0);
+    ~ContentSniffer();
+
+    ContentSniffer(const ContentSniffer&) = delete;
+    ContentSniffer& operator=(const ContentSniffer&) = delete;
+
+    void Start(OnFinished onFinished);
+    void Cancel();
+
+    bool     IsRunning() const { return m_activeWorkers.load() > 0; }
+    Progress GetProgress() const;
+
+    // One category per path. Only valid once the job has finished.
+    std::vector<CategoryId>& Results() { return m_results; }
+
+private:
+    std::vector<std::string> m_paths;
+    std::vector<CategoryId>  m_results;   // starts out as byName
+    unsigned                 m_threads;
+    OnFinished               m_onFinished;
+
+    std::vector<std::jthread> m_workers;
+    std::atomic<size_t>       m_next{0};
+    std::atomic<unsigned>     m_activeWorkers{0};
+    std::atomic<bool>         m_cancelled{false};
+
+    std::atomic<uint64_t> m_done{0};
+    std::atomic<uint64_t> m_errors{0};
+    std::atomic<uint64_t> m_bytes{0};
+
+    void WorkerMain(std::stop_token stop);
+};
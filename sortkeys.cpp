@@ -0,0 +1,234 @@
+// sortkeys.cpp
+
+#include "sortkeys.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace {
+
+// Below this many files per core the thread start-up costs more than it saves
+constexpr size_t kMinFilesPerWorker = 16 * 1024;
+
+// Key bytes held in NameKeys' integer prefix
+constexpr size_t kPrefixBytes = 8;
+
+// Longer digit runs still sort as numbers of the same magnitude
+constexpr size_t kMaxDigitRun = 20;
+
+uint64_t PackPrefix(std::string_view key)
+{
+    uint64_t prefix = 0;
+    for (size_t k = 0; k < kPrefixBytes; ++k)
+        prefix = (prefix << 8) | (k < key.size() ? static_cast<uint8_t>(key[k]) : 0);
+    return prefix;
+}
+
+template <typename Value>
+int CompareValues(Value a, Value b)
+{
+    return (a > b) - (a < b);
+}
+
+// Calls fn(less) with the strict weak order `order` stands for; files with
+// equal keys are ordered by index
+template <typename Fn>
+void WithLess(SortOrder order, const NameKeys& names, const StrategyKeys& keys, Fn&& fn)
+{
+    auto by = [&fn, descending = order.descending](auto cmp) {
+        fn([cmp, descending](FileIndex a, FileIndex b) {
+            int c = cmp(a, b);
+            if (c != 0)
+                return descending ? c > 0 : c < 0;
+            return a < b;
+        });
+    };
+
+    switch (order.column) {
+    case SortColumn::None:
+        fn([](FileIndex a, FileIndex b) { return a < b; });
+        break;
+    case SortColumn::Name:
+        by([&names](FileIndex a, FileIndex b) { return names.Compare(a, b); });
+        break;
+    case SortColumn::Size:
+        by([&keys](FileIndex a, FileIndex b) { return CompareValues(keys.sizes[a], keys.sizes[b]); });
+        break;
+    case SortColumn::Modified:
+        by([&keys](FileIndex a, FileIndex b) { return CompareValues(keys.mtimes[a], keys.mtimes[b]); });
+        break;
+    }
+}
+
+template <typename Less>
+void ParallelSort(std::span<FileIndex> files, Less less, bool parallel)
+{
+    const size_t n = files.size();
+    unsigned chunks = parallel ? ParallelWorkerCount(n, kMinFilesPerWorker) : 1;
+
+    ParallelChunks(n, chunks, [&](unsigned, size_t from, size_t to) {
+        std::sort(files.begin() + from, files.begin() + to, less);
+    });
+
+    // Merge neighbouring runs until one is left; the merges of a round are
+    // independent of each other
+    for (unsigned width = 1; width < chunks; width *= 2) {
+        unsigned merges = (chunks + 2 * width - 1) / (2 * width);
+        ParallelChunks(merges, merges, [&](unsigned m, size_t, size_t) {
+            unsigned first = m * 2 * width;
+            unsigned middle = first + width;
+            if (middle >= chunks)
+                return;
+            unsigned last = std::min(middle + width, chunks);
+            std::inplace_merge(files.begin() + ChunkBegin(n, chunks, first),
+                               files.begin() + ChunkBegin(n, chunks, middle),
+                               files.begin() + ChunkBegin(n, chunks, last), less);
+        });
+    }
+}
+
+void Sort(std::span<FileIndex> files, SortOrder order, const NameKeys& names,
+          const StrategyKeys& keys, bool parallel)
+{
+    WithLess(order, names, keys, [&](auto less) { ParallelSort(files, less, parallel); });
+}
+
+} // namespace
+
+void AppendCollationKey(std::string& out, std::string_view nativeName)
+{
+    std::string folded = FoldFileName(nativeName);
+
+    // Digits are ASCII in UTF-8, so runs can be found bytewise
+    for (size_t k = 0; k < folded.size();) {
+        char ch = folded[k];
+        if (ch < '0' || ch > '9') {
+            out += ch;
+            ++k;
+            continue;
+        }
+
+        // Leading zeros do not count towards the magnitude
+        size_t run = k;
+        while (run < folded.size() && folded[run] == '0')
+            ++run;
+        size_t end = run;
+        while (end < folded.size() && folded[end] >= '0' && folded[end] <= '9')
+            ++end;
+
+        // The length byte stays within '1' .. 'E' and so sorts like a digit
+        // against the punctuation and letters around it
+        out += static_cast<char>('1' + std::min(end - run, kMaxDigitRun));
+        out.append(folded, run, end - run);
+        k = end;
+    }
+}
+
+// ------------------------------- NameKeys -------------------------------
+
+void NameKeys::Extend(const std::vector<FileInfo>& files, bool parallel)
+{
+    const size_t begin = size();
+    if (begin >= files.size())
+        return;
+
+    PhaseScope phase("sort.keys", files.size() - begin);
+
+    const size_t n = files.size() - begin;
+    m_prefix.resize(files.size());
+
+    // Each chunk builds its own heap; they are concatenated in order
+    unsigned chunks = parallel ? ParallelWorkerCount(n, kMinFilesPerWorker) : 1;
+    std::vector<std::string> heaps(chunks);
+    std::vector<std::vector<uint32_t>> ends(chunks);
+
+    ParallelChunks(n, chunks, [&](unsigned c, size_t from, size_t to) {
+        std::string key;
+        ends[c].reserve(to - from);
+        for (size_t i = begin + from; i < begin + to; ++i) {
+            key.clear();
+            AppendCollationKey(key, files[i].NativeName());
+            m_prefix[i] = PackPrefix(key);
+            if (key.size() > kPrefixBytes)
+                heaps[c].append(key, kPrefixBytes);
+            ends[c].push_back(static_cast<uint32_t>(heaps[c].size()));
+        }
+    });
+
+    m_ends.reserve(files.size());
+    for (unsigned c = 0; c < chunks; ++c) {
+        uint32_t base = static_cast<uint32_t>(m_heap.size());
+        m_heap += heaps[c];
+        for (uint32_t end : ends[c])
+            m_ends.push_back(base + end);
+    }
+}
+
+void NameKeys::Remove(std::span<const FileIndex> remap)
+{
+    std::string heap;
+    heap.reserve(m_heap.size());
+    std::vector<uint32_t> ends;
+    ends.reserve(m_ends.size());
+
+    for (size_t i = 0; i < m_ends.size() && i < remap.size(); ++i) {
+        if (remap[i] == kRemovedFile)
+            continue;
+        heap += Rest(static_cast<FileIndex>(i));
+        ends.push_back(static_cast<uint32_t>(heap.size()));
+    }
+
+    CompactByRemap(m_prefix, remap);
+    m_ends = std::move(ends);
+    m_heap = std::move(heap);
+}
+
+void NameKeys::Clear()
+{
+    m_prefix.clear();
+    m_ends.clear();
+    m_heap.clear();
+}
+
+// -------------------------------- Sorting -------------------------------
+
+void SortFiles(std::span<FileIndex> files, SortOrder order, const NameKeys& names,
+               const StrategyKeys& keys, bool parallel)
+{
+    PhaseScope phase("sort", files.size());
+    Sort(files, order, names, keys, parallel);
+}
+
+void AppendSorted(std::vector<FileIndex>& sorted, size_t fileCount, SortOrder order,
+                  const NameKeys& names, const StrategyKeys& keys, bool parallel)
+{
+    const size_t middle = sorted.size();
+    if (middle >= fileCount)
+        return;
+
+    PhaseScope phase("sort", fileCount - middle);
+
+    for (size_t i = middle; i < fileCount; ++i)
+        sorted.push_back(static_cast<FileIndex>(i));
+
+    WithLess(order, names, keys, [&](auto less) {
+        ParallelSort(std::span(sorted).subspan(middle), less, parallel);
+        std::inplace_merge(sorted.begin(), sorted.begin() + middle, sorted.end(), less);
+    });
+}
+
+void SortWithinCategories(Grouping& grouping, std::span<const CategoryId> categories,
+                          SortOrder order, const NameKeys& names, const StrategyKeys& keys,
+                          bool parallel)
+{
+    PhaseScope phase("sort", grouping.FileCount());
+
+    // Categories are sorted one after another, each on all cores if it is
+    // big enough to be worth it
+    for (CategoryId c : categories) {
+        std::span<FileIndex> files = std::span(grouping.order).subspan(grouping.offsets[c], grouping.GroupSize(c));
+        if (files.size() > 1)
+            Sort(files, order, names, keys, parallel);
+    }
+}
@@ -0,0 +1,91 @@
+// sortkeys.h
+//
+// Sorting file lists by name, size or modification time. Sorts never move
+// FileInfo records: they reorder a permutation of file indices, comparing
+// precomputed integer keys (the size and mtime columns of StrategyKeys) and
+// cached name collation keys, on all cores for large lists.
+
+#pragma once
+
+#include "fileinfo.h"
+#include "grouping.h"
+#include "organizer.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SortColumn {
+    None = 0,       // file-list order
+    Name,
+    Size,
+    Modified
+};
+
+struct SortOrder {
+    SortColumn column = SortColumn::None;
+    bool       descending = false;
+
+    bool IsSorted() const { return column != SortColumn::None; }
+};
+
+// Collation key of a file name in file-system form: lower-cased UTF-8 in
+// which every run of digits is prefixed with its length, so that byte
+// order is case-insensitive and "IMG_9.jpg" sorts before "IMG_10.jpg".
+void AppendCollationKey(std::string& out, std::string_view nativeName);
+
+// Collation keys of a file list, indexed in parallel with it. The first
+// eight key bytes are packed into an integer that settles most comparisons;
+// the rest of every key lives in one shared byte heap.
+class NameKeys {
+public:
+    size_t size() const { return m_prefix.size(); }
+
+    // Appends the keys of files[size()] .. files.back()
+    void Extend(const std::vector<FileInfo>& files, bool parallel);
+
+    // Drops the keys of removed files; remap as for CompactByRemap()
+    void Remove(std::span<const FileIndex> remap);
+
+    void Clear();
+
+    // <0, 0 or >0, like memcmp over the full keys
+    int Compare(FileIndex a, FileIndex b) const
+    {
+        if (m_prefix[a] != m_prefix[b])
+            return m_prefix[a] < m_prefix[b] ? -1 : 1;
+        int c = Rest(a).compare(Rest(b));
+        return (c > 0) - (c < 0);
+    }
+
+private:
+    std::vector<uint64_t> m_prefix;
+    std::vector<uint32_t> m_ends;     // end of file i's key bytes beyond the prefix
+    std::string           m_heap;
+
+    std::string_view Rest(FileIndex i) const
+    {
+        uint32_t begin = i ? m_ends[i - 1] : 0;
+        return std::string_view(m_heap).substr(begin, m_ends[i] - begin);
+    }
+};
+
+// Sorts file indices by `order`; equal keys keep ascending index order, so
+// SortColumn::None restores file-list order. names must cover the files
+// when sorting by name. The parallel sort splits the span into one chunk
+// per core and merges the sorted chunks pairwise.
+void SortFiles(std::span<FileIndex> files, SortOrder order, const NameKeys& names,
+               const StrategyKeys& keys, bool parallel);
+
+// Adds files [sorted.size(), fileCount) to a list already sorted by
+// `order`: the new indices are sorted on their own and merged in.
+void AppendSorted(std::vector<FileIndex>& sorted, size_t fileCount, SortOrder order,
+                  const NameKeys& names, const StrategyKeys& keys, bool parallel);
+
+// Sorts the files inside each of the given categories of a grouping, e.g.
+// all of NonEmptyCategories(). Grouping::order is permuted in place.
+void SortWithinCategories(Grouping& grouping, std::span<const CategoryId> categories,
+                          SortOrder order, const NameKeys& names, const StrategyKeys& keys,
+                          bool parallel);
@@ -0,0 +1,369 @@
+// thumbcache.cpp
+
+#include "thumbcache.h"
+#include "trace.h"
+
+#include <wx/filefn.h>
+
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+// ----------------------------- File format -----------------------------
+
+// At the start of both files. The stamp ties an index to the data file it
+// was written with, so a crash between the two renames of a compaction is
+// caught rather than pointing records at the wrong thumbnails.
+struct CacheHeader {
+    char     magic[8];        // kIndexMagic or kDataMagic
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t thumbnailSide;
+    uint32_t stamp;
+};
+
+struct CacheRecord {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t  mtime;
+    uint64_t dhash;
+    uint64_t phash;
+    uint64_t offset;          // of the thumbnail in the data file
+    uint32_t hashVersion;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(CacheHeader) == 24);
+static_assert(sizeof(CacheRecord) == 64);
+
+constexpr char     kIndexMagic[8] = {'M', 'E', 'D', 'A', 'M', 'A', 'T', 'I'};
+constexpr char     kDataMagic[8] = {'M', 'E', 'D', 'A', 'M', 'A', 'T', 'D'};
+constexpr uint32_t kCacheVersion = 1;
+constexpr uint32_t kCacheByteOrder = 0x01020304;
+
+// Records read per block when loading
+constexpr size_t kLoadBlock = 4096;
+
+// Compacting a small cache is not worth the rewrite
+constexpr size_t kMinCompactRecords = 4096;
+
+CacheHeader MakeHeader(const char (&magic)[8], uint32_t stamp)
+{
+    CacheHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = kCacheVersion;
+    header.byteOrder = kCacheByteOrder;
+    header.thumbnailSide = kThumbnailSide;
+    header.stamp = stamp;
+    return header;
+}
+
+bool ReadHeader(wxFFile& file, const char (&magic)[8], CacheHeader& header)
+{
+    return file.Read(&header, sizeof(header)) == sizeof(header)
+        && std::memcmp(header.magic, magic, sizeof(header.magic)) == 0
+        && header.version == kCacheVersion && header.byteOrder == kCacheByteOrder
+        && header.thumbnailSide == kThumbnailSide;
+}
+
+// FNV-1a; unlike HashBytes() the same in every build, as cached keys must be
+uint64_t HashPath(std::string_view s)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+} // namespace
+
+ThumbnailKey ThumbnailKeyOf(const FileInfo& file)
+{
+    ThumbnailKey key;
+    key.device = file.device;
+    key.inode = file.inode != 0 ? file.inode : HashPath(file.NativePath());
+    key.size = file.size.GetValue();
+    key.mtime = file.modified.IsValid() ? static_cast<int64_t>(file.modified.GetTicks()) : 0;
+    return key;
+}
+
+// ------------------------------- Opening --------------------------------
+
+ThumbnailCache::~ThumbnailCache()
+{
+    Close();
+}
+
+bool ThumbnailCache::Open(const wxString& basename, size_t budget)
+{
+    Close();
+
+    std::lock_guard lock(m_mutex);
+    PhaseScope phase("similar.cache");
+    m_basename = basename;
+    m_budget = budget;
+
+    bool torn = false;
+    if (!Load(torn))
+        return Create();
+
+    // A torn index would misalign every record appended after it
+    if (torn || (m_records >= kMinCompactRecords && m_records > 2 * m_entries.size())) {
+        if (!Compact() && (torn || !IsOpen()))
+            return Create();
+    }
+    phase.AddItems(m_entries.size());
+    return true;
+}
+
+bool ThumbnailCache::Load(bool& torn)
+{
+    const wxString indexName = m_basename + ".idx";
+    const wxString dataName = m_basename + ".dat";
+    if (!wxFileExists(indexName) || !wxFileExists(dataName))
+        return false;
+
+    CacheHeader indexHeader, dataHeader;
+    wxFFile index(indexName, "rb");
+    wxFFile data(dataName, "rb");
+    if (!index.IsOpened() || !data.IsOpened() || !ReadHeader(index, kIndexMagic, indexHeader)
+        || !ReadHeader(data, kDataMagic, dataHeader) || indexHeader.stamp != dataHeader.stamp)
+        return false;
+
+    wxFileOffset indexLength = index.Length();
+    wxFileOffset dataLength = data.Length();
+    if (indexLength < static_cast<wxFileOffset>(sizeof(CacheHeader)) || dataLength < 0)
+        return false;
+    data.Close();
+
+    // Later records of a file replace earlier ones. Records pointing past the
+    // end of the data file were written before a crash lost their thumbnails.
+    const uint64_t dataSize = static_cast<uint64_t>(dataLength);
+    const uint64_t recordBytes = static_cast<uint64_t>(indexLength) - sizeof(CacheHeader);
+    torn = recordBytes % sizeof(CacheRecord) != 0;
+
+    std::vector<CacheRecord> block(kLoadBlock);
+    for (uint64_t left = recordBytes / sizeof(CacheRecord); left > 0;) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(left, kLoadBlock));
+        if (index.Read(block.data(), count * sizeof(CacheRecord)) != count * sizeof(CacheRecord))
+            return false;
+        left -= count;
+
+        for (size_t k = 0; k < count; ++k) {
+            const CacheRecord& r = block[k];
+            ++m_records;
+            if (r.offset < sizeof(CacheHeader) || r.offset > dataSize || dataSize - r.offset < kThumbnailPixels)
+                continue;
+            m_entries.insert_or_assign(FileId{r.device, r.inode},
+                                       Entry{r.size, r.mtime, {r.dhash, r.phash}, r.offset, r.hashVersion});
+        }
+    }
+    index.Close();
+
+    m_dataSize = dataSize;
+    return m_index.Open(indexName, "ab") && m_data.Open(dataName, "a+b");
+}
+
+bool ThumbnailCache::Create()
+{
+    m_index.Close();
+    m_data.Close();
+    m_entries.clear();
+    m_records = 0;
+
+    const wxString indexName = m_basename + ".idx";
+    const wxString dataName = m_basename + ".dat";
+    const uint32_t stamp = static_cast<uint32_t>(std::time(nullptr));
+
+    CacheHeader indexHeader = MakeHeader(kIndexMagic, stamp);
+    CacheHeader dataHeader = MakeHeader(kDataMagic, stamp);
+    {
+        wxFFile index(indexName, "wb");
+        wxFFile data(dataName, "wb");
+        bool ok = index.IsOpened() && data.IsOpened()
+               && index.Write(&indexHeader, sizeof(indexHeader)) == sizeof(indexHeader)
+               && data.Write(&dataHeader, sizeof(dataHeader)) == sizeof(dataHeader);
+        if (!index.Close() || !data.Close() || !ok)
+            return false;
+    }
+
+    m_dataSize = sizeof(CacheHeader);
+    return m_index.Open(indexName, "ab") && m_data.Open(dataName, "a+b");
+}
+
+bool ThumbnailCache::Compact()
+{
+    PhaseScope phase("similar.cache.compact", m_entries.size());
+
+    const wxString indexName = m_basename + ".idx";
+    const wxString dataName = m_basename + ".dat";
+    const wxString indexTemp = indexName + ".tmp";
+    const wxString dataTemp = dataName + ".tmp";
+    const uint32_t stamp = static_cast<uint32_t>(std::time(nullptr));
+
+    // Live thumbnails are copied one at a time, so the rewrite needs no
+    // more memory than the records
+    std::vector<uint64_t> offsets;
+    offsets.reserve(m_entries.size());
+    {
+        wxFFile index(indexTemp, "wb");
+        wxFFile data(dataTemp, "wb");
+        CacheHeader indexHeader = MakeHeader(kIndexMagic, stamp);
+        CacheHeader dataHeader = MakeHeader(kDataMagic, stamp);
+        bool ok = index.IsOpened() && data.IsOpened()
+               && index.Write(&indexHeader, sizeof(indexHeader)) == sizeof(indexHeader)
+               && data.Write(&dataHeader, sizeof(dataHeader)) == sizeof(dataHeader);
+
+        uint64_t offset = sizeof(CacheHeader);
+        uint8_t pixels[kThumbnailPixels];
+        for (auto it = m_entries.begin(); ok && it != m_entries.end(); ++it) {
+            const Entry& e = it->second;
+            ok = m_data.Seek(static_cast<wxFileOffset>(e.offset)) && m_data.Read(pixels, sizeof(pixels)) == sizeof(pixels)
+              && data.Write(pixels, sizeof(pixels)) == sizeof(pixels);
+
+            CacheRecord r = {it->first.device, it->first.inode, e.size, e.mtime, e.hashes.dhash, e.hashes.phash,
+                             offset, e.hashVersion, 0};
+            ok = ok && index.Write(&r, sizeof(r)) == sizeof(r);
+            offsets.push_back(offset);
+            offset += sizeof(pixels);
+        }
+
+        if (!index.Close() || !data.Close() || !ok) {
+            wxRemoveFile(indexTemp);
+            wxRemoveFile(dataTemp);
+            return false;
+        }
+    }
+
+    m_index.Close();
+    m_data.Close();
+    if (!wxRenameFile(dataTemp, dataName, true) || !wxRenameFile(indexTemp, indexName, true))
+        return false;
+
+    size_t k = 0;
+    for (auto& [id, e] : m_entries)
+        e.offset = offsets[k++];
+    m_records = m_entries.size();
+    m_dataSize = sizeof(CacheHeader) + uint64_t(m_entries.size()) * kThumbnailPixels;
+    return m_index.Open(indexName, "ab") && m_data.Open(dataName, "a+b");
+}
+
+void ThumbnailCache::Close()
+{
+    std::lock_guard lock(m_mutex);
+    FlushLocked();
+    m_index.Close();
+    m_data.Close();
+    m_entries.clear();
+    m_pending.clear();
+    m_pendingPixels.clear();
+    m_records = 0;
+    m_dataSize = 0;
+}
+
+size_t ThumbnailCache::size() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_entries.size();
+}
+
+// ------------------------------- Lookups --------------------------------
+
+const ThumbnailCache::Entry* ThumbnailCache::Current(const ThumbnailKey& key) const
+{
+    auto it = m_entries.find(FileId{key.device, key.inode});
+    if (it == m_entries.end() || it->second.size != key.size || it->second.mtime != key.mtime)
+        return nullptr;
+    return &it->second;
+}
+
+bool ThumbnailCache::Find(const ThumbnailKey& key, ImageHashes& hashes)
+{
+    std::lock_guard lock(m_mutex);
+    const Entry* e = Current(key);
+    if (!e || e->hashVersion != kImageHashVersion)
+        return false;
+    hashes = e->hashes;
+    return true;
+}
+
+bool ThumbnailCache::Thumbnail(const ThumbnailKey& key, std::vector<uint8_t>& thumbnail)
+{
+    std::lock_guard lock(m_mutex);
+    const Entry* e = Current(key);
+    if (!e)
+        return false;
+
+    thumbnail.resize(kThumbnailPixels);
+    if (e->offset >= m_dataSize) {
+        auto first = m_pendingPixels.begin() + static_cast<ptrdiff_t>(e->offset - m_dataSize);
+        std::copy(first, first + kThumbnailPixels, thumbnail.begin());
+        return true;
+    }
+    return m_data.Seek(static_cast<wxFileOffset>(e->offset))
+        && m_data.Read(thumbnail.data(), kThumbnailPixels) == kThumbnailPixels;
+}
+
+// ------------------------------- Writing --------------------------------
+
+void ThumbnailCache::Store(const ThumbnailKey& key, std::span<const uint8_t> thumbnail, const ImageHashes& hashes)
+{
+    std::lock_guard lock(m_mutex);
+    if (!m_index.IsOpened() || thumbnail.size() != kThumbnailPixels)
+        return;
+
+    FileId id{key.device, key.inode};
+    m_entries.insert_or_assign(id, Entry{key.size, key.mtime, hashes, m_dataSize + m_pendingPixels.size(),
+                                         kImageHashVersion});
+    m_pending.push_back(id);
+    m_pendingPixels.insert(m_pendingPixels.end(), thumbnail.begin(), thumbnail.end());
+
+    if (m_pendingPixels.size() + m_pending.size() * sizeof(CacheRecord) >= m_budget)
+        FlushLocked();
+}
+
+bool ThumbnailCache::Flush()
+{
+    std::lock_guard lock(m_mutex);
+    return FlushLocked();
+}
+
+bool ThumbnailCache::FlushLocked()
+{
+    if (m_pending.empty())
+        return true;
+
+    // Thumbnails first: a record never points at pixels that are not there
+    std::vector<CacheRecord> records;
+    records.reserve(m_pending.size());
+    for (const FileId& id : m_pending) {
+        const Entry& e = m_entries.at(id);
+        records.push_back({id.device, id.inode, e.size, e.mtime, e.hashes.dhash, e.hashes.phash, e.offset,
+                           e.hashVersion, 0});
+    }
+
+    bool ok = m_data.IsOpened() && m_data.Seek(0, wxFromEnd)
+           && m_data.Write(m_pendingPixels.data(), m_pendingPixels.size()) == m_pendingPixels.size()
+           && m_data.Flush()
+           && m_index.Write(records.data(), records.size() * sizeof(CacheRecord)) == records.size() * sizeof(CacheRecord)
+           && m_index.Flush();
+
+    if (ok) {
+        m_dataSize += m_pendingPixels.size();
+        m_records += records.size();
+    } else {
+        // Whatever made it out is unreachable; drop the entries pointing there
+        const uint64_t written = m_dataSize;
+        std::erase_if(m_entries, [written](const auto& item) { return item.second.offset >= written; });
+        wxFileOffset length = m_data.IsOpened() ? m_data.Length() : wxInvalidOffset;
+        m_dataSize = length != wxInvalidOffset ? static_cast<uint64_t>(length) : written;
+    }
+
+    m_pending.clear();
+    m_pendingPixels.clear();
+    return ok;
+}
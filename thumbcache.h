@@ -0,0 +1,110 @@
+// thumbcache.h
+//
+// On-disk cache of the thumbnails and perceptual hashes of "Similar Images"
+// (see similar.h), so repeat runs skip decoding. One cache serves every
+// folder: files are keyed by device and inode, which survive renames and
+// moves, and a changed size or mtime makes an entry stale.
+//
+// The cache is two append-only files: "<name>.idx", fixed-width records
+// with the keys and hashes, and "<name>.dat", the thumbnails they point
+// into. Opening reads only the records, so memory holds about a hundred
+// bytes per cached image; thumbnails are read back only when their hashes
+// are stale. New entries are buffered until they reach the memory budget
+// and then appended, thumbnails before the records that point at them, so
+// a crash loses at most the unflushed entries. Superseded records are
+// dropped by rewriting both files once they outnumber the live ones.
+
+#pragma once
+
+#include "fileinfo.h"
+#include "similar.h"
+
+#include <wx/ffile.h>
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The cache key of a loaded file
+ThumbnailKey ThumbnailKeyOf(const FileInfo& file);
+
+class ThumbnailCache {
+public:
+    // Bytes of new entries held in memory before they are written
+    static constexpr size_t kDefaultBudget = size_t(16) << 20;
+
+    ThumbnailCache() = default;
+    ~ThumbnailCache();
+
+    ThumbnailCache(const ThumbnailCache&) = delete;
+    ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+    // Opens the cache at basename (".idx" and ".dat" are appended),
+    // starting a new one if it is missing, damaged or from another version.
+    // Fails only if the files cannot be created.
+    bool Open(const wxString& basename, size_t budget = kDefaultBudget);
+
+    // Writes what is buffered and closes the files
+    void Close();
+
+    bool   IsOpen() const { return m_index.IsOpened(); }
+    size_t size() const;
+
+    // Everything below may be called from several threads at once.
+
+    // The current hashes of the file key describes, or false if it is not
+    // cached, changed since, or was hashed by another kImageHashVersion
+    bool Find(const ThumbnailKey& key, ImageHashes& hashes);
+
+    // The cached thumbnail of the file key describes, whatever its hashes
+    bool Thumbnail(const ThumbnailKey& key, std::vector<uint8_t>& thumbnail);
+
+    // Adds or replaces an entry; written out once the budget is reached
+    void Store(const ThumbnailKey& key, std::span<const uint8_t> thumbnail, const ImageHashes& hashes);
+
+    // Writes the buffered entries
+    bool Flush();
+
+private:
+    struct FileId {
+        uint64_t device;
+        uint64_t inode;
+
+        bool operator==(const FileId&) const = default;
+    };
+
+    struct FileIdHash {
+        size_t operator()(const FileId& id) const { return std::hash<uint64_t>()(id.inode * 31 + id.device); }
+    };
+
+    struct Entry {
+        uint64_t    size;
+        int64_t     mtime;
+        ImageHashes hashes;
+        uint64_t    offset;        // of the thumbnail in the data file
+        uint32_t    hashVersion;
+    };
+
+    mutable std::mutex m_mutex;
+    wxString           m_basename;
+    wxFFile            m_index;
+    wxFFile            m_data;
+    uint64_t           m_dataSize = 0;        // written, not counting m_pendingPixels
+    size_t             m_budget = kDefaultBudget;
+    size_t             m_records = 0;         // in the index file, live or not
+
+    std::unordered_map<FileId, Entry, FileIdHash> m_entries;
+
+    // Entries not written yet; their offsets run on from m_dataSize
+    std::vector<FileId>  m_pending;
+    std::vector<uint8_t> m_pendingPixels;
+
+    bool Load(bool& torn);
+    bool Create();
+    bool Compact();
+    bool FlushLocked();
+    const Entry* Current(const ThumbnailKey& key) const;
+};
@@ -0,0 +1,272 @@
+// trace.cpp
+
+#include "trace.h"
+#include "fileinfo.h"
+
+#include <wx/ffile.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace {
+
+const auto kEpoch = std::chrono::steady_clock::now();
+
+std::atomic<uint32_t> g_nextThread{0};
+
+#ifdef MEDAMA_COUNT_ALLOCATIONS
+// Constant-initialized, so it is safe to touch from operator new at any time
+thread_local uint64_t t_allocations = 0;
+#endif
+
+bool IsTopLevel(const char* name)
+{
+    return std::strchr(name, '.') == nullptr;
+}
+
+wxString FormatDuration(int64_t micros)
+{
+    if (micros < 10'000)
+        return wxString::Format("%.2f ms", micros / 1e3);
+    if (micros < 1'000'000)
+        return wxString::Format("%.0f ms", micros / 1e3);
+    return wxString::Format("%.2f s", micros / 1e6);
+}
+
+// 77k, 1.2M
+wxString FormatCount(double n)
+{
+    if (n < 10'000)
+        return wxString::Format("%.0f", n);
+    if (n < 1e6)
+        return wxString::Format("%.0fk", n / 1e3);
+    return wxString::Format("%.1fM", n / 1e6);
+}
+
+void AppendJsonName(std::string& out, const char* name)
+{
+    out += '"';
+    for (const char* p = name; *p; ++p) {
+        if (*p == '"' || *p == '\\')
+            out += '\\';
+        out += *p;
+    }
+    out += '"';
+}
+
+} // namespace
+
+#ifdef MEDAMA_COUNT_ALLOCATIONS
+
+// Array and nothrow new forward to this one, and the default deletes free()
+// what it returns; the aligned variants are left alone.
+void* operator new(std::size_t size)
+{
+    ++t_allocations;
+    if (size == 0)
+        size = 1;
+    for (;;) {
+        if (void* p = std::malloc(size))
+            return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+uint64_t ThreadAllocations()
+{
+    return t_allocations;
+}
+
+#else
+
+uint64_t ThreadAllocations()
+{
+    return 0;
+}
+
+#endif
+
+// -------------------------------- Trace ---------------------------------
+
+Trace& Trace::Get()
+{
+    static Trace trace;
+    return trace;
+}
+
+int64_t Trace::Now()
+{
+    return ToMicros(std::chrono::steady_clock::now());
+}
+
+int64_t Trace::ToMicros(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - kEpoch).count();
+}
+
+uint32_t Trace::CurrentThread()
+{
+    thread_local uint32_t id = g_nextThread.fetch_add(1, std::memory_order_relaxed) + 1;
+    return id;
+}
+
+void Trace::Record(const TraceEvent& event)
+{
+    std::lock_guard lock(m_mutex);
+
+    if (m_events.size() < kMaxEvents) {
+        m_events.push_back(event);
+    } else {
+        m_events[m_next] = event;
+        m_next = (m_next + 1) % kMaxEvents;
+    }
+
+    // Names are literals, but the same literal may have several addresses
+    Totals* totals = nullptr;
+    for (Totals& t : m_totals) {
+        if (t.name == event.name || std::strcmp(t.name, event.name) == 0) {
+            totals = &t;
+            break;
+        }
+    }
+    if (!totals)
+        totals = &m_totals.emplace_back(Totals{event.name});
+
+    ++totals->count;
+    totals->duration += event.duration;
+    totals->items += event.items;
+    totals->bytes += event.bytes;
+    totals->allocations += event.allocations;
+    ++m_generation;
+}
+
+std::vector<Trace::Totals> Trace::GetTotals() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_totals;
+}
+
+void Trace::ResetTotals()
+{
+    std::lock_guard lock(m_mutex);
+    m_totals.clear();
+    ++m_generation;
+}
+
+uint64_t Trace::Generation() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_generation;
+}
+
+wxString Trace::Summary() const
+{
+    wxString text;
+    for (const Totals& t : GetTotals()) {
+        if (!IsTopLevel(t.name))
+            continue;
+
+        if (!text.empty())
+            text += " • ";
+        text += wxString::FromUTF8(t.name) + " " + FormatDuration(t.duration);
+        if (t.count > 1)
+            text += wxString::Format(" ×%llu", static_cast<unsigned long long>(t.count));
+
+        wxString details;
+        double seconds = t.duration / 1e6;
+        if (t.items) {
+            details += FormatCount(static_cast<double>(t.items)) + " files";
+            if (seconds > 0.0)
+                details += ", " + FormatCount(t.items / seconds) + "/s";
+        }
+        if (t.bytes) {
+            if (!details.empty())
+                details += ", ";
+            details += FormatFileSize(t.bytes);
+        }
+        if (t.allocations) {
+            if (!details.empty())
+                details += ", ";
+            details += FormatCount(static_cast<double>(t.allocations)) + " allocs";
+        }
+        if (!details.empty())
+            text += " (" + details + ")";
+    }
+    return text;
+}
+
+bool Trace::WriteChromeTrace(const wxString& filename) const
+{
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard lock(m_mutex);
+        events.reserve(m_events.size());
+        events.insert(events.end(), m_events.begin() + m_next, m_events.end());
+        events.insert(events.end(), m_events.begin(), m_events.begin() + m_next);
+    }
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                      "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                      "\"args\":{\"name\":\"medama\"}}";
+    out.reserve(out.size() + events.size() * 160);
+
+    char buf[192];
+    for (const TraceEvent& e : events) {
+        out += ",\n{\"name\":";
+        AppendJsonName(out, e.name);
+        std::snprintf(buf, sizeof(buf),
+                      ",\"cat\":\"medama\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld,"
+                      "\"args\":{\"files\":%llu,\"bytes\":%llu,\"allocations\":%llu}}",
+                      e.thread, static_cast<long long>(e.start), static_cast<long long>(e.duration),
+                      static_cast<unsigned long long>(e.items), static_cast<unsigned long long>(e.bytes),
+                      static_cast<unsigned long long>(e.allocations));
+        out += buf;
+    }
+    out += "\n]}\n";
+
+    wxFFile file(filename, "wb");
+    if (!file.IsOpened())
+        return false;
+    bool ok = file.Write(out.data(), out.size()) == out.size();
+    return file.Close() && ok;
+}
+
+// ------------------------------ PhaseScope ------------------------------
+
+PhaseScope::PhaseScope(const char* name, uint64_t items)
+    : m_name(name)
+    , m_start(Trace::Now())
+    , m_items(items)
+    , m_allocations(ThreadAllocations())
+{
+}
+
+PhaseScope::~PhaseScope()
+{
+    TraceEvent event;
+    event.name = m_name;
+    event.start = m_start;
+    event.duration = Trace::Now() - m_start;
+    event.thread = Trace::CurrentThread();
+    event.items = m_items;
+    event.bytes = m_bytes;
+    event.allocations = Allocations();
+    Trace::Get().Record(event);
+}
@@ -0,0 +1,242 @@
+// treegen.cpp
+
+#include "treegen.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <numbers>
+#include <string_view>
+#include <system_error>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Files created per worker at least
+constexpr size_t kMinFilesPerWorker = 4096;
+
+struct Signature {
+    std::string_view ext;
+    std::string_view bytes;
+};
+
+constexpr Signature kSignatures[] = {
+    {"png",  {"\x89PNG\r\n\x1a\n", 8}},
+    {"jpg",  {"\xFF\xD8\xFF\xE0", 4}},
+    {"jpeg", {"\xFF\xD8\xFF\xE0", 4}},
+    {"gif",  {"GIF89a", 6}},
+    {"pdf",  {"%PDF-1.7\n", 9}},
+    {"zip",  {"PK\x03\x04", 4}},
+    {"docx", {"PK\x03\x04", 4}},
+    {"xlsx", {"PK\x03\x04", 4}},
+    {"mp3",  {"ID3\x04", 4}},
+    {"gz",   {"\x1F\x8B\x08", 3}},
+    {"sh",   {"#!/bin/sh\n", 10}},
+};
+
+// SplitMix64: a full-period generator whose output is a good hash of its
+// state, so file i can seed its own stream without any shared state
+struct SplitMix64 {
+    uint64_t state;
+
+    uint64_t Next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in (0, 1)
+    double Unit() { return (static_cast<double>(Next() >> 11) + 0.5) * 0x1.0p-53; }
+};
+
+std::string_view SignatureFor(const std::string& ext)
+{
+    for (const Signature& s : kSignatures) {
+        if (s.ext == ext)
+            return s.bytes;
+    }
+    return {};
+}
+
+bool WriteFile(const std::string& path, uint64_t size, int64_t mtime, std::string_view head)
+{
+    if (head.size() > size)
+        head = {};
+
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    bool ok = (head.empty() || ::pwrite(fd, head.data(), head.size(), 0) == static_cast<ssize_t>(head.size()))
+           && ::ftruncate(fd, static_cast<off_t>(size)) == 0;
+
+    struct timespec times[2] = {{mtime, 0}, {mtime, 0}};
+    ok = ok && ::futimens(fd, times) == 0;
+    return ::close(fd) == 0 && ok;
+#else
+    {
+        std::ofstream out(fs::path(path), std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(head.data(), static_cast<std::streamsize>(head.size())))
+            return false;
+    }
+    std::error_code ec;
+    fs::resize_file(fs::path(path), size, ec);
+    if (ec)
+        return false;
+    auto when = std::chrono::sys_seconds(std::chrono::seconds(mtime));
+    fs::last_write_time(fs::path(path), std::chrono::file_clock::from_sys(when), ec);
+    return !ec;
+#endif
+}
+
+} // namespace
+
+std::vector<std::pair<std::string, unsigned>> DefaultExtensionMix()
+{
+    return {
+        {"jpg", 18}, {"png", 8}, {"gif", 2}, {"pdf", 6}, {"docx", 4}, {"xlsx", 2},
+        {"txt", 8}, {"md", 2}, {"cpp", 6}, {"h", 5}, {"py", 4}, {"js", 4}, {"json", 3},
+        {"mp3", 4}, {"mp4", 3}, {"zip", 2}, {"gz", 2}, {"sh", 1}, {"", 4}, {"dat", 6},
+        {"cache", 4}, {"verylongextension", 1},
+    };
+}
+
+bool ParseExtensionMix(const std::string& text, std::vector<std::pair<std::string, unsigned>>& mix)
+{
+    mix.clear();
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+
+        size_t eq = item.find('=');
+        if (eq == std::string::npos)
+            return false;
+        std::string ext = item.substr(0, eq);
+        if (!ext.empty() && ext.front() == '.')
+            ext.erase(0, 1);
+
+        char* end = nullptr;
+        unsigned long weight = std::strtoul(item.c_str() + eq + 1, &end, 10);
+        if (end == item.c_str() + eq + 1 || *end != '\0')
+            return false;
+        if (weight > 0)
+            mix.emplace_back(std::move(ext), static_cast<unsigned>(weight));
+
+        if (comma == std::string::npos)
+            break;
+        pos = comma + 1;
+    }
+    return !mix.empty();
+}
+
+bool GenerateTree(const std::string& root, const TreeSpec& spec, TreeStats& stats, std::string& error)
+{
+    stats = {};
+    const auto& mix = spec.extensions.empty() ? DefaultExtensionMix() : spec.extensions;
+
+    // Directories level by level; files are dealt out over all of them
+    std::vector<std::string> dirs{root};
+    size_t levelBegin = 0;
+    for (unsigned level = 0; level < spec.depth; ++level) {
+        size_t levelEnd = dirs.size();
+        for (size_t d = levelBegin; d < levelEnd; ++d) {
+            for (unsigned k = 0; k < spec.fanout; ++k) {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/dir%02u", k);
+                dirs.push_back(dirs[d] + name);
+            }
+        }
+        levelBegin = levelEnd;
+    }
+
+    for (const std::string& dir : dirs) {
+        std::error_code ec;
+        fs::create_directories(fs::path(dir), ec);
+        if (ec) {
+            error = dir + ": " + ec.message();
+            return false;
+        }
+    }
+    stats.directories = dirs.size();
+
+    std::vector<unsigned> cumulative;
+    unsigned totalWeight = 0;
+    for (const auto& [ext, weight] : mix)
+        cumulative.push_back(totalWeight += weight);
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const double mu = std::log(std::max(1.0, spec.sizeMedian));
+
+    std::atomic<bool>     failed{false};
+    std::atomic<uint64_t> bytes{0};
+    std::mutex            errorMutex;
+
+    unsigned chunks = ParallelWorkerCount(spec.files, kMinFilesPerWorker);
+    ParallelChunks(spec.files, chunks, [&](unsigned, size_t begin, size_t end) {
+        uint64_t chunkBytes = 0;
+        std::string path;
+
+        for (size_t i = begin; i < end && !failed.load(std::memory_order_relaxed); ++i) {
+            SplitMix64 rng{spec.seed * 0x2545F4914F6CDD1Dull + i};
+
+            unsigned pick = static_cast<unsigned>(rng.Next() % totalWeight);
+            size_t e = 0;
+            while (cumulative[e] <= pick)
+                ++e;
+            const std::string& ext = mix[e].first;
+
+            // Box-Muller for the normal behind the log-normal size
+            double normal = std::sqrt(-2.0 * std::log(rng.Unit())) * std::cos(2.0 * std::numbers::pi * rng.Unit());
+            double size = std::exp(mu + spec.sizeSigma * normal);
+            uint64_t bytesOfFile = static_cast<uint64_t>(std::min(size, static_cast<double>(spec.sizeMax)));
+
+            int64_t mtime = now - static_cast<int64_t>(rng.Unit() * spec.mtimeDays * 86400.0);
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "/file%08zu", i);
+            path = dirs[i % dirs.size()];
+            path += name;
+            if (!ext.empty()) {
+                path += '.';
+                path += ext;
+            }
+
+            if (!WriteFile(path, bytesOfFile, mtime, spec.signatures ? SignatureFor(ext) : std::string_view())) {
+                std::lock_guard lock(errorMutex);
+                if (!failed.exchange(true))
+                    error = path + ": " + std::generic_category().message(errno);
+                return;
+            }
+            chunkBytes += bytesOfFile;
+        }
+        bytes += chunkBytes;
+    });
+
+    if (failed)
+        return false;
+
+    stats.files = spec.files;
+    stats.bytes = bytes;
+    return true;
+}
@@ -0,0 +1,49 @@
+// treegen.h
+//
+// Synthetic file trees for the benchmarks. Everything about a file (its
+// directory, extension, size and mtime) is derived from the seed and the
+// file's index, so a spec always produces the same tree. Files are sparse:
+// they have their full size but only the signature bytes are written.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct TreeSpec {
+    size_t   files = 1000;
+    unsigned depth = 3;                  // directory levels below the root
+    unsigned fanout = 8;                 // subdirectories per directory
+
+    // Extension (without the dot, empty for none) and relative weight
+    std::vector<std::pair<std::string, unsigned>> extensions;
+
+    double   sizeMedian = 64 * 1024.0;   // log-normal sizes, in bytes
+    double   sizeSigma = 2.0;
+    uint64_t sizeMax = 256ull << 20;
+    unsigned mtimeDays = 1500;           // uniform over the last mtimeDays days
+    uint64_t seed = 1;
+
+    // Write the format signature of known extensions (png, pdf, zip, ...)
+    // so content sniffing has something to find
+    bool signatures = true;
+};
+
+struct TreeStats {
+    size_t   files = 0;
+    size_t   directories = 0;
+    uint64_t bytes = 0;                  // apparent size
+};
+
+// A mix roughly like a home directory: images, documents, code, media,
+// archives, some files without and some with unknown extensions.
+std::vector<std::pair<std::string, unsigned>> DefaultExtensionMix();
+
+// Parses "jpg=20,png=10,=5" (an empty name means no extension).
+bool ParseExtensionMix(const std::string& text, std::vector<std::pair<std::string, unsigned>>& mix);
+
+// Creates the tree below root, which is created if needed. Files are
+// written in parallel. Returns false with a message on the first failure.
+bool GenerateTree(const std::string& root, const TreeSpec& spec, TreeStats& stats, std::string& error);
@@ -0,0 +1,78 @@
+// treemap.cpp
+
+#include "treemap.h"
+
+#include <algorithm>
+
+namespace {
+
+// Worst aspect ratio of a row of areas [minArea, maxArea] summing to sum,
+// laid along a side of length side
+double WorstRatio(double sum, double minArea, double maxArea, double side)
+{
+    double s2 = sum * sum;
+    double w2 = side * side;
+    return std::max(w2 * maxArea / s2, s2 / (w2 * minArea));
+}
+
+} // namespace
+
+void Squarify(std::span<const uint64_t> weights, const TreemapRect& bounds, std::vector<TreemapRect>& out)
+{
+    const size_t n = weights.size();
+    out.assign(n, TreemapRect{bounds.x, bounds.y, 0, 0});
+
+    double total = 0;
+    for (uint64_t w : weights)
+        total += static_cast<double>(w);
+    if (total <= 0 || bounds.w <= 0 || bounds.h <= 0)
+        return;
+
+    const double scale = bounds.w * bounds.h / total;
+    TreemapRect rest = bounds;
+
+    size_t i = 0;
+    while (i < n && weights[i] == 0)
+        ++i;
+    while (i < n) {
+        const double side = std::min(rest.w, rest.h);
+
+        // Grows the row while its worst rectangle gets squarer
+        double first = static_cast<double>(weights[i]) * scale;
+        double sum = first, minArea = first, maxArea = first;
+        double worst = WorstRatio(sum, minArea, maxArea, side);
+        size_t end = i + 1;
+        for (; end < n && weights[end] > 0; ++end) {
+            double area = static_cast<double>(weights[end]) * scale;
+            double ratio = WorstRatio(sum + area, std::min(minArea, area), std::max(maxArea, area), side);
+            if (ratio > worst)
+                break;
+            sum += area;
+            minArea = std::min(minArea, area);
+            maxArea = std::max(maxArea, area);
+            worst = ratio;
+        }
+
+        // The row is a strip along the shorter side, its thickness set by its area
+        const double thickness = sum / side;
+        const bool column = rest.w >= rest.h;
+        double at = column ? rest.y : rest.x;
+        for (size_t k = i; k < end; ++k) {
+            double length = static_cast<double>(weights[k]) * scale / thickness;
+            out[k] = column ? TreemapRect{rest.x, at, thickness, length}
+                            : TreemapRect{at, rest.y, length, thickness};
+            at += length;
+        }
+        if (column) {
+            rest.x += thickness;
+            rest.w = std::max(0.0, rest.w - thickness);
+        } else {
+            rest.y += thickness;
+            rest.h = std::max(0.0, rest.h - thickness);
+        }
+
+        i = end;
+        while (i < n && weights[i] == 0)
+            ++i;
+    }
+}
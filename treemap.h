@@ -0,0 +1,24 @@
+// treemap.h
+//
+// Squarified treemap layout (Bruls, Huizing and van Wijk): areas
+// proportional to weights, laid out in rows along the shorter side of the
+// space left, each row grown only while that keeps its worst aspect ratio
+// improving. Pure geometry; the drawing is TreemapView's.
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct TreemapRect {
+    double x = 0;
+    double y = 0;
+    double w = 0;
+    double h = 0;
+};
+
+// out[i] = the rectangle of weights[i] inside bounds. Weights should come
+// largest first, which is what keeps the rectangles square; zero weights
+// get an empty rectangle.
+void Squarify(std::span<const uint64_t> weights, const TreemapRect& bounds, std::vector<TreemapRect>& out);
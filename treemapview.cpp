@@ -0,0 +1,305 @@
+// treemapview.cpp
+
+#include "treemapview.h"
+#include "ingest.h"
+#include "pathstore.h"
+#include "trace.h"
+
+#include <wx/dcbuffer.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const wxColour kBackground(10, 10, 25);
+const wxColour kBarText(180, 140, 255);
+const wxColour kDirectoryText(255, 255, 255);
+const wxColour kFilesText(10, 10, 25);
+const wxColour kBorder(10, 10, 25);
+
+// Directory boxes alternate by depth so that nesting stays readable
+const wxColour kDirectoryColours[] = {
+    wxColour(25, 25, 50),
+    wxColour(40, 35, 70),
+};
+
+// Categories keep their colour wherever they appear
+const wxColour kCategoryColours[] = {
+    wxColour(150, 110, 230), wxColour(90, 150, 220), wxColour(80, 190, 160),
+    wxColour(220, 180, 90),  wxColour(220, 110, 110), wxColour(120, 200, 220),
+    wxColour(180, 200, 100), wxColour(230, 140, 190), wxColour(140, 140, 220),
+    wxColour(220, 150, 90),  wxColour(120, 180, 130), wxColour(200, 160, 240),
+};
+
+wxRect ToPixels(const TreemapRect& r)
+{
+    int x0 = static_cast<int>(std::lround(r.x));
+    int y0 = static_cast<int>(std::lround(r.y));
+    int x1 = static_cast<int>(std::lround(r.x + r.w));
+    int y1 = static_cast<int>(std::lround(r.y + r.h));
+    return wxRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+} // namespace
+
+TreemapView::TreemapView(wxWindow* parent, wxWindowID id)
+    : wxWindow(parent, id, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE | wxWANTS_CHARS)
+{
+    SetBackgroundStyle(wxBG_STYLE_PAINT);
+    SetBackgroundColour(kBackground);
+
+    m_barHeight = GetCharHeight() + FromDIP(12);
+    m_labelHeight = GetCharHeight() + FromDIP(4);
+    m_padding = FromDIP(2);
+    m_minSide = FromDIP(12);
+
+    Bind(wxEVT_PAINT, &TreemapView::OnPaint, this);
+    Bind(wxEVT_SIZE, &TreemapView::OnSize, this);
+    Bind(wxEVT_LEFT_DOWN, &TreemapView::OnLeftDown, this);
+    Bind(wxEVT_RIGHT_DOWN, &TreemapView::OnRightDown, this);
+    Bind(wxEVT_MOTION, &TreemapView::OnMotion, this);
+    Bind(wxEVT_KEY_DOWN, &TreemapView::OnKeyDown, this);
+}
+
+void TreemapView::SetUsage(const DiskUsage* usage, const CategoryRegistry* categories)
+{
+    m_usage = usage;
+    m_categories = categories;
+
+    if (!m_usage || m_usage->empty()) {
+        // Directory IDs do not outlive the file set they were interned for
+        m_zoom = DiskUsage::kNoNode;
+        m_zoomDir = kNoDir;
+        m_tiles.clear();
+        m_hover = SIZE_MAX;
+        m_layoutValid = false;
+        Refresh();
+        return;
+    }
+
+    uint32_t node = m_zoomDir != kNoDir ? m_usage->NodeOf(m_zoomDir) : DiskUsage::kNoNode;
+    Zoom(node != DiskUsage::kNoNode ? node : m_usage->Top());
+}
+
+void TreemapView::Zoom(uint32_t node)
+{
+    m_zoom = node;
+    m_zoomDir = node != DiskUsage::kNoNode ? (*m_usage)[node].dir : kNoDir;
+    m_layoutValid = false;
+    Refresh();
+}
+
+void TreemapView::ZoomOut()
+{
+    // Never further out than where the view starts
+    if (m_usage && !m_usage->empty() && m_zoom != DiskUsage::kNoNode && m_zoom != m_usage->Top())
+        Zoom((*m_usage)[m_zoom].parent);
+}
+
+// ------------------------------- Layout --------------------------------
+
+void TreemapView::UpdateLayout()
+{
+    PhaseScope phase("render.layout");
+
+    m_tiles.clear();
+    m_hover = SIZE_MAX;
+    m_layoutSize = GetClientSize();
+    m_layoutValid = true;
+    if (!m_usage || m_usage->empty())
+        return;
+
+    TreemapRect area{0, static_cast<double>(m_barHeight), static_cast<double>(m_layoutSize.x),
+                     static_cast<double>(m_layoutSize.y - m_barHeight)};
+    LayOut(m_zoom, area, 0);
+    phase.AddItems(m_tiles.size());
+}
+
+void TreemapView::LayOut(uint32_t node, const TreemapRect& rect, int depth)
+{
+    if (rect.w < 1 || rect.h < 1)
+        return;
+
+    // Subdirectories and the node's own files by category, merged into
+    // one largest-first list; both come sorted that way
+    std::span<const uint32_t> children = m_usage->Children(node);
+    std::span<const DiskUsage::Share> shares;
+    if (node != DiskUsage::kNoNode)
+        shares = m_usage->Shares(node);
+
+    std::vector<Tile> items;
+    items.reserve(children.size() + shares.size());
+    size_t c = 0, s = 0;
+    while (c < children.size() || s < shares.size()) {
+        if (s == shares.size() || (c < children.size() && (*m_usage)[children[c]].bytes >= shares[s].bytes)) {
+            uint32_t child = children[c++];
+            items.push_back({wxRect(), child, 0, false, depth, (*m_usage)[child].bytes, (*m_usage)[child].files});
+        } else {
+            const DiskUsage::Share& share = shares[s++];
+            items.push_back({wxRect(), node, share.category, true, depth, share.bytes, share.files});
+        }
+    }
+
+    std::vector<uint64_t> weights(items.size());
+    for (size_t k = 0; k < items.size(); ++k)
+        weights[k] = items[k].bytes;
+    std::vector<TreemapRect> rects;
+    Squarify(weights, rect, rects);
+
+    for (size_t k = 0; k < items.size(); ++k) {
+        Tile& tile = items[k];
+        tile.rect = ToPixels(rects[k]);
+        if (tile.rect.width < 1 || tile.rect.height < 1)
+            continue;
+        m_tiles.push_back(tile);
+
+        // Only boxes large enough to show something get contents
+        const TreemapRect& r = rects[k];
+        if (!tile.files && r.w >= 2 * m_minSide && r.h >= m_labelHeight + 2 * m_minSide) {
+            TreemapRect inner{r.x + m_padding, r.y + m_labelHeight, r.w - 2 * m_padding,
+                              r.h - m_labelHeight - m_padding};
+            LayOut(tile.node, inner, depth + 1);
+        }
+    }
+}
+
+size_t TreemapView::TileAt(const wxPoint& pt) const
+{
+    // Contents come after their directory, so the last hit is the innermost
+    for (size_t k = m_tiles.size(); k-- > 0;) {
+        if (m_tiles[k].rect.Contains(pt))
+            return k;
+    }
+    return SIZE_MAX;
+}
+
+wxString TreemapView::PathOf(uint32_t node) const
+{
+    if (node == DiskUsage::kNoNode)
+        return "All folders";
+    std::string path;
+    PathStore::Get().AppendPath(path, (*m_usage)[node].dir);
+    return FromFileSystem(path);
+}
+
+wxString TreemapView::Describe(const Tile& tile) const
+{
+    wxString what = tile.files ? wxString::Format("%s in %s", m_categories->Label(tile.category), PathOf(tile.node))
+                               : PathOf(tile.node);
+    return wxString::Format("%s\n%s in %llu files", what, FormatFileSize(tile.bytes),
+                            static_cast<unsigned long long>(tile.count));
+}
+
+// ----------------------------- Painting --------------------------------
+
+void TreemapView::OnPaint(wxPaintEvent& WXUNUSED(evt))
+{
+    PhaseScope phase("render");
+
+    wxAutoBufferedPaintDC dc(this);
+    dc.SetBackground(wxBrush(GetBackgroundColour()));
+    dc.Clear();
+
+    if (!m_usage || m_usage->empty())
+        return;
+    if (!m_layoutValid || m_layoutSize != GetClientSize())
+        UpdateLayout();
+
+    dc.SetFont(GetFont());
+
+    // Where the view is zoomed to, and how much is below it
+    uint64_t bytes = m_zoom != DiskUsage::kNoNode ? (*m_usage)[m_zoom].bytes : m_usage->TotalBytes();
+    uint64_t files = m_zoom != DiskUsage::kNoNode ? (*m_usage)[m_zoom].files : m_usage->TotalFiles();
+    wxString bar = wxString::Format("%s • %s in %llu files", PathOf(m_zoom), FormatFileSize(bytes),
+                                    static_cast<unsigned long long>(files));
+    dc.SetTextForeground(kBarText);
+    dc.DrawText(bar, 2 * m_padding, (m_barHeight - dc.GetCharHeight()) / 2);
+
+    for (const Tile& tile : m_tiles) {
+        const wxColour& fill = tile.files ? kCategoryColours[tile.category % WXSIZEOF(kCategoryColours)]
+                                          : kDirectoryColours[tile.depth % WXSIZEOF(kDirectoryColours)];
+        dc.SetBrush(wxBrush(fill));
+        dc.SetPen(wxPen(kBorder));
+        dc.DrawRectangle(tile.rect);
+
+        if (tile.rect.height < m_labelHeight || tile.rect.width < m_minSide)
+            continue;
+
+        wxString label;
+        if (tile.files)
+            label = m_categories->Label(tile.category);
+        else
+            label = FromFileSystem(PathStore::Get().DirectoryName((*m_usage)[tile.node].dir));
+        label += "  " + FormatFileSize(tile.bytes);
+
+        // Clipped to the box instead of spilling into its neighbours
+        wxRect clip = tile.rect;
+        dc.SetClippingRegion(clip.Deflate(m_padding, 0));
+        dc.SetTextForeground(tile.files ? kFilesText : kDirectoryText);
+        dc.DrawText(label, tile.rect.x + 2 * m_padding, tile.rect.y + (m_labelHeight - dc.GetCharHeight()) / 2);
+        dc.DestroyClippingRegion();
+    }
+    phase.AddItems(m_tiles.size());
+}
+
+// ------------------------------ Events ---------------------------------
+
+void TreemapView::OnSize(wxSizeEvent& evt)
+{
+    m_layoutValid = false;
+    Refresh();
+    evt.Skip();
+}
+
+void TreemapView::OnLeftDown(wxMouseEvent& evt)
+{
+    SetFocus();
+    if (!m_usage || m_usage->empty())
+        return;
+
+    // Drills down one level: into the directory of the zoomed one under the pointer
+    for (const Tile& tile : m_tiles) {
+        if (tile.depth == 0 && tile.rect.Contains(evt.GetPosition())) {
+            if (!tile.files)
+                Zoom(tile.node);
+            return;
+        }
+    }
+}
+
+void TreemapView::OnRightDown(wxMouseEvent& WXUNUSED(evt))
+{
+    ZoomOut();
+}
+
+void TreemapView::OnMotion(wxMouseEvent& evt)
+{
+    size_t k = TileAt(evt.GetPosition());
+    if (k != m_hover) {
+        m_hover = k;
+        if (k == SIZE_MAX)
+            UnsetToolTip();
+        else
+            SetToolTip(Describe(m_tiles[k]));
+    }
+
+    bool zoomable = false;
+    for (const Tile& tile : m_tiles) {
+        if (tile.depth == 0 && tile.rect.Contains(evt.GetPosition())) {
+            zoomable = !tile.files;
+            break;
+        }
+    }
+    SetCursor(wxCursor(zoomable ? wxCURSOR_HAND : wxCURSOR_ARROW));
+
+    evt.Skip();
+}
+
+void TreemapView::OnKeyDown(wxKeyEvent& evt)
+{
+    if (evt.GetKeyCode() == WXK_BACK) {
+        ZoomOut();
+        return;
+    }
+    evt.Skip();
+}
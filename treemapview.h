@@ -0,0 +1,73 @@
+// treemapview.h
+//
+// Owner-drawn treemap of a DiskUsage: every directory is a box sized by the
+// bytes below it, holding its subdirectories and one block per category of
+// its own files. Only the zoomed directory's subtree is laid out, and only
+// as deep as the boxes stay large enough to see, so the layout is bounded
+// by the window's pixels rather than the size of the tree. Clicking a
+// directory zooms into it, a right click or Backspace zooms back out.
+
+#pragma once
+
+#include "classifier.h"
+#include "diskusage.h"
+#include "treemap.h"
+
+#include <wx/wx.h>
+#include <vector>
+
+class TreemapView : public wxWindow {
+public:
+    explicit TreemapView(wxWindow* parent, wxWindowID id = wxID_ANY);
+
+    // Attaches totals (or detaches with nullptr). The view stays zoomed into
+    // the same directory if it still holds files, else starts at the top.
+    void SetUsage(const DiskUsage* usage, const CategoryRegistry* categories);
+
+private:
+    // A box on display: a directory, or the files of one category in it
+    struct Tile {
+        wxRect     rect;
+        uint32_t   node;
+        CategoryId category;    // files only
+        bool       files;
+        int        depth;       // 0 for the zoomed directory's contents
+        uint64_t   bytes;
+        uint64_t   count;       // files
+    };
+
+    const DiskUsage*        m_usage = nullptr;
+    const CategoryRegistry* m_categories = nullptr;
+
+    uint32_t m_zoom = DiskUsage::kNoNode;
+    DirId    m_zoomDir = kNoDir;      // survives rebuilds of the totals
+
+    // Laid out for m_zoom at m_layoutSize, parents before their contents
+    std::vector<Tile> m_tiles;
+    wxSize            m_layoutSize;
+    bool              m_layoutValid = false;
+    size_t            m_hover = SIZE_MAX;   // tile the tooltip describes
+
+    int m_barHeight = 0;
+    int m_labelHeight = 0;
+    int m_padding = 0;
+    int m_minSide = 0;
+
+    void Zoom(uint32_t node);
+    void ZoomOut();
+    void UpdateLayout();
+    void LayOut(uint32_t node, const TreemapRect& rect, int depth);
+
+    // Index of the innermost tile under a point, or SIZE_MAX
+    size_t TileAt(const wxPoint& pt) const;
+
+    wxString PathOf(uint32_t node) const;
+    wxString Describe(const Tile& tile) const;
+
+    void OnPaint(wxPaintEvent& evt);
+    void OnSize(wxSizeEvent& evt);
+    void OnLeftDown(wxMouseEvent& evt);
+    void OnRightDown(wxMouseEvent& evt);
+    void OnMotion(wxMouseEvent& evt);
+    void OnKeyDown(wxKeyEvent& evt);
+};
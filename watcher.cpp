@@ -0,0 +1,310 @@
+// watcher.cpp
+
+#include "watcher.h"
+#include "ingest.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+
+// Entry changes of a directory, plus finished writes and touches of its
+// files. IN_MODIFY is left out on purpose: a download would raise it for
+// every block, while IN_CLOSE_WRITE arrives once it is complete.
+constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE
+                              | IN_ATTRIB | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+// Longest the thread blocks before looking at its stop token
+constexpr int kPollMs = 100;
+
+std::string JoinPath(const std::string& dir, std::string_view name)
+{
+    std::string path;
+    path.reserve(dir.size() + name.size() + 1);
+    path += dir;
+    if (path.empty() || path.back() != '/')
+        path += '/';
+    path += name;
+    return path;
+}
+
+bool IsBelow(const std::string& path, const std::string& dir)
+{
+    if (path.size() <= dir.size() || path.compare(0, dir.size(), dir) != 0)
+        return false;
+    return dir.back() == '/' || path[dir.size()] == '/';
+}
+
+// Same record the scanner would produce; symlinks are not followed
+bool StatRegularFile(const std::string& path, FileInfo& info)
+{
+    struct statx stx;
+    if (::statx(AT_FDCWD, path.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) != 0 ||
+        !S_ISREG(stx.stx_mode))
+        return false;
+
+    info.SetPath(path);
+    info.size = stx.stx_size;
+    info.modified = wxDateTime(static_cast<time_t>(stx.stx_mtime.tv_sec));
+    info.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    info.inode = stx.stx_ino;
+    return true;
+}
+
+#endif
+
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher(std::chrono::milliseconds debounce, std::chrono::milliseconds maxDelay)
+    : m_debounce(debounce)
+    , m_maxDelay(std::max(debounce, maxDelay))
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    Stop();
+}
+
+#ifdef __linux__
+
+bool DirectoryWatcher::Start(std::span<const ScannedDirectory> dirs, OnChanges onChanges)
+{
+    Stop();
+
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0)
+        return false;
+
+    for (const ScannedDirectory& dir : dirs)
+        AddWatch(dir.path, false, nullptr);
+    if (m_pathOf.empty()) {
+        Stop();
+        return false;
+    }
+
+    m_watchCount = m_pathOf.size();
+    m_onChanges = std::move(onChanges);
+    m_thread = std::jthread([this](std::stop_token stop) { ThreadMain(stop); });
+    return true;
+}
+
+void DirectoryWatcher::Stop()
+{
+    if (m_thread.joinable()) {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+    if (m_fd >= 0)
+        ::close(m_fd);   // drops all watches
+    m_fd = -1;
+    m_pathOf.clear();
+    m_watchOf.clear();
+    m_watchCount = 0;
+}
+
+void DirectoryWatcher::AddWatch(const std::string& dir, bool scan, std::vector<std::string>* files)
+{
+    // Fails with ENOSPC beyond fs.inotify.max_user_watches; such a
+    // directory is simply not followed
+    int wd = ::inotify_add_watch(m_fd, dir.c_str(), kWatchMask);
+    if (wd < 0)
+        return;
+
+    // The same directory under a new name keeps its descriptor
+    if (auto old = m_pathOf.find(wd); old != m_pathOf.end())
+        m_watchOf.erase(old->second);
+    m_pathOf[wd] = dir;
+    m_watchOf[dir] = wd;
+
+    if (!scan)
+        return;
+
+    DIR* d = ::opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent* entry = ::readdir(d)) {
+        std::string_view name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+
+        unsigned char type = entry->d_type;
+        std::string path = JoinPath(dir, name);
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (::lstat(path.c_str(), &st) != 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR)
+            AddWatch(path, true, files);
+        else if (type == DT_REG)
+            files->push_back(std::move(path));
+    }
+    ::closedir(d);
+}
+
+void DirectoryWatcher::RemoveWatches(const std::string& dir)
+{
+    for (auto it = m_watchOf.begin(); it != m_watchOf.end();) {
+        if (it->first == dir || IsBelow(it->first, dir)) {
+            ::inotify_rm_watch(m_fd, it->second);
+            m_pathOf.erase(it->second);
+            it = m_watchOf.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DirectoryWatcher::ThreadMain(std::stop_token stop)
+{
+    using Clock = std::chrono::steady_clock;
+
+    alignas(struct inotify_event) char buf[64 * 1024];
+
+    // The pending batch: files to stat, directories that went away
+    std::unordered_set<std::string> check;
+    std::vector<std::string>        removedTrees;
+    bool                            overflow = false;
+    bool                            pending = false;
+    Clock::time_point               first, last;
+
+    while (!stop.stop_requested()) {
+        int timeout = kPollMs;
+        if (pending) {
+            Clock::time_point due = std::min(last + m_debounce, first + m_maxDelay);
+            Clock::time_point now = Clock::now();
+            if (now >= due) {
+                // ----- Deliver: removals first, then the stat'ed files -----
+                std::vector<WatchChange> changes;
+                if (overflow)
+                    changes.push_back({WatchChange::Kind::Overflow, {}, {}});
+                for (std::string& dir : removedTrees)
+                    changes.push_back({WatchChange::Kind::RemovedTree, std::move(dir), {}});
+
+                std::vector<std::string> paths(check.begin(), check.end());
+                std::sort(paths.begin(), paths.end());
+                for (std::string& path : paths) {
+                    WatchChange change;
+                    change.kind = StatRegularFile(path, change.info) ? WatchChange::Kind::Changed
+                                                                      : WatchChange::Kind::Removed;
+                    change.path = std::move(path);
+                    changes.push_back(std::move(change));
+                }
+
+                check.clear();
+                removedTrees.clear();
+                overflow = pending = false;
+                if (m_onChanges)
+                    m_onChanges(std::move(changes));
+                continue;
+            }
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1;
+            timeout = static_cast<int>(std::min<int64_t>(timeout, wait));
+        }
+
+        struct pollfd pfd = {m_fd, POLLIN, 0};
+        if (::poll(&pfd, 1, timeout) <= 0)
+            continue;
+
+        for (;;) {
+            ssize_t n = ::read(m_fd, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+
+            for (ssize_t off = 0; off < n;) {
+                auto* ev = reinterpret_cast<struct inotify_event*>(buf + off);
+                off += sizeof(struct inotify_event) + ev->len;
+
+                if (!pending)
+                    first = Clock::now();
+                last = Clock::now();
+                pending = true;
+
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+
+                auto it = m_pathOf.find(ev->wd);
+                if (it == m_pathOf.end())
+                    continue;
+
+                if (ev->mask & IN_IGNORED) {
+                    m_watchOf.erase(it->second);
+                    m_pathOf.erase(it);
+                    continue;
+                }
+
+                if (ev->mask & IN_DELETE_SELF) {
+                    // Normally the parent reports it, unless this is the root
+                    std::string dir = it->second;
+                    size_t slash = dir.rfind('/');
+                    std::string parent = slash == 0 ? "/" : dir.substr(0, slash);
+                    if (slash == std::string::npos || !m_watchOf.contains(parent)) {
+                        RemoveWatches(dir);
+                        removedTrees.push_back(std::move(dir));
+                    }
+                    continue;
+                }
+                if (ev->len == 0)
+                    continue;
+
+                std::string path = JoinPath(it->second, ev->name);
+                if (!(ev->mask & IN_ISDIR)) {
+                    check.insert(std::move(path));
+                } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    RemoveWatches(path);
+                    std::erase_if(check, [&path](const std::string& p) { return IsBelow(p, path); });
+                    removedTrees.push_back(std::move(path));
+                } else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    // Moved in or unpacked with contents: watch and list it all
+                    std::vector<std::string> files;
+                    AddWatch(path, true, &files);
+                    check.insert(std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+                }
+            }
+        }
+        m_watchCount = m_pathOf.size();
+    }
+}
+
+#else
+
+bool DirectoryWatcher::Start(std::span<const ScannedDirectory> WXUNUSED(dirs), OnChanges WXUNUSED(onChanges))
+{
+    return false;
+}
+
+void DirectoryWatcher::Stop()
+{
+}
+
+void DirectoryWatcher::AddWatch(const std::string& WXUNUSED(dir), bool WXUNUSED(scan),
+                                std::vector<std::string>* WXUNUSED(files))
+{
+}
+
+void DirectoryWatcher::RemoveWatches(const std::string& WXUNUSED(dir))
+{
+}
+
+void DirectoryWatcher::ThreadMain(std::stop_token WXUNUSED(stop))
+{
+}
+
+#endif
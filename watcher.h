@@ -0,0 +1,80 @@
+// watcher.h
+//
+// Live watch mode: follows changes below a scanned folder with inotify and
+// reports them in coalesced batches. A burst of events (a download being
+// written, an archive being unpacked) becomes one batch once the folder has
+// been quiet for the debounce interval, with every path stat'ed once on the
+// watcher's thread, so the GUI only merges ready FileInfo records.
+//
+// Linux only; elsewhere Start() fails and the view is refreshed by rescanning.
+
+#pragma once
+
+#include "fileinfo.h"
+#include "metaindex.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct WatchChange {
+    enum class Kind {
+        Changed,        // a regular file at path exists; info is current
+        Removed,        // nothing (or no regular file) is at path any more
+        RemovedTree,    // the directory at path and everything below it is gone
+        Overflow        // events were lost; only a rescan is reliable now
+    };
+
+    Kind        kind = Kind::Changed;
+    std::string path;   // ToFileSystem() form
+    FileInfo    info;   // Kind::Changed only
+};
+
+class DirectoryWatcher {
+public:
+    // Called on the watcher's thread with one coalesced batch. Removals come
+    // before changes, so a directory that was replaced ends up repopulated.
+    using OnChanges = std::function<void(std::vector<WatchChange>&& changes)>;
+
+    // A batch is delivered once no event has arrived for `debounce`, or at
+    // the latest `maxDelay` after its first event.
+    explicit DirectoryWatcher(std::chrono::milliseconds debounce = std::chrono::milliseconds(300),
+                              std::chrono::milliseconds maxDelay = std::chrono::milliseconds(2000));
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Watches the directories of a finished scan (see
+    // DirectoryScanner::TakeDirectories()); directories created later are
+    // picked up on their own. Returns false if nothing could be watched.
+    bool Start(std::span<const ScannedDirectory> dirs, OnChanges onChanges);
+    void Stop();
+
+    bool   IsRunning() const { return m_thread.joinable(); }
+    size_t WatchCount() const { return m_watchCount.load(std::memory_order_relaxed); }
+
+private:
+    std::chrono::milliseconds m_debounce;
+    std::chrono::milliseconds m_maxDelay;
+    OnChanges                 m_onChanges;
+
+    int m_fd = -1;
+    std::unordered_map<int, std::string> m_pathOf;   // watch descriptor -> directory
+    std::unordered_map<std::string, int> m_watchOf;
+    std::atomic<size_t>                  m_watchCount{0};
+
+    std::jthread m_thread;
+
+    void ThreadMain(std::stop_token stop);
+
+    // Watches a directory; with scan, also everything below it, returning
+    // the regular files found there in files.
+    void AddWatch(const std::string& dir, bool scan, std::vector<std::string>* files);
+    void RemoveWatches(const std::string& dir);
+};